@@ -0,0 +1,118 @@
+
+// Zen-C Lexer Throughput Benchmark
+// Usage: ./bench/lexer_throughput <file.zc>...
+//
+// Lexes every file repeatedly and reports MB/s for on-demand scanning
+// (lexer_init + lexer_next) and for building the pre-lexed token buffer
+// (lexer_init_buffered). 'make bench' runs it over std/ and examples/.
+
+#include "zprep.h"
+#include <time.h>
+
+typedef struct
+{
+    char *src;
+    size_t len;
+} SourceFile;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t lex_all_scan(SourceFile *files, int n)
+{
+    size_t tokens = 0;
+    for (int i = 0; i < n; i++)
+    {
+        Lexer l;
+        lexer_init(&l, files[i].src);
+        while (lexer_next(&l).type != TOK_EOF)
+        {
+            tokens++;
+        }
+    }
+    return tokens;
+}
+
+static size_t lex_all_buffered(SourceFile *files, int n)
+{
+    size_t tokens = 0;
+    for (int i = 0; i < n; i++)
+    {
+        Lexer l;
+        lexer_init_buffered(&l, files[i].src);
+        while (lexer_next(&l).type != TOK_EOF)
+        {
+            tokens++;
+        }
+    }
+    return tokens;
+}
+
+// Repeats 'fn' until at least 'min_seconds' have passed; returns MB/s.
+static double measure(size_t (*fn)(SourceFile *, int), SourceFile *files, int n, size_t bytes,
+                      double min_seconds, size_t *tokens)
+{
+    int reps = 0;
+    double start = now();
+    double elapsed;
+    do
+    {
+        *tokens = fn(files, n);
+        reps++;
+        elapsed = now() - start;
+    } while (elapsed < min_seconds);
+
+    return (double)bytes * reps / elapsed / (1024.0 * 1024.0);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <file.zc>...\n", argv[0]);
+        return 1;
+    }
+
+    SourceFile *files = xmalloc(sizeof(SourceFile) * (argc - 1));
+    int n = 0;
+    size_t bytes = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        char *src = load_file(argv[i]);
+        if (!src)
+        {
+            fprintf(stderr, "Skipping unreadable file: %s\n", argv[i]);
+            continue;
+        }
+        files[n].src = src;
+        files[n].len = strlen(src);
+        bytes += files[n].len;
+        n++;
+    }
+
+#if defined(__AVX2__)
+    const char *simd = "AVX2";
+#elif defined(__SSE2__)
+    const char *simd = "SSE2";
+#else
+    const char *simd = "scalar";
+#endif
+
+    printf("** Zen C lexer throughput (%d files, %.2f MB, %s spans) **\n", n,
+           bytes / (1024.0 * 1024.0), simd);
+    printf("%10s %12s %10s\n", "mode", "tokens", "MB/s");
+
+    size_t tokens;
+    double mbs = measure(lex_all_scan, files, n, bytes, 1.0, &tokens);
+    printf("%10s %12zu %10.1f\n", "scan", tokens, mbs);
+
+    // The token buffer lives in the never-freed arena; keep this run short.
+    mbs = measure(lex_all_buffered, files, n, bytes, 0.25, &tokens);
+    printf("%10s %12zu %10.1f\n", "buffered", tokens, mbs);
+
+    return 0;
+}
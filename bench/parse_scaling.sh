@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# Zen-C Front-End Scaling Benchmark
+# Usage: ./bench/parse_scaling.sh [sizes...]
+#
+# Generates programs with N structs, N globals and N functions (each with a
+# handful of locals) and times 'zc check' on them. Time per function should
+# stay flat as N grows; a rising column means a lookup went quadratic.
+#
+# Examples:
+#   ./bench/parse_scaling.sh                  # Default sizes
+#   ./bench/parse_scaling.sh 1000 8000 32000  # Custom sizes
+#   ZC=/path/to/zc ./bench/parse_scaling.sh   # Compare another build
+
+ZC="${ZC:-./zc}"
+LOCALS=16
+SIZES="$*"
+if [ -z "$SIZES" ]; then
+    SIZES="1000 2000 4000 8000 16000"
+fi
+
+if [ ! -f "$ZC" ]; then
+    echo "Error: zc binary not found. Please build it first."
+    exit 1
+fi
+
+TMP_DIR=$(mktemp -d)
+trap 'rm -rf "$TMP_DIR"' EXIT
+
+gen_program() {
+    local n=$1
+    awk -v n="$n" -v locals="$LOCALS" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "var g%d: int = %d;\n", i, i;
+        }
+        for (i = 0; i < n; i++) {
+            printf "struct S%d { a: int; b: int; }\n", i;
+            printf "fn f%d(x: int) -> int {\n", i;
+            for (j = 0; j < locals; j++) {
+                printf "    var v%d = x + %d + g%d;\n", j, j, i;
+            }
+            printf "    var s = S%d { a: v0, b: v1 };\n", i;
+            printf "    return s.a + v%d;\n}\n", locals - 1;
+        }
+        printf "fn main() {\n    var t = 0;\n";
+        for (i = 0; i < n; i++) {
+            printf "    t = t + f%d(1);\n", i;
+        }
+        printf "}\n";
+    }'
+}
+
+now() {
+    date +%s.%N
+}
+
+echo "** Zen C front-end scaling (zc check, $LOCALS locals per function) **"
+printf "%10s %10s %12s %14s\n" "functions" "lines" "seconds" "us/function"
+
+for n in $SIZES; do
+    src="$TMP_DIR/stress_$n.zc"
+    gen_program "$n" > "$src"
+    lines=$(wc -l < "$src")
+
+    start=$(now)
+    if ! $ZC check "$src" -q > /dev/null 2>&1; then
+        echo "zc check failed for N=$n"
+        exit 1
+    fi
+    end=$(now)
+
+    awk -v n="$n" -v l="$lines" -v s="$start" -v e="$end" \
+        'BEGIN { t = e - s; printf "%10d %10d %12.3f %14.2f\n", n, l, t, t * 1e6 / n }'
+done
@@ -0,0 +1,512 @@
+
+#include "reachability.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+// ** Internal State **
+
+typedef struct FuncRef
+{
+    ASTNode *fn;
+    struct FuncRef *next;
+} FuncRef;
+
+typedef struct Reach
+{
+    ParserContext *ctx;
+    int has_main;      // Without a user 'main' every function is a root.
+    HashMap seen;      // Interned identifiers already looked up.
+    HashMap raw;       // Identifiers mentioned in file-scope raw C.
+    HashMap by_name;   // C name -> FuncRef* (functions not reached yet).
+    HashMap by_method; // Bare method name -> FuncRef* (impl methods).
+    ASTNode **work;    // Reached functions whose bodies are still to be walked.
+    int work_count;
+    int work_cap;
+    ASTNode **live; // Every reached function, for the linkage decision.
+    int live_count;
+    int live_cap;
+} Reach;
+
+static void push_node(ASTNode ***arr, int *count, int *cap, ASTNode *n)
+{
+    if (*count == *cap)
+    {
+        *cap = *cap ? *cap * 2 : 64;
+        *arr = realloc(*arr, sizeof(ASTNode *) * *cap);
+    }
+    (*arr)[(*count)++] = n;
+}
+
+static void add_ref(HashMap *m, const char *name, ASTNode *fn)
+{
+    FuncRef *r = malloc(sizeof(FuncRef));
+    r->fn = fn;
+    char *key = intern(name);
+    r->next = hashmap_get(m, key);
+    hashmap_put(m, key, r);
+}
+
+static int is_root_func(Reach *r, ASTNode *fn)
+{
+    return !r->has_main || !fn->func.body || strcmp(fn->func.name, "main") == 0 ||
+           fn->func.is_export || fn->func.constructor || fn->func.destructor || fn->func.weak;
+}
+
+static void reach_func(Reach *r, ASTNode *fn)
+{
+    if (!fn->func.is_unreachable)
+    {
+        return;
+    }
+    fn->func.is_unreachable = 0;
+    push_node(&r->work, &r->work_count, &r->work_cap, fn);
+    push_node(&r->live, &r->live_count, &r->live_cap, fn);
+}
+
+// ** Names **
+
+// A function is reached once its C name (Vec_int_new, util_helper) or, for
+// impl methods, its bare name (v.push(): the receiver type is only known in
+// codegen) shows up in live code.
+static void reach_name(Reach *r, const char *s, int len)
+{
+    char *name = intern_n(s, len);
+    if (hashmap_put(&r->seen, name, name))
+    {
+        return;
+    }
+
+    for (FuncRef *f = hashmap_get(&r->by_name, name); f; f = f->next)
+    {
+        reach_func(r, f->fn);
+    }
+    for (FuncRef *f = hashmap_get(&r->by_method, name); f; f = f->next)
+    {
+        reach_func(r, f->fn);
+    }
+
+    LazyMethod *m = hashmap_get(&r->ctx->index.lazy_methods, name);
+    if (m)
+    {
+        ASTNode *fn = instantiate_lazy_method(m);
+        if (fn)
+        {
+            fn->func.is_unreachable = 1;
+            reach_func(r, fn);
+        }
+    }
+    for (m = hashmap_get(&r->ctx->index.lazy_by_method, name); m; m = m->next_same_method)
+    {
+        ASTNode *fn = instantiate_lazy_method(m);
+        if (fn)
+        {
+            fn->func.is_unreachable = 1;
+            reach_func(r, fn);
+        }
+    }
+}
+
+// Every identifier in argument lists, patterns, string literals and raw C.
+// 'is_raw' marks file-scope C, which is emitted ahead of the prototypes and
+// may declare functions itself.
+static void reach_text(Reach *r, const char *s, int is_raw)
+{
+    if (!s)
+    {
+        return;
+    }
+    while (*s)
+    {
+        if (isalpha((unsigned char)*s) || *s == '_')
+        {
+            const char *start = s;
+            while (isalnum((unsigned char)*s) || *s == '_')
+            {
+                s++;
+            }
+            reach_name(r, start, (int)(s - start));
+            if (is_raw)
+            {
+                char *name = intern_n(start, (int)(s - start));
+                hashmap_put(&r->raw, name, name);
+            }
+        }
+        else
+        {
+            s++;
+        }
+    }
+}
+
+// ** AST Walk **
+
+static void reach_ast(Reach *r, ASTNode *n)
+{
+    for (; n; n = n->next)
+    {
+        switch (n->type)
+        {
+        case NODE_ROOT:
+            reach_ast(r, n->root.children);
+            break;
+        case NODE_FUNCTION:
+            reach_text(r, n->func.args, 0);
+            for (int i = 0; n->func.defaults && i < n->func.arg_count; i++)
+            {
+                reach_text(r, n->func.defaults[i], 0);
+            }
+            reach_ast(r, n->func.body);
+            break;
+        case NODE_IMPL:
+            reach_ast(r, n->impl.methods);
+            break;
+        case NODE_IMPL_TRAIT:
+            reach_ast(r, n->impl_trait.methods);
+            break;
+        case NODE_TRAIT:
+            reach_ast(r, n->trait.methods);
+            break;
+        case NODE_TEST:
+            reach_ast(r, n->test_stmt.body);
+            break;
+        case NODE_BLOCK:
+            reach_ast(r, n->block.statements);
+            break;
+        case NODE_RAW_STMT:
+            reach_text(r, n->raw_stmt.content, 0);
+            break;
+        case NODE_PLUGIN:
+            reach_text(r, n->plugin_stmt.body, 0);
+            break;
+        case NODE_ASM:
+            reach_text(r, n->asm_stmt.code, 0);
+            for (int i = 0; i < n->asm_stmt.num_outputs; i++)
+            {
+                reach_text(r, n->asm_stmt.outputs[i], 0);
+            }
+            for (int i = 0; i < n->asm_stmt.num_inputs; i++)
+            {
+                reach_text(r, n->asm_stmt.inputs[i], 0);
+            }
+            break;
+        case NODE_VAR_DECL:
+        case NODE_CONST:
+            reach_ast(r, n->var_decl.init_expr);
+            break;
+        case NODE_DESTRUCT_VAR:
+            reach_ast(r, n->destruct.init_expr);
+            reach_ast(r, n->destruct.else_block);
+            break;
+        case NODE_RETURN:
+            reach_ast(r, n->ret.value);
+            break;
+        case NODE_IF:
+            reach_ast(r, n->if_stmt.condition);
+            reach_ast(r, n->if_stmt.then_body);
+            reach_ast(r, n->if_stmt.else_body);
+            break;
+        case NODE_WHILE:
+            reach_ast(r, n->while_stmt.condition);
+            reach_ast(r, n->while_stmt.body);
+            break;
+        case NODE_DO_WHILE:
+            reach_ast(r, n->do_while_stmt.condition);
+            reach_ast(r, n->do_while_stmt.body);
+            break;
+        case NODE_FOR:
+            reach_ast(r, n->for_stmt.init);
+            reach_ast(r, n->for_stmt.condition);
+            reach_ast(r, n->for_stmt.step);
+            reach_ast(r, n->for_stmt.body);
+            break;
+        case NODE_FOR_RANGE:
+            reach_ast(r, n->for_range.start);
+            reach_ast(r, n->for_range.end);
+            reach_text(r, n->for_range.step, 0);
+            reach_ast(r, n->for_range.body);
+            break;
+        case NODE_LOOP:
+            reach_ast(r, n->loop_stmt.body);
+            break;
+        case NODE_REPEAT:
+            reach_text(r, n->repeat_stmt.count, 0);
+            reach_ast(r, n->repeat_stmt.body);
+            break;
+        case NODE_UNLESS:
+            reach_ast(r, n->unless_stmt.condition);
+            reach_ast(r, n->unless_stmt.body);
+            break;
+        case NODE_GUARD:
+            reach_ast(r, n->guard_stmt.condition);
+            reach_ast(r, n->guard_stmt.body);
+            break;
+        case NODE_MATCH:
+            reach_ast(r, n->match_stmt.expr);
+            reach_ast(r, n->match_stmt.cases);
+            break;
+        case NODE_MATCH_CASE:
+            reach_text(r, n->match_case.pattern, 0);
+            reach_ast(r, n->match_case.guard);
+            reach_ast(r, n->match_case.body);
+            break;
+        case NODE_DEFER:
+            reach_ast(r, n->defer_stmt.stmt);
+            break;
+        case NODE_GOTO:
+            reach_ast(r, n->goto_stmt.goto_expr);
+            break;
+        case NODE_ASSERT:
+            reach_ast(r, n->assert_stmt.condition);
+            break;
+        case NODE_TRY:
+            reach_ast(r, n->try_stmt.expr);
+            break;
+        case NODE_REPL_PRINT:
+            reach_ast(r, n->repl_print.expr);
+            break;
+        case NODE_LAMBDA:
+            reach_ast(r, n->lambda.body);
+            break;
+        case NODE_TERNARY:
+            reach_ast(r, n->ternary.cond);
+            reach_ast(r, n->ternary.true_expr);
+            reach_ast(r, n->ternary.false_expr);
+            break;
+        case NODE_EXPR_BINARY:
+            // '==' on structs is emitted as a call to T_eq by codegen.
+            if (strcmp(n->binary.op, "==") == 0 || strcmp(n->binary.op, "!=") == 0)
+            {
+                reach_name(r, "eq", 2);
+            }
+            reach_ast(r, n->binary.left);
+            reach_ast(r, n->binary.right);
+            break;
+        case NODE_EXPR_UNARY:
+        case NODE_AWAIT:
+            reach_ast(r, n->unary.operand);
+            break;
+        case NODE_EXPR_LITERAL:
+            if (n->literal.type_kind == 2)
+            {
+                reach_text(r, n->literal.string_val, 0);
+            }
+            break;
+        case NODE_EXPR_VAR:
+            reach_text(r, n->var_ref.name, 0);
+            break;
+        case NODE_EXPR_CALL:
+            reach_ast(r, n->call.callee);
+            reach_ast(r, n->call.args);
+            break;
+        case NODE_EXPR_MEMBER:
+            reach_ast(r, n->member.target);
+            reach_text(r, n->member.field, 0);
+            break;
+        case NODE_EXPR_INDEX:
+            reach_ast(r, n->index.array);
+            reach_ast(r, n->index.index);
+            break;
+        case NODE_EXPR_SLICE:
+            reach_ast(r, n->slice.array);
+            reach_ast(r, n->slice.start);
+            reach_ast(r, n->slice.end);
+            break;
+        case NODE_EXPR_CAST:
+            reach_ast(r, n->cast.expr);
+            break;
+        case NODE_EXPR_SIZEOF:
+        case NODE_TYPEOF:
+            reach_ast(r, n->size_of.expr);
+            break;
+        case NODE_EXPR_STRUCT_INIT:
+            reach_ast(r, n->struct_init.fields);
+            break;
+        case NODE_EXPR_ARRAY_LITERAL:
+            reach_ast(r, n->array_literal.elements);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Walks 'n' alone, without its siblings.
+static void reach_one(Reach *r, ASTNode *n)
+{
+    ASTNode *backup_next = n->next;
+    n->next = NULL;
+    reach_ast(r, n);
+    n->next = backup_next;
+}
+
+// ** Roots and Candidates **
+
+// Impl methods are emitted as Struct_method whether or not the parser already
+// mangled their name (see emit_protos).
+static void add_method(Reach *r, const char *sname, ASTNode *m)
+{
+    const char *fname = m->func.name;
+    size_t slen = sname ? strlen(sname) : 0;
+    if (sname && strncmp(fname, sname, slen) == 0 && fname[slen] == '_')
+    {
+        add_ref(&r->by_name, fname, m);
+        add_ref(&r->by_method, fname + slen + 1, m);
+    }
+    else
+    {
+        add_ref(&r->by_method, fname, m);
+        if (sname)
+        {
+            char *cname = malloc(slen + strlen(fname) + 2);
+            sprintf(cname, "%s_%s", sname, fname);
+            add_ref(&r->by_name, cname, m);
+        }
+    }
+}
+
+static void add_candidates(Reach *r, ASTNode *n)
+{
+    if (n->type == NODE_FUNCTION)
+    {
+        if (!is_root_func(r, n))
+        {
+            n->func.is_unreachable = 1;
+            add_ref(&r->by_name, n->func.name, n);
+        }
+    }
+    else if (n->type == NODE_IMPL)
+    {
+        for (ASTNode *m = n->impl.methods; m; m = m->next)
+        {
+            if (m->type == NODE_FUNCTION && !is_root_func(r, m))
+            {
+                m->func.is_unreachable = 1;
+                add_method(r, n->impl.struct_name, m);
+            }
+        }
+    }
+}
+
+// Top-level declarations: everything except functions that are still
+// candidates is a root.
+static void reach_top(Reach *r, ASTNode *n)
+{
+    for (; n; n = n->next)
+    {
+        if (n->type == NODE_RAW_STMT)
+        {
+            reach_text(r, n->raw_stmt.content, 1);
+        }
+        else if (n->type == NODE_PLUGIN)
+        {
+            reach_text(r, n->plugin_stmt.body, 1);
+        }
+        else if (n->type == NODE_FUNCTION)
+        {
+            if (!n->func.is_unreachable)
+            {
+                reach_one(r, n);
+            }
+        }
+        else if (n->type == NODE_IMPL)
+        {
+            for (ASTNode *m = n->impl.methods; m; m = m->next)
+            {
+                if (!m->func.is_unreachable)
+                {
+                    reach_one(r, m);
+                }
+            }
+        }
+        else
+        {
+            reach_one(r, n);
+        }
+    }
+}
+
+static void reach_list(Reach *r, StructRef *s, int candidates)
+{
+    for (; s; s = s->next)
+    {
+        if (candidates)
+        {
+            add_candidates(r, s->node);
+        }
+        else
+        {
+            ASTNode *backup_next = s->node->next;
+            s->node->next = NULL;
+            reach_top(r, s->node);
+            s->node->next = backup_next;
+        }
+    }
+}
+
+static int has_user_main(ParserContext *ctx)
+{
+    for (StructRef *s = ctx->parsed_funcs_list; s; s = s->next)
+    {
+        if (s->node->type == NODE_FUNCTION && strcmp(s->node->func.name, "main") == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ** Main Entry Point **
+
+void mark_reachable(ParserContext *ctx, ASTNode *root)
+{
+    Reach r;
+    memset(&r, 0, sizeof(r));
+    r.ctx = ctx;
+    r.has_main = has_user_main(ctx);
+
+    reach_list(&r, ctx->parsed_funcs_list, 1);
+    reach_list(&r, ctx->parsed_impls_list, 1);
+    for (ASTNode *n = ctx->instantiated_funcs; n; n = n->next)
+    {
+        add_candidates(&r, n);
+    }
+
+    reach_top(&r, root->root.children);
+    reach_list(&r, ctx->parsed_funcs_list, 0);
+    reach_list(&r, ctx->parsed_impls_list, 0);
+    reach_list(&r, ctx->parsed_globals_list, 0);
+    reach_top(&r, ctx->instantiated_funcs);
+    for (LambdaRef *l = ctx->global_lambdas; l; l = l->next)
+    {
+        reach_one(&r, l->node);
+    }
+
+    long pos = ctx->hoist_out ? ftell(ctx->hoist_out) : 0;
+    if (pos > 0)
+    {
+        char *text = malloc(pos + 1);
+        rewind(ctx->hoist_out);
+        size_t n = fread(text, 1, pos, ctx->hoist_out);
+        text[n] = 0;
+        fseek(ctx->hoist_out, pos, SEEK_SET);
+        reach_text(&r, text, 1);
+    }
+
+    while (r.work_count)
+    {
+        reach_one(&r, r.work[--r.work_count]);
+    }
+
+    // Internal linkage lets the C compiler inline and discard freely. A
+    // non-static declaration in file-scope raw C followed by a static
+    // definition would not compile, so those keep external linkage.
+    for (int i = 0; r.has_main && i < r.live_count; i++)
+    {
+        ASTNode *fn = r.live[i];
+        if (!fn->func.is_async && !hashmap_contains(&r.raw, fn->func.name))
+        {
+            fn->func.is_static = 1;
+        }
+    }
+}
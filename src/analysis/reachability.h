@@ -0,0 +1,18 @@
+#ifndef REACHABILITY_H
+#define REACHABILITY_H
+
+#include "ast.h"
+#include "parser.h"
+
+// Whole-program reachability, run once before codegen.
+// Roots are 'main', tests, @export / @constructor / @destructor / @weak
+// functions, trait impls (vtables and Drop glue reference them), lambdas,
+// globals and raw C. Everything a root references by name is live; generic
+// impl methods are instantiated the first time they are reached.
+// Functions that stay unreachable get func.is_unreachable and are not emitted,
+// and the remaining ones that are only used inside this translation unit get
+// func.is_static. Without a user 'main' the program is a library and every
+// function is a root.
+void mark_reachable(ParserContext *ctx, ASTNode *root);
+
+#endif // REACHABILITY_H
@@ -14,8 +14,7 @@ static void tc_error(TypeChecker *tc, Token t, const char *msg)
 
 static void tc_enter_scope(TypeChecker *tc)
 {
-    Scope *s = malloc(sizeof(Scope));
-    s->symbols = NULL;
+    Scope *s = calloc(1, sizeof(Scope));
     s->parent = tc->current_scope;
     tc->current_scope = s;
 }
@@ -1,7 +1,9 @@
 
 #include "ast.h"
 #include "../parser/parser.h"
+#include "hashmap.h"
 #include "zprep.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -15,10 +17,20 @@ static TraitReg *registered_traits = NULL;
 
 void register_trait(const char *name)
 {
+    // Process-wide: every reparse (LSP, REPL) registers the same traits again.
+    arena_global_lock();
+    if (is_trait(name))
+    {
+        arena_global_unlock();
+        return;
+    }
+    Arena *prev = arena_switch(arena_global());
     TraitReg *r = xmalloc(sizeof(TraitReg));
     r->name = xstrdup(name);
     r->next = registered_traits;
     registered_traits = r;
+    arena_switch(prev);
+    arena_global_unlock();
 }
 
 int is_trait(const char *name)
@@ -35,10 +47,11 @@ int is_trait(const char *name)
     return 0;
 }
 
+static Pool node_pool = POOL_INIT(ASTNode);
+
 ASTNode *ast_create(NodeType type)
 {
-    ASTNode *node = xmalloc(sizeof(ASTNode));
-    memset(node, 0, sizeof(ASTNode));
+    ASTNode *node = pool_alloc(&node_pool);
     node->type = type;
     return node;
 }
@@ -59,6 +72,8 @@ Type *type_new(TypeKind kind)
     t->arg_count = 0;
     t->is_const = 0;
     t->array_size = 0;
+    t->is_interned = 0;
+    t->str = NULL;
     return t;
 }
 
@@ -69,6 +84,157 @@ Type *type_new_ptr(Type *inner)
     return t;
 }
 
+// ** Type interning **
+// Open-addressed set of canonical types. Children are interned first, so a
+// type is identified by its own fields plus the pointers of its children.
+
+static Type **type_table = NULL;
+static int type_table_cap = 0;
+static int type_table_count = 0;
+
+static unsigned int type_hash(const Type *t)
+{
+    unsigned int h = 2166136261u;
+#define MIX(v)                                                                                     \
+    do                                                                                             \
+    {                                                                                              \
+        h ^= (unsigned int)(v);                                                                    \
+        h *= 16777619u;                                                                            \
+    } while (0)
+    MIX(t->kind);
+    MIX(t->name ? hash_string(t->name) : 0);
+    MIX((uintptr_t)t->inner);
+    MIX((uintptr_t)t->inner >> 16);
+    for (int i = 0; i < t->arg_count; i++)
+    {
+        MIX((uintptr_t)t->args[i]);
+        MIX((uintptr_t)t->args[i] >> 16);
+    }
+    MIX(t->arg_count);
+    MIX(t->is_const);
+    MIX(t->array_size);
+#undef MIX
+    return h;
+}
+
+// 't' has interned children; 'c' is canonical.
+static int type_same(const Type *t, const Type *c)
+{
+    if (t->kind != c->kind || t->inner != c->inner || t->arg_count != c->arg_count ||
+        t->is_const != c->is_const || t->array_size != c->array_size)
+    {
+        return 0;
+    }
+    if (t->name != c->name && (!t->name || !c->name || strcmp(t->name, c->name) != 0))
+    {
+        return 0;
+    }
+    for (int i = 0; i < t->arg_count; i++)
+    {
+        if (t->args[i] != c->args[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static Type **type_slot(const Type *t, unsigned int h)
+{
+    unsigned int mask = (unsigned int)type_table_cap - 1;
+    unsigned int i = h & mask;
+    while (type_table[i] && !type_same(t, type_table[i]))
+    {
+        i = (i + 1) & mask;
+    }
+    return &type_table[i];
+}
+
+static void type_table_grow(void)
+{
+    Type **old = type_table;
+    int old_cap = type_table_cap;
+
+    type_table_cap = old_cap ? old_cap * 2 : 256;
+    type_table = xcalloc(type_table_cap, sizeof(Type *));
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old[i])
+        {
+            *type_slot(old[i], type_hash(old[i])) = old[i];
+        }
+    }
+    free(old);
+}
+
+Type *type_intern(Type *t)
+{
+    if (!t || t->is_interned)
+    {
+        return t;
+    }
+
+    // Probe with a stack key whose children are already canonical.
+    Type key = *t;
+    Type *key_args[16];
+    key.inner = type_intern(t->inner);
+    if (t->arg_count > 0 && t->args)
+    {
+        key.args = t->arg_count <= 16 ? key_args : xmalloc(sizeof(Type *) * t->arg_count);
+        for (int i = 0; i < t->arg_count; i++)
+        {
+            key.args[i] = type_intern(t->args[i]);
+        }
+    }
+    else
+    {
+        key.arg_count = 0;
+        key.args = NULL;
+    }
+
+    // Canonical types are shared by every parse, so they outlive scoped arenas.
+    arena_global_lock();
+    Arena *prev = arena_switch(arena_global());
+    if ((type_table_count + 1) * 4 > type_table_cap * 3)
+    {
+        type_table_grow();
+    }
+
+    unsigned int h = type_hash(&key);
+    Type **slot = type_slot(&key, h);
+    if (*slot)
+    {
+        arena_switch(prev);
+        arena_global_unlock();
+        return *slot;
+    }
+
+    Type *c = xmalloc(sizeof(Type));
+    *c = key;
+    c->name = t->name ? intern(t->name) : NULL;
+    if (key.arg_count > 0)
+    {
+        c->args = xmalloc(sizeof(Type *) * key.arg_count);
+        memcpy(c->args, key.args, sizeof(Type *) * key.arg_count);
+    }
+    c->is_interned = 1;
+    c->str = NULL;
+    *slot = c;
+    type_table_count++;
+    arena_switch(prev);
+    arena_global_unlock();
+    return c;
+}
+
+Type *type_clone(Type *t)
+{
+    Type *c = xmalloc(sizeof(Type));
+    *c = *t;
+    c->is_interned = 0;
+    c->str = NULL;
+    return c;
+}
+
 int is_char_ptr(Type *t)
 {
     // Handle both primitive char* and legacy struct char*.
@@ -151,7 +317,11 @@ int type_eq(Type *a, Type *b)
 
     if (a->kind == TYPE_STRUCT || a->kind == TYPE_GENERIC)
     {
-        return 0 == strcmp(a->name, b->name);
+        if (a->is_interned && b->is_interned)
+        {
+            return a->name == b->name;
+        }
+        return a->name == b->name || 0 == strcmp(a->name, b->name);
     }
     if (a->kind == TYPE_POINTER || a->kind == TYPE_ARRAY)
     {
@@ -161,7 +331,105 @@ int type_eq(Type *a, Type *b)
     return 1;
 }
 
+static char *type_to_string_uncached(Type *t);
+
+char *type_spelling(Type *t)
+{
+    if (!t->str)
+    {
+        arena_global_lock();
+        if (!t->str)
+        {
+            Arena *prev = arena_switch(arena_global());
+            t->str = type_to_string_uncached(t);
+            arena_switch(prev);
+        }
+        arena_global_unlock();
+    }
+    return t->str;
+}
+
+static HashMap spelled_types; // Interned spelling -> interned Type.
+
+static Type *type_from_spelling_uncached(const char *s)
+{
+    size_t len = strlen(s);
+    if (len > 1 && '*' == s[len - 1])
+    {
+        char *base = xstrdup(s);
+        base[len - 1] = 0;
+        Type *ptr = type_intern(type_new_ptr(type_from_spelling(base)));
+        if (0 == strcmp(type_spelling(ptr), s))
+        {
+            return ptr;
+        }
+    }
+
+    for (TypeKind k = TYPE_VOID; k <= TYPE_UINT; k++)
+    {
+        Type prim = {0};
+        prim.kind = k;
+        Type *t = type_intern(&prim);
+        if (0 == strcmp(type_spelling(t), s))
+        {
+            return t;
+        }
+    }
+
+    // Anything else (mangled generics, C types, "Async"...) stays opaque: a
+    // named type without arguments spells exactly as its name.
+    Type named = {0};
+    named.kind = TYPE_STRUCT;
+    named.name = (char *)s;
+    return type_intern(&named);
+}
+
+Type *type_from_spelling(const char *s)
+{
+    if (!s)
+    {
+        return NULL;
+    }
+    arena_global_lock();
+    char *key = intern(s);
+    Type *t = hashmap_get(&spelled_types, key);
+    if (!t)
+    {
+        t = type_from_spelling_uncached(key);
+        Arena *prev = arena_switch(arena_global());
+        hashmap_put(&spelled_types, key, t);
+        arena_switch(prev);
+    }
+    arena_global_unlock();
+    return t;
+}
+
+Type *type_instance(const char *base, Type *arg)
+{
+    Type inst = {0};
+    inst.kind = TYPE_STRUCT;
+    inst.name = (char *)base;
+    inst.args = &arg;
+    inst.arg_count = 1;
+    return type_intern(&inst);
+}
+
+int type_is_instance_of(Type *t, const char *base)
+{
+    return t && TYPE_STRUCT == t->kind && t->arg_count > 0 && 0 == strcmp(t->name, base);
+}
+
 char *type_to_string(Type *t)
+{
+    // Interned types are immutable, so their spelling is built once.
+    if (t && t->is_interned)
+    {
+        return xstrdup(type_spelling(t));
+    }
+    return type_to_string_uncached(t);
+}
+
+static char *type_to_string_uncached(Type *t)
 {
     if (!t)
     {
@@ -60,6 +60,8 @@ typedef struct Type
         int is_restrict; // For restrict pointers.
         int has_drop;    // For RAII: does this type implement Drop?
     };
+    int is_interned; // Canonical instance from type_intern(); shared, never mutate.
+    char *str;       // Cached type_to_string() of an interned type.
 } Type;
 
 // ** AST Node Types **
@@ -124,20 +126,24 @@ typedef enum
 } NodeType;
 
 // ** AST Node Structure **
+// Nodes come from a per-arena pool (see ast_create), so keep this small:
+// fields are ordered to avoid padding and the union is sized by its largest
+// member, which is why 'func' packs its flags into bits.
 struct ASTNode
 {
     NodeType type;
-    ASTNode *next;
     int line; // Source line number for debugging.
+    ASTNode *next;
 
     // Type information.
     char *resolved_type; // Legacy string representation (for example: "int",
                          // "User*"). > Yes, 'legacy' is a thing, this is the
                          // third iteration > of this project (for now).
     Type *type_info;     // Formal type object (for inference/generics).
+    Type *inferred_type; // Memoized infer_type_info() result (codegen).
     Token token;
-    Token definition_token; // For LSP: Location where the symbol used in this
-                            // node was defined.
+    const Token *definition_token; // For LSP: Location where the symbol used in
+                                   // this node was defined (NULL if unknown).
 
     union
     {
@@ -155,25 +161,27 @@ struct ASTNode
             Type **arg_types;
             char **defaults;
             char **param_names; // Explicit parameter names.
-            int arg_count;
             Type *ret_type_info;
-            int is_varargs;
-            int is_inline;
-            int must_use; // @must_use: warn if return value is discarded.
+            char *section; // @section("name")
+            int arg_count;
+            unsigned is_varargs : 1;
+            unsigned is_inline : 1;
+            unsigned must_use : 1; // @must_use: warn if return value is discarded.
             // GCC attributes
-            int noinline;    // @noinline
-            int constructor; // @constructor
-            int destructor;  // @destructor
-            int unused;      // @unused
-            int weak;        // @weak
-            int is_export;   // @export (visibility default).
-            int cold;        // @cold
-            int hot;         // @hot
-            int noreturn;    // @noreturn
-            int pure;        // @pure
-            char *section;   // @section("name")
-            int is_async;    // async function
-            int is_comptime; // @comptime function
+            unsigned noinline : 1;    // @noinline
+            unsigned constructor : 1; // @constructor
+            unsigned destructor : 1;  // @destructor
+            unsigned unused : 1;      // @unused
+            unsigned weak : 1;        // @weak
+            unsigned is_export : 1;   // @export (visibility default).
+            unsigned cold : 1;        // @cold
+            unsigned hot : 1;         // @hot
+            unsigned noreturn : 1;    // @noreturn
+            unsigned pure : 1;        // @pure
+            unsigned is_async : 1;    // async function
+            unsigned is_comptime : 1; // @comptime function
+            unsigned is_static : 1;      // Internal linkage (set by the reachability pass).
+            unsigned is_unreachable : 1; // Never referenced from a root; not emitted.
         } func;
 
         struct
@@ -543,7 +551,22 @@ void ast_free(ASTNode *node);
 
 Type *type_new(TypeKind kind);
 Type *type_new_ptr(Type *inner);
+// Canonical shared instance of 't' (which is left untouched). Structurally
+// identical types intern to the same pointer.
+Type *type_intern(Type *t);
+// Private, mutable shallow copy (use before modifying an interned type).
+Type *type_clone(Type *t);
 int type_eq(Type *a, Type *b);
 char *type_to_string(Type *t);
+// Cached type_to_string() of an interned type; shared, never modify it.
+char *type_spelling(Type *t);
+// Interned type whose spelling is exactly 's'. Primitive and pointer
+// spellings decompose into formal types; anything else is an opaque name.
+Type *type_from_spelling(const char *s);
+// Interned instance of the generic 'base' at 'arg' (Option<int>). It spells
+// as the mangled name the instance is emitted under (Option_int).
+Type *type_instance(const char *base, Type *arg);
+// Whether 't' is an instance of the generic 'base'.
+int type_is_instance_of(Type *t, const char *base);
 
 #endif
@@ -11,8 +11,8 @@
 #include "zprep_plugin.h"
 
 // static function for internal use.
-static char *g_current_func_ret_type = NULL;
-static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out, int use_result)
+static _Thread_local char *g_current_func_ret_type = NULL;
+static void codegen_match_internal(ParserContext *ctx, ASTNode *node, OutBuf *out, int use_result)
 {
     int id = tmp_counter++;
     int is_self = (node->match_stmt.expr->type == NODE_EXPR_VAR &&
@@ -21,28 +21,28 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
     char *ret_type = infer_type(ctx, node);
     int is_expr = (use_result && ret_type && strcmp(ret_type, "void") != 0);
 
-    fprintf(out, "({ ");
+    ob_puts(out, "({ ");
     emit_auto_type(ctx, node->match_stmt.expr, node->token, out);
-    fprintf(out, " _m_%d = ", id);
+    ob_printf(out, " _m_%d = ", id);
     if (is_self)
     {
-        fprintf(out, "*(");
+        ob_puts(out, "*(");
     }
     codegen_expression(ctx, node->match_stmt.expr, out);
     if (is_self)
     {
-        fprintf(out, ")");
+        ob_putc(out, ')');
     }
-    fprintf(out, "; ");
+    ob_puts(out, "; ");
 
     if (is_expr)
     {
-        fprintf(out, "%s _r_%d; ", ret_type, id);
+        ob_printf(out, "%s _r_%d; ", ret_type, id);
     }
 
-    char *expr_type = infer_type(ctx, node->match_stmt.expr);
-    int is_option = (expr_type && strncmp(expr_type, "Option_", 7) == 0);
-    int is_result = (expr_type && strncmp(expr_type, "Result_", 7) == 0);
+    Type *expr_type = infer_type_info(ctx, node->match_stmt.expr);
+    int is_option = type_is_instance_of(expr_type, "Option");
+    int is_result = type_is_instance_of(expr_type, "Result");
 
     char *enum_name = NULL;
     ASTNode *chk = node->match_stmt.cases;
@@ -99,41 +99,41 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
     {
         if (!first)
         {
-            fprintf(out, " else ");
+            ob_puts(out, " else ");
         }
-        fprintf(out, "if (");
+        ob_puts(out, "if (");
         if (strcmp(c->match_case.pattern, "_") == 0)
         {
-            fprintf(out, "1");
+            ob_putc(out, '1');
         }
         else if (is_option)
         {
             if (strcmp(c->match_case.pattern, "Some") == 0)
             {
-                fprintf(out, "_m_%d.is_some", id);
+                ob_printf(out, "_m_%d.is_some", id);
             }
             else if (strcmp(c->match_case.pattern, "None") == 0)
             {
-                fprintf(out, "!_m_%d.is_some", id);
+                ob_printf(out, "!_m_%d.is_some", id);
             }
             else
             {
-                fprintf(out, "1");
+                ob_putc(out, '1');
             }
         }
         else if (is_result)
         {
             if (strcmp(c->match_case.pattern, "Ok") == 0)
             {
-                fprintf(out, "_m_%d.is_ok", id);
+                ob_printf(out, "_m_%d.is_ok", id);
             }
             else if (strcmp(c->match_case.pattern, "Err") == 0)
             {
-                fprintf(out, "!_m_%d.is_ok", id);
+                ob_printf(out, "!_m_%d.is_ok", id);
             }
             else
             {
-                fprintf(out, "1");
+                ob_putc(out, '1');
             }
         }
         else
@@ -141,40 +141,40 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
             EnumVariantReg *reg = find_enum_variant(ctx, c->match_case.pattern);
             if (reg)
             {
-                fprintf(out, "_m_%d.tag == %d", id, reg->tag_id);
+                ob_printf(out, "_m_%d.tag == %d", id, reg->tag_id);
             }
             else if (c->match_case.pattern[0] == '"')
             {
-                fprintf(out, "strcmp(_m_%d, %s) == 0", id, c->match_case.pattern);
+                ob_printf(out, "strcmp(_m_%d, %s) == 0", id, c->match_case.pattern);
             }
             else if (isdigit(c->match_case.pattern[0]) || c->match_case.pattern[0] == '-')
             {
                 // Numeric pattern
-                fprintf(out, "_m_%d == %s", id, c->match_case.pattern);
+                ob_printf(out, "_m_%d == %s", id, c->match_case.pattern);
             }
             else if (c->match_case.pattern[0] == '\'')
             {
                 // Char literal pattern
-                fprintf(out, "_m_%d == %s", id, c->match_case.pattern);
+                ob_printf(out, "_m_%d == %s", id, c->match_case.pattern);
             }
             else
             {
-                fprintf(out, "1");
+                ob_putc(out, '1');
             }
         }
-        fprintf(out, ") { ");
+        ob_puts(out, ") { ");
         if (c->match_case.binding_name)
         {
             if (is_option)
             {
                 if (strstr(g_config.cc, "tcc"))
                 {
-                    fprintf(out, "__typeof__(_m_%d.val) %s = _m_%d.val; ", id,
-                            c->match_case.binding_name, id);
+                    ob_printf(out, "__typeof__(_m_%d.val) %s = _m_%d.val; ", id,
+                              c->match_case.binding_name, id);
                 }
                 else
                 {
-                    fprintf(out, "__auto_type %s = _m_%d.val; ", c->match_case.binding_name, id);
+                    ob_printf(out, "__auto_type %s = _m_%d.val; ", c->match_case.binding_name, id);
                 }
             }
             if (is_result)
@@ -183,26 +183,26 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
                 {
                     if (strstr(g_config.cc, "tcc"))
                     {
-                        fprintf(out, "__typeof__(_m_%d.val) %s = _m_%d.val; ", id,
-                                c->match_case.binding_name, id);
+                        ob_printf(out, "__typeof__(_m_%d.val) %s = _m_%d.val; ", id,
+                                  c->match_case.binding_name, id);
                     }
                     else
                     {
-                        fprintf(out, "__auto_type %s = _m_%d.val; ", c->match_case.binding_name,
-                                id);
+                        ob_printf(out, "__auto_type %s = _m_%d.val; ", c->match_case.binding_name,
+                                  id);
                     }
                 }
                 else
                 {
                     if (strstr(g_config.cc, "tcc"))
                     {
-                        fprintf(out, "__typeof__(_m_%d.err) %s = _m_%d.err; ", id,
-                                c->match_case.binding_name, id);
+                        ob_printf(out, "__typeof__(_m_%d.err) %s = _m_%d.err; ", id,
+                                  c->match_case.binding_name, id);
                     }
                     else
                     {
-                        fprintf(out, "__auto_type %s = _m_%d.err; ", c->match_case.binding_name,
-                                id);
+                        ob_printf(out, "__auto_type %s = _m_%d.err; ", c->match_case.binding_name,
+                                  id);
                     }
                 }
             }
@@ -217,7 +217,8 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
                 {
                     f = c->match_case.pattern;
                 }
-                fprintf(out, "__auto_type %s = _m_%d.data.%s; ", c->match_case.binding_name, id, f);
+                ob_printf(out, "__auto_type %s = _m_%d.data.%s; ", c->match_case.binding_name, id,
+                          f);
             }
         }
 
@@ -227,7 +228,7 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
 
         if (is_expr)
         {
-            fprintf(out, "_r_%d = ", id);
+            ob_printf(out, "_r_%d = ", id);
             if (is_string_literal)
             {
                 codegen_node_single(ctx, body, out);
@@ -237,7 +238,7 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
                 if (body->type == NODE_BLOCK)
                 {
                     int saved = defer_count;
-                    fprintf(out, "({ ");
+                    ob_puts(out, "({ ");
                     ASTNode *stmt = body->block.statements;
                     while (stmt)
                     {
@@ -249,22 +250,22 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
                         codegen_node_single(ctx, defer_stack[i], out);
                     }
                     defer_count = saved;
-                    fprintf(out, " })");
+                    ob_puts(out, " })");
                 }
                 else
                 {
                     codegen_node_single(ctx, body, out);
                 }
             }
-            fprintf(out, ";");
+            ob_putc(out, ';');
         }
         else
         {
             if (is_string_literal)
             {
-                fprintf(out, "({ printf(\"%%s\", ");
+                ob_puts(out, "({ printf(\"%s\", ");
                 codegen_expression(ctx, body, out);
-                fprintf(out, "); printf(\"\\n\"); 0; })");
+                ob_puts(out, "); printf(\"\\n\"); 0; })");
             }
             else
             {
@@ -272,22 +273,22 @@ static void codegen_match_internal(ParserContext *ctx, ASTNode *node, FILE *out,
             }
         }
 
-        fprintf(out, " }");
+        ob_puts(out, " }");
         first = 0;
         c = c->next;
     }
 
     if (is_expr)
     {
-        fprintf(out, " _r_%d; })", id);
+        ob_printf(out, " _r_%d; })", id);
     }
     else
     {
-        fprintf(out, " })");
+        ob_puts(out, " })");
     }
 }
 
-void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
+void codegen_expression(ParserContext *ctx, ASTNode *node, OutBuf *out)
 {
     if (!node)
     {
@@ -301,25 +302,25 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
     case NODE_EXPR_BINARY:
         if (strncmp(node->binary.op, "??", 2) == 0 && strlen(node->binary.op) == 2)
         {
-            fprintf(out, "({ ");
+            ob_puts(out, "({ ");
             emit_auto_type(ctx, node->binary.left, node->token, out);
-            fprintf(out, " _l = (");
+            ob_puts(out, " _l = (");
             codegen_expression(ctx, node->binary.left, out);
-            fprintf(out, "); _l ? _l : (");
+            ob_puts(out, "); _l ? _l : (");
             codegen_expression(ctx, node->binary.right, out);
-            fprintf(out, "); })");
+            ob_puts(out, "); })");
         }
         else if (strcmp(node->binary.op, "?\?=") == 0)
         {
-            fprintf(out, "({ if (!(");
+            ob_puts(out, "({ if (!(");
             codegen_expression(ctx, node->binary.left, out);
-            fprintf(out, ")) ");
+            ob_puts(out, ")) ");
             codegen_expression(ctx, node->binary.left, out);
-            fprintf(out, " = (");
+            ob_puts(out, " = (");
             codegen_expression(ctx, node->binary.right, out);
-            fprintf(out, "); ");
+            ob_puts(out, "); ");
             codegen_expression(ctx, node->binary.left, out);
-            fprintf(out, "; })");
+            ob_puts(out, "; })");
         }
         else if ((strcmp(node->binary.op, "==") == 0 || strcmp(node->binary.op, "!=") == 0))
         {
@@ -382,34 +383,34 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
 
                 if (strcmp(node->binary.op, "!=") == 0)
                 {
-                    fprintf(out, "(!");
+                    ob_puts(out, "(!");
                 }
-                fprintf(out, "%s_eq(&", base);
+                ob_printf(out, "%s_eq(&", base);
                 codegen_expression(ctx, node->binary.left, out);
-                fprintf(out, ", ");
+                ob_puts(out, ", ");
                 codegen_expression(ctx, node->binary.right, out);
-                fprintf(out, ")");
+                ob_putc(out, ')');
                 if (strcmp(node->binary.op, "!=") == 0)
                 {
-                    fprintf(out, ")");
+                    ob_putc(out, ')');
                 }
             }
             else
             {
-                fprintf(out, "(");
+                ob_putc(out, '(');
                 codegen_expression(ctx, node->binary.left, out);
-                fprintf(out, " %s ", node->binary.op);
+                ob_printf(out, " %s ", node->binary.op);
                 codegen_expression(ctx, node->binary.right, out);
-                fprintf(out, ")");
+                ob_putc(out, ')');
             }
         }
         else
         {
-            fprintf(out, "(");
+            ob_putc(out, '(');
             codegen_expression(ctx, node->binary.left, out);
-            fprintf(out, " %s ", node->binary.op);
+            ob_printf(out, " %s ", node->binary.op);
             codegen_expression(ctx, node->binary.right, out);
-            fprintf(out, ")");
+            ob_putc(out, ')');
         }
         break;
     case NODE_EXPR_VAR:
@@ -419,7 +420,7 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             {
                 if (strcmp(node->var_ref.name, g_current_lambda->lambda.captured_vars[i]) == 0)
                 {
-                    fprintf(out, "ctx->%s", node->var_ref.name);
+                    ob_printf(out, "ctx->%s", node->var_ref.name);
                     return;
                 }
             }
@@ -437,18 +438,18 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 zwarn_at(node->token, "%s\n   = help: %s", msg, help);
             }
         }
-        fprintf(out, "%s", node->var_ref.name);
+        ob_puts(out, node->var_ref.name);
         break;
     case NODE_LAMBDA:
         if (node->lambda.num_captures > 0)
         {
-            fprintf(out,
-                    "({ struct Lambda_%d_Ctx *ctx = malloc(sizeof(struct "
-                    "Lambda_%d_Ctx));\n",
-                    node->lambda.lambda_id, node->lambda.lambda_id);
+            ob_printf(out,
+                      "({ struct Lambda_%d_Ctx *ctx = malloc(sizeof(struct "
+                      "Lambda_%d_Ctx));\n",
+                      node->lambda.lambda_id, node->lambda.lambda_id);
             for (int i = 0; i < node->lambda.num_captures; i++)
             {
-                fprintf(out, "ctx->%s = ", node->lambda.captured_vars[i]);
+                ob_printf(out, "ctx->%s = ", node->lambda.captured_vars[i]);
                 int found = 0;
                 if (g_current_lambda)
                 {
@@ -457,7 +458,7 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                         if (strcmp(node->lambda.captured_vars[i],
                                    g_current_lambda->lambda.captured_vars[k]) == 0)
                         {
-                            fprintf(out, "ctx->%s", node->lambda.captured_vars[i]);
+                            ob_printf(out, "ctx->%s", node->lambda.captured_vars[i]);
                             found = 1;
                             break;
                         }
@@ -465,36 +466,36 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 }
                 if (!found)
                 {
-                    fprintf(out, "%s", node->lambda.captured_vars[i]);
+                    ob_puts(out, node->lambda.captured_vars[i]);
                 }
-                fprintf(out, ";\n");
+                ob_puts(out, ";\n");
             }
-            fprintf(out, "(z_closure_T){.func = _lambda_%d, .ctx = ctx}; })",
-                    node->lambda.lambda_id);
+            ob_printf(out, "(z_closure_T){.func = _lambda_%d, .ctx = ctx}; })",
+                      node->lambda.lambda_id);
         }
         else
         {
-            fprintf(out, "((z_closure_T){.func = (void*)_lambda_%d, .ctx = NULL})",
-                    node->lambda.lambda_id);
+            ob_printf(out, "((z_closure_T){.func = (void*)_lambda_%d, .ctx = NULL})",
+                      node->lambda.lambda_id);
         }
         break;
     case NODE_EXPR_LITERAL:
         if (node->literal.type_kind == TOK_STRING)
         {
-            fprintf(out, "\"%s\"", node->literal.string_val);
+            ob_printf(out, "\"%s\"", node->literal.string_val);
         }
         else if (node->literal.type_kind == TOK_CHAR)
         {
-            fprintf(out, "%s", node->literal.string_val);
+            ob_puts(out, node->literal.string_val);
         }
         else if (node->literal.type_kind == 1)
         {
-            fprintf(out, "%f", node->literal.float_val);
+            ob_printf(out, "%f", node->literal.float_val);
         }
 
         else
         {
-            fprintf(out, "%lluULL", (unsigned long long)node->literal.int_val);
+            ob_printf(out, "%lluULL", (unsigned long long)node->literal.int_val);
         }
         break;
     case NODE_EXPR_CALL:
@@ -510,12 +511,12 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 {
                     if (target->type_info->array_size > 0)
                     {
-                        fprintf(out, "%d", target->type_info->array_size);
+                        ob_int(out, target->type_info->array_size);
                     }
                     else
                     {
                         codegen_expression(ctx, target, out);
-                        fprintf(out, ".len");
+                        ob_puts(out, ".len");
                     }
                     return;
                 }
@@ -539,34 +540,34 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
 
                 if (!strchr(type, '*') && target->type == NODE_EXPR_CALL)
                 {
-                    fprintf(out, "({ %s _t = ", type);
+                    ob_printf(out, "({ %s _t = ", type);
                     codegen_expression(ctx, target, out);
-                    fprintf(out, "; %s_%s(&_t", base, method);
+                    ob_printf(out, "; %s_%s(&_t", base, method);
                     ASTNode *arg = node->call.args;
                     while (arg)
                     {
-                        fprintf(out, ", ");
+                        ob_puts(out, ", ");
                         codegen_expression(ctx, arg, out);
                         arg = arg->next;
                     }
-                    fprintf(out, "); })");
+                    ob_puts(out, "); })");
                 }
                 else
                 {
-                    fprintf(out, "%s_%s(", base, method);
+                    ob_printf(out, "%s_%s(", base, method);
                     if (!strchr(type, '*'))
                     {
-                        fprintf(out, "&");
+                        ob_putc(out, '&');
                     }
                     codegen_expression(ctx, target, out);
                     ASTNode *arg = node->call.args;
                     while (arg)
                     {
-                        fprintf(out, ", ");
+                        ob_puts(out, ", ");
                         codegen_expression(ctx, arg, out);
                         arg = arg->next;
                     }
-                    fprintf(out, ")");
+                    ob_putc(out, ')');
                 }
                 free(clean);
                 return;
@@ -577,16 +578,16 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             ASTNode *def = find_struct_def(ctx, node->call.callee->var_ref.name);
             if (def && def->type == NODE_STRUCT)
             {
-                fprintf(out, "(struct %s){0}", node->call.callee->var_ref.name);
+                ob_printf(out, "(struct %s){0}", node->call.callee->var_ref.name);
                 return;
             }
         }
 
         if (node->call.callee->type_info && node->call.callee->type_info->kind == TYPE_FUNCTION)
         {
-            fprintf(out, "({ z_closure_T _c = ");
+            ob_puts(out, "({ z_closure_T _c = ");
             codegen_expression(ctx, node->call.callee, out);
-            fprintf(out, "; ");
+            ob_puts(out, "; ");
 
             Type *ft = node->call.callee->type_info;
             char *ret = type_to_string(ft->inner);
@@ -596,33 +597,33 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 ret = xstrdup("char*");
             }
 
-            fprintf(out, "((%s (*)(void*", ret);
+            ob_printf(out, "((%s (*)(void*", ret);
             for (int i = 0; i < ft->arg_count; i++)
             {
                 char *as = type_to_string(ft->args[i]);
-                fprintf(out, ", %s", as);
+                ob_printf(out, ", %s", as);
                 free(as);
             }
             if (ft->is_varargs)
             {
-                fprintf(out, ", ...");
+                ob_puts(out, ", ...");
             }
-            fprintf(out, "))_c.func)(_c.ctx");
+            ob_puts(out, "))_c.func)(_c.ctx");
 
             ASTNode *arg = node->call.args;
             while (arg)
             {
-                fprintf(out, ", ");
+                ob_puts(out, ", ");
                 codegen_expression(ctx, arg, out);
                 arg = arg->next;
             }
-            fprintf(out, "); })");
+            ob_puts(out, "); })");
             free(ret);
             break;
         }
 
         codegen_expression(ctx, node->call.callee, out);
-        fprintf(out, "(");
+        ob_putc(out, '(');
 
         if (node->call.arg_names && node->call.callee->type == NODE_EXPR_VAR)
         {
@@ -652,7 +653,7 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             {
                 if (!first)
                 {
-                    fprintf(out, ", ");
+                    ob_puts(out, ", ");
                 }
                 first = 0;
                 codegen_expression(ctx, arg, out);
@@ -667,12 +668,12 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 codegen_expression(ctx, arg, out);
                 if (arg->next)
                 {
-                    fprintf(out, ", ");
+                    ob_puts(out, ", ");
                 }
                 arg = arg->next;
             }
         }
-        fprintf(out, ")");
+        ob_putc(out, ')');
         break;
     }
     case NODE_EXPR_MEMBER:
@@ -684,7 +685,7 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
                 {
                     if (node->member.target->type_info->array_size > 0)
                     {
-                        fprintf(out, "%d", node->member.target->type_info->array_size);
+                        ob_int(out, node->member.target->type_info->array_size);
                         break;
                     }
                 }
@@ -693,16 +694,16 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
 
         if (node->member.is_pointer_access == 2)
         {
-            fprintf(out, "({ ");
+            ob_puts(out, "({ ");
             emit_auto_type(ctx, node->member.target, node->token, out);
-            fprintf(out, " _t = (");
+            ob_puts(out, " _t = (");
             codegen_expression(ctx, node->member.target, out);
-            fprintf(out, "); _t ? _t->%s : 0; })", node->member.field);
+            ob_printf(out, "); _t ? _t->%s : 0; })", node->member.field);
         }
         else
         {
             codegen_expression(ctx, node->member.target, out);
-            fprintf(out, "%s%s", node->member.is_pointer_access ? "->" : ".", node->member.field);
+            ob_printf(out, "%s%s", node->member.is_pointer_access ? "->" : ".", node->member.field);
         }
         break;
     case NODE_EXPR_INDEX:
@@ -729,18 +730,18 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             if (node->index.array->type == NODE_EXPR_VAR)
             {
                 codegen_expression(ctx, node->index.array, out);
-                fprintf(out, ".data[_z_check_bounds(");
+                ob_puts(out, ".data[_z_check_bounds(");
                 codegen_expression(ctx, node->index.index, out);
-                fprintf(out, ", ");
+                ob_puts(out, ", ");
                 codegen_expression(ctx, node->index.array, out);
-                fprintf(out, ".len)]");
+                ob_puts(out, ".len)]");
             }
             else
             {
                 codegen_expression(ctx, node->index.array, out);
-                fprintf(out, ".data[");
+                ob_puts(out, ".data[");
                 codegen_expression(ctx, node->index.index, out);
-                fprintf(out, "]");
+                ob_putc(out, ']');
             }
         }
         else
@@ -752,17 +753,17 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             }
 
             codegen_expression(ctx, node->index.array, out);
-            fprintf(out, "[");
+            ob_putc(out, '[');
             if (fixed_size > 0)
             {
-                fprintf(out, "_z_check_bounds(");
+                ob_puts(out, "_z_check_bounds(");
             }
             codegen_expression(ctx, node->index.index, out);
             if (fixed_size > 0)
             {
-                fprintf(out, ", %d)", fixed_size);
+                ob_printf(out, ", %d)", fixed_size);
             }
-            fprintf(out, "]");
+            ob_putc(out, ']');
         }
     }
     break;
@@ -788,67 +789,67 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             tname = type_to_string(node->type_info->inner);
         }
 
-        fprintf(out, "({ ");
+        ob_puts(out, "({ ");
         emit_auto_type(ctx, node->slice.array, node->token, out);
-        fprintf(out, " _arr = ");
+        ob_puts(out, " _arr = ");
         codegen_expression(ctx, node->slice.array, out);
-        fprintf(out, "; int _start = ");
+        ob_puts(out, "; int _start = ");
         if (node->slice.start)
         {
             codegen_expression(ctx, node->slice.start, out);
         }
         else
         {
-            fprintf(out, "0");
+            ob_putc(out, '0');
         }
-        fprintf(out, "; int _len = ");
+        ob_puts(out, "; int _len = ");
 
         if (node->slice.end)
         {
             codegen_expression(ctx, node->slice.end, out);
-            fprintf(out, " - _start; ");
+            ob_puts(out, " - _start; ");
         }
         else
         {
             if (known_size > 0)
             {
-                fprintf(out, "%d - _start; ", known_size);
+                ob_printf(out, "%d - _start; ", known_size);
             }
             else if (is_slice_struct)
             {
-                fprintf(out, "_arr.len - _start; ");
+                ob_puts(out, "_arr.len - _start; ");
             }
             else
             {
-                fprintf(out, "/* UNSAFE: Full Slice on unknown size */ 0; ");
+                ob_puts(out, "/* UNSAFE: Full Slice on unknown size */ 0; ");
             }
         }
 
         if (is_slice_struct)
         {
-            fprintf(out,
-                    "(Slice_%s){ .data = _arr.data + _start, .len = _len, .cap = "
-                    "_len }; })",
-                    tname);
+            ob_printf(out,
+                      "(Slice_%s){ .data = _arr.data + _start, .len = _len, .cap = "
+                      "_len }; })",
+                      tname);
         }
         else
         {
-            fprintf(out, "(Slice_%s){ .data = _arr + _start, .len = _len, .cap = _len }; })",
-                    tname);
+            ob_printf(out, "(Slice_%s){ .data = _arr + _start, .len = _len, .cap = _len }; })",
+                      tname);
         }
         break;
     }
     case NODE_BLOCK:
     {
         int saved = defer_count;
-        fprintf(out, "({ ");
+        ob_puts(out, "({ ");
         codegen_walker(ctx, node->block.statements, out);
         for (int i = defer_count - 1; i >= saved; i--)
         {
             codegen_node_single(ctx, defer_stack[i], out);
         }
         defer_count = saved;
-        fprintf(out, " })");
+        ob_puts(out, " })");
         break;
     }
     case NODE_TRY:
@@ -900,29 +901,29 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             }
         }
 
-        fprintf(out, "({ ");
+        ob_puts(out, "({ ");
         emit_auto_type(ctx, node->try_stmt.expr, node->token, out);
-        fprintf(out, " _try = ");
+        ob_puts(out, " _try = ");
         codegen_expression(ctx, node->try_stmt.expr, out);
 
         if (is_enum)
         {
-            fprintf(out,
-                    "; if (_try.tag == %s_Err_Tag) return (%s_Err(_try.data.Err)); "
-                    "_try.data.Ok; })",
-                    search_name, search_name);
+            ob_printf(out,
+                      "; if (_try.tag == %s_Err_Tag) return (%s_Err(_try.data.Err)); "
+                      "_try.data.Ok; })",
+                      search_name, search_name);
         }
         else
         {
-            fprintf(out,
-                    "; if (!_try.is_ok) return %s_Err(_try.err); "
-                    "_try.val; })",
-                    search_name);
+            ob_printf(out,
+                      "; if (!_try.is_ok) return %s_Err(_try.err); "
+                      "_try.val; })",
+                      search_name);
         }
         break;
     }
     case NODE_RAW_STMT:
-        fprintf(out, "%s", node->raw_stmt.content);
+        ob_printf(out, "%s", node->raw_stmt.content);
         break;
     case NODE_PLUGIN:
     {
@@ -931,81 +932,87 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
 
         if (found)
         {
+            // Plugins write through stdio; capture and splice into the buffer.
+            ObStream inline_out;
             ZApi api = {.filename = g_current_filename ? g_current_filename : "input.zc",
                         .current_line = node->line,
-                        .out = out,
+                        .out = ob_stream_begin(&inline_out),
                         .hoist_out = ctx->hoist_out};
+            // Plugins keep static state and share hoist_out: one at a time.
+            arena_global_lock();
             found->fn(node->plugin_stmt.body, &api);
+            arena_global_unlock();
+            ob_stream_end(out, &inline_out);
         }
         else
         {
-            fprintf(out, "/* Unknown plugin: %s */\n", node->plugin_stmt.plugin_name);
+            ob_printf(out, "/* Unknown plugin: %s */\n", node->plugin_stmt.plugin_name);
         }
         break;
     }
     case NODE_EXPR_UNARY:
         if (node->unary.op && strcmp(node->unary.op, "&_rval") == 0)
         {
-            fprintf(out, "({ ");
+            ob_puts(out, "({ ");
             emit_auto_type(ctx, node->unary.operand, node->token, out);
-            fprintf(out, " _t = (");
+            ob_puts(out, " _t = (");
             codegen_expression(ctx, node->unary.operand, out);
-            fprintf(out, "); &_t; })");
+            ob_puts(out, "); &_t; })");
         }
         else if (node->unary.op && strcmp(node->unary.op, "?") == 0)
         {
-            fprintf(out, "({ ");
+            ob_puts(out, "({ ");
             emit_auto_type(ctx, node->unary.operand, node->token, out);
-            fprintf(out, " _t = (");
+            ob_puts(out, " _t = (");
             codegen_expression(ctx, node->unary.operand, out);
-            fprintf(out, "); if (_t.tag != 0) return _t; _t.data.Ok; })");
+            ob_puts(out, "); if (_t.tag != 0) return _t; _t.data.Ok; })");
         }
         else if (node->unary.op && strcmp(node->unary.op, "_post++") == 0)
         {
-            fprintf(out, "(");
+            ob_putc(out, '(');
             codegen_expression(ctx, node->unary.operand, out);
-            fprintf(out, "++)");
+            ob_puts(out, "++)");
         }
         else if (node->unary.op && strcmp(node->unary.op, "_post--") == 0)
         {
-            fprintf(out, "(");
+            ob_putc(out, '(');
             codegen_expression(ctx, node->unary.operand, out);
-            fprintf(out, "--)");
+            ob_puts(out, "--)");
         }
         else
         {
-            fprintf(out, "(%s", node->unary.op);
+            ob_printf(out, "(%s", node->unary.op);
             codegen_expression(ctx, node->unary.operand, out);
-            fprintf(out, ")");
+            ob_putc(out, ')');
         }
         break;
     case NODE_EXPR_CAST:
-        fprintf(out, "(%s)(", node->cast.target_type);
+        ob_printf(out, "(%s)(", node->cast.target_type);
         codegen_expression(ctx, node->cast.expr, out);
-        fprintf(out, ")");
+        ob_putc(out, ')');
         break;
     case NODE_EXPR_SIZEOF:
         if (node->size_of.target_type)
         {
-            fprintf(out, "sizeof(%s)", node->size_of.target_type);
+            ob_printf(out, "sizeof(%s)", node->size_of.target_type);
         }
         else
         {
-            fprintf(out, "sizeof(");
+            ob_puts(out, "sizeof(");
             codegen_expression(ctx, node->size_of.expr, out);
-            fprintf(out, ")");
+            ob_putc(out, ')');
         }
         break;
     case NODE_TYPEOF:
         if (node->size_of.target_type)
         {
-            fprintf(out, "typeof(%s)", node->size_of.target_type);
+            ob_printf(out, "typeof(%s)", node->size_of.target_type);
         }
         else
         {
-            fprintf(out, "typeof(");
+            ob_puts(out, "typeof(");
             codegen_expression(ctx, node->size_of.expr, out);
-            fprintf(out, ")");
+            ob_putc(out, ')');
         }
         break;
 
@@ -1015,14 +1022,14 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
         if (node->reflection.kind == 0)
         { // @type_name
             char *s = type_to_string(t);
-            fprintf(out, "\"%s\"", s);
+            ob_printf(out, "\"%s\"", s);
             free(s);
         }
         else
         { // @fields
             if (t->kind != TYPE_STRUCT || !t->name)
             {
-                fprintf(out, "((void*)0)");
+                ob_puts(out, "((void*)0)");
                 break;
             }
             char *sname = t->name;
@@ -1030,25 +1037,25 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             ASTNode *def = find_struct_def(ctx, sname);
             if (!def)
             {
-                fprintf(out, "((void*)0)");
+                ob_puts(out, "((void*)0)");
                 break;
             }
 
-            fprintf(out,
-                    "({ static struct { char *name; char *type; unsigned long offset; } "
-                    "_fields_%s[] = {",
-                    sname);
+            ob_printf(out,
+                      "({ static struct { char *name; char *type; unsigned long offset; } "
+                      "_fields_%s[] = {",
+                      sname);
             ASTNode *f = def->strct.fields;
             while (f)
             {
                 if (f->type == NODE_FIELD)
                 {
-                    fprintf(out, "{ \"%s\", \"%s\", __builtin_offsetof(struct %s, %s) }, ",
-                            f->field.name, f->field.type, sname, f->field.name);
+                    ob_printf(out, "{ \"%s\", \"%s\", __builtin_offsetof(struct %s, %s) }, ",
+                              f->field.name, f->field.type, sname, f->field.name);
                 }
                 f = f->next;
             }
-            fprintf(out, "{ 0 } }; (void*)_fields_%s; })", sname);
+            ob_printf(out, "{ 0 } }; (void*)_fields_%s; })", sname);
         }
         break;
     }
@@ -1059,45 +1066,45 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
         {
             struct_name = g_current_impl_type;
         }
-        fprintf(out, "(struct %s){", struct_name);
+        ob_printf(out, "(struct %s){", struct_name);
         ASTNode *f = node->struct_init.fields;
         while (f)
         {
-            fprintf(out, ".%s = ", f->var_decl.name);
+            ob_printf(out, ".%s = ", f->var_decl.name);
             codegen_expression(ctx, f->var_decl.init_expr, out);
             if (f->next)
             {
-                fprintf(out, ", ");
+                ob_puts(out, ", ");
             }
             f = f->next;
         }
-        fprintf(out, "}");
+        ob_putc(out, '}');
         break;
     }
     case NODE_EXPR_ARRAY_LITERAL:
-        fprintf(out, "{");
+        ob_putc(out, '{');
         ASTNode *elem = node->array_literal.elements;
         int first = 1;
         while (elem)
         {
             if (!first)
             {
-                fprintf(out, ", ");
+                ob_puts(out, ", ");
             }
             codegen_expression(ctx, elem, out);
             elem = elem->next;
             first = 0;
         }
-        fprintf(out, "}");
+        ob_putc(out, '}');
         break;
     case NODE_TERNARY:
-        fprintf(out, "((");
+        ob_puts(out, "((");
         codegen_expression(ctx, node->ternary.cond, out);
-        fprintf(out, ") ? (");
+        ob_puts(out, ") ? (");
         codegen_expression(ctx, node->ternary.true_expr, out);
-        fprintf(out, ") : (");
+        ob_puts(out, ") : (");
         codegen_expression(ctx, node->ternary.false_expr, out);
-        fprintf(out, "))");
+        ob_puts(out, "))");
         break;
     case NODE_AWAIT:
     {
@@ -1154,28 +1161,28 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
             }
         }
 
-        fprintf(out, "({ Async _a = ");
+        ob_puts(out, "({ Async _a = ");
         codegen_expression(ctx, node->unary.operand, out);
-        fprintf(out, "; void* _r; pthread_join(_a.thread, &_r); ");
+        ob_puts(out, "; void* _r; pthread_join(_a.thread, &_r); ");
         if (strcmp(ret_type, "void") == 0)
         {
-            fprintf(out, "})");
+            ob_puts(out, "})");
         }
         else
         {
             if (returns_struct)
             {
-                fprintf(out, "%s _val = *(%s*)_r; free(_r); _val; })", ret_type, ret_type);
+                ob_printf(out, "%s _val = *(%s*)_r; free(_r); _val; })", ret_type, ret_type);
             }
             else
             {
                 if (needs_long_cast)
                 {
-                    fprintf(out, "(%s)(long)_r; })", ret_type);
+                    ob_printf(out, "(%s)(long)_r; })", ret_type);
                 }
                 else
                 {
-                    fprintf(out, "(%s)_r; })", ret_type);
+                    ob_printf(out, "(%s)_r; })", ret_type);
                 }
             }
         }
@@ -1190,7 +1197,7 @@ void codegen_expression(ParserContext *ctx, ASTNode *node, FILE *out)
     }
 }
 
-void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
+void codegen_node_single(ParserContext *ctx, ASTNode *node, OutBuf *out)
 {
     if (!node)
     {
@@ -1200,19 +1207,20 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
     {
     case NODE_MATCH:
         codegen_match_internal(ctx, node, out, 0); // 0 = statement context
-        fprintf(out, ";\n");
+        ob_puts(out, ";\n");
         break;
     case NODE_FUNCTION:
-        if (!node->func.body)
+        if (!node->func.body || node->func.is_unreachable)
         {
             break;
         }
 
         if (node->func.is_async)
         {
-            fprintf(out, "struct %s_Args {\n", node->func.name);
+            ob_printf(out, "struct %s_Args {\n", node->func.name);
             char *args_copy = xstrdup(node->func.args);
-            char *token = strtok(args_copy, ",");
+            char *save = NULL;
+            char *token = strtok_r(args_copy, ",", &save);
             int arg_count = 0;
             char **arg_names = xmalloc(32 * sizeof(char *));
 
@@ -1228,19 +1236,19 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                     *last_space = 0;
                     char *type = token;
                     char *name = last_space + 1;
-                    fprintf(out, "%s %s;\n", type, name);
+                    ob_printf(out, "%s %s;\n", type, name);
 
                     arg_names[arg_count++] = xstrdup(name);
                 }
-                token = strtok(NULL, ",");
+                token = strtok_r(NULL, ",", &save);
             }
             free(args_copy);
-            fprintf(out, "};\n");
+            ob_puts(out, "};\n");
 
-            fprintf(out, "void* _runner_%s(void* _args)\n", node->func.name);
-            fprintf(out, "{\n");
-            fprintf(out, "    struct %s_Args* args = (struct %s_Args*)_args;\n", node->func.name,
-                    node->func.name);
+            ob_printf(out, "void* _runner_%s(void* _args)\n", node->func.name);
+            ob_puts(out, "{\n");
+            ob_printf(out, "    struct %s_Args* args = (struct %s_Args*)_args;\n", node->func.name,
+                      node->func.name);
 
             // Determine mechanism: struct/large-type? -> malloc; primitive -> cast
             int returns_struct = 0;
@@ -1261,71 +1269,71 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
             // Call Impl
             if (returns_struct)
             {
-                fprintf(out, "    %s *res_ptr = malloc(sizeof(%s));\n", rt, rt);
-                fprintf(out, "    *res_ptr = ");
+                ob_printf(out, "    %s *res_ptr = malloc(sizeof(%s));\n", rt, rt);
+                ob_puts(out, "    *res_ptr = ");
             }
             else if (strcmp(rt, "void") != 0 && strcmp(rt, "Async") != 0)
             {
-                fprintf(out, "    %s res = ", rt);
+                ob_printf(out, "    %s res = ", rt);
             }
             else
             {
-                fprintf(out, "    ");
+                ob_indent(out, 1);
             }
 
-            fprintf(out, "_impl_%s(", node->func.name);
+            ob_printf(out, "_impl_%s(", node->func.name);
             for (int i = 0; i < arg_count; i++)
             {
-                fprintf(out, "%sargs->%s", i > 0 ? ", " : "", arg_names[i]);
+                ob_printf(out, "%sargs->%s", i > 0 ? ", " : "", arg_names[i]);
             }
-            fprintf(out, ");\n");
-            fprintf(out, "    free(args);\n");
+            ob_puts(out, ");\n");
+            ob_puts(out, "    free(args);\n");
 
             if (returns_struct)
             {
-                fprintf(out, "    return (void*)res_ptr;\n");
+                ob_puts(out, "    return (void*)res_ptr;\n");
             }
             else if (strcmp(rt, "void") != 0)
             {
-                fprintf(out, "    return (void*)(long)res;\n");
+                ob_puts(out, "    return (void*)(long)res;\n");
             }
             else
             {
-                fprintf(out, "    return NULL;\n");
+                ob_puts(out, "    return NULL;\n");
             }
-            fprintf(out, "}\n");
+            ob_puts(out, "}\n");
 
-            fprintf(out, "%s _impl_%s(%s)\n", node->func.ret_type, node->func.name,
-                    node->func.args);
-            fprintf(out, "{\n");
+            ob_printf(out, "%s _impl_%s(%s)\n", node->func.ret_type, node->func.name,
+                      node->func.args);
+            ob_puts(out, "{\n");
             defer_count = 0;
             codegen_walker(ctx, node->func.body, out);
             for (int i = defer_count - 1; i >= 0; i--)
             {
                 codegen_node_single(ctx, defer_stack[i], out);
             }
-            fprintf(out, "}\n");
+            ob_puts(out, "}\n");
 
             // 4. Define Public Wrapper (Spawns Thread)
-            fprintf(out, "Async %s(%s)\n", node->func.name, node->func.args);
-            fprintf(out, "{\n");
-            fprintf(out, "    struct %s_Args* args = malloc(sizeof(struct %s_Args));\n",
-                    node->func.name, node->func.name);
+            ob_printf(out, "Async %s(%s)\n", node->func.name, node->func.args);
+            ob_puts(out, "{\n");
+            ob_printf(out, "    struct %s_Args* args = malloc(sizeof(struct %s_Args));\n",
+                      node->func.name, node->func.name);
             for (int i = 0; i < arg_count; i++)
             {
-                fprintf(out, "    args->%s = %s;\n", arg_names[i], arg_names[i]);
+                ob_printf(out, "    args->%s = %s;\n", arg_names[i], arg_names[i]);
             }
 
-            fprintf(out, "    pthread_t th;\n");
-            fprintf(out, "    pthread_create(&th, NULL, _runner_%s, args);\n", node->func.name);
-            fprintf(out, "    return (Async){.thread=th, .result=NULL};\n");
-            fprintf(out, "}\n");
+            ob_puts(out, "    pthread_t th;\n");
+            ob_printf(out, "    pthread_create(&th, NULL, _runner_%s, args);\n", node->func.name);
+            ob_puts(out, "    return (Async){.thread=th, .result=NULL};\n");
+            ob_puts(out, "}\n");
 
             break;
         }
 
         defer_count = 0;
-        fprintf(out, "\n");
+        ob_putc(out, '\n');
 
         // Emit GCC attributes before function
         {
@@ -1335,14 +1343,14 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                             node->func.pure || node->func.section;
             if (has_attrs)
             {
-                fprintf(out, "__attribute__((");
+                ob_puts(out, "__attribute__((");
                 int first = 1;
 #define EMIT_ATTR(cond, name)                                                                      \
     if (cond)                                                                                      \
     {                                                                                              \
         if (!first)                                                                                \
-            fprintf(out, ", ");                                                                    \
-        fprintf(out, name);                                                                        \
+            ob_puts(out, ", ");                                                                  \
+        ob_printf(out, name);                                                                      \
         first = 0;                                                                                 \
     }
                 EMIT_ATTR(node->func.constructor, "constructor");
@@ -1358,21 +1366,25 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                 {
                     if (!first)
                     {
-                        fprintf(out, ", ");
+                        ob_puts(out, ", ");
                     }
-                    fprintf(out, "section(\"%s\")", node->func.section);
+                    ob_printf(out, "section(\"%s\")", node->func.section);
                 }
 #undef EMIT_ATTR
-                fprintf(out, ")) ");
+                ob_puts(out, ")) ");
             }
         }
 
+        if (node->func.is_static)
+        {
+            ob_puts(out, "static ");
+        }
         if (node->func.is_inline)
         {
-            fprintf(out, "inline ");
+            ob_puts(out, "inline ");
         }
-        fprintf(out, "%s %s(%s)\n", node->func.ret_type, node->func.name, node->func.args);
-        fprintf(out, "{\n");
+        ob_printf(out, "%s %s(%s)\n", node->func.ret_type, node->func.name, node->func.args);
+        ob_puts(out, "{\n");
         char *prev_ret = g_current_func_ret_type;
         g_current_func_ret_type = node->func.ret_type;
         codegen_walker(ctx, node->func.body, out);
@@ -1381,7 +1393,7 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
             codegen_node_single(ctx, defer_stack[i], out);
         }
         g_current_func_ret_type = prev_ret;
-        fprintf(out, "}\n");
+        ob_puts(out, "}\n");
         break;
 
     case NODE_DEFER:
@@ -1402,21 +1414,21 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
         if (strcmp(node->impl_trait.trait_name, "Drop") == 0)
         {
             char *tname = node->impl_trait.target_type;
-            fprintf(out, "\n// RAII Glue\n");
-            fprintf(out, "void %s_Drop_glue(%s *self) {\n", tname, tname);
-            fprintf(out, "    %s_Drop_drop(self);\n", tname);
-            fprintf(out, "}\n");
+            ob_puts(out, "\n// RAII Glue\n");
+            ob_printf(out, "void %s_Drop_glue(%s *self) {\n", tname, tname);
+            ob_printf(out, "    %s_Drop_drop(self);\n", tname);
+            ob_puts(out, "}\n");
         }
         g_current_impl_type = NULL;
         break;
     case NODE_DESTRUCT_VAR:
     {
         int id = tmp_counter++;
-        fprintf(out, "    ");
+        ob_indent(out, 1);
         emit_auto_type(ctx, node->destruct.init_expr, node->token, out);
-        fprintf(out, " _tmp_%d = ", id);
+        ob_printf(out, " _tmp_%d = ", id);
         codegen_expression(ctx, node->destruct.init_expr, out);
-        fprintf(out, ";\n");
+        ob_puts(out, ";\n");
 
         if (node->destruct.is_guard)
         {
@@ -1426,37 +1438,37 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
 
             if (strcmp(variant, "Some") == 0)
             {
-                fprintf(out, "    if (!_tmp_%d.is_some) {\n", id);
+                ob_printf(out, "    if (!_tmp_%d.is_some) {\n", id);
             }
             else if (strcmp(variant, "Ok") == 0)
             {
-                fprintf(out, "    if (!_tmp_%d.is_ok) {\n", id);
+                ob_printf(out, "    if (!_tmp_%d.is_ok) {\n", id);
             }
             else if (strcmp(variant, "Err") == 0)
             {
-                fprintf(out, "    if (_tmp_%d.is_ok) {\n", id); // Err if NOT ok
+                ob_printf(out, "    if (_tmp_%d.is_ok) {\n", id); // Err if NOT ok
                 check = "err";
             }
             else
             {
                 // Generic guard? Assume .is_variant present?
-                fprintf(out, "    if (!_tmp_%d.is_%s) {\n", id, variant);
+                ob_printf(out, "    if (!_tmp_%d.is_%s) {\n", id, variant);
             }
 
             // Else block
             codegen_walker(ctx, node->destruct.else_block->block.statements, out);
-            fprintf(out, "    }\n");
+            ob_puts(out, "    }\n");
 
             // Bind value
             if (strstr(g_config.cc, "tcc"))
             {
-                fprintf(out, "    __typeof__(_tmp_%d.%s) %s = _tmp_%d.%s;\n", id, check,
-                        node->destruct.names[0], id, check);
+                ob_printf(out, "    __typeof__(_tmp_%d.%s) %s = _tmp_%d.%s;\n", id, check,
+                          node->destruct.names[0], id, check);
             }
             else
             {
-                fprintf(out, "    __auto_type %s = _tmp_%d.%s;\n", node->destruct.names[0], id,
-                        check);
+                ob_printf(out, "    __auto_type %s = _tmp_%d.%s;\n", node->destruct.names[0], id,
+                          check);
             }
         }
         else
@@ -1469,26 +1481,26 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                                                              : node->destruct.names[i];
                     if (strstr(g_config.cc, "tcc"))
                     {
-                        fprintf(out, "    __typeof__(_tmp_%d.%s) %s = _tmp_%d.%s;\n", id, field,
-                                node->destruct.names[i], id, field);
+                        ob_printf(out, "    __typeof__(_tmp_%d.%s) %s = _tmp_%d.%s;\n", id, field,
+                                  node->destruct.names[i], id, field);
                     }
                     else
                     {
-                        fprintf(out, "    __auto_type %s = _tmp_%d.%s;\n", node->destruct.names[i],
-                                id, field);
+                        ob_printf(out, "    __auto_type %s = _tmp_%d.%s;\n",
+                                  node->destruct.names[i], id, field);
                     }
                 }
                 else
                 {
                     if (strstr(g_config.cc, "tcc"))
                     {
-                        fprintf(out, "    __typeof__(_tmp_%d.v%d) %s = _tmp_%d.v%d;\n", id, i,
-                                node->destruct.names[i], id, i);
+                        ob_printf(out, "    __typeof__(_tmp_%d.v%d) %s = _tmp_%d.v%d;\n", id, i,
+                                  node->destruct.names[i], id, i);
                     }
                     else
                     {
-                        fprintf(out, "    __auto_type %s = _tmp_%d.v%d;\n", node->destruct.names[i],
-                                id, i);
+                        ob_printf(out, "    __auto_type %s = _tmp_%d.v%d;\n",
+                                  node->destruct.names[i], id, i);
                     }
                 }
             }
@@ -1498,25 +1510,25 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
     case NODE_BLOCK:
     {
         int saved = defer_count;
-        fprintf(out, "    {\n");
+        ob_puts(out, "    {\n");
         codegen_walker(ctx, node->block.statements, out);
         for (int i = defer_count - 1; i >= saved; i--)
         {
             codegen_node_single(ctx, defer_stack[i], out);
         }
         defer_count = saved;
-        fprintf(out, "    }\n");
+        ob_puts(out, "    }\n");
         break;
     }
     case NODE_VAR_DECL:
-        fprintf(out, "    ");
+        ob_indent(out, 1);
         if (node->var_decl.is_static)
         {
-            fprintf(out, "static ");
+            ob_puts(out, "static ");
         }
         if (node->var_decl.is_autofree)
         {
-            fprintf(out, "__attribute__((cleanup(_z_autofree_impl))) ");
+            ob_puts(out, "__attribute__((cleanup(_z_autofree_impl))) ");
         }
         {
             char *tname = NULL;
@@ -1535,20 +1547,21 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                 ASTNode *def = find_struct_def(ctx, tname);
                 if (def && def->type_info && def->type_info->has_drop)
                 {
-                    fprintf(out, "__attribute__((cleanup(%s_Drop_glue))) ", tname);
+                    ob_printf(out, "__attribute__((cleanup(%s_Drop_glue))) ", tname);
                 }
             }
         }
         if (node->var_decl.type_str && strcmp(node->var_decl.type_str, "__auto_type") != 0)
         {
             emit_var_decl_type(ctx, out, node->var_decl.type_str, node->var_decl.name);
-            add_symbol(ctx, node->var_decl.name, node->var_decl.type_str, node->var_decl.type_info);
+            declare_local_symbol(ctx, node->var_decl.name, node->var_decl.type_str,
+                                 node->var_decl.type_info);
             if (node->var_decl.init_expr)
             {
-                fprintf(out, " = ");
+                ob_puts(out, " = ");
                 codegen_expression(ctx, node->var_decl.init_expr, out);
             }
-            fprintf(out, ";\n");
+            ob_puts(out, ";\n");
         }
         else
         {
@@ -1561,16 +1574,16 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
             if (inferred && strcmp(inferred, "__auto_type") != 0)
             {
                 emit_var_decl_type(ctx, out, inferred, node->var_decl.name);
-                add_symbol(ctx, node->var_decl.name, inferred, NULL);
+                declare_local_symbol(ctx, node->var_decl.name, inferred, NULL);
             }
             else
             {
                 emit_auto_type(ctx, node->var_decl.init_expr, node->token, out);
-                fprintf(out, " %s", node->var_decl.name);
+                ob_printf(out, " %s", node->var_decl.name);
 
                 if (inferred)
                 {
-                    add_symbol(ctx, node->var_decl.name, inferred, NULL);
+                    declare_local_symbol(ctx, node->var_decl.name, inferred, NULL);
                 }
                 else
                 {
@@ -1578,70 +1591,70 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                 }
             }
 
-            fprintf(out, " = ");
+            ob_puts(out, " = ");
             codegen_expression(ctx, node->var_decl.init_expr, out);
-            fprintf(out, ";\n");
+            ob_puts(out, ";\n");
         }
         break;
     case NODE_CONST:
-        fprintf(out, "    const ");
+        ob_puts(out, "    const ");
         if (node->var_decl.type_str)
         {
-            fprintf(out, "%s %s", node->var_decl.type_str, node->var_decl.name);
+            ob_printf(out, "%s %s", node->var_decl.type_str, node->var_decl.name);
         }
         else
         {
             emit_auto_type(ctx, node->var_decl.init_expr, node->token, out);
-            fprintf(out, " %s", node->var_decl.name);
+            ob_printf(out, " %s", node->var_decl.name);
         }
-        fprintf(out, " = ");
+        ob_puts(out, " = ");
         codegen_expression(ctx, node->var_decl.init_expr, out);
-        fprintf(out, ";\n");
+        ob_puts(out, ";\n");
         break;
     case NODE_FIELD:
         if (node->field.bit_width > 0)
         {
-            fprintf(out, "    %s %s : %d;\n", node->field.type, node->field.name,
-                    node->field.bit_width);
+            ob_printf(out, "    %s %s : %d;\n", node->field.type, node->field.name,
+                      node->field.bit_width);
         }
         else
         {
-            fprintf(out, "    ");
+            ob_indent(out, 1);
             emit_var_decl_type(ctx, out, node->field.type, node->field.name);
-            fprintf(out, ";\n");
+            ob_puts(out, ";\n");
         }
         break;
     case NODE_IF:
-        fprintf(out, "if (");
+        ob_puts(out, "if (");
         codegen_expression(ctx, node->if_stmt.condition, out);
-        fprintf(out, ") ");
+        ob_puts(out, ") ");
         codegen_node_single(ctx, node->if_stmt.then_body, out);
         if (node->if_stmt.else_body)
         {
-            fprintf(out, " else ");
+            ob_puts(out, " else ");
             codegen_node_single(ctx, node->if_stmt.else_body, out);
         }
         break;
     case NODE_UNLESS:
-        fprintf(out, "if (!(");
+        ob_puts(out, "if (!(");
         codegen_expression(ctx, node->unless_stmt.condition, out);
-        fprintf(out, ")) ");
+        ob_puts(out, ")) ");
         codegen_node_single(ctx, node->unless_stmt.body, out);
         break;
     case NODE_GUARD:
-        fprintf(out, "if (!(");
+        ob_puts(out, "if (!(");
         codegen_expression(ctx, node->guard_stmt.condition, out);
-        fprintf(out, ")) ");
+        ob_puts(out, ")) ");
         codegen_node_single(ctx, node->guard_stmt.body, out);
         break;
     case NODE_WHILE:
-        fprintf(out, "while (");
+        ob_puts(out, "while (");
         codegen_expression(ctx, node->while_stmt.condition, out);
-        fprintf(out, ") ");
+        ob_puts(out, ") ");
         codegen_node_single(ctx, node->while_stmt.body, out);
         break;
     case NODE_FOR:
-        fprintf(out, "for (");
+        ob_puts(out, "for (");
         if (node->for_stmt.init)
         {
             if (node->for_stmt.init->type == NODE_VAR_DECL)
@@ -1649,15 +1662,15 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                 ASTNode *v = node->for_stmt.init;
                 if (v->var_decl.type_str && strcmp(v->var_decl.type_str, "__auto_type") != 0)
                 {
-                    fprintf(out, "%s %s = (%s)(", v->var_decl.type_str, v->var_decl.name,
-                            v->var_decl.type_str);
+                    ob_printf(out, "%s %s = (%s)(", v->var_decl.type_str, v->var_decl.name,
+                              v->var_decl.type_str);
                     codegen_expression(ctx, v->var_decl.init_expr, out);
-                    fprintf(out, ")");
+                    ob_putc(out, ')');
                 }
                 else
                 {
                     emit_auto_type(ctx, v->var_decl.init_expr, v->token, out);
-                    fprintf(out, " %s = ", v->var_decl.name);
+                    ob_printf(out, " %s = ", v->var_decl.name);
                     codegen_expression(ctx, v->var_decl.init_expr, out);
                 }
             }
@@ -1666,95 +1679,95 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
                 codegen_expression(ctx, node->for_stmt.init, out);
             }
         }
-        fprintf(out, "; ");
+        ob_puts(out, "; ");
         if (node->for_stmt.condition)
         {
             codegen_expression(ctx, node->for_stmt.condition, out);
         }
-        fprintf(out, "; ");
+        ob_puts(out, "; ");
         if (node->for_stmt.step)
         {
             codegen_expression(ctx, node->for_stmt.step, out);
         }
-        fprintf(out, ") ");
+        ob_puts(out, ") ");
         codegen_node_single(ctx, node->for_stmt.body, out);
         break;
     case NODE_BREAK:
         if (node->break_stmt.target_label)
         {
-            fprintf(out, "goto __break_%s;\n", node->break_stmt.target_label);
+            ob_printf(out, "goto __break_%s;\n", node->break_stmt.target_label);
         }
         else
         {
-            fprintf(out, "break;\n");
+            ob_puts(out, "break;\n");
         }
         break;
     case NODE_CONTINUE:
         if (node->continue_stmt.target_label)
         {
-            fprintf(out, "goto __continue_%s;\n", node->continue_stmt.target_label);
+            ob_printf(out, "goto __continue_%s;\n", node->continue_stmt.target_label);
         }
         else
         {
-            fprintf(out, "continue;\n");
+            ob_puts(out, "continue;\n");
         }
         break;
     case NODE_GOTO:
         if (node->goto_stmt.goto_expr)
         {
             // Computed goto: goto *expr;
-            fprintf(out, "goto *(");
+            ob_puts(out, "goto *(");
             codegen_expression(ctx, node->goto_stmt.goto_expr, out);
-            fprintf(out, ");\n");
+            ob_puts(out, ");\n");
         }
         else
         {
-            fprintf(out, "goto %s;\n", node->goto_stmt.label_name);
+            ob_printf(out, "goto %s;\n", node->goto_stmt.label_name);
         }
         break;
     case NODE_LABEL:
-        fprintf(out, "%s:;\n", node->label_stmt.label_name);
+        ob_printf(out, "%s:;\n", node->label_stmt.label_name);
         break;
     case NODE_DO_WHILE:
-        fprintf(out, "do ");
+        ob_puts(out, "do ");
         codegen_node_single(ctx, node->do_while_stmt.body, out);
-        fprintf(out, " while (");
+        ob_puts(out, " while (");
         codegen_expression(ctx, node->do_while_stmt.condition, out);
-        fprintf(out, ");\n");
+        ob_puts(out, ");\n");
         break;
     // Loop constructs: loop, repeat, for-in
     case NODE_LOOP:
         // loop { ... } => while (1) { ... }
-        fprintf(out, "while (1) ");
+        ob_puts(out, "while (1) ");
         codegen_node_single(ctx, node->loop_stmt.body, out);
         break;
     case NODE_REPEAT:
-        fprintf(out, "for (int _rpt_i = 0; _rpt_i < (%s); _rpt_i++) ", node->repeat_stmt.count);
+        ob_printf(out, "for (int _rpt_i = 0; _rpt_i < (%s); _rpt_i++) ", node->repeat_stmt.count);
         codegen_node_single(ctx, node->repeat_stmt.body, out);
         break;
     case NODE_FOR_RANGE:
-        fprintf(out, "for (");
+        ob_puts(out, "for (");
         if (strstr(g_config.cc, "tcc"))
         {
-            fprintf(out, "__typeof__((");
+            ob_puts(out, "__typeof__((");
             codegen_expression(ctx, node->for_range.start, out);
-            fprintf(out, ")) %s = ", node->for_range.var_name);
+            ob_printf(out, ")) %s = ", node->for_range.var_name);
         }
         else
         {
-            fprintf(out, "__auto_type %s = ", node->for_range.var_name);
+            ob_printf(out, "__auto_type %s = ", node->for_range.var_name);
         }
         codegen_expression(ctx, node->for_range.start, out);
-        fprintf(out, "; %s < ", node->for_range.var_name);
+        ob_printf(out, "; %s < ", node->for_range.var_name);
         codegen_expression(ctx, node->for_range.end, out);
-        fprintf(out, "; %s", node->for_range.var_name);
+        ob_printf(out, "; %s", node->for_range.var_name);
         if (node->for_range.step)
         {
-            fprintf(out, " += %s) ", node->for_range.step);
+            ob_printf(out, " += %s) ", node->for_range.step);
         }
         else
         {
-            fprintf(out, "++) ");
+            ob_puts(out, "++) ");
         }
         codegen_node_single(ctx, node->for_range.body, out);
         break;
@@ -1765,11 +1778,11 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
 
         if (node->asm_stmt.is_volatile)
         {
-            fprintf(out, "    __asm__ __volatile__(");
+            ob_puts(out, "    __asm__ __volatile__(");
         }
         else
         {
-            fprintf(out, "    __asm__(");
+            ob_puts(out, "    __asm__(");
         }
 
         char *code = node->asm_stmt.code;
@@ -1853,92 +1866,92 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
         }
         *dst = 0;
 
-        fprintf(out, "\"");
+        ob_putc(out, '"');
         for (char *p = transformed; *p; p++)
         {
             if (*p == '\n')
             {
-                fprintf(out, "\\n\"\n        \"");
+                ob_puts(out, "\\n\"\n        \"");
             }
             else if (*p == '"')
             {
-                fprintf(out, "\\\"");
+                ob_puts(out, "\\\"");
             }
             else if (*p == '\\')
             {
-                fprintf(out, "\\\\");
+                ob_puts(out, "\\\\");
             }
             else
             {
-                fputc(*p, out);
+                ob_putc(out, *p);
             }
         }
-        fprintf(out, "\\n\"");
+        ob_puts(out, "\\n\"");
 
         if (node->asm_stmt.num_outputs > 0)
         {
-            fprintf(out, "\n        : ");
+            ob_puts(out, "\n        : ");
             for (int i = 0; i < node->asm_stmt.num_outputs; i++)
             {
                 if (i > 0)
                 {
-                    fprintf(out, ", ");
+                    ob_puts(out, ", ");
                 }
 
                 // Determine constraint
                 char *mode = node->asm_stmt.output_modes[i];
                 if (strcmp(mode, "out") == 0)
                 {
-                    fprintf(out, "\"=r\"(%s)", node->asm_stmt.outputs[i]);
+                    ob_printf(out, "\"=r\"(%s)", node->asm_stmt.outputs[i]);
                 }
                 else if (strcmp(mode, "inout") == 0)
                 {
-                    fprintf(out, "\"+r\"(%s)", node->asm_stmt.outputs[i]);
+                    ob_printf(out, "\"+r\"(%s)", node->asm_stmt.outputs[i]);
                 }
                 else
                 {
-                    fprintf(out, "\"=r\"(%s)", node->asm_stmt.outputs[i]);
+                    ob_printf(out, "\"=r\"(%s)", node->asm_stmt.outputs[i]);
                 }
             }
         }
 
         if (node->asm_stmt.num_inputs > 0)
         {
-            fprintf(out, "\n        : ");
+            ob_puts(out, "\n        : ");
             for (int i = 0; i < node->asm_stmt.num_inputs; i++)
             {
                 if (i > 0)
                 {
-                    fprintf(out, ", ");
+                    ob_puts(out, ", ");
                 }
-                fprintf(out, "\"r\"(%s)", node->asm_stmt.inputs[i]);
+                ob_printf(out, "\"r\"(%s)", node->asm_stmt.inputs[i]);
             }
         }
         else if (node->asm_stmt.num_outputs > 0)
         {
-            fprintf(out, "\n        : ");
+            ob_puts(out, "\n        : ");
         }
 
         if (node->asm_stmt.num_clobbers > 0)
         {
-            fprintf(out, "\n        : ");
+            ob_puts(out, "\n        : ");
             for (int i = 0; i < node->asm_stmt.num_clobbers; i++)
             {
                 if (i > 0)
                 {
-                    fprintf(out, ", ");
+                    ob_puts(out, ", ");
                 }
-                fprintf(out, "\"%s\"", node->asm_stmt.clobbers[i]);
+                ob_printf(out, "\"%s\"", node->asm_stmt.clobbers[i]);
             }
         }
 
-        fprintf(out, ");\n");
+        ob_puts(out, ");\n");
         break;
     }
     case NODE_RETURN:
-        fprintf(out, "    return ");
+        ob_puts(out, "    return ");
         codegen_expression(ctx, node->ret.value, out);
-        fprintf(out, ";\n");
+        ob_puts(out, ";\n");
         break;
     case NODE_EXPR_MEMBER:
     {
@@ -1946,11 +1959,11 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
         char *lt = infer_type(ctx, node->member.target);
         if (lt && (lt[strlen(lt) - 1] == '*' || strstr(lt, "*")))
         {
-            fprintf(out, "->%s", node->member.field);
+            ob_printf(out, "->%s", node->member.field);
         }
         else
         {
-            fprintf(out, ".%s", node->member.field);
+            ob_printf(out, ".%s", node->member.field);
         }
         if (lt)
         {
@@ -1960,12 +1973,12 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
     }
     case NODE_REPL_PRINT:
     {
-        fprintf(out, "{ ");
+        ob_puts(out, "{ ");
         emit_auto_type(ctx, node->repl_print.expr, node->token, out);
-        fprintf(out, " _zval = (");
+        ob_puts(out, " _zval = (");
         codegen_expression(ctx, node->repl_print.expr, out);
-        fprintf(out, "); fprintf(stdout, _z_str(_zval), _zval); fprintf(stdout, "
-                     "\"\\n\"); }\n");
+        ob_puts(out, "); fprintf(stdout, _z_str(_zval), _zval); fprintf(stdout, "
+                "\"\\n\"); }\n");
         break;
     }
     case NODE_AWAIT:
@@ -2026,29 +2039,29 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
             }
         }
 
-        fprintf(out, "({ Async _a = ");
+        ob_puts(out, "({ Async _a = ");
         codegen_expression(ctx, node->unary.operand, out);
-        fprintf(out, "; void* _r; pthread_join(_a.thread, &_r); ");
+        ob_puts(out, "; void* _r; pthread_join(_a.thread, &_r); ");
         if (strcmp(ret_type, "void") == 0)
         {
-            fprintf(out, "})"); // result unused
+            ob_puts(out, "})"); // result unused
         }
         else
         {
             if (returns_struct)
             {
                 // Dereference and free
-                fprintf(out, "%s _val = *(%s*)_r; free(_r); _val; })", ret_type, ret_type);
+                ob_printf(out, "%s _val = *(%s*)_r; free(_r); _val; })", ret_type, ret_type);
             }
             else
             {
                 if (needs_long_cast)
                 {
-                    fprintf(out, "(%s)(long)_r; })", ret_type);
+                    ob_printf(out, "(%s)(long)_r; })", ret_type);
                 }
                 else
                 {
-                    fprintf(out, "(%s)_r; })", ret_type);
+                    ob_printf(out, "(%s)_r; })", ret_type);
                 }
             }
         }
@@ -2056,18 +2069,18 @@ void codegen_node_single(ParserContext *ctx, ASTNode *node, FILE *out)
         {
             free(ret_type);
         }
-        fprintf(out, ";\n"); // Statement terminator
+        ob_puts(out, ";\n"); // Statement terminator
         break;
     }
     default:
         codegen_expression(ctx, node, out);
-        fprintf(out, ";\n");
+        ob_puts(out, ";\n");
         break;
     }
 }
 
 // Walks AST nodes and generates code.
-void codegen_walker(ParserContext *ctx, ASTNode *node, FILE *out)
+void codegen_walker(ParserContext *ctx, ASTNode *node, OutBuf *out)
 {
     while (node)
     {
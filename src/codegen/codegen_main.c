@@ -1,192 +1,323 @@
 
+#include "../analysis/reachability.h"
 #include "../ast/ast.h"
 #include "../zprep.h"
 #include "codegen.h"
+#include "hashmap.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-// Helper: Check if a struct depends on another struct/enum by-value.
-static int struct_depends_on(ASTNode *s1, const char *target_name)
-{
-    if (!s1)
-    {
-        return 0;
-    }
-
-    // Only structs have dependencies that matter for ordering.
-    if (s1->type != NODE_STRUCT)
-    {
-        return 0;
-    }
-
-    ASTNode *field = s1->strct.fields;
-    while (field)
-    {
-        if (field->type == NODE_FIELD && field->field.type)
-        {
-            char *type_str = field->field.type;
-            // Skip pointers - they don't create ordering dependency.
-            if (strchr(type_str, '*'))
-            {
-                field = field->next;
-                continue;
-            }
+#define CODEGEN_MAX_THREADS 64
+#define CODEGEN_ITEMS_PER_THREAD 32 // Fewer items per thread than this is not worth a thread.
 
-            // Check if this field's type matches target (struct or enum).
-            if (strcmp(type_str, target_name) == 0)
-            {
-                return 1;
-            }
-        }
-        field = field->next;
-    }
-    return 0;
+static const char *decl_name(ASTNode *n)
+{
+    return NODE_STRUCT == n->type ? n->strct.name : n->enm.name;
 }
 
 // Topologically sort a list of struct/enum nodes.
+// A struct must come after every struct/enum it holds by value (pointer
+// fields impose no order). The order is the one a round-based scan gives:
+// round r walks the list and emits every node whose dependencies were
+// emitted in an earlier round or earlier in round r. A node's round is
+// computed directly while draining the dependency graph (Kahn), so the sort
+// is O(V+E). Nodes on or behind a cycle keep their list order at the end.
 static ASTNode *topo_sort_structs(ASTNode *head)
 {
-    if (!head)
-    {
-        return NULL;
-    }
-
-    // Count all nodes (structs + enums).
     int count = 0;
-    ASTNode *n = head;
-    while (n)
+    for (ASTNode *n = head; n; n = n->next)
     {
         if (n->type == NODE_STRUCT || n->type == NODE_ENUM)
         {
             count++;
         }
-        n = n->next;
     }
     if (count == 0)
     {
         return head;
     }
 
-    // Build array of all nodes.
-    ASTNode **nodes = malloc(count * sizeof(ASTNode *));
-    int *emitted = calloc(count, sizeof(int));
-    n = head;
+    ASTNode **nodes = xmalloc(count * sizeof(ASTNode *));
+    int *same_name = xmalloc(count * sizeof(int)); // Next node with the same name.
+    HashMap by_name = {0};                         // Name -> first node index + 1.
     int idx = 0;
-    while (n)
+    for (ASTNode *n = head; n; n = n->next)
     {
         if (n->type == NODE_STRUCT || n->type == NODE_ENUM)
         {
+            const char *name = decl_name(n);
+            same_name[idx] = -1;
+            if (name)
+            {
+                same_name[idx] = (int)(intptr_t)hashmap_get(&by_name, name) - 1;
+                hashmap_put(&by_name, name, (void *)(intptr_t)(idx + 1));
+            }
             nodes[idx++] = n;
         }
-        n = n->next;
     }
 
-    // Build order array (indices in emission order).
-    int *order = malloc(count * sizeof(int));
-    int order_idx = 0;
-
-    int changed = 1;
-    int max_iterations = count * count;
-    int iterations = 0;
-
-    while (changed && iterations < max_iterations)
+    // Edges dep -> user, stored by dep (CSR). Pass 0 counts, pass 1 fills.
+    int *first = xcalloc(count + 1, sizeof(int));
+    int *users = NULL;
+    int *indeg = xcalloc(count, sizeof(int));
+    for (int pass = 0; pass < 2; pass++)
     {
-        changed = 0;
-        iterations++;
-
-        for (int i = 0; i < count; i++)
+        int *fill = NULL;
+        if (1 == pass)
         {
-            if (emitted[i])
+            for (int i = 0; i < count; i++)
             {
-                continue;
+                first[i + 1] += first[i];
             }
+            users = xmalloc((first[count] + 1) * sizeof(int));
+            fill = xmalloc(count * sizeof(int));
+            memcpy(fill, first, count * sizeof(int));
+        }
 
-            // Enums have no dependencies, emit first.
-            if (nodes[i]->type == NODE_ENUM)
+        for (int i = 0; i < count; i++)
+        {
+            if (nodes[i]->type != NODE_STRUCT)
             {
-                order[order_idx++] = i;
-                emitted[i] = 1;
-                changed = 1;
                 continue;
             }
-
-            // For structs, check if all dependencies are emitted.
-            int can_emit = 1;
-            for (int j = 0; j < count; j++)
+            for (ASTNode *f = nodes[i]->strct.fields; f; f = f->next)
             {
-                if (i == j || emitted[j])
+                if (f->type != NODE_FIELD || !f->field.type || strchr(f->field.type, '*'))
                 {
                     continue;
                 }
-
-                // Get the name of the potential dependency.
-                const char *dep_name = NULL;
-                if (nodes[j]->type == NODE_STRUCT)
+                int j = (int)(intptr_t)hashmap_get(&by_name, f->field.type) - 1;
+                for (; j >= 0; j = same_name[j])
                 {
-                    dep_name = nodes[j]->strct.name;
-                }
-                else if (nodes[j]->type == NODE_ENUM)
-                {
-                    dep_name = nodes[j]->enm.name;
-                }
-
-                if (dep_name && struct_depends_on(nodes[i], dep_name))
-                {
-                    can_emit = 0;
-                    break;
+                    if (j == i)
+                    {
+                        continue;
+                    }
+                    if (0 == pass)
+                    {
+                        first[j + 1]++;
+                        indeg[i]++;
+                    }
+                    else
+                    {
+                        users[fill[j]++] = i;
+                    }
                 }
             }
+        }
+    }
 
-            if (can_emit)
+    int *round = xmalloc(count * sizeof(int));
+    int *queue = xmalloc(count * sizeof(int));
+    int q_head = 0;
+    int q_tail = 0;
+    for (int i = 0; i < count; i++)
+    {
+        round[i] = 0;
+        if (0 == indeg[i])
+        {
+            queue[q_tail++] = i;
+        }
+    }
+    while (q_head < q_tail)
+    {
+        int j = queue[q_head++];
+        for (int e = first[j]; e < first[j + 1]; e++)
+        {
+            int i = users[e];
+            int r = j < i ? round[j] : round[j] + 1;
+            if (r > round[i])
             {
-                order[order_idx++] = i;
-                emitted[i] = 1;
-                changed = 1;
+                round[i] = r;
+            }
+            if (0 == --indeg[i])
+            {
+                queue[q_tail++] = i;
             }
         }
     }
 
-    // Add any remaining nodes (cycles).
+    // Bucket the sorted nodes by round (list order within a round), then
+    // append the unsorted ones.
+    int *bucket = xcalloc(count + 1, sizeof(int));
+    for (int i = 0; i < count; i++)
+    {
+        if (0 == indeg[i])
+        {
+            bucket[round[i] + 1]++;
+        }
+    }
+    for (int r = 0; r < count; r++)
+    {
+        bucket[r + 1] += bucket[r];
+    }
+    int *order = xmalloc(count * sizeof(int));
+    int tail = q_tail;
     for (int i = 0; i < count; i++)
     {
-        if (!emitted[i])
+        if (0 == indeg[i])
+        {
+            order[bucket[round[i]]++] = i;
+        }
+        else
         {
-            order[order_idx++] = i;
+            order[tail++] = i;
         }
     }
 
-    // Now build the linked list in the correct order.
-    ASTNode *result = NULL;
-    ASTNode *result_tail = NULL;
+    for (int i = 0; i + 1 < count; i++)
+    {
+        nodes[order[i]]->next = nodes[order[i + 1]];
+    }
+    nodes[order[count - 1]]->next = NULL;
+    return nodes[order[0]];
+}
 
-    for (int i = 0; i < order_idx; i++)
+// Appends a detached copy of 'n' to the merged declaration list.
+static void merge_decl(ASTNode **merged, ASTNode **tail, HashMap *seen, ASTNode *n)
+{
+    ASTNode *copy = xmalloc(sizeof(ASTNode));
+    *copy = *n;
+    copy->next = NULL;
+    if (!*merged)
     {
-        ASTNode *node = nodes[order[i]];
-        if (!result)
+        *merged = copy;
+    }
+    else
+    {
+        (*tail)->next = copy;
+    }
+    *tail = copy;
+
+    if (n->type == NODE_STRUCT || n->type == NODE_ENUM)
+    {
+        const char *name = decl_name(n);
+        if (name)
         {
-            result = node;
-            result_tail = node;
+            hashmap_put(&seen[NODE_STRUCT == n->type ? 0 : 1], name, copy);
         }
-        else
+    }
+}
+
+// ** Function bodies **
+// Once the program is parsed, instantiated and marked, each top-level function
+// or impl block only reads shared state. Every item is generated into its own
+// buffer with fresh per-thread emission state and a scope of its own for the
+// locals codegen declares, and the buffers are joined in list order, so the
+// output is the same whatever the thread count.
+typedef struct
+{
+    ParserContext *ctx;
+    ASTNode **items;
+    OutBuf *bufs;
+    int count;
+    atomic_int next;
+} FuncJobs;
+
+typedef struct
+{
+    FuncJobs *jobs;
+    Arena *arena;
+} FuncWorker;
+
+static void emit_function_item(ParserContext *wctx, FuncJobs *jobs, int i)
+{
+    Scope scope = {0};
+    scope.parent = jobs->ctx->current_scope;
+    wctx->current_scope = &scope;
+    tmp_counter = 0;
+    defer_count = 0;
+    g_current_lambda = NULL;
+    g_current_impl_type = NULL;
+    codegen_node_single(wctx, jobs->items[i], &jobs->bufs[i]);
+}
+
+static void *function_worker(void *arg)
+{
+    FuncWorker *w = arg;
+    FuncJobs *jobs = w->jobs;
+    Arena *prev = arena_switch(w->arena);
+    // Private copy: declaring locals writes to the context.
+    ParserContext wctx = *jobs->ctx;
+    for (int i; (i = atomic_fetch_add(&jobs->next, 1)) < jobs->count;)
+    {
+        emit_function_item(&wctx, jobs, i);
+    }
+    arena_switch(prev);
+    return NULL;
+}
+
+static int codegen_thread_count(int items)
+{
+    long n = g_config.jobs > 0 ? g_config.jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > items / CODEGEN_ITEMS_PER_THREAD)
+    {
+        n = items / CODEGEN_ITEMS_PER_THREAD;
+    }
+    if (n > CODEGEN_MAX_THREADS)
+    {
+        n = CODEGEN_MAX_THREADS;
+    }
+    return n < 1 ? 1 : (int)n;
+}
+
+static void emit_function_bodies(ParserContext *ctx, ASTNode **items, int count, OutBuf *out)
+{
+    FuncJobs jobs = {ctx, items, calloc(count ? count : 1, sizeof(OutBuf)), count, 0};
+    int saved_tmp = tmp_counter;
+    int threads = codegen_thread_count(count);
+
+    if (threads <= 1)
+    {
+        ParserContext wctx = *ctx;
+        for (int i = 0; i < count; i++)
         {
-            result_tail->next = node;
-            result_tail = node;
+            emit_function_item(&wctx, &jobs, i);
         }
     }
-    if (result_tail)
+    else
     {
-        result_tail->next = NULL;
+        // The calling thread is worker 0. Worker arenas are kept: memoized
+        // inference results and cached spellings may point into them.
+        FuncWorker workers[CODEGEN_MAX_THREADS];
+        pthread_t tids[CODEGEN_MAX_THREADS];
+        int started = 1;
+        arena_set_threaded(1);
+        for (int t = 0; t < threads; t++)
+        {
+            workers[t].jobs = &jobs;
+            workers[t].arena = arena_create("codegen-worker");
+        }
+        for (int t = 1; t < threads; t++)
+        {
+            if (pthread_create(&tids[t], NULL, function_worker, &workers[t]) != 0)
+            {
+                break; // Fewer threads; the items still get done.
+            }
+            started++;
+        }
+        function_worker(&workers[0]);
+        for (int t = 1; t < started; t++)
+        {
+            pthread_join(tids[t], NULL);
+        }
+        arena_set_threaded(0);
     }
 
-    free(nodes);
-    free(emitted);
-    free(order);
-    return result;
+    for (int i = 0; i < count; i++)
+    {
+        ob_append(out, &jobs.bufs[i]);
+    }
+    tmp_counter = saved_tmp;
 }
 
 // Main entry point for code generation.
-void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
+void codegen_node(ParserContext *ctx, ASTNode *node, OutBuf *out)
 {
     if (node->type == NODE_ROOT)
     {
@@ -200,6 +331,8 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
 
         global_user_structs = kids;
 
+        mark_reachable(ctx, node);
+
         if (!ctx->skip_preamble)
         {
             emit_preamble(ctx, out);
@@ -215,118 +348,45 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
             size_t n;
             while ((n = fread(buf, 1, sizeof(buf), ctx->hoist_out)) > 0)
             {
-                fwrite(buf, 1, n, out);
+                ob_write(out, buf, n);
             }
             fseek(ctx->hoist_out, pos, SEEK_SET);
         }
 
+        // Every struct and enum once: instantiations, then imports, then the
+        // user's own declarations that are not already listed (by kind and name).
         ASTNode *merged = NULL;
         ASTNode *merged_tail = NULL;
+        HashMap seen[2] = {{0}}; // Struct names, enum names.
 
-        ASTNode *s = ctx->instantiated_structs;
-        while (s)
+        for (ASTNode *s = ctx->instantiated_structs; s; s = s->next)
         {
-            ASTNode *copy = xmalloc(sizeof(ASTNode));
-            *copy = *s;
-            copy->next = NULL;
-            if (!merged)
-            {
-                merged = copy;
-                merged_tail = copy;
-            }
-            else
-            {
-                merged_tail->next = copy;
-                merged_tail = copy;
-            }
-            s = s->next;
+            merge_decl(&merged, &merged_tail, seen, s);
         }
-
-        StructRef *sr = ctx->parsed_structs_list;
-        while (sr)
+        for (StructRef *sr = ctx->parsed_structs_list; sr; sr = sr->next)
         {
             if (sr->node)
             {
-                ASTNode *copy = xmalloc(sizeof(ASTNode));
-                *copy = *sr->node;
-                copy->next = NULL;
-                if (!merged)
-                {
-                    merged = copy;
-                    merged_tail = copy;
-                }
-                else
-                {
-                    merged_tail->next = copy;
-                    merged_tail = copy;
-                }
+                merge_decl(&merged, &merged_tail, seen, sr->node);
             }
-            sr = sr->next;
         }
-
-        StructRef *er = ctx->parsed_enums_list;
-        while (er)
+        for (StructRef *er = ctx->parsed_enums_list; er; er = er->next)
         {
             if (er->node)
             {
-                ASTNode *copy = xmalloc(sizeof(ASTNode));
-                *copy = *er->node;
-                copy->next = NULL;
-                if (!merged)
-                {
-                    merged = copy;
-                    merged_tail = copy;
-                }
-                else
-                {
-                    merged_tail->next = copy;
-                    merged_tail = copy;
-                }
+                merge_decl(&merged, &merged_tail, seen, er->node);
             }
-            er = er->next;
         }
-
-        ASTNode *k = kids;
-        while (k)
+        for (ASTNode *k = kids; k; k = k->next)
         {
             if (k->type == NODE_STRUCT || k->type == NODE_ENUM)
             {
-                int found = 0;
-                ASTNode *chk = merged;
-                while (chk)
+                const char *name = decl_name(k);
+                if (!name || !hashmap_contains(&seen[NODE_STRUCT == k->type ? 0 : 1], name))
                 {
-                    if (chk->type == k->type)
-                    {
-                        const char *n1 = (k->type == NODE_STRUCT) ? k->strct.name : k->enm.name;
-                        const char *n2 =
-                            (chk->type == NODE_STRUCT) ? chk->strct.name : chk->enm.name;
-                        if (n1 && n2 && strcmp(n1, n2) == 0)
-                        {
-                            found = 1;
-                            break;
-                        }
-                    }
-                    chk = chk->next;
-                }
-
-                if (!found)
-                {
-                    ASTNode *copy = xmalloc(sizeof(ASTNode));
-                    *copy = *k;
-                    copy->next = NULL;
-                    if (!merged)
-                    {
-                        merged = copy;
-                        merged_tail = copy;
-                    }
-                    else
-                    {
-                        merged_tail->next = copy;
-                        merged_tail = copy;
-                    }
+                    merge_decl(&merged, &merged_tail, seen, k);
                 }
             }
-            k = k->next;
         }
 
         // Topologically sort.
@@ -346,7 +406,7 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
         {
             if (raw_iter->type == NODE_RAW_STMT)
             {
-                fprintf(out, "%s\n", raw_iter->raw_stmt.content);
+                ob_printf(out, "%s\n", raw_iter->raw_stmt.content);
             }
             raw_iter = raw_iter->next;
         }
@@ -446,6 +506,14 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
 
         emit_tests_and_runner(ctx, kids, out);
 
+        int item_count = 0;
+        for (ASTNode *n = merged_funcs; n; n = n->next)
+        {
+            item_count++;
+        }
+        ASTNode **items = xmalloc(sizeof(ASTNode *) * (item_count ? item_count : 1));
+        item_count = 0;
+
         ASTNode *iter = merged_funcs;
         while (iter)
         {
@@ -458,42 +526,7 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
                     continue;
                 }
 
-                char *mangled = replace_string_type(sname);
-                ASTNode *def = find_struct_def_codegen(ctx, mangled);
-                int skip = 0;
-                if (def)
-                {
-                    if (def->type == NODE_STRUCT && def->strct.is_template)
-                    {
-                        skip = 1;
-                    }
-                    else if (def->type == NODE_ENUM && def->enm.is_template)
-                    {
-                        skip = 1;
-                    }
-                }
-                else
-                {
-                    char *lt = strchr(sname, '<');
-                    if (lt)
-                    {
-                        int len = lt - sname;
-                        char *buf = xmalloc(len + 1);
-                        strncpy(buf, sname, len);
-                        buf[len] = 0;
-                        def = find_struct_def_codegen(ctx, buf);
-                        if (def && def->strct.is_template)
-                        {
-                            skip = 1;
-                        }
-                        free(buf);
-                    }
-                }
-                if (mangled)
-                {
-                    free(mangled);
-                }
-                if (skip)
+                if (is_template_impl_target(ctx, sname))
                 {
                     iter = iter->next;
                     continue;
@@ -508,46 +541,16 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
                     continue;
                 }
 
-                char *mangled = replace_string_type(sname);
-                ASTNode *def = find_struct_def_codegen(ctx, mangled);
-                int skip = 0;
-                if (def)
-                {
-                    if (def->strct.is_template)
-                    {
-                        skip = 1;
-                    }
-                }
-                else
-                {
-                    char *lt = strchr(sname, '<');
-                    if (lt)
-                    {
-                        int len = lt - sname;
-                        char *buf = xmalloc(len + 1);
-                        strncpy(buf, sname, len);
-                        buf[len] = 0;
-                        def = find_struct_def_codegen(ctx, buf);
-                        if (def && def->strct.is_template)
-                        {
-                            skip = 1;
-                        }
-                        free(buf);
-                    }
-                }
-                if (mangled)
-                {
-                    free(mangled);
-                }
-                if (skip)
+                if (is_template_impl_target(ctx, sname))
                 {
                     iter = iter->next;
                     continue;
                 }
             }
-            codegen_node_single(ctx, iter, out);
+            items[item_count++] = iter;
             iter = iter->next;
         }
+        emit_function_bodies(ctx, items, item_count, out);
 
         int has_user_main = 0;
         ASTNode *chk = merged_funcs;
@@ -563,7 +566,7 @@ void codegen_node(ParserContext *ctx, ASTNode *node, FILE *out)
 
         if (!has_user_main)
         {
-            fprintf(out, "\nint main() { _z_run_tests(); return 0; }\n");
+            ob_puts(out, "\nint main() { _z_run_tests(); return 0; }\n");
         }
     }
 }
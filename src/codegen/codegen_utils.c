@@ -10,14 +10,16 @@
 
 // Global state
 ASTNode *global_user_structs = NULL;
-char *g_current_impl_type = NULL;
-int tmp_counter = 0;
-ASTNode *defer_stack[MAX_DEFER];
-int defer_count = 0;
-ASTNode *g_current_lambda = NULL;
+
+// Per-thread emission state (function bodies may be generated in parallel).
+_Thread_local char *g_current_impl_type = NULL;
+_Thread_local int tmp_counter = 0;
+_Thread_local ASTNode *defer_stack[MAX_DEFER];
+_Thread_local int defer_count = 0;
+_Thread_local ASTNode *g_current_lambda = NULL;
 
 // Helper to emit variable declarations with array types.
-void emit_var_decl_type(ParserContext *ctx, FILE *out, const char *type_str, const char *var_name)
+void emit_var_decl_type(ParserContext *ctx, OutBuf *out, const char *type_str, const char *var_name)
 {
     (void)ctx;
 
@@ -26,11 +28,11 @@ void emit_var_decl_type(ParserContext *ctx, FILE *out, const char *type_str, con
     if (bracket)
     {
         int base_len = bracket - type_str;
-        fprintf(out, "%.*s %s%s", base_len, type_str, var_name, bracket);
+        ob_printf(out, "%.*s %s%s", base_len, type_str, var_name, bracket);
     }
     else
     {
-        fprintf(out, "%s %s", type_str, var_name);
+        ob_printf(out, "%s %s", type_str, var_name);
     }
 }
 
@@ -74,6 +76,14 @@ ASTNode *find_struct_def_codegen(ParserContext *ctx, const char *name)
     return NULL;
 }
 
+// Impl targets are plain names: a generic impl is kept as a template and its
+// instances are named after the mangled type, so no '<' is left to look for.
+int is_template_impl_target(ParserContext *ctx, const char *name)
+{
+    ASTNode *def = find_struct_def_codegen(ctx, name);
+    return def && def->strct.is_template;
+}
+
 // Get field type from struct.
 char *get_field_type_str(ParserContext *ctx, const char *struct_name, const char *field_name)
 {
@@ -106,23 +116,19 @@ char *get_field_type_str(ParserContext *ctx, const char *struct_name, const char
 }
 
 // Type inference.
-char *infer_type(ParserContext *ctx, ASTNode *node)
+static Type *infer_type_uncached(ParserContext *ctx, ASTNode *node)
 {
     if (!node)
     {
         return NULL;
     }
-    if (node->resolved_type && strcmp(node->resolved_type, "unknown") != 0)
+    if (node->type_info)
     {
-        return node->resolved_type;
+        return type_intern(node->type_info);
     }
 
     if (node->type == NODE_EXPR_LITERAL)
     {
-        if (node->type_info)
-        {
-            return type_to_string(node->type_info);
-        }
         return NULL;
     }
 
@@ -133,11 +139,11 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
         {
             if (sym->type_name)
             {
-                return sym->type_name;
+                return type_from_spelling(sym->type_name);
             }
             if (sym->type_info)
             {
-                return type_to_string(sym->type_info);
+                return type_intern(sym->type_info);
             }
         }
     }
@@ -151,11 +157,11 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
             {
                 if (sig->is_async)
                 {
-                    return "Async";
+                    return type_from_spelling("Async");
                 }
                 if (sig->ret_type)
                 {
-                    return type_to_string(sig->ret_type);
+                    return type_intern(sig->ret_type);
                 }
             }
 
@@ -164,12 +170,12 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
                 strcmp(node->call.callee->var_ref.name, "calloc") == 0 ||
                 strcmp(node->call.callee->var_ref.name, "realloc") == 0)
             {
-                return "void*";
+                return type_from_spelling("void*");
             }
             ASTNode *sdef = find_struct_def_codegen(ctx, node->call.callee->var_ref.name);
             if (sdef)
             {
-                return node->call.callee->var_ref.name;
+                return type_from_spelling(node->call.callee->var_ref.name);
             }
         }
         // Method call: target.method() - look up Type_method signature.
@@ -198,7 +204,7 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
                 FuncSig *sig = find_func(ctx, func_name);
                 if (sig && sig->ret_type)
                 {
-                    return type_to_string(sig->ret_type);
+                    return type_intern(sig->ret_type);
                 }
             }
         }
@@ -209,31 +215,18 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
             if (sym && sym->type_info && sym->type_info->kind == TYPE_FUNCTION &&
                 sym->type_info->inner)
             {
-                return type_to_string(sym->type_info->inner);
+                return type_intern(sym->type_info->inner);
             }
         }
     }
 
     if (node->type == NODE_TRY)
     {
-        char *inner_type = infer_type(ctx, node->try_stmt.expr);
-        if (inner_type)
+        // T out of Result<T> or Option<T>.
+        Type *inner = infer_type_info(ctx, node->try_stmt.expr);
+        if (type_is_instance_of(inner, "Result") || type_is_instance_of(inner, "Option"))
         {
-            // Extract T from Result<T> or Option<T>
-            char *start = strchr(inner_type, '<');
-            if (start)
-            {
-                start++; // Skip <
-                char *end = strrchr(inner_type, '>');
-                if (end && end > start)
-                {
-                    int len = end - start;
-                    char *extracted = xmalloc(len + 1);
-                    strncpy(extracted, start, len);
-                    extracted[len] = 0;
-                    return extracted;
-                }
-            }
+            return inner->args[0];
         }
     }
 
@@ -253,14 +246,14 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
             *ptr = 0;
         }
 
-        return get_field_type_str(ctx, clean_name, node->member.field);
+        return type_from_spelling(get_field_type_str(ctx, clean_name, node->member.field));
     }
 
     if (node->type == NODE_EXPR_BINARY)
     {
         if (strcmp(node->binary.op, "??") == 0)
         {
-            return infer_type(ctx, node->binary.left);
+            return infer_type_info(ctx, node->binary.left);
         }
 
         const char *op = node->binary.op;
@@ -273,23 +266,23 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
 
         if (is_logical)
         {
-            return xstrdup("int");
+            return type_from_spelling("int");
         }
 
         if (left_type && strcmp(left_type, "usize") == 0)
         {
-            return "usize";
+            return type_from_spelling("usize");
         }
         if (right_type && strcmp(right_type, "usize") == 0)
         {
-            return "usize";
+            return type_from_spelling("usize");
         }
         if (left_type && strcmp(left_type, "double") == 0)
         {
-            return "double";
+            return type_from_spelling("double");
         }
 
-        return left_type ? left_type : right_type;
+        return type_from_spelling(left_type ? left_type : right_type);
     }
 
     if (node->type == NODE_MATCH)
@@ -300,7 +293,7 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
             char *type = infer_type(ctx, case_node->match_case.body);
             if (type && strcmp(type, "void") != 0 && strcmp(type, "unknown") != 0)
             {
-                return type;
+                return type_from_spelling(type);
             }
             case_node = case_node->next;
         }
@@ -320,10 +313,10 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
                 char *buf = xmalloc(len + 1);
                 strncpy(buf, array_type, len);
                 buf[len] = 0;
-                return buf;
+                return type_from_spelling(buf);
             }
         }
-        return "int";
+        return type_from_spelling("int");
     }
 
     if (node->type == NODE_EXPR_UNARY)
@@ -335,7 +328,7 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
             {
                 char *buf = xmalloc(strlen(inner) + 2);
                 sprintf(buf, "%s*", inner);
-                return buf;
+                return type_from_spelling(buf);
             }
         }
         if (strcmp(node->unary.op, "*") == 0)
@@ -351,11 +344,11 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
                     char *dup = xmalloc(len + 1);
                     strncpy(dup, inner, len);
                     dup[len] = 0;
-                    return dup;
+                    return type_from_spelling(dup);
                 }
             }
         }
-        return infer_type(ctx, node->unary.operand);
+        return infer_type_info(ctx, node->unary.operand);
     }
 
     if (node->type == NODE_AWAIT)
@@ -368,43 +361,78 @@ char *infer_type(ParserContext *ctx, ASTNode *node)
             FuncSig *sig = find_func(ctx, node->unary.operand->call.callee->var_ref.name);
             if (sig && sig->ret_type)
             {
-                return type_to_string(sig->ret_type);
+                return type_intern(sig->ret_type);
             }
         }
 
-        return "void*";
+        return type_from_spelling("void*");
     }
 
     if (node->type == NODE_EXPR_CAST)
     {
-        return node->cast.target_type;
+        return type_from_spelling(node->cast.target_type);
     }
 
     if (node->type == NODE_EXPR_STRUCT_INIT)
     {
-        return node->struct_init.struct_name;
+        return type_from_spelling(node->struct_init.struct_name);
     }
 
     if (node->type == NODE_EXPR_LITERAL)
     {
         if (node->literal.type_kind == TOK_STRING)
         {
-            return "string";
+            return type_from_spelling("string");
         }
         if (node->literal.type_kind == TOK_CHAR)
         {
-            return "char";
+            return type_from_spelling("char");
         }
         if (node->literal.type_kind == 1)
         {
-            return "double";
+            return type_from_spelling("double");
         }
-        return "int";
+        return type_from_spelling("int");
     }
 
+    // Last resort: the parser's legacy spelling.
+    if (node->resolved_type && strcmp(node->resolved_type, "unknown") != 0)
+    {
+        return type_from_spelling(node->resolved_type);
+    }
     return NULL;
 }
 
+Type *infer_type_info(ParserContext *ctx, ASTNode *node)
+{
+    if (!node)
+    {
+        return NULL;
+    }
+    if (!node->inferred_type)
+    {
+        Type *t = infer_type_uncached(ctx, node);
+        // The parser names a generic instance by its mangled spelling; the
+        // instantiation registry has the formal base<arg> behind it.
+        if (t && TYPE_STRUCT == t->kind && 0 == t->arg_count && t->name)
+        {
+            Instantiation *inst = hashmap_get(&ctx->index.instantiations, t->name);
+            if (inst && inst->type)
+            {
+                t = inst->type;
+            }
+        }
+        node->inferred_type = t;
+    }
+    return node->inferred_type;
+}
+
+char *infer_type(ParserContext *ctx, ASTNode *node)
+{
+    Type *t = infer_type_info(ctx, node);
+    return t ? type_spelling(t) : NULL;
+}
+
 // Extract variable names from argument string.
 char *extract_call_args(const char *args)
 {
@@ -416,7 +444,8 @@ char *extract_call_args(const char *args)
     out[0] = 0;
 
     char *dup = xstrdup(args);
-    char *p = strtok(dup, ",");
+    char *save = NULL;
+    char *p = strtok_r(dup, ",", &save);
     while (p)
     {
         while (*p == ' ')
@@ -442,7 +471,7 @@ char *extract_call_args(const char *args)
         }
         strcat(out, name);
 
-        p = strtok(NULL, ",");
+        p = strtok_r(NULL, ",", &save);
     }
     free(dup);
     return out;
@@ -492,7 +521,7 @@ char *replace_string_type(const char *args)
 }
 
 // Helper to emit auto type or fallback.
-void emit_auto_type(ParserContext *ctx, ASTNode *init_expr, Token t, FILE *out)
+void emit_auto_type(ParserContext *ctx, ASTNode *init_expr, Token t, OutBuf *out)
 {
     char *inferred = NULL;
     if (init_expr)
@@ -502,7 +531,7 @@ void emit_auto_type(ParserContext *ctx, ASTNode *init_expr, Token t, FILE *out)
 
     if (inferred && strcmp(inferred, "__auto_type") != 0 && strcmp(inferred, "unknown") != 0)
     {
-        fprintf(out, "%s", inferred);
+        ob_puts(out, inferred);
     }
     else
     {
@@ -515,7 +544,7 @@ void emit_auto_type(ParserContext *ctx, ASTNode *init_expr, Token t, FILE *out)
         }
         else
         {
-            fprintf(out, "__auto_type");
+            ob_puts(out, "__auto_type");
         }
     }
 }
@@ -1,12 +1,38 @@
 
+// Intrinsics come first: zprep.h redefines malloc/free, which mm_malloc.h uses.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <stdint.h>
+
 #include "zprep.h"
 
+// One pre-lexed token plus the lexer state right after it. The state it was
+// scanned from is the end state of the previous entry (or the initial state).
+typedef struct
+{
+    Token tok;
+    int end_pos;
+    int end_line;
+    int end_col;
+} BufferedToken;
+
+struct TokenBuffer
+{
+    BufferedToken *toks;
+    int count;
+};
+
 void lexer_init(Lexer *l, const char *src)
 {
     l->src = src;
     l->pos = 0;
     l->line = 1;
     l->col = 1;
+    l->tokens = NULL;
+    l->tok_idx = 0;
 }
 
 static int is_ident_start(char c)
@@ -14,30 +40,232 @@ static int is_ident_start(char c)
     return isalpha(c) || c == '_';
 }
 
+// ** Character-class spans **
+// Whitespace, identifier bodies and comment text are measured a vector at a
+// time. SSE2 is baseline on x86-64; building with -mavx2 (or -march=native)
+// switches to 32-byte vectors. Loads are aligned so they never cross into an
+// unmapped page past the terminating NUL. Other targets use the scalar loops.
+
+#if defined(__AVX2__)
+typedef __m256i lex_vec;
+#define LEX_VEC_BYTES 32
+#define LEX_VEC_FULL 0xFFFFFFFFu
+#define lv_load(p) _mm256_load_si256((const __m256i *)(p))
+#define lv_set1(c) _mm256_set1_epi8(c)
+#define lv_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define lv_gt(a, b) _mm256_cmpgt_epi8(a, b)
+#define lv_or(a, b) _mm256_or_si256(a, b)
+#define lv_and(a, b) _mm256_and_si256(a, b)
+#define lv_bits(v) ((uint32_t)_mm256_movemask_epi8(v))
+#elif defined(__SSE2__)
+typedef __m128i lex_vec;
+#define LEX_VEC_BYTES 16
+#define LEX_VEC_FULL 0xFFFFu
+#define lv_load(p) _mm_load_si128((const __m128i *)(p))
+#define lv_set1(c) _mm_set1_epi8(c)
+#define lv_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define lv_gt(a, b) _mm_cmpgt_epi8(a, b)
+#define lv_or(a, b) _mm_or_si128(a, b)
+#define lv_and(a, b) _mm_and_si128(a, b)
+#define lv_bits(v) ((uint32_t)_mm_movemask_epi8(v))
+#endif
+
+#ifdef LEX_VEC_BYTES
+
+// lo <= v <= hi, signed bytes (everything >= 0x80 falls outside).
+static inline lex_vec lv_range(lex_vec v, char lo, char hi)
+{
+    return lv_and(lv_gt(v, lv_set1((char)(lo - 1))), lv_gt(lv_set1((char)(hi + 1)), v));
+}
+
+// ' ', '\t', '\n', '\v', '\f', '\r' -- the C locale isspace() set.
+static inline uint32_t lv_space_bits(const char *p)
+{
+    lex_vec v = lv_load(p);
+    return lv_bits(lv_or(lv_eq(v, lv_set1(' ')), lv_range(v, '\t', '\r')));
+}
+
+// [A-Za-z0-9_]; OR-ing 0x20 folds upper case onto lower case.
+static inline uint32_t lv_ident_bits(const char *p)
+{
+    lex_vec v = lv_load(p);
+    lex_vec alpha = lv_range(lv_or(v, lv_set1(0x20)), 'a', 'z');
+    lex_vec digit = lv_range(v, '0', '9');
+    return lv_bits(lv_or(lv_or(alpha, digit), lv_eq(v, lv_set1('_'))));
+}
+
+// Anything but '\n' and NUL.
+static inline uint32_t lv_line_bits(const char *p)
+{
+    lex_vec v = lv_load(p);
+    return ~lv_bits(lv_or(lv_eq(v, lv_set1('\n')), lv_eq(v, lv_set1(0)))) & LEX_VEC_FULL;
+}
+
+// Length of the run starting at 's' whose bytes all satisfy 'is_class'. Most
+// runs (a single space, a short name) end within a few bytes, so those are
+// checked one at a time before switching to vectors. NUL is never in a
+// class, so the run always ends at the terminator.
+#define LEX_SCALAR_PREFIX 8
+#define LEX_SPAN(name, is_class, bits)                                                             \
+    static int name(const char *s)                                                                 \
+    {                                                                                              \
+        int len = 0;                                                                               \
+        while (len < LEX_SCALAR_PREFIX)                                                            \
+        {                                                                                          \
+            if (!is_class(s[len]))                                                                 \
+            {                                                                                      \
+                return len;                                                                        \
+            }                                                                                      \
+            len++;                                                                                 \
+        }                                                                                          \
+        const char *q = s + len;                                                                   \
+        unsigned skew = (uintptr_t)q & (LEX_VEC_BYTES - 1);                                        \
+        const char *p = q - skew;                                                                  \
+        uint32_t stop = (~bits(p) & LEX_VEC_FULL) >> skew;                                         \
+        if (stop)                                                                                  \
+        {                                                                                          \
+            return len + __builtin_ctz(stop);                                                      \
+        }                                                                                          \
+        len += LEX_VEC_BYTES - skew;                                                               \
+        for (p += LEX_VEC_BYTES;; p += LEX_VEC_BYTES, len += LEX_VEC_BYTES)                        \
+        {                                                                                          \
+            stop = ~bits(p) & LEX_VEC_FULL;                                                        \
+            if (stop)                                                                              \
+            {                                                                                      \
+                return len + __builtin_ctz(stop);                                                  \
+            }                                                                                      \
+        }                                                                                          \
+    }
+
+#define IS_SPACE_CHAR(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+#define IS_IDENT_CHAR(c)                                                                           \
+    (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z') || ((c) >= '0' && (c) <= '9') ||    \
+     (c) == '_')
+#define IS_LINE_CHAR(c) ((c) && (c) != '\n')
+
+LEX_SPAN(span_space, IS_SPACE_CHAR, lv_space_bits)
+LEX_SPAN(span_ident, IS_IDENT_CHAR, lv_ident_bits)
+LEX_SPAN(span_line, IS_LINE_CHAR, lv_line_bits)
+
+#else
+
 static int is_ident_char(char c)
 {
     return isalnum(c) || c == '_';
 }
 
-Token lexer_next(Lexer *l)
+static int span_space(const char *s)
+{
+    int len = 0;
+    while (isspace(s[len]))
+    {
+        len++;
+    }
+    return len;
+}
+
+static int span_ident(const char *s)
+{
+    int len = 0;
+    while (is_ident_char(s[len]))
+    {
+        len++;
+    }
+    return len;
+}
+
+static int span_line(const char *s)
+{
+    int len = 0;
+    while (s[len] && s[len] != '\n')
+    {
+        len++;
+    }
+    return len;
+}
+
+#endif
+
+// ** Keywords **
+// Perfect hash over the keyword set: (len + 3 * first + last) & 31 is
+// collision-free for these words. When adding a keyword, re-check that it
+// lands in an empty slot (or pick new multipliers) and keep the table in sync;
+// lexer_check_keywords(), run by 'make test', catches a table that is not.
+
+typedef struct
+{
+    const char *name;
+    int len;
+    TokenType type;
+} Keyword;
+
+#define KEYWORD_HASH(s, len) (((len) + 3 * (unsigned char)(s)[0] + (unsigned char)(s)[(len) - 1]) & 31)
+
+static const Keyword keyword_table[32] = {
+    [1] = {"or", 2, TOK_OR},
+    [3] = {"defer", 5, TOK_DEFER},
+    [5] = {"sizeof", 6, TOK_SIZEOF},
+    [7] = {"use", 3, TOK_USE},
+    [10] = {"and", 3, TOK_AND},
+    [11] = {"async", 5, TOK_ASYNC},
+    [15] = {"volatile", 8, TOK_VOLATILE},
+    [16] = {"autofree", 8, TOK_AUTOFREE},
+    [18] = {"union", 5, TOK_UNION},
+    [19] = {"asm", 3, TOK_ASM},
+    [20] = {"test", 4, TOK_TEST},
+    [22] = {"comptime", 8, TOK_COMPTIME},
+    [28] = {"await", 5, TOK_AWAIT},
+    [29] = {"assert", 6, TOK_ASSERT},
+    [30] = {"mut", 3, TOK_MUT},
+};
+
+int lexer_check_keywords(void)
+{
+    for (int i = 0; i < 32; i++)
+    {
+        const Keyword *k = &keyword_table[i];
+        if (k->name && (k->len != (int)strlen(k->name) || KEYWORD_HASH(k->name, k->len) != i))
+        {
+            fprintf(stderr, "internal error: keyword '%s' is in slot %d of the keyword table\n",
+                    k->name, i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Keyword token type for the identifier s[0..len), or TOK_IDENT.
+static TokenType keyword_type(const char *s, int len)
+{
+    const Keyword *k = &keyword_table[KEYWORD_HASH(s, len)];
+    if (k->len == len && memcmp(k->name, s, len) == 0)
+    {
+        return k->type;
+    }
+    return TOK_IDENT;
+}
+
+static Token lexer_scan(Lexer *l)
 {
     const char *s = l->src + l->pos;
     int start_line = l->line;
     int start_col = l->col;
 
-    while (isspace(*s))
+    int ws = span_space(s);
+    if (ws)
     {
-        if (*s == '\n')
-        {
-            l->line++;
-            l->col = 1;
-        }
-        else
+        int last_nl = -1;
+        for (int i = 0; i < ws; i++)
         {
-            l->col++;
+            if (s[i] == '\n')
+            {
+                l->line++;
+                last_nl = i;
+            }
         }
-        l->pos++;
-        s++;
+        l->col = (last_nl < 0) ? l->col + ws : ws - last_nl;
+        l->pos += ws;
+        s += ws;
         start_line = l->line;
         start_col = l->col;
     }
@@ -45,7 +273,7 @@ Token lexer_next(Lexer *l)
     // Check for EOF.
     if (!*s)
     {
-        return (Token){TOK_EOF, s, 0, start_line, start_col};
+        return (Token){TOK_EOF, 0, s, start_line, start_col};
     }
 
     // C preprocessor directives.
@@ -66,97 +294,30 @@ Token lexer_next(Lexer *l)
         }
         l->pos += len;
 
-        return (Token){TOK_PREPROC, s, len, start_line, start_col};
+        return (Token){TOK_PREPROC, len, s, start_line, start_col};
     }
 
     // Comments.
     if (s[0] == '/' && s[1] == '/')
     {
-        int len = 2;
-        while (s[len] && s[len] != '\n')
-        {
-            len++;
-        }
+        int len = 2 + span_line(s + 2);
         l->pos += len;
         l->col += len;
-        return lexer_next(l);
+        return lexer_scan(l);
     }
 
     // Identifiers.
     if (is_ident_start(*s))
     {
-        int len = 0;
-        while (is_ident_char(s[len]))
-        {
-            len++;
-        }
+        int len = span_ident(s);
 
         l->pos += len;
         l->col += len;
 
-        if (len == 4 && strncmp(s, "test", 4) == 0)
-        {
-            return (Token){TOK_TEST, s, 4, start_line, start_col};
-        }
-        if (len == 6 && strncmp(s, "assert", 6) == 0)
-        {
-            return (Token){TOK_ASSERT, s, 6, start_line, start_col};
-        }
-        if (len == 6 && strncmp(s, "sizeof", 6) == 0)
-        {
-            return (Token){TOK_SIZEOF, s, 6, start_line, start_col};
-        }
-        if (len == 5 && strncmp(s, "defer", 5) == 0)
-        {
-            return (Token){TOK_DEFER, s, 5, start_line, start_col};
-        }
-        if (len == 8 && strncmp(s, "autofree", 8) == 0)
+        TokenType kw = keyword_type(s, len);
+        if (kw != TOK_IDENT)
         {
-            return (Token){TOK_AUTOFREE, s, 8, start_line, start_col};
-        }
-        if (len == 3 && strncmp(s, "use", 3) == 0)
-        {
-            return (Token){TOK_USE, s, 3, start_line, start_col};
-        }
-        if (len == 3 && strncmp(s, "use", 3) == 0)
-        {
-            return (Token){TOK_USE, s, 3, start_line, start_col};
-        }
-        if (len == 8 && strncmp(s, "comptime", 8) == 0)
-        {
-            return (Token){TOK_COMPTIME, s, 8, start_line, start_col};
-        }
-        if (len == 5 && strncmp(s, "union", 5) == 0)
-        {
-            return (Token){TOK_UNION, s, 5, start_line, start_col};
-        }
-        if (len == 3 && strncmp(s, "asm", 3) == 0)
-        {
-            return (Token){TOK_ASM, s, 3, start_line, start_col};
-        }
-        if (len == 8 && strncmp(s, "volatile", 8) == 0)
-        {
-            return (Token){TOK_VOLATILE, s, 8, start_line, start_col};
-        }
-        if (len == 3 && strncmp(s, "mut", 3) == 0)
-        {
-            return (Token){TOK_MUT, s, 3, start_line, start_col};
-        }
-        if (len == 5 && strncmp(s, "async", 5) == 0)
-        {
-            return (Token){TOK_ASYNC, s, 5, start_line, start_col};
-        }
-        if (len == 5 && strncmp(s, "await", 5) == 0)
-        {
-            return (Token){TOK_AWAIT, s, 5, start_line, start_col};
-        }
-        if (len == 3 && strncmp(s, "and", 3) == 0)
-        {
-            return (Token){TOK_AND, s, 3, start_line, start_col};
-        }
-        if (len == 2 && strncmp(s, "or", 2) == 0)
-        {
-            return (Token){TOK_OR, s, 2, start_line, start_col};
+            return (Token){kw, len, s, start_line, start_col};
         }
 
         // F-Strings
@@ -168,7 +329,7 @@ Token lexer_next(Lexer *l)
         }
         else
         {
-            return (Token){TOK_IDENT, s, len, start_line, start_col};
+            return (Token){TOK_IDENT, len, s, start_line, start_col};
         }
     }
 
@@ -189,7 +350,7 @@ Token lexer_next(Lexer *l)
         }
         l->pos += len;
         l->col += len;
-        return (Token){TOK_FSTRING, s, len, start_line, start_col};
+        return (Token){TOK_FSTRING, len, s, start_line, start_col};
     }
 
     // Numbers
@@ -229,13 +390,13 @@ Token lexer_next(Lexer *l)
                     }
                     l->pos += len;
                     l->col += len;
-                    return (Token){TOK_FLOAT, s, len, start_line, start_col};
+                    return (Token){TOK_FLOAT, len, s, start_line, start_col};
                 }
             }
         }
         l->pos += len;
         l->col += len;
-        return (Token){TOK_INT, s, len, start_line, start_col};
+        return (Token){TOK_INT, len, s, start_line, start_col};
     }
 
     // Strings
@@ -256,7 +417,7 @@ Token lexer_next(Lexer *l)
         }
         l->pos += len;
         l->col += len;
-        return (Token){TOK_STRING, s, len, start_line, start_col};
+        return (Token){TOK_STRING, len, s, start_line, start_col};
     }
 
     if (*s == '\'')
@@ -279,7 +440,7 @@ Token lexer_next(Lexer *l)
 
         l->pos += len;
         l->col += len;
-        return (Token){TOK_CHAR, s, len, start_line, start_col};
+        return (Token){TOK_CHAR, len, s, start_line, start_col};
     }
 
     // Operators.
@@ -405,18 +566,155 @@ Token lexer_next(Lexer *l)
 
     l->pos += len;
     l->col += len;
-    return (Token){type, s, len, start_line, start_col};
+    return (Token){type, len, s, start_line, start_col};
 }
 
-Token lexer_peek(Lexer *l)
+void lexer_init_buffered(Lexer *l, const char *src)
+{
+    lexer_init(l, src);
+
+    TokenBuffer *buf = xmalloc(sizeof(TokenBuffer));
+    int cap = 256;
+    buf->toks = xmalloc(sizeof(BufferedToken) * cap);
+    buf->count = 0;
+
+    Lexer scan = *l;
+    while (1)
+    {
+        if (buf->count == cap)
+        {
+            cap *= 2;
+            buf->toks = xrealloc(buf->toks, sizeof(BufferedToken) * cap);
+        }
+        BufferedToken *b = &buf->toks[buf->count++];
+        b->tok = lexer_scan(&scan);
+        b->end_pos = scan.pos;
+        b->end_line = scan.line;
+        b->end_col = scan.col;
+        if (b->tok.type == TOK_EOF)
+        {
+            break;
+        }
+    }
+
+    l->tokens = buf;
+}
+
+static int buffer_scan_pos(const TokenBuffer *buf, int i)
+{
+    return i ? buf->toks[i - 1].end_pos : 0;
+}
+
+// Index of the buffered token that scanning from l->pos would produce, or -1
+// if the parser has moved the cursor somewhere no token scan starts (for
+// example into the middle of a split '>>' or a raw block).
+static int buffer_locate(const Lexer *l)
+{
+    const TokenBuffer *buf = l->tokens;
+    if (l->tok_idx < buf->count && buffer_scan_pos(buf, l->tok_idx) == l->pos)
+    {
+        return l->tok_idx;
+    }
+
+    // Cursor was rewound or copied from elsewhere; scan positions are strictly
+    // increasing, so binary search them.
+    int lo = 0;
+    int hi = buf->count - 1;
+    while (lo <= hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        int p = buffer_scan_pos(buf, mid);
+        if (p == l->pos)
+        {
+            return mid;
+        }
+        if (p < l->pos)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+// Token 'j' as it would be scanned starting from l's state at entry 'i'.
+// Some parser paths restore only l->pos, so line/col may differ from the
+// state the buffer was built with; replay the scanner's arithmetic (lines
+// only ever add up, columns shift until the first newline resets them).
+static Token buffer_token(const Lexer *l, int i, int j, int *line_out, int *col_out)
+{
+    const TokenBuffer *buf = l->tokens;
+    int scan_line = i ? buf->toks[i - 1].end_line : 1;
+    int scan_col = i ? buf->toks[i - 1].end_col : 1;
+    const BufferedToken *b = &buf->toks[j];
+
+    Token t = b->tok;
+    int dline = l->line - scan_line;
+    int dcol = (t.line == scan_line) ? l->col - scan_col : 0;
+    t.line += dline;
+    t.col += dcol;
+    if (line_out)
+    {
+        *line_out = b->end_line + dline;
+        *col_out = b->end_col + dcol;
+    }
+    return t;
+}
+
+Token lexer_next(Lexer *l)
 {
+    if (l->tokens)
+    {
+        int i = buffer_locate(l);
+        if (i >= 0)
+        {
+            int line, col;
+            Token t = buffer_token(l, i, i, &line, &col);
+            l->pos = l->tokens->toks[i].end_pos;
+            l->line = line;
+            l->col = col;
+            l->tok_idx = i + 1;
+            return t;
+        }
+    }
+    return lexer_scan(l);
+}
+
+Token lexer_peek_n(Lexer *l, int n)
+{
+    if (l->tokens)
+    {
+        int i = buffer_locate(l);
+        if (i >= 0)
+        {
+            // Everything past the end is the trailing EOF token again.
+            int j = i + n - 1;
+            if (j >= l->tokens->count)
+            {
+                j = l->tokens->count - 1;
+            }
+            return buffer_token(l, i, j, NULL, NULL);
+        }
+    }
+
     Lexer saved = *l;
-    return lexer_next(&saved);
+    Token t = lexer_next(&saved);
+    while (--n > 0)
+    {
+        t = lexer_next(&saved);
+    }
+    return t;
+}
+
+Token lexer_peek(Lexer *l)
+{
+    return lexer_peek_n(l, 1);
 }
 
 Token lexer_peek2(Lexer *l)
 {
-    Lexer saved = *l;
-    lexer_next(&saved);
-    return lexer_next(&saved);
+    return lexer_peek_n(l, 2);
 }
@@ -26,6 +26,10 @@ typedef struct
 static ParserContext *g_ctx = NULL;
 static char *g_last_src = NULL;
 
+// Everything derived from the open document (context, AST, index, cached
+// source) lives here and is dropped wholesale on the next check.
+static Arena *g_doc_arena = NULL;
+
 // Callback for parser errors.
 void lsp_on_error(void *data, Token t, const char *msg)
 {
@@ -50,12 +54,14 @@ void lsp_on_error(void *data, Token t, const char *msg)
 
 void lsp_check_file(const char *uri, const char *json_src)
 {
-    // Prepare ParserContext (persistent).
-    if (g_ctx)
+    if (!g_doc_arena)
     {
-
-        free(g_ctx);
+        g_doc_arena = arena_create("lsp-document");
     }
+    arena_reset(g_doc_arena);
+    Arena *prev_arena = arena_switch(g_doc_arena);
+
+    // Prepare ParserContext (persistent until the next check).
     g_ctx = calloc(1, sizeof(ParserContext));
     g_ctx->is_fault_tolerant = 1;
 
@@ -63,29 +69,22 @@ void lsp_check_file(const char *uri, const char *json_src)
     g_ctx->error_callback_data = &diagnostics;
     g_ctx->on_error = lsp_on_error;
 
-    // Prepare Lexer.
-    // Cache source.
-    if (g_last_src)
-    {
-        free(g_last_src);
-    }
-    g_last_src = strdup(json_src);
+    // Cache source. Tokens point into it, so lex from the cached copy.
+    g_last_src = xstrdup(json_src);
 
     Lexer l;
-    lexer_init(&l, json_src);
+    lexer_init_buffered(&l, g_last_src);
 
     ASTNode *root = parse_program(g_ctx, &l);
 
-    if (g_index)
-    {
-        lsp_index_free(g_index);
-    }
     g_index = lsp_index_new();
     if (root)
     {
         lsp_build_index(g_index, root);
     }
 
+    arena_switch(prev_arena);
+
     // Construct JSON Response (notification)
 
     char *notification = malloc(128 * 1024);
@@ -131,6 +130,11 @@ void lsp_check_file(const char *uri, const char *json_src)
         free(cur);
         cur = next;
     }
+
+    if (g_config.verbose)
+    {
+        arena_report(stderr);
+    }
 }
 
 void lsp_goto_definition(const char *uri, int line, int col)
@@ -57,7 +57,7 @@ void lsp_index_add_def(LSPIndex *idx, Token t, const char *hover, ASTNode *node)
     r->end_col = t.col - 1 + t.len;
     if (hover)
     {
-        r->hover_text = strdup(hover);
+        r->hover_text = xstrdup(hover);
     }
     r->node = node;
 
@@ -150,14 +150,15 @@ void lsp_walk_node(LSPIndex *idx, ASTNode *node)
     }
 
     // Reference logic.
-    if (node->definition_token.line > 0 && node->definition_token.line != node->token.line)
+    const Token *def = node->definition_token;
+    if (def && def->line > 0 && def->line != node->token.line)
     {
         // It has a definition!
-        lsp_index_add_ref(idx, node->token, node->definition_token, node);
+        lsp_index_add_ref(idx, node->token, *def, node);
     }
-    else if (node->definition_token.line > 0)
+    else if (def && def->line > 0)
     {
-        lsp_index_add_ref(idx, node->token, node->definition_token, node);
+        lsp_index_add_ref(idx, node->token, *def, node);
     }
 
     // General recursion.
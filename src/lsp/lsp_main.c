@@ -1,5 +1,6 @@
 
 #include "json_rpc.h"
+#include "zprep.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,10 +9,18 @@
 // Simple Main Loop for LSP.
 int lsp_main(int argc, char **argv)
 {
-    (void)argc;
-    (void)argv;
+    for (int i = 2; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "--verbose") || 0 == strcmp(argv[i], "-v"))
+        {
+            g_config.verbose = 1;
+        }
+    }
     fprintf(stderr, "zls: Zen Language Server starting...\n");
 
+    // Replies and other per-message scratch; dropped after every message.
+    Arena *request_arena = arena_create("lsp-request");
+
     while (1)
     {
         // Read headers
@@ -40,11 +49,12 @@ int lsp_main(int argc, char **argv)
         }
 
         // Read body.
+        Arena *prev_arena = arena_switch(request_arena);
         char *body = malloc(content_len + 1);
         if (fread(body, 1, content_len, stdin) != (size_t)content_len)
         {
             fprintf(stderr, "zls: Error reading body\n");
-            free(body);
+            arena_switch(prev_arena);
             break;
         }
         body[content_len] = 0;
@@ -53,8 +63,10 @@ int lsp_main(int argc, char **argv)
         fprintf(stderr, "zls: Received: %s\n", body);
         handle_request(body);
 
-        free(body);
+        arena_switch(prev_arena);
+        arena_reset(request_arena);
     }
 
+    arena_destroy(request_arena);
     return 0;
 }
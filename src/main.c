@@ -1,14 +1,24 @@
+#include "cache.h"
 #include "codegen/codegen.h"
 #include "parser/parser.h"
 #include "plugins/plugin_manager.h"
 #include "repl/repl.h"
 #include "zen/zen_facts.h"
 #include "zprep.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+extern char **environ;
+
 // Forward decl for LSP
 int lsp_main(int argc, char **argv);
 
@@ -40,9 +50,372 @@ void print_usage()
     printf("  -g              Debug info\n");
     printf("  -v, --verbose   Verbose output\n");
     printf("  -q, --quiet     Quiet output\n");
+    printf("  -j <n>          Code generation threads (default: one per CPU)\n");
+    printf("  --no-cache      Always parse and compile; don't use the caches\n");
     printf("  -c              Compile only (produce .o)\n");
 }
 
+// Runs 'cmd' through the shell (as system() did) with its stdin on a pipe.
+// Returns the child's pid and the write end in *stdin_fd, or -1.
+static pid_t spawn_cc(const char *cmd, int *stdin_fd)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return -1;
+    }
+    // Later children (the program under 'run') must not hold the pipe open.
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fflush(stdout);
+
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&fa, fds[0]);
+
+    char *argv[] = {"sh", "-c", (char *)cmd, NULL};
+    pid_t pid;
+    int rc = posix_spawn(&pid, "/bin/sh", &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    close(fds[0]);
+    if (rc != 0)
+    {
+        close(fds[1]);
+        errno = rc;
+        return -1;
+    }
+    *stdin_fd = fds[1];
+    return pid;
+}
+
+// Diagnostics and debug info name the unit after the file --emit-c writes
+// rather than '<stdin>'; line numbers match that file.
+#define CC_STDIN_HEADER "#line 1 \"out.c\"\n"
+
+static pid_t pending_cc = -1;
+
+// If codegen bails out (zpanic exits) after the compiler was started, the
+// compiler would otherwise go on to compile a truncated translation unit and
+// report errors of its own.
+static void kill_pending_cc(void)
+{
+    if (pending_cc > 0)
+    {
+        kill(pending_cc, SIGKILL);
+        waitpid(pending_cc, NULL, 0);
+    }
+}
+
+// Starts the C compiler with 'cmd', reading the translation unit from a pipe.
+// Returns its pid and the write end in *cc_in, or -1.
+static pid_t start_cc(const char *cmd, int *cc_in)
+{
+    static int registered;
+    if (g_config.verbose)
+    {
+        printf("[CMD] %s\n", cmd);
+    }
+    pid_t pid = spawn_cc(cmd, cc_in);
+    if (pid < 0)
+    {
+        perror("spawn C compiler");
+        return -1;
+    }
+    if (!registered)
+    {
+        atexit(kill_pending_cc);
+        registered = 1;
+    }
+    pending_cc = pid;
+    return pid;
+}
+
+// Sends 'out' to a compiler started by start_cc() and waits for it.
+static int finish_cc(pid_t pid, int cc_in, const OutBuf *out)
+{
+    // A compiler that dies early must not take us down with SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+    ssize_t header = sizeof(CC_STDIN_HEADER) - 1;
+    int sent = header == write(cc_in, CC_STDIN_HEADER, header) ? ob_write_fd(out, cc_in) : -1;
+    close(cc_in);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && EINTR == errno)
+    {
+    }
+    pending_cc = -1;
+    return (0 == sent && WIFEXITED(status) && 0 == WEXITSTATUS(status)) ? 0 : -1;
+}
+
+// Compiles the translation unit in 'out' with 'cmd', streamed to its stdin.
+static int compile_c(const OutBuf *out, const char *cmd)
+{
+    int cc_in;
+    pid_t pid = start_cc(cmd, &cc_in);
+    return pid < 0 ? -1 : finish_cc(pid, cc_in, out);
+}
+
+static void format_cc_cmd(char *buf, size_t size, const char *outfile)
+{
+    snprintf(buf, size, "%s %s %s %s -o %s -x c - -x none -lm %s -I./src %s", g_config.cc,
+             g_config.gcc_flags, g_cflags, g_config.is_freestanding ? "-ffreestanding" : "",
+             outfile, g_parser_ctx->has_async ? "-lpthread" : "", g_link_flags);
+}
+
+static int is_system_path(const char *path)
+{
+    static const char *const roots[] = {"/usr/", "/lib/", "/lib64/", "/opt/", "/nix/store/"};
+    for (size_t i = 0; i < sizeof(roots) / sizeof(roots[0]); i++)
+    {
+        if (0 == strncmp(path, roots[i], strlen(roots[i])))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Adds to 'h' what the user's compiler and linker flags read from outside the
+// system: files named on their own (foo.o, libbar.a) and the libraries -l
+// finds in local -L directories. Returns 0 for a local include directory,
+// whose headers cannot be listed. (zc's own -I./src only serves
+// '#include "..."', which is never cached.)
+static int hash_local_inputs(uint64_t *h)
+{
+    char flags[sizeof(g_config.gcc_flags) + 2 * MAX_FLAGS_SIZE];
+    snprintf(flags, sizeof(flags), "%s %s %s", g_config.gcc_flags, g_cflags, g_link_flags);
+    char *lib_dirs[64];
+    char *libs[64];
+    int nlib_dirs = 0;
+    int nlibs = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(flags, " \t\n", &save); tok; tok = strtok_r(NULL, " \t\n", &save))
+    {
+        static const char *const dir_flags[] = {"-I", "-isystem", "-iquote", "-idirafter", "-L"};
+        size_t flag_len = 0;
+        int is_inc = 0;
+        for (size_t i = 0; i < sizeof(dir_flags) / sizeof(dir_flags[0]) && !flag_len; i++)
+        {
+            if (0 == strncmp(tok, dir_flags[i], strlen(dir_flags[i])))
+            {
+                flag_len = strlen(dir_flags[i]);
+                is_inc = 'L' != tok[1];
+            }
+        }
+        if (flag_len)
+        {
+            char *dir = tok + flag_len;
+            if (!*dir && !(dir = strtok_r(NULL, " \t\n", &save)))
+            {
+                break;
+            }
+            if (is_system_path(dir))
+            {
+                continue;
+            }
+            if (is_inc)
+            {
+                return 0;
+            }
+            if (nlib_dirs < 64)
+            {
+                lib_dirs[nlib_dirs++] = dir;
+            }
+        }
+        else if (0 == strncmp(tok, "-l", 2) && tok[2] && nlibs < 64)
+        {
+            libs[nlibs++] = tok + 2;
+        }
+        else if ('-' != tok[0] && !is_system_path(tok) && 0 == access(tok, R_OK))
+        {
+            *h = cache_hash_str(*h, tok);
+            cache_hash_file(h, tok);
+        }
+    }
+
+    static const char *const lib_forms[] = {"%s/lib%s.so", "%s/lib%s.a"};
+    for (int i = 0; i < nlib_dirs; i++)
+    {
+        for (int j = 0; j < nlibs; j++)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                char path[PATH_MAX];
+                snprintf(path, sizeof(path), lib_forms[k], lib_dirs[i], libs[j]);
+                if (0 == access(path, R_OK))
+                {
+                    *h = cache_hash_str(*h, path);
+                    cache_hash_file(h, path);
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+// Cache key of the binary built from 'out': the C source, the compile command
+// (all flags, minus the output path), the compiler's version, the working
+// directory its relative paths resolve against and the local files it links.
+// Returns 0 when the unit pulls in local headers ('#include "..."' or a local
+// -I directory), which the key cannot see.
+static int binary_cache_key(const OutBuf *out, uint64_t *key)
+{
+    char *c_src = ob_flatten(out);
+    if (strstr(c_src, "#include \""))
+    {
+        return 0;
+    }
+    char cmd[8192];
+    char cwd[PATH_MAX];
+    format_cc_cmd(cmd, sizeof(cmd), "");
+    uint64_t h = cache_hash_str(CACHE_HASH_SEED, "zc-binary-1");
+    h = cache_hash(h, c_src, out->len);
+    h = cache_hash_str(h, cmd);
+    h = cache_hash_str(h, cache_compiler_id(g_config.cc));
+    h = cache_hash_str(h, getcwd(cwd, sizeof(cwd)) ? cwd : "");
+    if (!hash_local_inputs(&h))
+    {
+        return 0;
+    }
+    *key = h;
+    return 1;
+}
+
+// Whether the program includes a local header (include "x.h"). Such a unit
+// is never cached (see binary_cache_key).
+static int includes_local_header(ASTNode *root)
+{
+    ASTNode *n = root->root.children;
+    while (n && NODE_ROOT == n->type)
+    {
+        n = n->root.children;
+    }
+    for (; n; n = n->next)
+    {
+        if (NODE_INCLUDE == n->type && !n->include.is_system)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int copy_file(const char *from, const char *to)
+{
+    int in = open(from, O_RDONLY);
+    if (in < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (0 != fstat(in, &st))
+    {
+        close(in);
+        return -1;
+    }
+    unlink(to); // Never write into a binary that may be running.
+    int outfd = open(to, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if (outfd < 0)
+    {
+        close(in);
+        return -1;
+    }
+    char buf[65536];
+    ssize_t n;
+    int rc = 0;
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+    {
+        if (write(outfd, buf, n) != n)
+        {
+            rc = -1;
+            break;
+        }
+    }
+    if (n < 0 || close(outfd) != 0)
+    {
+        rc = -1;
+    }
+    close(in);
+    return rc;
+}
+
+static char run_dir[] = "/tmp/zc-run-XXXXXX";
+static char run_file[sizeof(run_dir) + 8];
+
+static void remove_run_file(void)
+{
+    unlink(run_file);
+    rmdir(run_dir);
+}
+
+// Where 'run' builds an uncached binary: a directory of its own, so that
+// concurrent runs in one working directory cannot overwrite each other's
+// program. It is removed at exit.
+static const char *private_run_file(void)
+{
+    if (!run_file[0])
+    {
+        if (!mkdtemp(run_dir))
+        {
+            perror("mkdtemp");
+            exit(1);
+        }
+        snprintf(run_file, sizeof(run_file), "%s/a.out", run_dir);
+        atexit(remove_run_file);
+    }
+    return run_file;
+}
+
+// Runs the program at 'path' and waits for it, ignoring ^C meanwhile as
+// system() does. Returns its exit status, or 128 + the signal that killed it.
+static int run_program(const char *path)
+{
+    fflush(NULL);
+    struct sigaction ign = {0};
+    struct sigaction old_int, old_quit;
+    ign.sa_handler = SIG_IGN;
+    sigaction(SIGINT, &ign, &old_int);
+    sigaction(SIGQUIT, &ign, &old_quit);
+
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+        sigaction(SIGINT, &old_int, NULL);
+        sigaction(SIGQUIT, &old_quit, NULL);
+        char *run_argv[] = {(char *)path, NULL};
+        execv(path, run_argv);
+        perror(path);
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0)
+    {
+        perror("fork");
+        status = 1 << 8;
+    }
+    while (pid > 0 && waitpid(pid, &status, 0) < 0 && EINTR == errno)
+    {
+    }
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGQUIT, &old_quit, NULL);
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+static int write_c_file(const OutBuf *out, const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int rc = ob_write_fd(out, fd);
+    if (close(fd) != 0)
+    {
+        rc = -1;
+    }
+    return rc;
+}
+
 int main(int argc, char **argv)
 {
     // Defaults
@@ -164,6 +537,17 @@ int main(int argc, char **argv)
             strcat(g_config.gcc_flags, " ");
             strcat(g_config.gcc_flags, arg);
         }
+        else if (strcmp(arg, "--no-cache") == 0)
+        {
+            g_config.no_cache = 1;
+        }
+        else if (strcmp(arg, "-j") == 0)
+        {
+            if (i + 1 < argc)
+            {
+                g_config.jobs = atoi(argv[++i]);
+            }
+        }
         else if (strcmp(arg, "-g") == 0)
         {
             strcat(g_config.gcc_flags, " -g");
@@ -213,6 +597,7 @@ int main(int argc, char **argv)
     // Parse context init
     ParserContext ctx;
     memset(&ctx, 0, sizeof(ctx));
+    ctx.use_module_cache = !g_config.no_cache;
 
     // Scan for build directives (e.g. //> link: -lm)
     scan_build_directives(&ctx, src);
@@ -233,7 +618,7 @@ int main(int argc, char **argv)
     zptr_register_plugin(&sql_plugin);
 
     Lexer l;
-    lexer_init(&l, src);
+    lexer_init_buffered(&l, src);
 
     ctx.hoist_out = tmpfile(); // Temp file for plugin hoisting
     if (!ctx.hoist_out)
@@ -254,6 +639,10 @@ int main(int argc, char **argv)
         // Parse failed
         return 1;
     }
+    if (!g_config.no_cache)
+    {
+        cache_trim();
+    }
 
     if (g_config.mode_check)
     {
@@ -262,85 +651,124 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    // Codegen to C
-    FILE *out = fopen("out.c", "w");
-    if (!out)
+    char cmd[8192];
+    char *outfile = g_config.output_file ? g_config.output_file : "a.out";
+
+    // When the binary cache cannot be used, the C compiler is started before
+    // codegen, reading the translation unit from a pipe: it is up and running
+    // by the time the unit is done.
+    pid_t cc_pid = -1;
+    int cc_in = -1;
+    if (!g_config.mode_transpile && (g_config.no_cache || includes_local_header(root)))
     {
-        perror("fopen out.c");
-        return 1;
+        if (g_config.verbose)
+        {
+            printf("[zc] Cache not used\n");
+        }
+        format_cc_cmd(cmd, sizeof(cmd), g_config.mode_run ? private_run_file() : outfile);
+        if ((cc_pid = start_cc(cmd, &cc_in)) < 0)
+        {
+            return 1;
+        }
     }
 
-    codegen_node(&ctx, root, out);
-    fclose(out);
+    // Codegen to C: the whole translation unit is built in memory.
+    OutBuf out = OUTBUF_INIT;
+    codegen_node(&ctx, root, &out);
 
-    if (g_config.mode_transpile)
+    if (g_config.emit_c)
     {
-        if (g_config.output_file)
+        const char *c_file = emitted_c_file();
+        if (write_c_file(&out, c_file) != 0)
         {
-            // If user specified -o, rename out.c to that
-            if (rename("out.c", g_config.output_file) != 0)
-            {
-                perror("rename out.c");
-                return 1;
-            }
-            if (!g_config.quiet)
-            {
-                printf("[zc] Transpiled to %s\n", g_config.output_file);
-            }
+            perror(c_file);
+            return 1;
         }
-        else
+        if (g_config.mode_transpile && !g_config.quiet)
         {
-            if (!g_config.quiet)
-            {
-                printf("[zc] Transpiled to out.c\n");
-            }
+            printf("[zc] Transpiled to %s\n", c_file);
         }
-        // Done, no C compilation
-        return 0;
     }
 
-    // Compile C
-    char cmd[8192];
-    char *outfile = g_config.output_file ? g_config.output_file : "a.out";
-
-    // TCC-specific adjustments?
-    // Already handled by user passing --cc tcc
-
-    snprintf(cmd, sizeof(cmd), "%s %s %s %s %s -o %s out.c -lm %s -I./src %s", g_config.cc,
-             g_config.gcc_flags, g_cflags, g_config.is_freestanding ? "-ffreestanding" : "", "",
-             outfile, g_parser_ctx->has_async ? "-lpthread" : "", g_link_flags);
-
-    if (g_config.verbose)
+    if (g_config.mode_transpile)
     {
-        printf("[CMD] %s\n", cmd);
+        // Done, no C compilation
+        return 0;
     }
 
-    int ret = system(cmd);
-    if (ret != 0)
+    // Binaries are cached by content (see binary_cache_key): an unchanged
+    // program is neither compiled again nor, under 'run', even copied out.
+    char entry[PATH_MAX];
+    uint64_t key;
+    int cached = cc_pid < 0 && binary_cache_key(&out, &key) &&
+                 cache_entry_path(entry, sizeof(entry), "bin-", key);
+    if (cached)
     {
-        printf("C compilation failed.\n");
-        if (!g_config.emit_c)
+        // An object from 'build -c' is not executable, so test existence only
+        // ('-c' is part of the key).
+        int hit = 0 == access(entry, F_OK);
+        if (g_config.verbose)
         {
-            remove("out.c");
+            printf("[zc] Cache %s: %s\n", hit ? "hit" : "miss", entry);
         }
-        return 1;
-    }
+        if (hit)
+        {
+            cache_touch(entry);
+        }
+        else
+        {
+            // Concurrent builds of the same program race benignly: each one
+            // compiles to its own temp file and renames it over the entry.
+            char tmp[PATH_MAX + 32];
+            cache_temp_path(tmp, sizeof(tmp), entry);
+            format_cc_cmd(cmd, sizeof(cmd), tmp);
+            if (compile_c(&out, cmd) != 0 || rename(tmp, entry) != 0)
+            {
+                unlink(tmp);
+                printf("C compilation failed.\n");
+                return 1;
+            }
+        }
+        ob_free(&out);
 
-    if (!g_config.emit_c)
-    {
-        // remove("out.c"); // Keep it for debugging for now or follow flag
-        remove("out.c");
+        if (g_config.mode_run)
+        {
+            int ret = run_program(entry);
+            zptr_plugin_mgr_cleanup();
+            zen_trigger_global();
+            return ret;
+        }
+        if (copy_file(entry, outfile) != 0)
+        {
+            perror(outfile);
+            return 1;
+        }
     }
-
-    if (g_config.mode_run)
+    else
     {
-        char run_cmd[2048];
-        sprintf(run_cmd, "./%s", outfile);
-        ret = system(run_cmd);
-        remove(outfile);
-        zptr_plugin_mgr_cleanup();
-        zen_trigger_global();
-        return ret;
+        if (cc_pid < 0)
+        {
+            if (g_config.verbose)
+            {
+                printf("[zc] Cache not used\n");
+            }
+            format_cc_cmd(cmd, sizeof(cmd), g_config.mode_run ? private_run_file() : outfile);
+            cc_pid = start_cc(cmd, &cc_in);
+        }
+        if (cc_pid < 0 || finish_cc(cc_pid, cc_in, &out) != 0)
+        {
+            printf("C compilation failed.\n");
+            return 1;
+        }
+        ob_free(&out);
+
+        if (g_config.mode_run)
+        {
+            int ret = run_program(private_run_file());
+            zptr_plugin_mgr_cleanup();
+            zen_trigger_global();
+            return ret;
+        }
     }
 
     zptr_plugin_mgr_cleanup();
@@ -0,0 +1,2702 @@
+
+#include "parser.h"
+#include "zprep.h"
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// ** Comptime interpreter **
+// A comptime block used to be compiled as a C program and run, which costs a
+// C compiler invocation per block. Most blocks are loops over a few variables
+// that print code, so they are evaluated here instead, with the semantics of
+// the C they would have compiled to: integer literals are unsigned long long,
+// the usual arithmetic conversions apply, print sugar runs the fprintf calls it
+// was lowered to. Anything outside that subset - includes, declarations, raw
+// C, behaviour that is undefined or compiler-specific in C - gives up, and the
+// caller compiles the block as before. Giving up is always safe, so the
+// interpreter only has to be exact for what it accepts.
+
+#define CT_MAX_STEPS 2000000L           // Past this, compiling the block is likely faster.
+#define CT_MAX_STACK (4 * 1024 * 1024)  // Arrays; the compiled program keeps them on its stack.
+#define CT_CHUNK_SIZE (64 * 1024)
+#define CT_MAX_ARGS 32
+#define CT_MAX_WIDTH 4096 // printf widths and precisions.
+
+typedef enum
+{
+    CT_BOOL,
+    CT_CHAR,
+    CT_SCHAR,
+    CT_UCHAR,
+    CT_SHORT,
+    CT_USHORT,
+    CT_INT, // Each signed type from here is followed by its unsigned one.
+    CT_UINT,
+    CT_LONG,
+    CT_ULONG,
+    CT_LLONG,
+    CT_ULLONG,
+    CT_FLOAT,
+    CT_DOUBLE,
+    CT_STR // char*
+} CtType;
+
+static const struct
+{
+    int size;
+    int is_signed;
+    int rank;
+    const char *z_str; // What the preamble's _z_str() picks.
+} ct_types[] = {
+    [CT_BOOL] = {1, 0, 0, "%d"},    [CT_CHAR] = {1, 1, 1, "%c"},   [CT_SCHAR] = {1, 1, 1, "%c"},
+    [CT_UCHAR] = {1, 0, 1, "%u"},   [CT_SHORT] = {2, 1, 2, "%d"},  [CT_USHORT] = {2, 0, 2, "%u"},
+    [CT_INT] = {4, 1, 3, "%d"},     [CT_UINT] = {4, 0, 3, "%u"},   [CT_LONG] = {8, 1, 4, "%ld"},
+    [CT_ULONG] = {8, 0, 4, "%lu"},  [CT_LLONG] = {8, 1, 5, "%lld"}, [CT_ULLONG] = {8, 0, 5, "%llu"},
+    [CT_FLOAT] = {4, 1, 0, "%f"},   [CT_DOUBLE] = {8, 1, 0, "%f"}, [CT_STR] = {8, 0, 0, "%s"},
+};
+
+// The spellings a block's types reach C with (LP64, glibc).
+static const struct
+{
+    const char *name;
+    CtType type;
+} ct_type_names[] = {
+    {"bool", CT_BOOL},
+    {"_Bool", CT_BOOL},
+    {"char", CT_CHAR},
+    {"signed char", CT_SCHAR},
+    {"int8_t", CT_SCHAR},
+    {"I8", CT_SCHAR},
+    {"unsigned char", CT_UCHAR},
+    {"uint8_t", CT_UCHAR},
+    {"U8", CT_UCHAR},
+    {"short", CT_SHORT},
+    {"int16_t", CT_SHORT},
+    {"I16", CT_SHORT},
+    {"unsigned short", CT_USHORT},
+    {"uint16_t", CT_USHORT},
+    {"U16", CT_USHORT},
+    {"int", CT_INT},
+    {"int32_t", CT_INT},
+    {"I32", CT_INT},
+    {"unsigned", CT_UINT},
+    {"unsigned int", CT_UINT},
+    {"uint32_t", CT_UINT},
+    {"U32", CT_UINT},
+    {"long", CT_LONG},
+    {"int64_t", CT_LONG},
+    {"I64", CT_LONG},
+    {"ssize_t", CT_LONG},
+    {"ptrdiff_t", CT_LONG},
+    {"intptr_t", CT_LONG},
+    {"unsigned long", CT_ULONG},
+    {"uint64_t", CT_ULONG},
+    {"U64", CT_ULONG},
+    {"size_t", CT_ULONG},
+    {"usize", CT_ULONG},
+    {"uintptr_t", CT_ULONG},
+    {"long long", CT_LLONG},
+    {"unsigned long long", CT_ULLONG},
+    {"float", CT_FLOAT},
+    {"F32", CT_FLOAT},
+    {"double", CT_DOUBLE},
+    {"F64", CT_DOUBLE},
+    {"string", CT_STR},
+    {"char*", CT_STR},
+    {"char *", CT_STR},
+};
+
+typedef struct
+{
+    CtType type;
+    uint64_t i; // Integers, sign- or zero-extended from their width.
+    double f;   // CT_FLOAT holds values a float can represent.
+    char *s;    // CT_STR, and the bytes it may reach: [lo, hi).
+    char *lo;
+    char *hi;
+    int read_only; // Points into a string literal.
+    int is_array;  // An array expression: _Generic would not see a char*.
+} Value;
+
+typedef struct
+{
+    const char *name;
+    size_t len;
+    CtType type;
+    int count; // Array length; 0 for scalars.
+    int is_const;
+    int is_set;         // Scalars: holds a value.
+    Value val;          // Scalars.
+    unsigned char *mem; // Arrays.
+} CtVar;
+
+// Array storage: a stack of chunks that never move, popped with the scopes.
+typedef struct CtChunk
+{
+    struct CtChunk *prev;
+    size_t cap;
+    size_t used;
+    unsigned char data[];
+} CtChunk;
+
+// A decoded string literal, by where it is spelled: a literal is decoded
+// once however often it is evaluated, and keeps one address, as in C.
+typedef struct
+{
+    const char *key;
+    const char *end; // C text: just past the literal.
+    Value val;
+} CtLiteral;
+
+typedef struct
+{
+    CtVar *vars;
+    int nvars;
+    int cap;
+    int scope; // First variable of the innermost scope.
+    CtChunk *chunk;
+    CtChunk *spare; // Popped chunks, for reuse.
+    size_t stack;   // Bytes of array storage in use.
+    long steps;
+    CtLiteral *lits; // Open addressing, by key.
+    int nlits;
+    int lits_cap;
+    OutBuf out;
+    OutBuf err;
+    const char *why; // Why the block cannot be interpreted.
+} Ct;
+
+typedef struct
+{
+    int nvars;
+    int scope;
+    CtChunk *chunk;
+    size_t used;
+    size_t stack;
+} CtMark;
+
+// Where an assignment goes: a scalar variable, or memory.
+typedef struct
+{
+    CtType type;
+    int var; // -1 for memory.
+    unsigned char *mem;
+    int read_only;
+} CtRef;
+
+typedef enum
+{
+    CT_NEXT,
+    CT_BREAK,
+    CT_CONTINUE,
+    CT_FAIL
+} CtFlow;
+
+static int ct_fail(Ct *e, const char *why)
+{
+    if (!e->why)
+    {
+        e->why = why;
+    }
+    return 0;
+}
+
+static int ct_step(Ct *e)
+{
+    if (++e->steps > CT_MAX_STEPS)
+    {
+        return ct_fail(e, "runs too long");
+    }
+    return !e->why;
+}
+
+// ** Values **
+
+static int ct_is_int(CtType t)
+{
+    return t <= CT_ULLONG;
+}
+
+static int ct_is_float(CtType t)
+{
+    return CT_FLOAT == t || CT_DOUBLE == t;
+}
+
+static int ct_bits(CtType t)
+{
+    return ct_types[t].size * 8;
+}
+
+// What storing 'x' in a 't' keeps of it, extended back to 64 bits.
+static uint64_t ct_wrap(CtType t, uint64_t x)
+{
+    int bits = ct_bits(t);
+    if (bits >= 64)
+    {
+        return x;
+    }
+    uint64_t mask = (1ULL << bits) - 1;
+    x &= mask;
+    if (ct_types[t].is_signed && (x >> (bits - 1)) & 1)
+    {
+        x |= ~mask;
+    }
+    return x;
+}
+
+static Value ct_int(CtType t, uint64_t x)
+{
+    Value v = {0};
+    v.type = t;
+    v.i = CT_BOOL == t ? x != 0 : ct_wrap(t, x);
+    return v;
+}
+
+static Value ct_float(CtType t, double f)
+{
+    Value v = {0};
+    v.type = t;
+    v.f = CT_FLOAT == t ? (float)f : f;
+    return v;
+}
+
+static Value ct_typed(CtType t)
+{
+    Value v = {0};
+    v.type = t;
+    return v;
+}
+
+static int ct_truth(Value v)
+{
+    if (CT_STR == v.type)
+    {
+        return 1; // Never NULL.
+    }
+    return ct_is_float(v.type) ? v.f != 0 : v.i != 0;
+}
+
+static CtType ct_promote(CtType t)
+{
+    return ct_is_int(t) && ct_types[t].rank < ct_types[CT_INT].rank ? CT_INT : t;
+}
+
+// The usual arithmetic conversions.
+static CtType ct_common(CtType a, CtType b)
+{
+    if (CT_DOUBLE == a || CT_DOUBLE == b)
+    {
+        return CT_DOUBLE;
+    }
+    if (CT_FLOAT == a || CT_FLOAT == b)
+    {
+        return CT_FLOAT;
+    }
+    a = ct_promote(a);
+    b = ct_promote(b);
+    if (a == b)
+    {
+        return a;
+    }
+    if (ct_types[a].is_signed == ct_types[b].is_signed)
+    {
+        return ct_types[a].rank > ct_types[b].rank ? a : b;
+    }
+    CtType u = ct_types[a].is_signed ? b : a;
+    CtType s = ct_types[a].is_signed ? a : b;
+    if (ct_types[u].rank >= ct_types[s].rank)
+    {
+        return u;
+    }
+    return ct_types[s].size > ct_types[u].size ? s : (CtType)(s + 1);
+}
+
+static int ct_convert(Ct *e, Value v, CtType to, int live, Value *out)
+{
+    if (v.type == to)
+    {
+        *out = v;
+        return 1;
+    }
+    if (CT_STR == to || CT_STR == v.type)
+    {
+        return ct_fail(e, "pointer conversion");
+    }
+    if (!live)
+    {
+        *out = ct_typed(to);
+        return 1;
+    }
+    int from_signed = ct_types[v.type].is_signed;
+    if (CT_BOOL == to)
+    {
+        *out = ct_int(to, ct_is_float(v.type) ? v.f != 0 : v.i != 0);
+    }
+    else if (CT_FLOAT == to)
+    {
+        float f = ct_is_float(v.type) ? (float)v.f
+                  : from_signed       ? (float)(int64_t)v.i
+                                      : (float)v.i;
+        *out = ct_float(to, f);
+    }
+    else if (CT_DOUBLE == to)
+    {
+        double f = ct_is_float(v.type) ? v.f : from_signed ? (double)(int64_t)v.i : (double)v.i;
+        *out = ct_float(to, f);
+    }
+    else if (ct_is_float(v.type))
+    {
+        int is_signed = ct_types[to].is_signed;
+        double lim = ldexp(1.0, ct_bits(to) - is_signed);
+        double t = trunc(v.f);
+        if (!(is_signed ? (t >= -lim && t < lim) : (t >= 0 && t < lim)))
+        {
+            return ct_fail(e, "float out of the integer type's range");
+        }
+        *out = ct_int(to, is_signed ? (uint64_t)(int64_t)t : (uint64_t)t);
+    }
+    else
+    {
+        *out = ct_int(to, v.i);
+    }
+    return 1;
+}
+
+// Default argument promotions, for variadic arguments.
+static int ct_vararg(Ct *e, Value v, int live, Value *out)
+{
+    if (CT_FLOAT == v.type)
+    {
+        return ct_convert(e, v, CT_DOUBLE, live, out);
+    }
+    return ct_convert(e, v, ct_promote(v.type), live, out);
+}
+
+static int ct_type_named(const char *name, size_t len, CtType *out)
+{
+    for (size_t i = 0; i < sizeof(ct_type_names) / sizeof(ct_type_names[0]); i++)
+    {
+        if (strlen(ct_type_names[i].name) == len && 0 == strncmp(ct_type_names[i].name, name, len))
+        {
+            *out = ct_type_names[i].type;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Decodes the C escapes in [s, end) into 'out'. Returns the length, or -1.
+static long ct_unescape(const char *s, const char *end, char *out)
+{
+    long n = 0;
+    while (s < end)
+    {
+        if (*s != '\\')
+        {
+            out[n++] = *s++;
+            continue;
+        }
+        if (++s >= end)
+        {
+            return -1;
+        }
+        char c = *s++;
+        switch (c)
+        {
+        case 'n':
+            out[n++] = '\n';
+            break;
+        case 't':
+            out[n++] = '\t';
+            break;
+        case 'r':
+            out[n++] = '\r';
+            break;
+        case 'a':
+            out[n++] = '\a';
+            break;
+        case 'b':
+            out[n++] = '\b';
+            break;
+        case 'f':
+            out[n++] = '\f';
+            break;
+        case 'v':
+            out[n++] = '\v';
+            break;
+        case 'e':
+        case 'E':
+            out[n++] = 27;
+            break;
+        case '\\':
+        case '\'':
+        case '"':
+        case '?':
+            out[n++] = c;
+            break;
+        case 'x':
+        {
+            unsigned v = 0;
+            int digits = 0;
+            while (s < end && isxdigit((unsigned char)*s))
+            {
+                v = v * 16 + (isdigit((unsigned char)*s) ? *s - '0' : (tolower(*s) - 'a' + 10));
+                s++;
+                if (++digits > 2 && v > 0xFF)
+                {
+                    return -1;
+                }
+            }
+            if (!digits || v > 0xFF)
+            {
+                return -1;
+            }
+            out[n++] = (char)v;
+            break;
+        }
+        default:
+            if (c >= '0' && c <= '7')
+            {
+                unsigned v = c - '0';
+                for (int k = 0; k < 2 && s < end && *s >= '0' && *s <= '7'; k++)
+                {
+                    v = v * 8 + (*s++ - '0');
+                }
+                if (v > 0xFF)
+                {
+                    return -1;
+                }
+                out[n++] = (char)v;
+                break;
+            }
+            return -1;
+        }
+    }
+    return n;
+}
+
+// A string literal whose body (between the quotes) is [s, end).
+static int ct_string(Ct *e, const char *s, const char *end, Value *out)
+{
+    char *buf = xmalloc(end - s + 1);
+    long n = ct_unescape(s, end, buf);
+    if (n < 0)
+    {
+        return ct_fail(e, "unsupported escape");
+    }
+    buf[n] = 0;
+    *out = ct_typed(CT_STR);
+    out->s = out->lo = buf;
+    out->hi = buf + n + 1;
+    out->read_only = 1;
+    out->is_array = 1;
+    return 1;
+}
+
+// The entry for the literal at 'key', with val.s NULL if it is new.
+static CtLiteral *ct_literal(Ct *e, const char *key)
+{
+    if (2 * (e->nlits + 1) > e->lits_cap)
+    {
+        CtLiteral *old = e->lits;
+        int old_cap = e->lits_cap;
+        e->lits_cap = old_cap ? old_cap * 2 : 64;
+        e->lits = xcalloc(e->lits_cap, sizeof(CtLiteral));
+        e->nlits = 0;
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (old[i].key)
+            {
+                *ct_literal(e, old[i].key) = old[i];
+            }
+        }
+    }
+    size_t mask = e->lits_cap - 1;
+    size_t i = (size_t)(((uintptr_t)key >> 2) * 0x9E3779B97F4A7C15ULL) & mask;
+    while (e->lits[i].key && e->lits[i].key != key)
+    {
+        i = (i + 1) & mask;
+    }
+    if (!e->lits[i].key)
+    {
+        e->lits[i].key = key;
+        e->nlits++;
+    }
+    return &e->lits[i];
+}
+
+// The format string _z_str() picks for a 't'.
+static int ct_z_str(Ct *e, CtType t, Value *out)
+{
+    const char *f = ct_types[t].z_str;
+    CtLiteral *lit = ct_literal(e, f);
+    if (!lit->val.s && !ct_string(e, f, f + strlen(f), &lit->val))
+    {
+        return 0;
+    }
+    *out = lit->val;
+    return 1;
+}
+
+static int ct_char(Ct *e, const char *s, const char *end, Value *out)
+{
+    char buf[8];
+    if (end - s > 4 || 1 != ct_unescape(s, end, buf))
+    {
+        return ct_fail(e, "unsupported character literal");
+    }
+    *out = ct_int(CT_INT, (uint64_t)(int64_t)(signed char)buf[0]);
+    return 1;
+}
+
+// ** Variables **
+
+static CtMark ct_mark(Ct *e)
+{
+    CtMark m = {e->nvars, e->scope, e->chunk, e->chunk ? e->chunk->used : 0, e->stack};
+    return m;
+}
+
+static void ct_enter(Ct *e)
+{
+    e->scope = e->nvars;
+}
+
+static void ct_release(Ct *e, CtMark m)
+{
+    while (e->chunk != m.chunk)
+    {
+        CtChunk *c = e->chunk;
+        e->chunk = c->prev;
+        c->prev = e->spare;
+        e->spare = c;
+    }
+    if (e->chunk)
+    {
+        e->chunk->used = m.used;
+    }
+    e->nvars = m.nvars;
+    e->scope = m.scope;
+    e->stack = m.stack;
+}
+
+static unsigned char *ct_alloc(Ct *e, size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+    if (e->stack + size > CT_MAX_STACK)
+    {
+        ct_fail(e, "arrays too large");
+        return NULL;
+    }
+    if (!e->chunk || e->chunk->cap - e->chunk->used < size)
+    {
+        CtChunk *c = e->spare;
+        if (c && c->cap >= size)
+        {
+            e->spare = c->prev;
+        }
+        else
+        {
+            size_t cap = size > CT_CHUNK_SIZE ? size : CT_CHUNK_SIZE;
+            c = xmalloc(sizeof(CtChunk) + cap);
+            c->cap = cap;
+        }
+        c->used = 0;
+        c->prev = e->chunk;
+        e->chunk = c;
+    }
+    unsigned char *p = e->chunk->data + e->chunk->used;
+    e->chunk->used += size;
+    e->stack += size;
+    memset(p, 0, size);
+    return p;
+}
+
+static int ct_find(Ct *e, const char *name, size_t len)
+{
+    for (int i = e->nvars - 1; i >= 0; i--)
+    {
+        if (e->vars[i].len == len && 0 == memcmp(e->vars[i].name, name, len))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static CtVar *ct_declare(Ct *e, const char *name, CtType type, int count)
+{
+    for (int i = e->scope; i < e->nvars; i++)
+    {
+        if (0 == strcmp(e->vars[i].name, name))
+        {
+            ct_fail(e, "redeclaration");
+            return NULL;
+        }
+    }
+    if (e->nvars == e->cap)
+    {
+        e->cap = e->cap ? e->cap * 2 : 16;
+        e->vars = xrealloc(e->vars, sizeof(CtVar) * e->cap);
+    }
+    CtVar *v = &e->vars[e->nvars++];
+    memset(v, 0, sizeof(*v));
+    v->name = name;
+    v->len = strlen(name);
+    v->type = type;
+    v->count = count;
+    if (count)
+    {
+        v->mem = ct_alloc(e, (size_t)count * ct_types[type].size);
+        v->is_set = 1;
+        if (!v->mem)
+        {
+            return NULL;
+        }
+    }
+    return v;
+}
+
+// A char array used as a value decays to a char*.
+static int ct_decay(Ct *e, CtVar *v, Value *out)
+{
+    if (v->type != CT_CHAR)
+    {
+        return ct_fail(e, "array used as a value");
+    }
+    *out = ct_typed(CT_STR);
+    out->s = out->lo = (char *)v->mem;
+    out->hi = (char *)v->mem + v->count;
+    out->is_array = 1;
+    return 1;
+}
+
+static Value ct_read(CtType t, const unsigned char *p)
+{
+    switch (t)
+    {
+    case CT_FLOAT:
+    {
+        float f;
+        memcpy(&f, p, sizeof(f));
+        return ct_float(t, f);
+    }
+    case CT_DOUBLE:
+    {
+        double f;
+        memcpy(&f, p, sizeof(f));
+        return ct_float(t, f);
+    }
+    default:
+    {
+        uint64_t x = 0;
+        memcpy(&x, p, ct_types[t].size); // Little-endian.
+        return ct_int(t, x);
+    }
+    }
+}
+
+static void ct_write(Value v, unsigned char *p)
+{
+    if (CT_FLOAT == v.type)
+    {
+        float f = (float)v.f;
+        memcpy(p, &f, sizeof(f));
+    }
+    else if (CT_DOUBLE == v.type)
+    {
+        memcpy(p, &v.f, sizeof(v.f));
+    }
+    else
+    {
+        memcpy(p, &v.i, ct_types[v.type].size);
+    }
+}
+
+static int ct_load(Ct *e, CtRef r, int live, Value *out)
+{
+    if (!live)
+    {
+        *out = ct_typed(r.type);
+        return 1;
+    }
+    if (r.var < 0)
+    {
+        *out = ct_read(r.type, r.mem);
+        return 1;
+    }
+    CtVar *v = &e->vars[r.var];
+    if (!v->is_set)
+    {
+        return ct_fail(e, "read of an uninitialized variable");
+    }
+    *out = v->val;
+    return 1;
+}
+
+static int ct_store(Ct *e, CtRef r, Value v, int live, Value *out)
+{
+    if (r.read_only)
+    {
+        return ct_fail(e, "write to a string literal");
+    }
+    if (!ct_convert(e, v, r.type, live, &v))
+    {
+        return 0;
+    }
+    v.is_array = 0;
+    if (live)
+    {
+        if (r.var < 0)
+        {
+            ct_write(v, r.mem);
+        }
+        else
+        {
+            e->vars[r.var].val = v;
+            e->vars[r.var].is_set = 1;
+        }
+    }
+    *out = v;
+    return 1;
+}
+
+// Element 'index' of an array variable, or the char 'index' past a string.
+static int ct_element(Ct *e, CtVar *arr, Value base, Value index, int live, CtRef *out)
+{
+    if (!ct_is_int(index.type))
+    {
+        return ct_fail(e, "non-integer index");
+    }
+    out->var = -1;
+    out->type = arr ? arr->type : CT_CHAR;
+    out->read_only = arr ? 0 : base.read_only;
+    out->mem = NULL;
+    if (!live)
+    {
+        return 1;
+    }
+    int64_t i = (int64_t)index.i;
+    if (!ct_types[index.type].is_signed && index.i > INT64_MAX)
+    {
+        return ct_fail(e, "index out of bounds");
+    }
+    if (arr)
+    {
+        if (i < 0 || i >= arr->count)
+        {
+            return ct_fail(e, "index out of bounds");
+        }
+        out->mem = arr->mem + i * ct_types[arr->type].size;
+        return 1;
+    }
+    if (i < base.lo - base.s || i >= base.hi - base.s)
+    {
+        return ct_fail(e, "index out of bounds");
+    }
+    out->mem = (unsigned char *)base.s + i;
+    return 1;
+}
+
+// Length of the string 'v' points to, if it ends within its bounds.
+static int ct_strlen(Ct *e, Value v, size_t *len)
+{
+    if (CT_STR != v.type)
+    {
+        return ct_fail(e, "expected a string");
+    }
+    if (v.s < v.lo || v.s >= v.hi)
+    {
+        return ct_fail(e, "string out of bounds");
+    }
+    const char *nul = memchr(v.s, 0, v.hi - v.s);
+    if (!nul)
+    {
+        return ct_fail(e, "unterminated string");
+    }
+    *len = nul - v.s;
+    return 1;
+}
+
+// ** Operators **
+
+static int ct_shift(Ct *e, const char *op, Value a, Value b, int live, Value *out)
+{
+    if (!ct_is_int(a.type) || !ct_is_int(b.type))
+    {
+        return ct_fail(e, "shift of a non-integer");
+    }
+    CtType t = ct_promote(a.type);
+    if (!ct_convert(e, a, t, live, &a) || !ct_convert(e, b, ct_promote(b.type), live, &b))
+    {
+        return 0;
+    }
+    if (!live)
+    {
+        *out = ct_typed(t);
+        return 1;
+    }
+    int bits = ct_bits(t);
+    if ((ct_types[b.type].is_signed && (int64_t)b.i < 0) || b.i >= (uint64_t)bits)
+    {
+        return ct_fail(e, "shift count out of range");
+    }
+    int c = (int)b.i;
+    if ('>' == op[0])
+    {
+        *out = ct_int(t, ct_types[t].is_signed ? (uint64_t)((int64_t)a.i >> c) : a.i >> c);
+        return 1;
+    }
+    if (ct_types[t].is_signed)
+    {
+        int64_t max = bits >= 64 ? INT64_MAX : (int64_t)((1ULL << (bits - 1)) - 1);
+        if ((int64_t)a.i < 0 || (int64_t)a.i > (max >> c))
+        {
+            return ct_fail(e, "signed shift overflow");
+        }
+    }
+    *out = ct_int(t, a.i << c);
+    return 1;
+}
+
+// Whether the signed 'x' fits in 't'.
+static int ct_fits(CtType t, int64_t x)
+{
+    return (int64_t)ct_wrap(t, (uint64_t)x) == x;
+}
+
+static int ct_binary(Ct *e, const char *op, Value a, Value b, int live, Value *out)
+{
+    if (CT_STR == a.type || CT_STR == b.type)
+    {
+        return ct_fail(e, "pointer arithmetic");
+    }
+    char o0 = op[0], o1 = o0 ? op[1] : 0;
+    if (o1 && op[2])
+    {
+        return ct_fail(e, "unsupported operator");
+    }
+    if (('<' == o0 || '>' == o0) && o1 == o0)
+    {
+        return ct_shift(e, op, a, b, live, out);
+    }
+
+    int cmp = (('<' == o0 || '>' == o0) && (!o1 || '=' == o1)) ||
+              (('=' == o0 || '!' == o0) && '=' == o1);
+    int bitwise = !o1 && ('&' == o0 || '|' == o0 || '^' == o0);
+    int arith = o0 && !o1 && strchr("+-*/%", o0);
+    if (!cmp && !bitwise && !arith)
+    {
+        return ct_fail(e, "unsupported operator");
+    }
+    CtType t = ct_common(a.type, b.type);
+    if (ct_is_float(t) && (bitwise || '%' == op[0]))
+    {
+        return ct_fail(e, "integer operator on a float");
+    }
+    if (!ct_convert(e, a, t, live, &a) || !ct_convert(e, b, t, live, &b))
+    {
+        return 0;
+    }
+    if (!live)
+    {
+        *out = ct_typed(cmp ? CT_INT : t);
+        return 1;
+    }
+
+    if (cmp)
+    {
+        int lt, eq;
+        if (ct_is_float(t))
+        {
+            lt = a.f < b.f;
+            eq = a.f == b.f;
+            if (isnan(a.f) || isnan(b.f))
+            {
+                // Every comparison but != is false.
+                *out = ct_int(CT_INT, 0 == strcmp(op, "!="));
+                return 1;
+            }
+        }
+        else
+        {
+            lt = ct_types[t].is_signed ? (int64_t)a.i < (int64_t)b.i : a.i < b.i;
+            eq = a.i == b.i;
+        }
+        int r = '<' == op[0] ? (op[1] ? lt || eq : lt)
+                : '>' == op[0] ? (op[1] ? !lt : !lt && !eq)
+                : '=' == op[0] ? eq
+                               : !eq;
+        *out = ct_int(CT_INT, r);
+        return 1;
+    }
+
+    if (CT_FLOAT == t)
+    {
+        float x = (float)a.f, y = (float)b.f, r;
+        switch (op[0])
+        {
+        case '+':
+            r = x + y;
+            break;
+        case '-':
+            r = x - y;
+            break;
+        case '*':
+            r = x * y;
+            break;
+        default:
+            r = x / y;
+            break;
+        }
+        *out = ct_float(t, r);
+        return 1;
+    }
+    if (CT_DOUBLE == t)
+    {
+        double x = a.f, y = b.f;
+        *out = ct_float(t, '+' == op[0]   ? x + y
+                           : '-' == op[0] ? x - y
+                           : '*' == op[0] ? x * y
+                                          : x / y);
+        return 1;
+    }
+
+    uint64_t x = a.i, y = b.i, r;
+    if (bitwise)
+    {
+        r = '&' == op[0] ? x & y : '|' == op[0] ? x | y : x ^ y;
+        *out = ct_int(t, r);
+        return 1;
+    }
+    if (('/' == op[0] || '%' == op[0]) && 0 == y)
+    {
+        return ct_fail(e, "division by zero");
+    }
+    if (!ct_types[t].is_signed)
+    {
+        r = '+' == op[0]   ? x + y
+            : '-' == op[0] ? x - y
+            : '*' == op[0] ? x * y
+            : '/' == op[0] ? x / y
+                           : x % y;
+        *out = ct_int(t, r);
+        return 1;
+    }
+
+    // Signed overflow is undefined; leave it to the compiled program.
+    int64_t sx = (int64_t)x, sy = (int64_t)y, sr;
+    int overflow = 0;
+    switch (op[0])
+    {
+    case '+':
+        overflow = __builtin_add_overflow(sx, sy, &sr);
+        break;
+    case '-':
+        overflow = __builtin_sub_overflow(sx, sy, &sr);
+        break;
+    case '*':
+        overflow = __builtin_mul_overflow(sx, sy, &sr);
+        break;
+    default:
+        overflow = INT64_MIN == sx && -1 == sy;
+        sr = overflow ? 0 : '/' == op[0] ? sx / sy : sx % sy;
+        if (!overflow && '%' == op[0] && !ct_fits(t, sx / sy))
+        {
+            overflow = 1;
+        }
+        break;
+    }
+    if (overflow || !ct_fits(t, sr))
+    {
+        return ct_fail(e, "signed overflow");
+    }
+    *out = ct_int(t, (uint64_t)sr);
+    return 1;
+}
+
+static int ct_unary(Ct *e, char op, Value a, int live, Value *out)
+{
+    if (CT_STR == a.type)
+    {
+        if ('!' == op)
+        {
+            *out = ct_int(CT_INT, 0);
+            return 1;
+        }
+        return ct_fail(e, "pointer arithmetic");
+    }
+    if ('!' == op)
+    {
+        *out = ct_int(CT_INT, live && !ct_truth(a));
+        return 1;
+    }
+    if ('~' == op && !ct_is_int(a.type))
+    {
+        return ct_fail(e, "~ on a float");
+    }
+    if (!ct_convert(e, a, ct_promote(a.type), live, &a))
+    {
+        return 0;
+    }
+    if (!live || '+' == op)
+    {
+        *out = a;
+        return 1;
+    }
+    if ('~' == op)
+    {
+        *out = ct_int(a.type, ~a.i);
+    }
+    else if (ct_is_float(a.type))
+    {
+        *out = ct_float(a.type, -a.f);
+    }
+    else
+    {
+        int64_t x = (int64_t)a.i;
+        if (ct_types[a.type].is_signed && (INT64_MIN == x || !ct_fits(a.type, -x)))
+        {
+            return ct_fail(e, "signed overflow");
+        }
+        *out = ct_int(a.type, 0 - a.i);
+    }
+    return 1;
+}
+
+// ?: with both branches typed; 'pick' is the one that was evaluated.
+static int ct_choose(Ct *e, Value a, Value b, Value pick, int live, Value *out)
+{
+    if (CT_STR == a.type && CT_STR == b.type)
+    {
+        *out = pick;
+        out->is_array = 0;
+        return 1;
+    }
+    if (CT_STR == a.type || CT_STR == b.type)
+    {
+        return ct_fail(e, "mixed ?: operands");
+    }
+    return ct_convert(e, pick, ct_common(a.type, b.type), live, out);
+}
+
+// ** printf **
+
+// Where formatted text goes: a stream, or sprintf's destination.
+typedef struct
+{
+    OutBuf *ob;
+    char *dst;
+    size_t room;
+    size_t len; // Bytes produced, written or not.
+} CtSink;
+
+static void ct_emit(CtSink *k, const char *p, size_t n)
+{
+    if (k->ob)
+    {
+        ob_write(k->ob, p, n);
+    }
+    else if (k->len < k->room)
+    {
+        memcpy(k->dst + k->len, p, n < k->room - k->len ? n : k->room - k->len);
+    }
+    k->len += n;
+}
+
+static int ct_take_arg(Ct *e, const Value *args, int nargs, int *next, Value *out)
+{
+    if (*next >= nargs)
+    {
+        return ct_fail(e, "too few printf arguments");
+    }
+    *out = args[(*next)++];
+    return 1;
+}
+
+// An int argument for '*'.
+static int ct_star(Ct *e, const Value *args, int nargs, int *next, int *out)
+{
+    Value v;
+    if (!ct_take_arg(e, args, nargs, next, &v))
+    {
+        return 0;
+    }
+    if (CT_INT != v.type && CT_UINT != v.type)
+    {
+        return ct_fail(e, "printf '*' argument is not an int");
+    }
+    *out = (int)(int32_t)v.i;
+    return 1;
+}
+
+// Runs printf(fmt, args...) into 'k'; 'args' are promoted already.
+static int ct_format(Ct *e, CtSink *k, Value fmt, const Value *args, int nargs)
+{
+    size_t flen;
+    if (!ct_strlen(e, fmt, &flen))
+    {
+        return 0;
+    }
+    const char *p = fmt.s;
+    int next = 0;
+    while (*p)
+    {
+        const char *pct = strchr(p, '%');
+        if (!pct)
+        {
+            ct_emit(k, p, strlen(p));
+            break;
+        }
+        ct_emit(k, p, pct - p);
+        p = pct + 1;
+
+        char spec[64];
+        int sl = 0;
+        spec[sl++] = '%';
+        while (*p && strchr("-+ #0", *p) && sl < 8)
+        {
+            spec[sl++] = *p++;
+        }
+        int width = -1, prec = -1;
+        if ('*' == *p)
+        {
+            p++;
+            if (!ct_star(e, args, nargs, &next, &width))
+            {
+                return 0;
+            }
+            if (width < 0)
+            {
+                spec[sl++] = '-';
+                width = width == INT32_MIN ? CT_MAX_WIDTH + 1 : -width;
+            }
+        }
+        else
+        {
+            for (width = isdigit((unsigned char)*p) ? 0 : -1; isdigit((unsigned char)*p); p++)
+            {
+                width = width > CT_MAX_WIDTH ? width : width * 10 + (*p - '0');
+            }
+        }
+        if ('.' == *p)
+        {
+            p++;
+            if ('*' == *p)
+            {
+                p++;
+                if (!ct_star(e, args, nargs, &next, &prec))
+                {
+                    return 0;
+                }
+                prec = prec < 0 ? -1 : prec; // Negative: as if omitted.
+            }
+            else
+            {
+                for (prec = 0; isdigit((unsigned char)*p); p++)
+                {
+                    prec = prec > CT_MAX_WIDTH ? prec : prec * 10 + (*p - '0');
+                }
+            }
+        }
+        if (width > CT_MAX_WIDTH || prec > CT_MAX_WIDTH)
+        {
+            return ct_fail(e, "printf width too large");
+        }
+        if (width >= 0)
+        {
+            sl += snprintf(spec + sl, sizeof(spec) - sl, "%d", width);
+        }
+        if (prec >= 0)
+        {
+            sl += snprintf(spec + sl, sizeof(spec) - sl, ".%d", prec);
+        }
+
+        // Length: 'h', 'H' (hh), 'l' (l, ll, j, z, t, q), 'L', or none.
+        char len = 0;
+        if ('h' == p[0] && 'h' == p[1])
+        {
+            len = 'H';
+            p += 2;
+        }
+        else if ('l' == p[0] && 'l' == p[1])
+        {
+            len = 'l';
+            p += 2;
+        }
+        else if (*p && strchr("hljztqL", *p))
+        {
+            len = strchr("ljztq", *p) ? 'l' : *p;
+            p++;
+        }
+
+        char conv = *p ? *p++ : 0;
+        char buf[CT_MAX_WIDTH * 2 + 64];
+        int n;
+        Value a;
+        if ('%' == conv)
+        {
+            if (sl > 1 || len)
+            {
+                return ct_fail(e, "unsupported printf conversion");
+            }
+            ct_emit(k, "%", 1);
+            continue;
+        }
+        if (conv && strchr("diouxXc", conv))
+        {
+            if (!ct_take_arg(e, args, nargs, &next, &a))
+            {
+                return 0;
+            }
+            if (!ct_is_int(a.type) || 'L' == len || ('c' == conv && len))
+            {
+                return ct_fail(e, "printf argument does not match its conversion");
+            }
+            if ('l' == len && ct_types[a.type].size != 8)
+            {
+                return ct_fail(e, "printf argument does not match its conversion");
+            }
+            // Without 'l' only the low 32 bits of the argument are read.
+            uint64_t x = 'l' == len ? a.i : (uint64_t)(uint32_t)a.i;
+            int is_signed = 'd' == conv || 'i' == conv;
+            if ('h' == len)
+            {
+                x = is_signed ? (uint64_t)(int16_t)x : (uint16_t)x;
+            }
+            else if ('H' == len)
+            {
+                x = is_signed ? (uint64_t)(int8_t)x : (uint8_t)x;
+            }
+            else if (!len && is_signed)
+            {
+                x = (uint64_t)(int32_t)x;
+            }
+            if ('c' == conv)
+            {
+                snprintf(spec + sl, sizeof(spec) - sl, "c");
+                n = snprintf(buf, sizeof(buf), spec, (int)x);
+            }
+            else
+            {
+                snprintf(spec + sl, sizeof(spec) - sl, "ll%c", conv);
+                n = is_signed ? snprintf(buf, sizeof(buf), spec, (long long)x)
+                              : snprintf(buf, sizeof(buf), spec, (unsigned long long)x);
+            }
+        }
+        else if (conv && strchr("fFeEgGaA", conv))
+        {
+            if (!ct_take_arg(e, args, nargs, &next, &a))
+            {
+                return 0;
+            }
+            if (CT_DOUBLE != a.type || (len && 'l' != len))
+            {
+                return ct_fail(e, "printf argument does not match its conversion");
+            }
+            snprintf(spec + sl, sizeof(spec) - sl, "%c", conv);
+            n = snprintf(buf, sizeof(buf), spec, a.f);
+        }
+        else if ('s' == conv)
+        {
+            if (!ct_take_arg(e, args, nargs, &next, &a))
+            {
+                return 0;
+            }
+            if (CT_STR != a.type || len)
+            {
+                return ct_fail(e, "printf argument does not match its conversion");
+            }
+            size_t slen;
+            if (a.s < a.lo || a.s >= a.hi)
+            {
+                return ct_fail(e, "string out of bounds");
+            }
+            // With a precision, only that many bytes need to be there.
+            size_t avail = a.hi - a.s;
+            const char *nul = memchr(a.s, 0, avail);
+            if (nul)
+            {
+                slen = nul - a.s;
+            }
+            else if (prec >= 0 && (size_t)prec <= avail)
+            {
+                slen = prec;
+            }
+            else
+            {
+                return ct_fail(e, "unterminated string");
+            }
+            if (prec >= 0 && (size_t)prec < slen)
+            {
+                slen = prec;
+            }
+            size_t pad = width > 0 && (size_t)width > slen ? width - slen : 0;
+            int left = NULL != memchr(spec, '-', sl);
+            for (size_t i = 0; !left && i < pad; i++)
+            {
+                ct_emit(k, " ", 1);
+            }
+            ct_emit(k, a.s, slen);
+            for (size_t i = 0; left && i < pad; i++)
+            {
+                ct_emit(k, " ", 1);
+            }
+            continue;
+        }
+        else
+        {
+            return ct_fail(e, "unsupported printf conversion");
+        }
+        if (n < 0 || (size_t)n >= sizeof(buf))
+        {
+            return ct_fail(e, "printf conversion failed");
+        }
+        ct_emit(k, buf, n);
+    }
+    if (k->len > INT32_MAX)
+    {
+        return ct_fail(e, "printf output too long");
+    }
+    return 1;
+}
+
+// ** Library calls **
+
+// Whether [p, p + n) overlaps the string 's' (and its terminator).
+static int ct_overlaps(Value s, const char *p, size_t n)
+{
+    size_t len;
+    const char *nul = memchr(s.s, 0, s.hi - s.s);
+    len = nul ? (size_t)(nul - s.s) + 1 : (size_t)(s.hi - s.s);
+    return s.s < p + n && p < s.s + len;
+}
+
+// Writes into the char buffer 'dst' points to: sprintf, strcpy, strcat.
+static int ct_writable(Ct *e, Value dst, size_t *room)
+{
+    if (CT_STR != dst.type || dst.read_only)
+    {
+        return ct_fail(e, "write to a string literal");
+    }
+    if (dst.s < dst.lo || dst.s >= dst.hi)
+    {
+        return ct_fail(e, "string out of bounds");
+    }
+    *room = dst.hi - dst.s;
+    return 1;
+}
+
+// Calls the library function 'name' (or gives up on it). 'stream' is 1 for
+// stdout and 2 for stderr where the function takes one.
+static int ct_call(Ct *e, const char *name, size_t name_len, int stream, Value *args, int nargs,
+                   int live, Value *out)
+{
+    char fn[16];
+    if (name_len >= sizeof(fn))
+    {
+        return ct_fail(e, "call to an unsupported function");
+    }
+    memcpy(fn, name, name_len);
+    fn[name_len] = 0;
+
+    int is_fprintf = 0 == strcmp(fn, "fprintf");
+    int is_fflush = 0 == strcmp(fn, "fflush");
+    if ((is_fprintf || is_fflush) != (stream != 0))
+    {
+        return ct_fail(e, "unsupported stream argument");
+    }
+
+    // Fixed parameters first: how many, and their C types (CT_STR: char*).
+    static const struct
+    {
+        const char *name;
+        int fixed;
+        CtType params[3];
+        int variadic;
+        CtType ret;
+    } protos[] = {
+        {"printf", 1, {CT_STR}, 1, CT_INT},
+        {"fprintf", 1, {CT_STR}, 1, CT_INT},
+        {"sprintf", 2, {CT_STR, CT_STR}, 1, CT_INT},
+        {"snprintf", 3, {CT_STR, CT_ULONG, CT_STR}, 1, CT_INT},
+        {"puts", 1, {CT_STR}, 0, CT_INT},
+        {"putchar", 1, {CT_INT}, 0, CT_INT},
+        {"fflush", 0, {0}, 0, CT_INT},
+        {"strlen", 1, {CT_STR}, 0, CT_ULONG},
+        {"strcpy", 2, {CT_STR, CT_STR}, 0, CT_STR},
+        {"strcat", 2, {CT_STR, CT_STR}, 0, CT_STR},
+        {"abs", 1, {CT_INT}, 0, CT_INT},
+    };
+    int which = -1;
+    for (int i = 0; i < (int)(sizeof(protos) / sizeof(protos[0])); i++)
+    {
+        if (0 == strcmp(protos[i].name, fn))
+        {
+            which = i;
+        }
+    }
+    if (which < 0)
+    {
+        return ct_fail(e, "call to an unsupported function");
+    }
+    if (nargs < protos[which].fixed || (!protos[which].variadic && nargs != protos[which].fixed))
+    {
+        return ct_fail(e, "wrong number of arguments");
+    }
+    for (int i = 0; i < nargs; i++)
+    {
+        int ok = i < protos[which].fixed ? ct_convert(e, args[i], protos[which].params[i], live, &args[i])
+                                         : ct_vararg(e, args[i], live, &args[i]);
+        if (!ok)
+        {
+            return 0;
+        }
+    }
+    *out = ct_typed(protos[which].ret);
+    if (!live)
+    {
+        return 1;
+    }
+
+    OutBuf *ob = 2 == stream ? &e->err : &e->out;
+    CtSink k = {ob, NULL, 0, 0};
+    size_t room, len, len2;
+    if (0 == strcmp(fn, "printf") || is_fprintf)
+    {
+        if (!ct_format(e, &k, args[0], args + 1, nargs - 1))
+        {
+            return 0;
+        }
+        *out = ct_int(CT_INT, k.len);
+    }
+    else if (0 == strcmp(fn, "sprintf") || 0 == strcmp(fn, "snprintf"))
+    {
+        int sn = 'n' == fn[1];
+        int first = sn ? 2 : 1;
+        if (!ct_writable(e, args[0], &room))
+        {
+            return 0;
+        }
+        for (int i = first; i < nargs; i++)
+        {
+            if (CT_STR == args[i].type && ct_overlaps(args[i], args[0].s, room))
+            {
+                return ct_fail(e, "overlapping sprintf arguments");
+            }
+        }
+        size_t limit = sn ? (args[1].i ? args[1].i - 1 : 0) : room;
+        k.ob = NULL;
+        k.dst = args[0].s;
+        k.room = limit < room ? limit : room;
+        if (!ct_format(e, &k, args[first], args + first + 1, nargs - first - 1))
+        {
+            return 0;
+        }
+        size_t end = sn ? (k.len < limit ? k.len : limit) : k.len;
+        if ((!sn || args[1].i) && end >= room)
+        {
+            return ct_fail(e, "sprintf overflow");
+        }
+        if (!sn || args[1].i)
+        {
+            args[0].s[end] = 0;
+        }
+        *out = ct_int(CT_INT, k.len);
+    }
+    else if (0 == strcmp(fn, "puts"))
+    {
+        if (!ct_strlen(e, args[0], &len))
+        {
+            return 0;
+        }
+        ob_write(ob, args[0].s, len);
+        ob_putc(ob, '\n');
+        *out = ct_int(CT_INT, len + 1 > INT32_MAX ? INT32_MAX : len + 1);
+    }
+    else if (0 == strcmp(fn, "putchar"))
+    {
+        ob_putc(ob, (char)args[0].i);
+        *out = ct_int(CT_INT, (unsigned char)args[0].i);
+    }
+    else if (is_fflush)
+    {
+        *out = ct_int(CT_INT, 0);
+    }
+    else if (0 == strcmp(fn, "strlen"))
+    {
+        if (!ct_strlen(e, args[0], &len))
+        {
+            return 0;
+        }
+        *out = ct_int(CT_ULONG, len);
+    }
+    else if (0 == strcmp(fn, "strcpy") || 0 == strcmp(fn, "strcat"))
+    {
+        if (!ct_writable(e, args[0], &room) || !ct_strlen(e, args[1], &len2))
+        {
+            return 0;
+        }
+        len = 0;
+        if ('a' == fn[4] && !ct_strlen(e, args[0], &len))
+        {
+            return 0;
+        }
+        if (len + len2 >= room || ct_overlaps(args[1], args[0].s, len + len2 + 1))
+        {
+            return ct_fail(e, "string copy overflow");
+        }
+        memcpy(args[0].s + len, args[1].s, len2 + 1);
+        *out = args[0];
+        out->is_array = 0;
+    }
+    else
+    {
+        if ((uint64_t)(int64_t)INT32_MIN == args[0].i)
+        {
+            return ct_fail(e, "signed overflow");
+        }
+        int32_t x = (int32_t)args[0].i;
+        *out = ct_int(CT_INT, (uint64_t)(int64_t)(x < 0 ? -x : x));
+    }
+    return 1;
+}
+
+// ** C text **
+// Print sugar reaches the AST as the C it expands to, and repeat counts and
+// range steps as C expressions; this evaluates that text directly.
+
+typedef struct
+{
+    Ct *e;
+    const char *p;
+} CtText;
+
+static const char *ct_puncts[] = {"<<=", ">>=", "...", "<<", ">>", "<=", ">=", "==", "!=", "&&",
+                                  "||", "++", "--", "->", "+=", "-=", "*=", "/=", "%=", "&=",
+                                  "|=", "^=", "##"};
+
+// Length of the punctuator at the cursor (0 at an identifier, number or end).
+static int ct_punct(CtText *t)
+{
+    while (isspace((unsigned char)*t->p))
+    {
+        t->p++;
+    }
+    if (!*t->p || isalnum((unsigned char)*t->p) || '_' == *t->p || '"' == *t->p ||
+        '\'' == *t->p)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(ct_puncts) / sizeof(ct_puncts[0]); i++)
+    {
+        size_t n = strlen(ct_puncts[i]);
+        if (0 == strncmp(t->p, ct_puncts[i], n))
+        {
+            return (int)n;
+        }
+    }
+    return 1;
+}
+
+static int ct_accept(CtText *t, const char *op)
+{
+    int n = ct_punct(t);
+    if (n && (size_t)n == strlen(op) && 0 == strncmp(t->p, op, n))
+    {
+        t->p += n;
+        return 1;
+    }
+    return 0;
+}
+
+static int ct_expect(CtText *t, const char *op)
+{
+    return ct_accept(t, op) || ct_fail(t->e, "unsupported C text");
+}
+
+// The identifier at the cursor, if any.
+static size_t ct_ident(CtText *t, const char **start)
+{
+    ct_punct(t);
+    const char *s = t->p;
+    if (!isalpha((unsigned char)*s) && '_' != *s)
+    {
+        return 0;
+    }
+    while (isalnum((unsigned char)*s) || '_' == *s)
+    {
+        s++;
+    }
+    *start = t->p;
+    return s - t->p;
+}
+
+static int ct_text_expr(CtText *t, int live, Value *out);
+static int ct_text_unary(CtText *t, int live, Value *out);
+
+// An integer or floating constant, typed as C types it.
+static int ct_text_number(CtText *t, Value *out)
+{
+    Ct *e = t->e;
+    const char *s = t->p;
+    const char *q = s;
+    int hex = '0' == s[0] && ('x' == s[1] || 'X' == s[1]);
+    int is_float = 0;
+    for (q = hex ? s + 2 : s; isalnum((unsigned char)*q) || '.' == *q ||
+                              (('+' == *q || '-' == *q) && !hex && ('e' == q[-1] || 'E' == q[-1]));
+         q++)
+    {
+        if ('.' == *q || (!hex && ('e' == *q || 'E' == *q)))
+        {
+            is_float = 1;
+        }
+    }
+    t->p = q;
+    char text[128];
+    if (q - s >= (long)sizeof(text))
+    {
+        return ct_fail(e, "unsupported number");
+    }
+    memcpy(text, s, q - s);
+    text[q - s] = 0;
+
+    if (is_float)
+    {
+        if (hex)
+        {
+            return ct_fail(e, "unsupported number");
+        }
+        char *end;
+        char last = text[q - s - 1];
+        if ('f' == last || 'F' == last)
+        {
+            float f = strtof(text, &end);
+            if (end != text + (q - s) - 1)
+            {
+                return ct_fail(e, "unsupported number");
+            }
+            *out = ct_float(CT_FLOAT, f);
+            return 1;
+        }
+        double f = strtod(text, &end);
+        if (*end)
+        {
+            return ct_fail(e, "unsupported number");
+        }
+        *out = ct_float(CT_DOUBLE, f);
+        return 1;
+    }
+
+    char *end;
+    errno = 0;
+    uint64_t x = strtoull(text, &end, hex ? 16 : '0' == text[0] ? 8 : 10);
+    int is_unsigned = 0, longs = 0;
+    for (; *end; end++)
+    {
+        if ('u' == *end || 'U' == *end)
+        {
+            is_unsigned++;
+        }
+        else if ('l' == *end || 'L' == *end)
+        {
+            longs++;
+        }
+        else
+        {
+            return ct_fail(e, "unsupported number");
+        }
+    }
+    if (errno || is_unsigned > 1 || longs > 2)
+    {
+        return ct_fail(e, "unsupported number");
+    }
+    // The first of these the value fits, as C picks them.
+    int decimal = !hex && '0' != text[0];
+    static const CtType order[] = {CT_INT, CT_UINT, CT_LONG, CT_ULONG, CT_LLONG, CT_ULLONG};
+    int from = 2 == longs ? 4 : 1 == longs ? 2 : 0;
+    for (int i = from; i < 6; i++)
+    {
+        CtType c = order[i];
+        if ((is_unsigned && ct_types[c].is_signed) || (decimal && !is_unsigned && !ct_types[c].is_signed))
+        {
+            continue;
+        }
+        uint64_t max = ct_types[c].is_signed ? (1ULL << (ct_bits(c) - 1)) - 1
+                       : ct_bits(c) >= 64   ? UINT64_MAX
+                                            : (1ULL << ct_bits(c)) - 1;
+        if (x <= max)
+        {
+            *out = ct_int(c, x);
+            return 1;
+        }
+    }
+    return ct_fail(e, "unsupported number");
+}
+
+// A quoted literal at the cursor; adjacent strings are joined.
+static int ct_text_quoted(CtText *t, Value *out)
+{
+    char quote = *t->p;
+    CtLiteral *lit = '"' == quote ? ct_literal(t->e, t->p) : NULL;
+    if (lit && lit->val.s)
+    {
+        t->p = lit->end;
+        *out = lit->val;
+        return 1;
+    }
+    OutBuf body = OUTBUF_INIT;
+    do
+    {
+        const char *s = ++t->p;
+        while (*t->p && *t->p != quote)
+        {
+            t->p += '\\' == *t->p && t->p[1] ? 2 : 1;
+        }
+        if (!*t->p)
+        {
+            return ct_fail(t->e, "unterminated literal");
+        }
+        ob_write(&body, s, t->p - s);
+        t->p++;
+        ct_punct(t);
+    } while ('"' == quote && '"' == *t->p);
+    char *text = ob_flatten(&body);
+    size_t len = body.len;
+    ob_free(&body);
+    if (!lit)
+    {
+        return ct_char(t->e, text, text + len, out);
+    }
+    if (!ct_string(t->e, text, text + len, &lit->val))
+    {
+        return 0;
+    }
+    lit->end = t->p;
+    *out = lit->val;
+    return 1;
+}
+
+static int ct_stream(CtText *t, int *stream)
+{
+    const char *s;
+    size_t n = ct_ident(t, &s);
+    *stream = 6 == n && 0 == strncmp(s, "stdout", 6) ? 1 : 6 == n && 0 == strncmp(s, "stderr", 6) ? 2 : 0;
+    if (!*stream || ct_find(t->e, s, n) >= 0)
+    {
+        return ct_fail(t->e, "unsupported stream argument");
+    }
+    t->p += n;
+    return 1;
+}
+
+static int ct_text_call(CtText *t, const char *name, size_t len, int live, Value *out)
+{
+    Ct *e = t->e;
+    if (6 == len && 0 == strncmp(name, "_z_str", 6))
+    {
+        // Never evaluated: _Generic only looks at the type.
+        Value v;
+        if (!ct_text_expr(t, 0, &v) || !ct_expect(t, ")"))
+        {
+            return 0;
+        }
+        if (v.is_array)
+        {
+            return ct_fail(e, "_z_str of an array");
+        }
+        return ct_z_str(e, v.type, out);
+    }
+
+    int stream = 0;
+    Value args[CT_MAX_ARGS];
+    int nargs = 0;
+    int is_fprintf = 7 == len && 0 == strncmp(name, "fprintf", 7);
+    if (is_fprintf || (6 == len && 0 == strncmp(name, "fflush", 6)))
+    {
+        if (!ct_stream(t, &stream) || (is_fprintf && !ct_expect(t, ",")))
+        {
+            return 0;
+        }
+    }
+    if (!ct_accept(t, ")"))
+    {
+        do
+        {
+            if (nargs == CT_MAX_ARGS)
+            {
+                return ct_fail(e, "too many arguments");
+            }
+            if (!ct_text_expr(t, live, &args[nargs++]))
+            {
+                return 0;
+            }
+        } while (ct_accept(t, ","));
+        if (!ct_expect(t, ")"))
+        {
+            return 0;
+        }
+    }
+    return ct_call(e, name, len, stream, args, nargs, live, out);
+}
+
+static int ct_text_primary(CtText *t, int live, Value *out)
+{
+    Ct *e = t->e;
+    if (!ct_step(e))
+    {
+        return 0;
+    }
+    ct_punct(t);
+    if (isdigit((unsigned char)*t->p) || ('.' == *t->p && isdigit((unsigned char)t->p[1])))
+    {
+        return ct_text_number(t, out);
+    }
+    if ('"' == *t->p || '\'' == *t->p)
+    {
+        return ct_text_quoted(t, out);
+    }
+    if (ct_accept(t, "("))
+    {
+        if (!ct_accept(t, "{"))
+        {
+            return ct_text_expr(t, live, out) && ct_expect(t, ")");
+        }
+        // ({ e; e; ... }): the value of the last one.
+        int any = 0;
+        while (!ct_accept(t, "}"))
+        {
+            if (!ct_text_expr(t, live, out) || !ct_expect(t, ";"))
+            {
+                return 0;
+            }
+            any = 1;
+        }
+        return (any || ct_fail(e, "empty statement expression")) && ct_expect(t, ")");
+    }
+
+    const char *name;
+    size_t len = ct_ident(t, &name);
+    if (!len)
+    {
+        return ct_fail(e, "unsupported C text");
+    }
+    t->p += len;
+    int var = ct_find(e, name, len);
+    if (var < 0 && ct_accept(t, "("))
+    {
+        return ct_text_call(t, name, len, live, out);
+    }
+    if (var < 0)
+    {
+        if ((4 == len && 0 == strncmp(name, "true", 4)) || (5 == len && 0 == strncmp(name, "false", 5)))
+        {
+            *out = ct_int(CT_INT, 4 == len);
+            return 1;
+        }
+        return ct_fail(e, "unknown name");
+    }
+    CtVar *v = &e->vars[var];
+    if (!v->count)
+    {
+        CtRef r = {v->type, var, NULL, 0};
+        return ct_load(e, r, live, out);
+    }
+    if (!ct_accept(t, "["))
+    {
+        return ct_decay(e, v, out);
+    }
+    Value index, none = {0};
+    CtRef r;
+    if (!ct_text_expr(t, live, &index) || !ct_expect(t, "]") ||
+        !ct_element(e, &e->vars[var], none, index, live, &r))
+    {
+        return 0;
+    }
+    return ct_load(e, r, live, out);
+}
+
+static int ct_text_postfix(CtText *t, int live, Value *out)
+{
+    if (!ct_text_primary(t, live, out))
+    {
+        return 0;
+    }
+    while (ct_accept(t, "["))
+    {
+        Value index;
+        CtRef r;
+        if (CT_STR != out->type)
+        {
+            return ct_fail(t->e, "index of a non-array");
+        }
+        if (!ct_text_expr(t, live, &index) || !ct_expect(t, "]") ||
+            !ct_element(t->e, NULL, *out, index, live, &r) || !ct_load(t->e, r, live, out))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A parenthesized type name at the cursor, for a cast.
+static int ct_text_cast_type(CtText *t, CtType *type)
+{
+    const char *save = t->p;
+    if (!ct_accept(t, "("))
+    {
+        return 0;
+    }
+    char name[64];
+    size_t nl = 0;
+    const char *word;
+    size_t len;
+    while ((len = ct_ident(t, &word)) > 0 && nl + len + 2 < sizeof(name))
+    {
+        if (nl)
+        {
+            name[nl++] = ' ';
+        }
+        memcpy(name + nl, word, len);
+        nl += len;
+        t->p += len;
+    }
+    if (nl && ct_accept(t, "*") && nl + 1 < sizeof(name))
+    {
+        name[nl++] = '*';
+    }
+    name[nl] = 0;
+    if (nl && ct_type_named(name, nl, type) && (strchr(name, ' ') || ct_find(t->e, name, nl) < 0) &&
+        ct_accept(t, ")"))
+    {
+        return 1;
+    }
+    t->p = save;
+    return 0;
+}
+
+static int ct_text_unary(CtText *t, int live, Value *out)
+{
+    static const char *ops[] = {"-", "+", "!", "~"};
+    for (int i = 0; i < 4; i++)
+    {
+        if (ct_accept(t, ops[i]))
+        {
+            Value a;
+            return ct_text_unary(t, live, &a) && ct_unary(t->e, ops[i][0], a, live, out);
+        }
+    }
+    CtType type;
+    if (ct_text_cast_type(t, &type))
+    {
+        Value a;
+        return ct_text_unary(t, live, &a) && ct_convert(t->e, a, type, live, out);
+    }
+    return ct_text_postfix(t, live, out);
+}
+
+static int ct_text_prec(CtText *t, int *len)
+{
+    static const struct
+    {
+        const char *op;
+        int prec;
+    } table[] = {
+        {"||", 1}, {"&&", 2}, {"|", 3},  {"^", 4},  {"&", 5},  {"==", 6}, {"!=", 6},
+        {"<", 7},  {">", 7},  {"<=", 7}, {">=", 7}, {"<<", 8}, {">>", 8}, {"+", 9},
+        {"-", 9},  {"*", 10}, {"/", 10}, {"%", 10},
+    };
+    *len = ct_punct(t);
+    for (size_t i = 0; *len && i < sizeof(table) / sizeof(table[0]); i++)
+    {
+        if ((size_t)*len == strlen(table[i].op) && 0 == strncmp(t->p, table[i].op, *len))
+        {
+            return table[i].prec;
+        }
+    }
+    return 0;
+}
+
+static int ct_text_binary(CtText *t, int min_prec, int live, Value *out)
+{
+    if (!ct_text_unary(t, live, out))
+    {
+        return 0;
+    }
+    int len, prec;
+    while ((prec = ct_text_prec(t, &len)) >= min_prec && prec > 0)
+    {
+        char op[3] = {0};
+        memcpy(op, t->p, len);
+        t->p += len;
+        Value rhs;
+        if (prec <= 2)
+        {
+            int lhs = live && ct_truth(*out);
+            int rlive = live && (1 == prec ? !lhs : lhs);
+            if (!ct_text_binary(t, prec + 1, rlive, &rhs))
+            {
+                return 0;
+            }
+            int r = 1 == prec ? lhs || (rlive && ct_truth(rhs)) : lhs && rlive && ct_truth(rhs);
+            *out = ct_int(CT_INT, live && r);
+            continue;
+        }
+        if (!ct_text_binary(t, prec + 1, live, &rhs) || !ct_binary(t->e, op, *out, rhs, live, out))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int ct_text_expr(CtText *t, int live, Value *out)
+{
+    Value c, a, b;
+    if (!ct_text_binary(t, 1, live, &c))
+    {
+        return 0;
+    }
+    if (!ct_accept(t, "?"))
+    {
+        *out = c;
+        return 1;
+    }
+    int which = live && ct_truth(c);
+    if (!ct_text_expr(t, which, &a) || !ct_expect(t, ":") ||
+        !ct_text_expr(t, live && !which, &b))
+    {
+        return 0;
+    }
+    return ct_choose(t->e, a, b, which ? a : b, live, out);
+}
+
+// Evaluates the C expression 'text' (an optional ';' may follow).
+static int ct_text_eval(Ct *e, const char *text, Value *out)
+{
+    CtText t = {e, text};
+    if (!ct_text_expr(&t, 1, out))
+    {
+        return 0;
+    }
+    ct_accept(&t, ";");
+    return (0 == ct_punct(&t) && !*t.p) || ct_fail(e, "unsupported C text");
+}
+
+// ** AST **
+
+static int ct_expr(Ct *e, ASTNode *n, int live, Value *out);
+
+static int ct_var_named(Ct *e, const char *name)
+{
+    return ct_find(e, name, strlen(name));
+}
+
+static int ct_lvalue(Ct *e, ASTNode *n, int live, CtRef *out)
+{
+    if (NODE_EXPR_VAR == n->type)
+    {
+        int var = ct_var_named(e, n->var_ref.name);
+        if (var < 0 || e->vars[var].count)
+        {
+            return ct_fail(e, var < 0 ? "unknown name" : "array assignment");
+        }
+        CtRef r = {e->vars[var].type, var, NULL, e->vars[var].is_const};
+        *out = r;
+        return 1;
+    }
+    if (NODE_EXPR_INDEX == n->type)
+    {
+        ASTNode *base = n->index.array;
+        Type *bt = base->type_info;
+        if ((bt && TYPE_ARRAY == bt->kind && 0 == bt->array_size) ||
+            (base->resolved_type && 0 == strncmp(base->resolved_type, "Slice_", 6)))
+        {
+            return ct_fail(e, "slice index");
+        }
+        Value b = {0}, index;
+        CtVar *arr = NULL;
+        int var = NODE_EXPR_VAR == base->type ? ct_var_named(e, base->var_ref.name) : -1;
+        if (var >= 0 && e->vars[var].count)
+        {
+            arr = &e->vars[var];
+        }
+        else if (!ct_expr(e, base, live, &b))
+        {
+            return 0;
+        }
+        else if (CT_STR != b.type)
+        {
+            return ct_fail(e, "index of a non-array");
+        }
+        if (!ct_expr(e, n->index.index, live, &index))
+        {
+            return 0;
+        }
+        return ct_element(e, arr, b, index, live, out);
+    }
+    return ct_fail(e, "unsupported assignment target");
+}
+
+static int ct_incdec(Ct *e, ASTNode *n, const char *op, int live, Value *out)
+{
+    CtRef r;
+    Value old, one = ct_int(CT_INT, 1), neu;
+    if (!ct_lvalue(e, n, live, &r) || !ct_load(e, r, live, &old))
+    {
+        return 0;
+    }
+    if (CT_BOOL == r.type || CT_STR == r.type)
+    {
+        return ct_fail(e, "++ or -- on a bool or pointer");
+    }
+    if (!ct_binary(e, strchr(op, '+') ? "+" : "-", old, one, live, &neu) ||
+        !ct_store(e, r, neu, live, &neu))
+    {
+        return 0;
+    }
+    *out = '_' == op[0] ? old : neu;
+    return 1;
+}
+
+static int ct_ast_call(Ct *e, ASTNode *n, int live, Value *out)
+{
+    ASTNode *callee = n->call.callee;
+    if (NODE_EXPR_VAR != callee->type || n->call.arg_names ||
+        (callee->type_info && TYPE_FUNCTION == callee->type_info->kind) ||
+        ct_var_named(e, callee->var_ref.name) >= 0)
+    {
+        return ct_fail(e, "call to an unsupported function");
+    }
+    const char *name = callee->var_ref.name;
+    ASTNode *arg = n->call.args;
+    int stream = 0;
+    if ((0 == strcmp(name, "fprintf") || 0 == strcmp(name, "fflush")) && arg)
+    {
+        if (NODE_EXPR_VAR == arg->type && ct_var_named(e, arg->var_ref.name) < 0)
+        {
+            stream = 0 == strcmp(arg->var_ref.name, "stdout")   ? 1
+                     : 0 == strcmp(arg->var_ref.name, "stderr") ? 2
+                                                                : 0;
+        }
+        if (!stream)
+        {
+            return ct_fail(e, "unsupported stream argument");
+        }
+        arg = arg->next;
+    }
+    Value args[CT_MAX_ARGS];
+    int nargs = 0;
+    for (; arg; arg = arg->next)
+    {
+        if (nargs == CT_MAX_ARGS)
+        {
+            return ct_fail(e, "too many arguments");
+        }
+        if (!ct_expr(e, arg, live, &args[nargs++]))
+        {
+            return 0;
+        }
+    }
+    return ct_call(e, name, strlen(name), stream, args, nargs, live, out);
+}
+
+static int ct_expr(Ct *e, ASTNode *n, int live, Value *out)
+{
+    if (!ct_step(e))
+    {
+        return 0;
+    }
+    switch (n->type)
+    {
+    case NODE_EXPR_LITERAL:
+    {
+        const char *s = n->literal.string_val;
+        if (TOK_STRING == n->literal.type_kind)
+        {
+            CtLiteral *lit = ct_literal(e, s);
+            if (!lit->val.s && !ct_string(e, s, s + strlen(s), &lit->val))
+            {
+                return 0;
+            }
+            *out = lit->val;
+            return 1;
+        }
+        if (TOK_CHAR == n->literal.type_kind)
+        {
+            size_t len = strlen(s);
+            if (len < 3 || '\'' != s[0] || '\'' != s[len - 1])
+            {
+                return ct_fail(e, "unsupported character literal");
+            }
+            return ct_char(e, s + 1, s + len - 1, out);
+        }
+        if (1 == n->literal.type_kind)
+        {
+            // Emitted with "%f".
+            char buf[512];
+            snprintf(buf, sizeof(buf), "%f", n->literal.float_val);
+            *out = ct_float(CT_DOUBLE, strtod(buf, NULL));
+            return 1;
+        }
+        *out = ct_int(CT_ULLONG, n->literal.int_val);
+        return 1;
+    }
+    case NODE_EXPR_VAR:
+    {
+        int var = ct_var_named(e, n->var_ref.name);
+        if (var < 0)
+        {
+            if (0 == strcmp(n->var_ref.name, "true") || 0 == strcmp(n->var_ref.name, "false"))
+            {
+                *out = ct_int(CT_INT, 't' == n->var_ref.name[0]);
+                return 1;
+            }
+            return ct_fail(e, "unknown name");
+        }
+        if (e->vars[var].count)
+        {
+            return ct_decay(e, &e->vars[var], out);
+        }
+        CtRef r = {e->vars[var].type, var, NULL, 0};
+        return ct_load(e, r, live, out);
+    }
+    case NODE_EXPR_BINARY:
+    {
+        const char *op = n->binary.op;
+        Value a, b;
+        if (0 == strcmp(op, "="))
+        {
+            CtRef r;
+            return ct_lvalue(e, n->binary.left, live, &r) &&
+                   ct_expr(e, n->binary.right, live, &b) &&
+                   (!r.read_only || ct_fail(e, "assignment to a constant")) &&
+                   ct_store(e, r, b, live, out);
+        }
+        if (0 == strcmp(op, "&&") || 0 == strcmp(op, "||"))
+        {
+            int is_or = '|' == op[0];
+            if (!ct_expr(e, n->binary.left, live, &a))
+            {
+                return 0;
+            }
+            int lhs = live && ct_truth(a);
+            int rlive = live && (is_or ? !lhs : lhs);
+            if (!ct_expr(e, n->binary.right, rlive, &b))
+            {
+                return 0;
+            }
+            int r = is_or ? lhs || (rlive && ct_truth(b)) : lhs && rlive && ct_truth(b);
+            *out = ct_int(CT_INT, live && r);
+            return 1;
+        }
+        return ct_expr(e, n->binary.left, live, &a) && ct_expr(e, n->binary.right, live, &b) &&
+               ct_binary(e, op, a, b, live, out);
+    }
+    case NODE_EXPR_UNARY:
+    {
+        const char *op = n->unary.op;
+        Value a;
+        if (0 == strcmp(op, "++") || 0 == strcmp(op, "--") || 0 == strcmp(op, "_post++") ||
+            0 == strcmp(op, "_post--"))
+        {
+            return ct_incdec(e, n->unary.operand, op, live, out);
+        }
+        if (op[0] && !op[1] && strchr("-+!~", op[0]))
+        {
+            return ct_expr(e, n->unary.operand, live, &a) && ct_unary(e, op[0], a, live, out);
+        }
+        return ct_fail(e, "unsupported operator");
+    }
+    case NODE_EXPR_INDEX:
+    {
+        CtRef r;
+        return ct_lvalue(e, n, live, &r) && ct_load(e, r, live, out);
+    }
+    case NODE_EXPR_CAST:
+    {
+        CtType t;
+        Value a;
+        const char *name = n->cast.target_type;
+        if (!ct_type_named(name, strlen(name), &t))
+        {
+            return ct_fail(e, "unsupported type");
+        }
+        return ct_expr(e, n->cast.expr, live, &a) && ct_convert(e, a, t, live, out);
+    }
+    case NODE_TERNARY:
+    {
+        Value c, a, b;
+        if (!ct_expr(e, n->ternary.cond, live, &c))
+        {
+            return 0;
+        }
+        int which = live && ct_truth(c);
+        return ct_expr(e, n->ternary.true_expr, which, &a) &&
+               ct_expr(e, n->ternary.false_expr, live && !which, &b) &&
+               ct_choose(e, a, b, which ? a : b, live, out);
+    }
+    case NODE_EXPR_CALL:
+        return ct_ast_call(e, n, live, out);
+    case NODE_EXPR_MEMBER:
+    {
+        // Fixed arrays' .len is emitted as the number.
+        Type *tt = n->member.target->type_info;
+        if (0 == strcmp(n->member.field, "len") && tt && TYPE_ARRAY == tt->kind && tt->array_size > 0)
+        {
+            *out = ct_int(CT_INT, tt->array_size);
+            return 1;
+        }
+        return ct_fail(e, "member access");
+    }
+    case NODE_RAW_STMT:
+        // Print sugar only; other raw C is for the C compiler.
+        if (0 != strncmp(n->raw_stmt.content, "({ ", 3))
+        {
+            return ct_fail(e, "raw C");
+        }
+        return ct_text_eval(e, n->raw_stmt.content, out);
+    default:
+        return ct_fail(e, "unsupported expression");
+    }
+}
+
+static CtFlow ct_stmt(Ct *e, ASTNode *n);
+
+static CtFlow ct_stmts(Ct *e, ASTNode *n)
+{
+    for (; n; n = n->next)
+    {
+        CtFlow f = ct_stmt(e, n);
+        if (CT_NEXT != f)
+        {
+            return f;
+        }
+    }
+    return CT_NEXT;
+}
+
+// var and const declarations, which C sees as "T name = init".
+static int ct_decl(Ct *e, ASTNode *n, int is_const)
+{
+    const char *ts = n->var_decl.type_str;
+    if (n->var_decl.is_static || n->var_decl.is_autofree || !ts || 0 == strcmp(ts, "__auto_type"))
+    {
+        return ct_fail(e, "unsupported declaration");
+    }
+    const char *bracket = strchr(ts, '[');
+    size_t base = bracket ? (size_t)(bracket - ts) : strlen(ts);
+    long count = 0;
+    if (bracket)
+    {
+        char *end;
+        count = strtol(bracket + 1, &end, 10);
+        if (is_const || count <= 0 || count > CT_MAX_STACK || 0 != strcmp(end, "]"))
+        {
+            return ct_fail(e, "unsupported array type");
+        }
+    }
+    CtType t;
+    if (!ct_type_named(ts, base, &t) || (count && CT_STR == t))
+    {
+        return ct_fail(e, "unsupported type");
+    }
+
+    // The name is in scope in its own initializer, as in C.
+    CtVar *v = ct_declare(e, n->var_decl.name, t, (int)count);
+    if (!v)
+    {
+        return 0;
+    }
+    int var = v - e->vars;
+    v->is_const = is_const;
+    ASTNode *init = n->var_decl.init_expr;
+    if (!init)
+    {
+        return !is_const || ct_fail(e, "constant without a value");
+    }
+    if (!count)
+    {
+        Value val;
+        CtRef r = {t, var, NULL, 0};
+        return ct_expr(e, init, 1, &val) && ct_store(e, r, val, 1, &val);
+    }
+    if (NODE_EXPR_ARRAY_LITERAL != init->type)
+    {
+        return ct_fail(e, "unsupported array initializer");
+    }
+    int i = 0;
+    for (ASTNode *el = init->array_literal.elements; el; el = el->next, i++)
+    {
+        Value val;
+        if (i >= count)
+        {
+            return ct_fail(e, "too many initializers");
+        }
+        CtRef r = {t, -1, e->vars[var].mem + (size_t)i * ct_types[t].size, 0};
+        if (!ct_expr(e, el, 1, &val) || !ct_store(e, r, val, 1, &val))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// A loop body, then what the loop does next: 1 go on, 0 leave, -1 fail.
+static int ct_body(Ct *e, ASTNode *body)
+{
+    CtFlow f = ct_stmt(e, body);
+    return CT_FAIL == f ? -1 : CT_BREAK == f ? 0 : 1;
+}
+
+static int ct_cond(Ct *e, ASTNode *c, int *truth)
+{
+    Value v;
+    if (!ct_expr(e, c, 1, &v))
+    {
+        return 0;
+    }
+    *truth = ct_truth(v);
+    return 1;
+}
+
+// i = i + step, for range and repeat loops.
+static int ct_advance(Ct *e, int var, Value step)
+{
+    CtRef r = {e->vars[var].type, var, NULL, 0};
+    Value v;
+    return ct_load(e, r, 1, &v) && ct_binary(e, "+", v, step, 1, &v) && ct_store(e, r, v, 1, &v);
+}
+
+static CtFlow ct_loop_stmt(Ct *e, ASTNode *n)
+{
+    int go = 1, truth;
+    switch (n->type)
+    {
+    case NODE_WHILE:
+        while (ct_cond(e, n->while_stmt.condition, &truth) && truth &&
+               (go = ct_body(e, n->while_stmt.body)) > 0)
+        {
+        }
+        break;
+    case NODE_DO_WHILE:
+        while ((go = ct_body(e, n->do_while_stmt.body)) > 0 &&
+               ct_cond(e, n->do_while_stmt.condition, &truth) && truth)
+        {
+        }
+        break;
+    case NODE_LOOP:
+        while ((go = ct_body(e, n->loop_stmt.body)) > 0 && ct_step(e))
+        {
+        }
+        break;
+    case NODE_FOR:
+    {
+        ASTNode *init = n->for_stmt.init;
+        if (init && NODE_VAR_DECL == init->type)
+        {
+            // "T name = (T)(init)", or __auto_type.
+            const char *ts = init->var_decl.type_str;
+            Value v;
+            if (!ct_expr(e, init->var_decl.init_expr, 1, &v))
+            {
+                break;
+            }
+            CtType t = v.type;
+            if (ts && 0 != strcmp(ts, "__auto_type") && !ct_type_named(ts, strlen(ts), &t))
+            {
+                ct_fail(e, "unsupported type");
+                break;
+            }
+            CtVar *var = ct_declare(e, init->var_decl.name, t, 0);
+            CtRef r = {t, var ? (int)(var - e->vars) : -1, NULL, 0};
+            if (!var || !ct_store(e, r, v, 1, &v))
+            {
+                break;
+            }
+        }
+        else if (init && !ct_expr(e, init, 1, &(Value){0}))
+        {
+            break;
+        }
+        while ((!n->for_stmt.condition || (ct_cond(e, n->for_stmt.condition, &truth) && truth)) &&
+               (go = ct_body(e, n->for_stmt.body)) > 0 &&
+               (!n->for_stmt.step || ct_expr(e, n->for_stmt.step, 1, &(Value){0})) && ct_step(e))
+        {
+        }
+        break;
+    }
+    case NODE_FOR_RANGE:
+    {
+        // for (__auto_type i = start; i < end; i++ or i += step)
+        Value v, end, step = ct_int(CT_INT, 1);
+        if (!ct_expr(e, n->for_range.start, 1, &v))
+        {
+            break;
+        }
+        if (CT_STR == v.type)
+        {
+            ct_fail(e, "pointer loop variable");
+            break;
+        }
+        CtVar *var = ct_declare(e, n->for_range.var_name, v.type, 0);
+        if (!var)
+        {
+            break;
+        }
+        int vi = var - e->vars;
+        e->vars[vi].val = v;
+        e->vars[vi].val.is_array = 0;
+        e->vars[vi].is_set = 1;
+        CtRef r = {v.type, vi, NULL, 0};
+        while (ct_load(e, r, 1, &v) && ct_expr(e, n->for_range.end, 1, &end) &&
+               ct_binary(e, "<", v, end, 1, &v) && v.i && (go = ct_body(e, n->for_range.body)) > 0 &&
+               (!n->for_range.step || ct_text_eval(e, n->for_range.step, &step)) &&
+               ct_advance(e, vi, step))
+        {
+        }
+        break;
+    }
+    case NODE_REPEAT:
+    {
+        // for (int _rpt_i = 0; _rpt_i < (count); _rpt_i++)
+        CtVar *var = ct_declare(e, "_rpt_i", CT_INT, 0);
+        if (!var)
+        {
+            break;
+        }
+        int vi = var - e->vars;
+        e->vars[vi].val = ct_int(CT_INT, 0);
+        e->vars[vi].is_set = 1;
+        CtRef r = {CT_INT, vi, NULL, 0};
+        Value v, count;
+        while (ct_load(e, r, 1, &v) && ct_text_eval(e, n->repeat_stmt.count, &count) &&
+               ct_binary(e, "<", v, count, 1, &v) && v.i &&
+               (go = ct_body(e, n->repeat_stmt.body)) > 0 && ct_advance(e, vi, ct_int(CT_INT, 1)))
+        {
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return e->why || go < 0 ? CT_FAIL : CT_NEXT;
+}
+
+static CtFlow ct_stmt(Ct *e, ASTNode *n)
+{
+    if (!ct_step(e))
+    {
+        return CT_FAIL;
+    }
+    int truth;
+    switch (n->type)
+    {
+    case NODE_VAR_DECL:
+    case NODE_CONST:
+        return ct_decl(e, n, NODE_CONST == n->type) ? CT_NEXT : CT_FAIL;
+    case NODE_BLOCK:
+    {
+        CtMark m = ct_mark(e);
+        ct_enter(e);
+        CtFlow f = ct_stmts(e, n->block.statements);
+        ct_release(e, m);
+        return f;
+    }
+    case NODE_IF:
+        if (!ct_cond(e, n->if_stmt.condition, &truth))
+        {
+            return CT_FAIL;
+        }
+        if (truth)
+        {
+            return ct_stmt(e, n->if_stmt.then_body);
+        }
+        return n->if_stmt.else_body ? ct_stmt(e, n->if_stmt.else_body) : CT_NEXT;
+    case NODE_UNLESS:
+    case NODE_GUARD:
+    {
+        ASTNode *c = NODE_UNLESS == n->type ? n->unless_stmt.condition : n->guard_stmt.condition;
+        ASTNode *body = NODE_UNLESS == n->type ? n->unless_stmt.body : n->guard_stmt.body;
+        if (!ct_cond(e, c, &truth))
+        {
+            return CT_FAIL;
+        }
+        return truth ? CT_NEXT : ct_stmt(e, body);
+    }
+    case NODE_WHILE:
+    case NODE_DO_WHILE:
+    case NODE_LOOP:
+    case NODE_FOR:
+    case NODE_FOR_RANGE:
+    case NODE_REPEAT:
+    {
+        const char *label = NODE_WHILE == n->type      ? n->while_stmt.loop_label
+                            : NODE_DO_WHILE == n->type ? n->do_while_stmt.loop_label
+                            : NODE_LOOP == n->type     ? n->loop_stmt.loop_label
+                            : NODE_FOR == n->type      ? n->for_stmt.loop_label
+                                                       : NULL;
+        if (label)
+        {
+            ct_fail(e, "labeled loop");
+            return CT_FAIL;
+        }
+        // The scope of a for's declaration.
+        CtMark m = ct_mark(e);
+        ct_enter(e);
+        CtFlow f = ct_loop_stmt(e, n);
+        ct_release(e, m);
+        return f;
+    }
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        if (NODE_BREAK == n->type ? n->break_stmt.target_label : n->continue_stmt.target_label)
+        {
+            ct_fail(e, "labeled break or continue");
+            return CT_FAIL;
+        }
+        return NODE_BREAK == n->type ? CT_BREAK : CT_CONTINUE;
+    default:
+    {
+        Value v;
+        return ct_expr(e, n, 1, &v) ? CT_NEXT : CT_FAIL;
+    }
+    }
+}
+
+char *comptime_eval(ASTNode *stmts, const char **why)
+{
+    Ct e;
+    memset(&e, 0, sizeof(e));
+    if (g_config.is_freestanding || sizeof(long) != 8)
+    {
+        *why = "unsupported target";
+        return NULL;
+    }
+    for (ASTNode *n = stmts; n; n = n->next)
+    {
+        if (NODE_INCLUDE == n->type || NODE_STRUCT == n->type || NODE_ENUM == n->type ||
+            NODE_CONST == n->type || NODE_FUNCTION == n->type || NODE_IMPL == n->type)
+        {
+            *why = "block declares C-level items";
+            return NULL;
+        }
+    }
+
+    CtFlow f = ct_stmts(&e, stmts);
+    char *result = NULL;
+    if (CT_NEXT == f && !e.why)
+    {
+        result = ob_flatten(&e.out);
+        ob_write_file(&e.err, stderr);
+    }
+    else
+    {
+        *why = e.why ? e.why : "break or continue outside a loop";
+    }
+    ob_free(&e.out);
+    ob_free(&e.err);
+    return result;
+}
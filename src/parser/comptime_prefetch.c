@@ -0,0 +1,168 @@
+#include "parser.h"
+#include "zprep.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define COMPTIME_MAX_THREADS 64
+
+// ** Comptime prefetching **
+// A comptime block sees nothing of the program around it: it is parsed on its
+// own, against the preamble alone. So the blocks of a file can be found by a
+// token scan before the parser gets to them, and those the cache and the
+// interpreter cannot answer are compiled and run concurrently, each into its
+// own files. The parser then takes the outputs in source order. A
+// block whose preamble changed in between (the file declared an async
+// function first) is run again when it is reached.
+// Only the blocks before the first one that does not parse are prefetched: its
+// error, and any in the code before it, are reported when the parser gets
+// there.
+
+typedef struct
+{
+    ComptimeJob **items;
+    int count;
+    int cap;
+    atomic_int next;
+} ComptimeJobs;
+
+typedef struct
+{
+    ComptimeJobs *jobs;
+    Arena *arena;
+} ComptimeWorker;
+
+static PtrMap prefetched; // Block body start -> ComptimeJob.
+
+static void add_job(ComptimeJobs *jobs, ComptimeJob *job)
+{
+    if (jobs->count == jobs->cap)
+    {
+        jobs->cap = jobs->cap ? jobs->cap * 2 : 16;
+        jobs->items = xrealloc(jobs->items, sizeof(ComptimeJob *) * jobs->cap);
+    }
+    jobs->items[jobs->count++] = job;
+}
+
+static void *comptime_worker(void *arg)
+{
+    ComptimeWorker *w = arg;
+    ComptimeJobs *jobs = w->jobs;
+    Arena *prev = arena_switch(w->arena);
+    for (int i; (i = atomic_fetch_add(&jobs->next, 1)) < jobs->count;)
+    {
+        comptime_execute(jobs->items[i]);
+    }
+    arena_switch(prev);
+    return NULL;
+}
+
+static int comptime_thread_count(int blocks)
+{
+    long n = g_config.jobs > 0 ? g_config.jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > blocks)
+    {
+        n = blocks;
+    }
+    if (n > COMPTIME_MAX_THREADS)
+    {
+        n = COMPTIME_MAX_THREADS;
+    }
+    return n < 1 ? 1 : (int)n;
+}
+
+void prefetch_comptime(ParserContext *ctx, const Lexer *l)
+{
+    if (comptime_thread_count(2) < 2)
+    {
+        return;
+    }
+
+    // Blocks nested in a block belong to it, so they are skipped with it.
+    ComptimeJobs found = {0};
+    Lexer scan = *l;
+    while (1)
+    {
+        Token t = lexer_next(&scan);
+        if (TOK_EOF == t.type)
+        {
+            break;
+        }
+        if (TOK_COMPTIME != t.type || TOK_LBRACE != lexer_peek(&scan).type)
+        {
+            continue;
+        }
+        t = lexer_next(&scan);
+        ComptimeJob *job = xcalloc(1, sizeof(ComptimeJob));
+        job->start = t.start + t.len;
+        job->code = comptime_block_body(&scan);
+        add_job(&found, job);
+    }
+    // A single block gains nothing from running early.
+    if (found.count < 2)
+    {
+        return;
+    }
+
+    ComptimeJobs run = {0};
+    for (int i = 0; i < found.count; i++)
+    {
+        if (!comptime_prepare(ctx, found.items[i], 1))
+        {
+            break;
+        }
+        if (!found.items[i]->output)
+        {
+            add_job(&run, found.items[i]);
+        }
+        ptrmap_put(&prefetched, found.items[i]->start, found.items[i]);
+    }
+
+    int threads = comptime_thread_count(run.count);
+    if (threads <= 1)
+    {
+        for (int i = 0; i < run.count; i++)
+        {
+            comptime_execute(run.items[i]);
+        }
+        return;
+    }
+
+    // The calling thread is worker 0. Worker arenas are kept: the outputs
+    // live in them.
+    ComptimeWorker workers[COMPTIME_MAX_THREADS];
+    pthread_t tids[COMPTIME_MAX_THREADS];
+    int started = 1;
+    atomic_init(&run.next, 0);
+    arena_set_threaded(1);
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].jobs = &run;
+        workers[t].arena = arena_create("comptime-prefetch");
+    }
+    for (int t = 1; t < threads; t++)
+    {
+        if (pthread_create(&tids[t], NULL, comptime_worker, &workers[t]) != 0)
+        {
+            break; // Fewer threads; the blocks still get run.
+        }
+        started++;
+    }
+    comptime_worker(&workers[0]);
+    for (int t = 1; t < started; t++)
+    {
+        pthread_join(tids[t], NULL);
+    }
+    arena_set_threaded(0);
+}
+
+ComptimeJob *take_prefetched_comptime(ParserContext *ctx, const char *start)
+{
+    ComptimeJob *job = ptrmap_get(&prefetched, start);
+    if (!job || job->taken || job->has_async != ctx->has_async)
+    {
+        return NULL;
+    }
+    job->taken = 1;
+    return job;
+}
@@ -0,0 +1,1601 @@
+
+#include "cache.h"
+#include "parser.h"
+#include "zprep.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ** Module interface cache **
+// Every build used to re-lex and re-parse std/*.zc. The imports at the top of
+// the main file are always parsed from the same state (builtins only), so what
+// they produce -- their nodes plus everything they registered in the context
+// -- depends on nothing but the files they read. That outcome is stored as an
+// image in the on-disk cache (see cache.h), keyed by the import text, and is
+// only used while each of those files still hashes the same.
+//
+// An image is a list of records, one per object reachable from the context:
+// nodes, types, strings, registry entries. A record is the object's raw bytes
+// followed by the ids of the objects its pointer fields refer to; the xfer_*
+// functions below list those fields once for both directions. Loading maps
+// the entry, allocates every object, then patches the pointers, which is far
+// cheaper than parsing. Interned strings and types are interned again, so
+// pointer comparisons on them keep working.
+
+#define IMAGE_MAGIC 0x494d435au // "ZCMI"
+#define IMAGE_VERSION 2u
+
+typedef enum
+{
+    R_NONE,
+    R_STR,   // String: length and bytes.
+    R_ISTR,  // Interned string.
+    R_TEXT,  // Copy of a token that lies outside every source file.
+    R_SRC,   // Source file (by index) that tokens point into.
+    R_TYPE,  // Private Type.
+    R_ITYPE, // Interned Type, resolved on demand.
+    R_ARRAY, // Pointer array: element kind, count, allocated size, ids.
+    R_NODE,
+    R_TOKEN,
+    R_SCOPE,
+    R_SYMBOL,
+    R_FUNC_SIG,
+    R_TEMPLATE,
+    R_FUNC_TEMPLATE,
+    R_IMPL_TEMPLATE,
+    R_LAZY_IMPL,
+    R_LAZY_METHOD,
+    R_INSTANTIATION,
+    R_STRUCT_REF,
+    R_STRUCT_DEF,
+    R_ENUM_VARIANT,
+    R_IMPL_REG,
+    R_SLICE,
+    R_TUPLE,
+    R_MODULE,
+    R_SELECTIVE,
+    R_IMPORTED_FILE,
+    R_VAR_MUT,
+    R_DEPRECATED,
+    R_LAMBDA_REF,
+    R_KIND_COUNT
+} RecKind;
+
+// Raw size of the records that are plain structs.
+static const size_t rec_size[R_KIND_COUNT] = {
+    [R_TYPE] = sizeof(Type),
+    [R_NODE] = sizeof(ASTNode),
+    [R_TOKEN] = sizeof(Token),
+    [R_SCOPE] = sizeof(Scope),
+    [R_SYMBOL] = sizeof(Symbol),
+    [R_FUNC_SIG] = sizeof(FuncSig),
+    [R_TEMPLATE] = sizeof(GenericTemplate),
+    [R_FUNC_TEMPLATE] = sizeof(GenericFuncTemplate),
+    [R_IMPL_TEMPLATE] = sizeof(GenericImplTemplate),
+    [R_LAZY_IMPL] = sizeof(LazyImpl),
+    [R_LAZY_METHOD] = sizeof(LazyMethod),
+    [R_INSTANTIATION] = sizeof(Instantiation),
+    [R_STRUCT_REF] = sizeof(StructRef),
+    [R_STRUCT_DEF] = sizeof(StructDef),
+    [R_ENUM_VARIANT] = sizeof(EnumVariantReg),
+    [R_IMPL_REG] = sizeof(ImplReg),
+    [R_SLICE] = sizeof(SliceType),
+    [R_TUPLE] = sizeof(TupleType),
+    [R_MODULE] = sizeof(Module),
+    [R_SELECTIVE] = sizeof(SelectiveImport),
+    [R_IMPORTED_FILE] = sizeof(ImportedFile),
+    [R_VAR_MUT] = sizeof(VarMutability),
+    [R_DEPRECATED] = sizeof(DeprecatedFunc),
+    [R_LAMBDA_REF] = sizeof(LambdaRef),
+};
+
+// Kinds that may stand in for each other in a pointer field.
+static int rec_class(int kind)
+{
+    switch (kind)
+    {
+    case R_ISTR:
+        return R_STR;
+    case R_ITYPE:
+        return R_TYPE;
+    case R_SRC:
+        return R_TEXT;
+    default:
+        return kind;
+    }
+}
+
+// A file read while the imports were parsed. 'text' is NULL for a path that
+// was probed and did not exist; it must still be missing for a hit.
+typedef struct
+{
+    char *path;
+    const char *text;
+    size_t len;
+    uint64_t hash;
+} SourceFile;
+
+static struct
+{
+    int active;
+    int tainted; // Something the image cannot reproduce happened.
+    SourceFile *files;
+    int count;
+    int cap;
+} recording;
+
+typedef struct
+{
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} Bytes;
+
+typedef struct
+{
+    const unsigned char *p;
+    const unsigned char *end;
+} Reader;
+
+// Object waiting for its record (writing).
+typedef struct
+{
+    void *obj;
+    int kind;
+    int count; // R_ARRAY: elements. R_SRC: source index. R_TEXT: token length.
+    int cap;   // R_ARRAY: allocated elements. R_TEXT: bytes of line before the token.
+    int elem;  // R_ARRAY: element kind.
+} Pending;
+
+typedef struct
+{
+    int writing;
+    int failed;
+    SourceFile *srcs; // [0] is the main file.
+    int nsrcs;
+
+    // Writing.
+    Bytes *out;
+    PtrMap ids; // Object -> id.
+    Pending *pending;
+    int count;
+    int cap;
+
+    // Reading.
+    Reader *in;
+    int nobjs;
+    void **objs;
+    unsigned char *kinds;
+    const unsigned char **recs;
+    uint32_t *rec_len;
+    uint32_t *text_len;
+    int depth;
+} MCache;
+
+// ** Primitive transfers **
+
+static void put(Bytes *b, const void *p, size_t n)
+{
+    if (b->len + n > b->cap)
+    {
+        size_t cap = b->cap ? b->cap * 2 : 65536;
+        while (cap < b->len + n)
+        {
+            cap *= 2;
+        }
+        b->data = xrealloc(b->data, cap);
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void put_u32(Bytes *b, uint32_t v)
+{
+    put(b, &v, sizeof(v));
+}
+
+static int get(MCache *m, Reader *r, void *p, size_t n)
+{
+    if ((size_t)(r->end - r->p) < n)
+    {
+        m->failed = 1;
+        memset(p, 0, n);
+        return 0;
+    }
+    memcpy(p, r->p, n);
+    r->p += n;
+    return 1;
+}
+
+static uint32_t get_u32(MCache *m, Reader *r)
+{
+    uint32_t v;
+    get(m, r, &v, sizeof(v));
+    return v;
+}
+
+static void xfer_u32(MCache *m, uint32_t *v)
+{
+    if (m->writing)
+    {
+        put_u32(m->out, *v);
+    }
+    else
+    {
+        *v = get_u32(m, m->in);
+    }
+}
+
+static void xfer_int(MCache *m, int *v)
+{
+    xfer_u32(m, (uint32_t *)v);
+}
+
+// Id of 'obj', queueing it for a record the first time it is seen.
+static uint32_t ref_id(MCache *m, void *obj, int kind, int count, int cap, int elem)
+{
+    if (!obj)
+    {
+        return 0;
+    }
+    if (R_STR == kind && is_interned(obj))
+    {
+        kind = R_ISTR;
+    }
+    else if (R_TYPE == kind && ((Type *)obj)->is_interned)
+    {
+        kind = R_ITYPE;
+    }
+
+    // Token copies are made per token; everything else keeps its identity.
+    if (R_TEXT != kind)
+    {
+        uintptr_t id = (uintptr_t)ptrmap_get(&m->ids, obj);
+        if (id)
+        {
+            Pending *p = &m->pending[id - 1];
+            if (p->kind != kind || (R_ARRAY == kind && (p->count != count || p->elem != elem)))
+            {
+                m->failed = 1; // Same memory seen as two different things.
+            }
+            if (R_ARRAY == kind && cap > p->cap)
+            {
+                p->cap = cap;
+            }
+            return (uint32_t)id;
+        }
+    }
+
+    if (m->count == m->cap)
+    {
+        m->cap = m->cap ? m->cap * 2 : 4096;
+        m->pending = xrealloc(m->pending, sizeof(Pending) * m->cap);
+    }
+    m->pending[m->count] = (Pending){obj, kind, count, cap, elem};
+    uint32_t id = (uint32_t)++m->count;
+    if (R_TEXT != kind)
+    {
+        ptrmap_put(&m->ids, obj, (void *)(uintptr_t)id);
+    }
+    return id;
+}
+
+static Type *itype_get(MCache *m, uint32_t id);
+
+static void *read_ref(MCache *m, Reader *r, int kind)
+{
+    uint32_t id = get_u32(m, r);
+    if (0 == id || m->failed)
+    {
+        return NULL;
+    }
+    if (id > (uint32_t)m->nobjs || rec_class(m->kinds[id]) != rec_class(kind))
+    {
+        m->failed = 1;
+        return NULL;
+    }
+    return R_ITYPE == m->kinds[id] ? itype_get(m, id) : m->objs[id];
+}
+
+static void xfer_ptr(MCache *m, void **slot, int kind)
+{
+    if (m->writing)
+    {
+        put_u32(m->out, ref_id(m, *slot, kind, 0, 0, 0));
+    }
+    else
+    {
+        *slot = read_ref(m, m->in, kind);
+    }
+}
+
+static void xfer_array(MCache *m, void **slot, int count, int cap, int elem)
+{
+    if (m->writing)
+    {
+        put_u32(m->out, ref_id(m, *slot, R_ARRAY, count, cap, elem));
+    }
+    else
+    {
+        *slot = read_ref(m, m->in, R_ARRAY);
+    }
+}
+
+// A token's text pointer becomes (source file, offset). Tokens from generated
+// code keep a private copy of their text, padded so that the line context
+// error messages print stays addressable.
+static void xfer_token(MCache *m, Token *t)
+{
+    if (!m->writing)
+    {
+        uint32_t id = get_u32(m, m->in);
+        uint32_t off = get_u32(m, m->in);
+        t->start = NULL;
+        if (id && !m->failed)
+        {
+            if (id > (uint32_t)m->nobjs || R_TEXT != rec_class(m->kinds[id]) ||
+                off > m->text_len[id])
+            {
+                m->failed = 1;
+                return;
+            }
+            t->start = (const char *)m->objs[id] + off;
+        }
+        return;
+    }
+
+    uint32_t id = 0;
+    uint32_t off = 0;
+    if (t->start)
+    {
+        for (int i = 0; i < m->nsrcs && !id; i++)
+        {
+            const char *base = m->srcs[i].text;
+            if (base && t->start >= base && t->start <= base + m->srcs[i].len)
+            {
+                id = ref_id(m, (void *)base, R_SRC, i, 0, 0);
+                off = (uint32_t)(t->start - base);
+            }
+        }
+        if (!id)
+        {
+            int pad = t->col - 1;
+            if (pad < 0 || pad > 4096)
+            {
+                pad = 0;
+            }
+            id = ref_id(m, (void *)t->start, R_TEXT, t->len > 0 ? t->len : 0, pad, 0);
+            off = (uint32_t)pad;
+        }
+    }
+    put_u32(m->out, id);
+    put_u32(m->out, off);
+}
+
+#define X_REF(f, k) xfer_ptr(m, (void **)&(f), k)
+#define X_STR(f) X_REF(f, R_STR)
+#define X_TYPE(f) X_REF(f, R_TYPE)
+#define X_NODE(f) X_REF(f, R_NODE)
+#define X_STRS(f, n) xfer_array(m, (void **)&(f), n, n, R_STR)
+#define X_TYPES(f, n) xfer_array(m, (void **)&(f), n, n, R_TYPE)
+#define X_TOKEN(t) xfer_token(m, &(t))
+#define X_INT(f) xfer_int(m, &(f))
+
+// ** Object layouts **
+
+static void xfer_node(MCache *m, ASTNode *n)
+{
+    X_NODE(n->next);
+    X_STR(n->resolved_type);
+    X_TYPE(n->type_info);
+    X_TYPE(n->inferred_type);
+    X_TOKEN(n->token);
+    X_REF(n->definition_token, R_TOKEN);
+
+    switch (n->type)
+    {
+    case NODE_ROOT:
+        X_NODE(n->root.children);
+        break;
+    case NODE_FUNCTION:
+        X_STR(n->func.name);
+        X_STR(n->func.args);
+        X_STR(n->func.ret_type);
+        X_NODE(n->func.body);
+        X_TYPES(n->func.arg_types, n->func.arg_count);
+        X_STRS(n->func.defaults, n->func.arg_count);
+        X_STRS(n->func.param_names, n->func.arg_count);
+        X_TYPE(n->func.ret_type_info);
+        X_STR(n->func.section);
+        break;
+    case NODE_BLOCK:
+        X_NODE(n->block.statements);
+        break;
+    case NODE_RETURN:
+        X_NODE(n->ret.value);
+        break;
+    case NODE_VAR_DECL:
+    case NODE_CONST:
+        X_STR(n->var_decl.name);
+        X_STR(n->var_decl.type_str);
+        X_NODE(n->var_decl.init_expr);
+        X_TYPE(n->var_decl.type_info);
+        break;
+    case NODE_TYPE_ALIAS:
+        X_STR(n->type_alias.alias);
+        X_STR(n->type_alias.original_type);
+        break;
+    case NODE_IF:
+        X_NODE(n->if_stmt.condition);
+        X_NODE(n->if_stmt.then_body);
+        X_NODE(n->if_stmt.else_body);
+        break;
+    case NODE_WHILE:
+        X_NODE(n->while_stmt.condition);
+        X_NODE(n->while_stmt.body);
+        X_STR(n->while_stmt.loop_label);
+        break;
+    case NODE_FOR:
+        X_NODE(n->for_stmt.init);
+        X_NODE(n->for_stmt.condition);
+        X_NODE(n->for_stmt.step);
+        X_NODE(n->for_stmt.body);
+        X_STR(n->for_stmt.loop_label);
+        break;
+    case NODE_FOR_RANGE:
+        X_STR(n->for_range.var_name);
+        X_NODE(n->for_range.start);
+        X_NODE(n->for_range.end);
+        X_STR(n->for_range.step);
+        X_NODE(n->for_range.body);
+        break;
+    case NODE_LOOP:
+        X_NODE(n->loop_stmt.body);
+        X_STR(n->loop_stmt.loop_label);
+        break;
+    case NODE_REPEAT:
+        X_STR(n->repeat_stmt.count);
+        X_NODE(n->repeat_stmt.body);
+        break;
+    case NODE_UNLESS:
+        X_NODE(n->unless_stmt.condition);
+        X_NODE(n->unless_stmt.body);
+        break;
+    case NODE_GUARD:
+        X_NODE(n->guard_stmt.condition);
+        X_NODE(n->guard_stmt.body);
+        break;
+    case NODE_DO_WHILE:
+        X_NODE(n->do_while_stmt.condition);
+        X_NODE(n->do_while_stmt.body);
+        X_STR(n->do_while_stmt.loop_label);
+        break;
+    case NODE_BREAK:
+        X_STR(n->break_stmt.target_label);
+        break;
+    case NODE_CONTINUE:
+        X_STR(n->continue_stmt.target_label);
+        break;
+    case NODE_MATCH:
+        X_NODE(n->match_stmt.expr);
+        X_NODE(n->match_stmt.cases);
+        break;
+    case NODE_MATCH_CASE:
+        X_STR(n->match_case.pattern);
+        X_STR(n->match_case.binding_name);
+        X_NODE(n->match_case.guard);
+        X_NODE(n->match_case.body);
+        break;
+    case NODE_EXPR_BINARY:
+        X_STR(n->binary.op);
+        X_NODE(n->binary.left);
+        X_NODE(n->binary.right);
+        break;
+    case NODE_EXPR_UNARY:
+    case NODE_AWAIT:
+        X_STR(n->unary.op);
+        X_NODE(n->unary.operand);
+        break;
+    case NODE_EXPR_LITERAL:
+        X_STR(n->literal.string_val);
+        break;
+    case NODE_EXPR_VAR:
+        X_STR(n->var_ref.name);
+        X_STR(n->var_ref.suggestion);
+        break;
+    case NODE_EXPR_CALL:
+        X_NODE(n->call.callee);
+        X_NODE(n->call.args);
+        X_STRS(n->call.arg_names, n->call.arg_count);
+        break;
+    case NODE_EXPR_MEMBER:
+        X_NODE(n->member.target);
+        X_STR(n->member.field);
+        break;
+    case NODE_EXPR_INDEX:
+        X_NODE(n->index.array);
+        X_NODE(n->index.index);
+        break;
+    case NODE_EXPR_SLICE:
+        X_NODE(n->slice.array);
+        X_NODE(n->slice.start);
+        X_NODE(n->slice.end);
+        break;
+    case NODE_EXPR_CAST:
+        X_STR(n->cast.target_type);
+        X_NODE(n->cast.expr);
+        break;
+    case NODE_EXPR_SIZEOF:
+    case NODE_TYPEOF:
+        X_STR(n->size_of.target_type);
+        X_NODE(n->size_of.expr);
+        break;
+    case NODE_EXPR_STRUCT_INIT:
+        X_STR(n->struct_init.struct_name);
+        X_NODE(n->struct_init.fields);
+        break;
+    case NODE_EXPR_ARRAY_LITERAL:
+        X_NODE(n->array_literal.elements);
+        break;
+    case NODE_STRUCT:
+        X_STR(n->strct.name);
+        X_NODE(n->strct.fields);
+        X_STR(n->strct.generic_param);
+        X_STR(n->strct.parent);
+        break;
+    case NODE_FIELD:
+        X_STR(n->field.name);
+        X_STR(n->field.type);
+        break;
+    case NODE_ENUM:
+        X_STR(n->enm.name);
+        X_NODE(n->enm.variants);
+        X_STR(n->enm.generic_param);
+        break;
+    case NODE_ENUM_VARIANT:
+        X_STR(n->variant.name);
+        X_TYPE(n->variant.payload);
+        break;
+    case NODE_TRAIT:
+        X_STR(n->trait.name);
+        X_NODE(n->trait.methods);
+        break;
+    case NODE_IMPL:
+        X_STR(n->impl.struct_name);
+        X_NODE(n->impl.methods);
+        break;
+    case NODE_IMPL_TRAIT:
+        X_STR(n->impl_trait.trait_name);
+        X_STR(n->impl_trait.target_type);
+        X_NODE(n->impl_trait.methods);
+        break;
+    case NODE_INCLUDE:
+        X_STR(n->include.path);
+        break;
+    case NODE_RAW_STMT:
+        X_STR(n->raw_stmt.content);
+        X_STRS(n->raw_stmt.used_symbols, n->raw_stmt.used_symbol_count);
+        break;
+    case NODE_TEST:
+        X_STR(n->test_stmt.name);
+        X_NODE(n->test_stmt.body);
+        break;
+    case NODE_ASSERT:
+        X_NODE(n->assert_stmt.condition);
+        X_STR(n->assert_stmt.message);
+        break;
+    case NODE_DEFER:
+        X_NODE(n->defer_stmt.stmt);
+        break;
+    case NODE_DESTRUCT_VAR:
+        X_STRS(n->destruct.names, n->destruct.count);
+        X_NODE(n->destruct.init_expr);
+        X_STR(n->destruct.struct_name);
+        X_STRS(n->destruct.field_names, n->destruct.count);
+        X_STR(n->destruct.guard_variant);
+        X_NODE(n->destruct.else_block);
+        break;
+    case NODE_TERNARY:
+        X_NODE(n->ternary.cond);
+        X_NODE(n->ternary.true_expr);
+        X_NODE(n->ternary.false_expr);
+        break;
+    case NODE_ASM:
+        X_STR(n->asm_stmt.code);
+        X_STRS(n->asm_stmt.outputs, n->asm_stmt.num_outputs);
+        X_STRS(n->asm_stmt.output_modes, n->asm_stmt.num_outputs);
+        X_STRS(n->asm_stmt.inputs, n->asm_stmt.num_inputs);
+        X_STRS(n->asm_stmt.clobbers, n->asm_stmt.num_clobbers);
+        break;
+    case NODE_LAMBDA:
+        X_STRS(n->lambda.param_names, n->lambda.num_params);
+        X_STRS(n->lambda.param_types, n->lambda.num_params);
+        X_STR(n->lambda.return_type);
+        X_NODE(n->lambda.body);
+        X_STRS(n->lambda.captured_vars, n->lambda.num_captures);
+        X_STRS(n->lambda.captured_types, n->lambda.num_captures);
+        break;
+    case NODE_GOTO:
+        X_STR(n->goto_stmt.label_name);
+        X_NODE(n->goto_stmt.goto_expr);
+        break;
+    case NODE_LABEL:
+        X_STR(n->label_stmt.label_name);
+        break;
+    case NODE_TRY:
+        X_NODE(n->try_stmt.expr);
+        break;
+    case NODE_REFLECTION:
+        X_TYPE(n->reflection.target_type);
+        break;
+    case NODE_REPL_PRINT:
+        X_NODE(n->repl_print.expr);
+        break;
+    default:
+        // Plugin output depends on the plugin, not on the sources.
+        m->failed = 1;
+        break;
+    }
+}
+
+static void xfer_symtab(MCache *m, SymbolTable *t)
+{
+    X_INT(t->cap);
+    X_INT(t->count);
+    xfer_array(m, (void **)&t->slots, t->cap, t->cap, R_SYMBOL);
+}
+
+static void xfer_map(MCache *m, HashMap *map, int value_kind)
+{
+    X_INT(map->cap);
+    X_INT(map->count);
+    if (!m->writing)
+    {
+        if (map->cap < 0 || map->cap > (1 << 24) || (map->cap & (map->cap - 1)))
+        {
+            m->failed = 1;
+            map->cap = 0;
+        }
+        map->entries = map->cap ? xcalloc(map->cap, sizeof(HashMapEntry)) : NULL;
+    }
+    for (int i = 0; i < map->cap && !m->failed; i++)
+    {
+        HashMapEntry *e = &map->entries[i];
+        X_STR(e->key);
+        if (e->key)
+        {
+            xfer_u32(m, &e->hash);
+            X_REF(e->value, value_kind);
+        }
+    }
+}
+
+static void xfer_object(MCache *m, int kind, void *obj)
+{
+    switch (kind)
+    {
+    case R_TYPE:
+    {
+        Type *t = obj;
+        X_STR(t->name);
+        X_TYPE(t->inner);
+        X_TYPES(t->args, t->arg_count);
+        X_STR(t->str);
+        break;
+    }
+    case R_NODE:
+        xfer_node(m, obj);
+        break;
+    case R_TOKEN:
+        X_TOKEN(*(Token *)obj);
+        break;
+    case R_SCOPE:
+    {
+        Scope *s = obj;
+        X_REF(s->symbols, R_SYMBOL);
+        xfer_array(m, (void **)&s->table.slots, s->table.cap, s->table.cap, R_SYMBOL);
+        X_REF(s->parent, R_SCOPE);
+        break;
+    }
+    case R_SYMBOL:
+    {
+        Symbol *s = obj;
+        X_STR(s->name);
+        X_STR(s->type_name);
+        X_TYPE(s->type_info);
+        X_TOKEN(s->decl_token);
+        X_REF(s->next, R_SYMBOL);
+        break;
+    }
+    case R_FUNC_SIG:
+    {
+        FuncSig *f = obj;
+        X_STR(f->name);
+        X_TOKEN(f->decl_token);
+        X_STRS(f->defaults, f->total_args);
+        X_TYPES(f->arg_types, f->total_args);
+        X_TYPE(f->ret_type);
+        X_REF(f->next, R_FUNC_SIG);
+        break;
+    }
+    case R_TEMPLATE:
+    {
+        GenericTemplate *t = obj;
+        X_STR(t->name);
+        X_NODE(t->struct_node);
+        X_REF(t->next, R_TEMPLATE);
+        break;
+    }
+    case R_FUNC_TEMPLATE:
+    {
+        GenericFuncTemplate *t = obj;
+        X_STR(t->name);
+        X_STR(t->generic_param);
+        X_NODE(t->func_node);
+        X_REF(t->next, R_FUNC_TEMPLATE);
+        break;
+    }
+    case R_IMPL_TEMPLATE:
+    {
+        GenericImplTemplate *t = obj;
+        X_STR(t->struct_name);
+        X_STR(t->generic_param);
+        X_NODE(t->impl_node);
+        X_REF(t->next, R_IMPL_TEMPLATE);
+        X_REF(t->next_same_struct, R_IMPL_TEMPLATE);
+        break;
+    }
+    case R_LAZY_IMPL:
+    {
+        // The substitution's maps only memoize; they start out empty again.
+        LazyImpl *li = obj;
+        X_STR(li->subst.param);
+        X_STR(li->subst.concrete);
+        X_STR(li->subst.old_struct);
+        X_STR(li->subst.new_struct);
+        X_STR(li->subst.clean_concrete);
+        if (!m->writing)
+        {
+            memset(&li->subst.type_strs, 0, sizeof(HashMap));
+            memset(&li->subst.names, 0, sizeof(HashMap));
+            memset(&li->subst.types, 0, sizeof(PtrMap));
+        }
+        X_NODE(li->impl);
+        xfer_array(m, (void **)&li->slots, li->count, li->count, R_NODE);
+        break;
+    }
+    case R_LAZY_METHOD:
+    {
+        LazyMethod *lm = obj;
+        X_REF(lm->owner, R_LAZY_IMPL);
+        X_NODE(lm->tmpl);
+        X_STR(lm->name);
+        X_REF(lm->next_same_method, R_LAZY_METHOD);
+        break;
+    }
+    case R_INSTANTIATION:
+    {
+        Instantiation *i = obj;
+        X_STR(i->name);
+        X_STR(i->template_name);
+        X_STR(i->concrete_arg);
+        X_TYPE(i->type);
+        X_NODE(i->struct_node);
+        X_REF(i->next, R_INSTANTIATION);
+        X_REF(i->next_same_template, R_INSTANTIATION);
+        break;
+    }
+    case R_STRUCT_REF:
+    {
+        StructRef *r = obj;
+        X_NODE(r->node);
+        X_REF(r->next, R_STRUCT_REF);
+        break;
+    }
+    case R_STRUCT_DEF:
+    {
+        StructDef *d = obj;
+        X_STR(d->name);
+        X_NODE(d->node);
+        X_REF(d->next, R_STRUCT_DEF);
+        break;
+    }
+    case R_ENUM_VARIANT:
+    {
+        EnumVariantReg *v = obj;
+        X_STR(v->enum_name);
+        X_STR(v->variant_name);
+        X_REF(v->next, R_ENUM_VARIANT);
+        break;
+    }
+    case R_IMPL_REG:
+    {
+        ImplReg *r = obj;
+        X_STR(r->trait);
+        X_STR(r->strct);
+        X_REF(r->next, R_IMPL_REG);
+        break;
+    }
+    case R_SLICE:
+    {
+        SliceType *s = obj;
+        X_STR(s->name);
+        X_REF(s->next, R_SLICE);
+        break;
+    }
+    case R_TUPLE:
+    {
+        TupleType *t = obj;
+        X_STR(t->sig);
+        X_REF(t->next, R_TUPLE);
+        break;
+    }
+    case R_MODULE:
+    {
+        Module *mod = obj;
+        X_STR(mod->alias);
+        X_STR(mod->path);
+        X_STR(mod->base_name);
+        X_REF(mod->next, R_MODULE);
+        break;
+    }
+    case R_SELECTIVE:
+    {
+        SelectiveImport *si = obj;
+        X_STR(si->symbol);
+        X_STR(si->alias);
+        X_STR(si->source_module);
+        X_REF(si->next, R_SELECTIVE);
+        break;
+    }
+    case R_IMPORTED_FILE:
+    {
+        ImportedFile *f = obj;
+        X_STR(f->path);
+        X_REF(f->next, R_IMPORTED_FILE);
+        break;
+    }
+    case R_VAR_MUT:
+    {
+        VarMutability *v = obj;
+        X_STR(v->name);
+        X_REF(v->next, R_VAR_MUT);
+        break;
+    }
+    case R_DEPRECATED:
+    {
+        DeprecatedFunc *d = obj;
+        X_STR(d->name);
+        X_STR(d->reason);
+        X_REF(d->next, R_DEPRECATED);
+        break;
+    }
+    case R_LAMBDA_REF:
+    {
+        LambdaRef *r = obj;
+        X_NODE(r->node);
+        X_REF(r->next, R_LAMBDA_REF);
+        break;
+    }
+    default:
+        m->failed = 1;
+        break;
+    }
+}
+
+// Everything parsing the imports can have changed in the context.
+static void xfer_context(MCache *m, ParserContext *c)
+{
+    if (m->writing && (c->imported_plugins || c->current_module_prefix || c->current_impl_struct))
+    {
+        m->failed = 1;
+        return;
+    }
+
+    X_REF(c->current_scope, R_SCOPE);
+    X_REF(c->func_registry, R_FUNC_SIG);
+
+    xfer_map(m, &c->index.funcs, R_FUNC_SIG);
+    xfer_map(m, &c->index.templates, R_TEMPLATE);
+    xfer_map(m, &c->index.func_templates, R_FUNC_TEMPLATE);
+    xfer_map(m, &c->index.impl_templates, R_IMPL_TEMPLATE);
+    xfer_map(m, &c->index.instantiations, R_INSTANTIATION);
+    xfer_map(m, &c->index.inst_by_template, R_INSTANTIATION);
+    xfer_map(m, &c->index.parsed_structs, R_NODE);
+    xfer_map(m, &c->index.parsed_enums, R_NODE);
+    xfer_map(m, &c->index.struct_defs, R_STRUCT_DEF);
+    xfer_map(m, &c->index.enum_variants, R_ENUM_VARIANT);
+    xfer_map(m, &c->index.impls, R_IMPL_REG);
+    xfer_map(m, &c->index.imported_files, R_IMPORTED_FILE);
+    xfer_map(m, &c->index.var_mutability, R_VAR_MUT);
+    xfer_map(m, &c->index.lazy_methods, R_LAZY_METHOD);
+    xfer_map(m, &c->index.lazy_by_method, R_LAZY_METHOD);
+
+    X_REF(c->global_lambdas, R_LAMBDA_REF);
+    X_INT(c->lambda_counter);
+
+    X_INT(c->known_generics_count);
+    if (c->known_generics_count < 0 || c->known_generics_count > MAX_KNOWN_GENERICS)
+    {
+        m->failed = 1;
+        return;
+    }
+    for (int i = 0; i < c->known_generics_count; i++)
+    {
+        X_STR(c->known_generics[i]);
+    }
+    X_REF(c->templates, R_TEMPLATE);
+    X_REF(c->func_templates, R_FUNC_TEMPLATE);
+    X_REF(c->impl_templates, R_IMPL_TEMPLATE);
+
+    X_REF(c->instantiations, R_INSTANTIATION);
+    X_NODE(c->instantiated_structs);
+    X_NODE(c->instantiated_funcs);
+
+    X_REF(c->parsed_structs_list, R_STRUCT_REF);
+    X_REF(c->parsed_enums_list, R_STRUCT_REF);
+    X_REF(c->parsed_funcs_list, R_STRUCT_REF);
+    X_REF(c->parsed_impls_list, R_STRUCT_REF);
+    X_REF(c->parsed_globals_list, R_STRUCT_REF);
+    X_REF(c->struct_defs, R_STRUCT_DEF);
+    X_REF(c->enum_variants, R_ENUM_VARIANT);
+    X_REF(c->registered_impls, R_IMPL_REG);
+
+    X_REF(c->used_slices, R_SLICE);
+    X_REF(c->used_tuples, R_TUPLE);
+
+    X_REF(c->modules, R_MODULE);
+    X_REF(c->selective_imports, R_SELECTIVE);
+    X_REF(c->imported_files, R_IMPORTED_FILE);
+
+    X_INT(c->immutable_by_default);
+    X_REF(c->var_mutability_table, R_VAR_MUT);
+    X_REF(c->deprecated_funcs, R_DEPRECATED);
+
+    X_REF(c->all_symbols, R_SYMBOL);
+    xfer_symtab(m, &c->all_symbols_index);
+
+    // register_extern_symbol() grows the array 64 entries at a time.
+    X_INT(c->has_external_includes);
+    X_INT(c->extern_symbol_count);
+    int extern_cap = (c->extern_symbol_count + 63) / 64 * 64;
+    xfer_array(m, (void **)&c->extern_symbols, c->extern_symbol_count, extern_cap, R_STR);
+    X_INT(c->has_async);
+}
+
+// ** Writing **
+
+static void write_record(MCache *m, Bytes *b, int id)
+{
+    Pending p = m->pending[id - 1];
+    unsigned char kind = (unsigned char)p.kind;
+    put(b, &kind, 1);
+    size_t len_at = b->len;
+    put_u32(b, 0);
+
+    m->out = b;
+    switch (p.kind)
+    {
+    case R_STR:
+    case R_ISTR:
+    {
+        uint32_t len = (uint32_t)strlen(p.obj);
+        put_u32(b, len);
+        put(b, p.obj, len);
+        break;
+    }
+    case R_TEXT:
+        put_u32(b, (uint32_t)p.cap);
+        put_u32(b, (uint32_t)p.count);
+        put(b, p.obj, p.count);
+        break;
+    case R_SRC:
+        put_u32(b, (uint32_t)p.count);
+        break;
+    case R_ITYPE:
+    {
+        Type *t = p.obj;
+        put_u32(b, t->kind);
+        put_u32(b, (uint32_t)t->arg_count);
+        put_u32(b, (uint32_t)t->is_const);
+        put_u32(b, (uint32_t)t->array_size);
+        put_u32(b, ref_id(m, t->name, R_STR, 0, 0, 0));
+        put_u32(b, ref_id(m, t->inner, R_TYPE, 0, 0, 0));
+        for (int i = 0; i < t->arg_count; i++)
+        {
+            put_u32(b, ref_id(m, t->args[i], R_TYPE, 0, 0, 0));
+        }
+        break;
+    }
+    case R_ARRAY:
+    {
+        void **elems = p.obj;
+        put_u32(b, (uint32_t)p.elem);
+        put_u32(b, (uint32_t)p.count);
+        put_u32(b, (uint32_t)p.cap);
+        for (int i = 0; i < p.count; i++)
+        {
+            put_u32(b, ref_id(m, elems[i], p.elem, 0, 0, 0));
+        }
+        break;
+    }
+    default:
+        put(b, p.obj, rec_size[p.kind]);
+        xfer_object(m, p.kind, p.obj);
+        break;
+    }
+
+    uint32_t len = (uint32_t)(b->len - len_at - sizeof(uint32_t));
+    memcpy(b->data + len_at, &len, sizeof(len));
+}
+
+static int write_all(int fd, const Bytes *b)
+{
+    size_t off = 0;
+    while (off < b->len)
+    {
+        ssize_t n = write(fd, b->data + off, b->len - off);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    return 0;
+}
+
+static void save_image(ParserContext *ctx, ASTNode *nodes, const char *entry)
+{
+    MCache mc = {0};
+    MCache *m = &mc;
+    m->writing = 1;
+    m->srcs = recording.files;
+    m->nsrcs = recording.count;
+
+    Bytes root = {0};
+    m->out = &root;
+    xfer_context(m, ctx);
+    X_NODE(nodes);
+
+    Bytes objs = {0};
+    for (int id = 1; id <= m->count && !m->failed; id++)
+    {
+        write_record(m, &objs, id);
+    }
+    if (m->failed)
+    {
+        return;
+    }
+
+    Bytes head = {0};
+    put_u32(&head, IMAGE_MAGIC);
+    put_u32(&head, IMAGE_VERSION);
+    put_u32(&head, (uint32_t)(recording.count - 1));
+    for (int i = 1; i < recording.count; i++)
+    {
+        SourceFile *f = &recording.files[i];
+        uint32_t len = (uint32_t)strlen(f->path);
+        put_u32(&head, f->text ? 1 : 0);
+        put(&head, &f->hash, sizeof(f->hash));
+        put_u32(&head, len);
+        put(&head, f->path, len);
+    }
+    put_u32(&head, (uint32_t)root.len);
+    put(&head, root.data, root.len);
+    put_u32(&head, (uint32_t)m->count);
+
+    char tmp[PATH_MAX + 32];
+    cache_temp_path(tmp, sizeof(tmp), entry);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+    int ok = 0 == write_all(fd, &head) && 0 == write_all(fd, &objs);
+    if (0 != close(fd) || !ok || 0 != rename(tmp, entry))
+    {
+        unlink(tmp);
+    }
+}
+
+// ** Reading **
+
+static Type *itype_get(MCache *m, uint32_t id)
+{
+    if (m->objs[id])
+    {
+        return m->objs[id];
+    }
+    if (++m->depth > 256)
+    {
+        m->failed = 1;
+        return NULL;
+    }
+
+    Reader r = {m->recs[id], m->recs[id] + m->rec_len[id]};
+    Type key = {0};
+    key.kind = (TypeKind)get_u32(m, &r);
+    key.arg_count = (int)get_u32(m, &r);
+    key.is_const = (int)get_u32(m, &r);
+    key.array_size = (int)get_u32(m, &r);
+    key.name = read_ref(m, &r, R_STR);
+    key.inner = read_ref(m, &r, R_TYPE);
+    if (key.arg_count < 0 || (size_t)key.arg_count > (size_t)(r.end - r.p) / sizeof(uint32_t))
+    {
+        m->failed = 1;
+    }
+    else if (key.arg_count > 0)
+    {
+        key.args = xmalloc(sizeof(Type *) * key.arg_count);
+        for (int i = 0; i < key.arg_count; i++)
+        {
+            key.args[i] = read_ref(m, &r, R_TYPE);
+        }
+    }
+    m->depth--;
+    if (m->failed)
+    {
+        return NULL;
+    }
+    m->objs[id] = type_intern(&key);
+    return m->objs[id];
+}
+
+// First pass: create every object, so the second can patch pointers in any
+// order. Strings are complete after this pass.
+static void load_objects(MCache *m, Reader *r)
+{
+    for (int id = 1; id <= m->nobjs && !m->failed; id++)
+    {
+        unsigned char kind;
+        get(m, r, &kind, 1);
+        uint32_t len = get_u32(m, r);
+        if (m->failed || kind <= R_NONE || kind >= R_KIND_COUNT || len > (size_t)(r->end - r->p))
+        {
+            m->failed = 1;
+            return;
+        }
+        m->kinds[id] = kind;
+        m->recs[id] = r->p;
+        m->rec_len[id] = len;
+        Reader rec = {r->p, r->p + len};
+        r->p += len;
+
+        switch (kind)
+        {
+        case R_STR:
+        case R_ISTR:
+        {
+            uint32_t n = get_u32(m, &rec);
+            if (n > (size_t)(rec.end - rec.p))
+            {
+                m->failed = 1;
+                return;
+            }
+            if (R_ISTR == kind)
+            {
+                m->objs[id] = intern_n((const char *)rec.p, (int)n);
+            }
+            else
+            {
+                char *s = xmalloc(n + 1);
+                memcpy(s, rec.p, n);
+                s[n] = 0;
+                m->objs[id] = s;
+            }
+            break;
+        }
+        case R_TEXT:
+        {
+            uint32_t pad = get_u32(m, &rec);
+            uint32_t n = get_u32(m, &rec);
+            if (n > (size_t)(rec.end - rec.p) || pad > 4096)
+            {
+                m->failed = 1;
+                return;
+            }
+            char *s = xmalloc(pad + n + 1);
+            memset(s, ' ', pad);
+            memcpy(s + pad, rec.p, n);
+            s[pad + n] = 0;
+            m->objs[id] = s;
+            m->text_len[id] = pad + n;
+            break;
+        }
+        case R_SRC:
+        {
+            uint32_t i = get_u32(m, &rec);
+            if (i >= (uint32_t)m->nsrcs || !m->srcs[i].text)
+            {
+                m->failed = 1;
+                return;
+            }
+            m->objs[id] = (void *)m->srcs[i].text;
+            m->text_len[id] = (uint32_t)m->srcs[i].len;
+            break;
+        }
+        case R_ITYPE:
+            break;
+        case R_ARRAY:
+        {
+            get_u32(m, &rec);
+            uint32_t count = get_u32(m, &rec);
+            uint32_t cap = get_u32(m, &rec);
+            if (count > (size_t)(rec.end - rec.p) / sizeof(uint32_t) || cap > (1u << 24))
+            {
+                m->failed = 1;
+                return;
+            }
+            m->objs[id] = xcalloc(cap > count ? cap : (count ? count : 1), sizeof(void *));
+            break;
+        }
+        case R_NODE:
+            if (len < sizeof(ASTNode))
+            {
+                m->failed = 1;
+                return;
+            }
+            m->objs[id] = ast_create(NODE_ROOT);
+            break;
+        default:
+            if (len < rec_size[kind])
+            {
+                m->failed = 1;
+                return;
+            }
+            m->objs[id] = xcalloc(1, rec_size[kind]);
+            break;
+        }
+    }
+}
+
+// Second pass: raw bytes, then pointer fields.
+static void link_objects(MCache *m)
+{
+    for (int id = 1; id <= m->nobjs && !m->failed; id++)
+    {
+        int kind = m->kinds[id];
+        Reader rec = {m->recs[id], m->recs[id] + m->rec_len[id]};
+        m->in = &rec;
+        if (R_ARRAY == kind)
+        {
+            int elem = (int)get_u32(m, &rec);
+            uint32_t count = get_u32(m, &rec);
+            get_u32(m, &rec);
+            void **elems = m->objs[id];
+            for (uint32_t i = 0; i < count; i++)
+            {
+                elems[i] = read_ref(m, &rec, elem);
+            }
+        }
+        else if (rec_size[kind])
+        {
+            get(m, &rec, m->objs[id], rec_size[kind]);
+            if (R_NODE == kind && (unsigned)((ASTNode *)m->objs[id])->type > NODE_REPL_PRINT)
+            {
+                m->failed = 1;
+                return;
+            }
+            xfer_object(m, kind, m->objs[id]);
+        }
+        else
+        {
+            continue;
+        }
+        if (rec.p != rec.end)
+        {
+            m->failed = 1;
+        }
+    }
+}
+
+static int load_image(ParserContext *ctx, const char *entry, const char *main_src,
+                      ASTNode **nodes)
+{
+    int fd = open(entry, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (0 == fstat(fd, &st) && st.st_size > 0)
+    {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (MAP_FAILED == map)
+    {
+        return 0;
+    }
+
+    MCache mc = {0};
+    MCache *m = &mc;
+    Reader r = {map, (const unsigned char *)map + st.st_size};
+    if (IMAGE_MAGIC != get_u32(m, &r) || IMAGE_VERSION != get_u32(m, &r))
+    {
+        m->failed = 1;
+    }
+
+    // Every file the image was built from must be unchanged (or still absent).
+    uint32_t ndeps = get_u32(m, &r);
+    if (ndeps > 65536)
+    {
+        m->failed = 1;
+        ndeps = 0;
+    }
+    m->srcs = xcalloc(ndeps + 1, sizeof(SourceFile));
+    m->srcs[0].text = main_src;
+    m->srcs[0].len = strlen(main_src);
+    m->nsrcs = (int)ndeps + 1;
+    for (uint32_t i = 1; i <= ndeps && !m->failed; i++)
+    {
+        uint32_t present = get_u32(m, &r);
+        uint64_t hash;
+        get(m, &r, &hash, sizeof(hash));
+        uint32_t len = get_u32(m, &r);
+        if (m->failed || len > (size_t)(r.end - r.p) || len >= PATH_MAX)
+        {
+            m->failed = 1;
+            break;
+        }
+        char path[PATH_MAX];
+        memcpy(path, r.p, len);
+        path[len] = 0;
+        r.p += len;
+
+        if (!present)
+        {
+            m->failed = 0 == access(path, F_OK);
+            continue;
+        }
+        char *text = load_file(path);
+        size_t tlen = text ? strlen(text) : 0;
+        if (!text || cache_hash(CACHE_HASH_SEED, text, tlen) != hash)
+        {
+            m->failed = 1;
+            break;
+        }
+        m->srcs[i].text = text;
+        m->srcs[i].len = tlen;
+    }
+
+    uint32_t root_len = get_u32(m, &r);
+    Reader root = {r.p, r.p};
+    if (!m->failed && root_len <= (size_t)(r.end - r.p))
+    {
+        root.end = r.p + root_len;
+        r.p += root_len;
+    }
+    else
+    {
+        m->failed = 1;
+    }
+
+    m->nobjs = (int)get_u32(m, &r);
+    if (!m->failed && (size_t)m->nobjs <= (size_t)(r.end - r.p) / 5)
+    {
+        m->objs = xcalloc(m->nobjs + 1, sizeof(void *));
+        m->kinds = xcalloc(m->nobjs + 1, 1);
+        m->recs = xcalloc(m->nobjs + 1, sizeof(unsigned char *));
+        m->rec_len = xcalloc(m->nobjs + 1, sizeof(uint32_t));
+        m->text_len = xcalloc(m->nobjs + 1, sizeof(uint32_t));
+        load_objects(m, &r);
+        link_objects(m);
+    }
+    else
+    {
+        m->failed = 1;
+    }
+
+    // Read into a copy so a bad image leaves the context untouched.
+    ParserContext img = *ctx;
+    if (!m->failed)
+    {
+        m->in = &root;
+        xfer_context(m, &img);
+        X_NODE(*nodes);
+    }
+    munmap(map, (size_t)st.st_size);
+    if (m->failed || root.p != root.end)
+    {
+        return 0;
+    }
+
+    // Traits live in a process-wide table rather than in the context.
+    for (int id = 1; id <= m->nobjs; id++)
+    {
+        ASTNode *n = m->objs[id];
+        if (R_NODE == m->kinds[id] && NODE_TRAIT == n->type && n->trait.name)
+        {
+            register_trait(n->trait.name);
+        }
+    }
+    *ctx = img;
+    return 1;
+}
+
+// ** Parsing **
+
+// Moves 'l' past the imports at the top of a file (with the comments and
+// semicolons between them) and returns how many there were. Plugin imports
+// end the run: what they register lives outside the context.
+static int skip_leading_imports(Lexer *l)
+{
+    int n = 0;
+    Lexer scan = *l;
+    while (1)
+    {
+        Token t = lexer_peek(&scan);
+        if (TOK_COMMENT == t.type || TOK_SEMICOLON == t.type)
+        {
+            lexer_next(&scan);
+            continue;
+        }
+        if (TOK_IDENT != t.type || !is_token(t, "import") ||
+            is_token(lexer_peek2(&scan), "plugin"))
+        {
+            break;
+        }
+        lexer_next(&scan);
+
+        t = lexer_next(&scan);
+        if (TOK_LBRACE == t.type)
+        {
+            do
+            {
+                t = lexer_next(&scan);
+            } while (TOK_IDENT == t.type || TOK_COMMA == t.type);
+            if (TOK_RBRACE != t.type || !is_token(lexer_next(&scan), "from") ||
+                TOK_STRING != lexer_next(&scan).type)
+            {
+                break;
+            }
+        }
+        else if (TOK_STRING != t.type)
+        {
+            break;
+        }
+        else if (is_token(lexer_peek(&scan), "as"))
+        {
+            lexer_next(&scan);
+            if (TOK_IDENT != lexer_next(&scan).type)
+            {
+                break;
+            }
+        }
+        *l = scan;
+        n++;
+    }
+    return n;
+}
+
+// The imports themselves, exactly as parse_program_nodes() would parse them.
+static ASTNode *parse_imports_until(ParserContext *ctx, Lexer *l, const Lexer *end)
+{
+    ASTNode *h = NULL, *tl = NULL;
+    while (l->pos < end->pos)
+    {
+        Token t = lexer_peek(l);
+        if (TOK_IDENT != t.type || !is_token(t, "import"))
+        {
+            lexer_next(l);
+            continue;
+        }
+        ASTNode *s = parse_import(ctx, l);
+        if (s)
+        {
+            if (!h)
+            {
+                h = s;
+            }
+            else
+            {
+                tl->next = s;
+            }
+            tl = s;
+            while (tl->next)
+            {
+                tl = tl->next;
+            }
+        }
+    }
+    return h;
+}
+
+static int imports_key(ParserContext *ctx, const Lexer *l, const Lexer *end, uint64_t *key)
+{
+    char cwd[PATH_MAX];
+    const char *self = cache_self_id();
+    if (!self || !getcwd(cwd, sizeof(cwd)))
+    {
+        return 0;
+    }
+    // Imports resolve against the working directory and the main file's
+    // directory; everything else that shapes the parse is the compiler.
+    uint64_t h = cache_hash_str(CACHE_HASH_SEED, "zc-modules-1");
+    h = cache_hash_str(h, self);
+    h = cache_hash_str(h, cwd);
+    h = cache_hash_str(h, g_current_filename);
+    h = cache_hash(h, l->src, (size_t)end->pos);
+    h = cache_hash(h, &ctx->immutable_by_default, sizeof(ctx->immutable_by_default));
+    *key = h;
+    return 1;
+}
+
+ASTNode *parse_imports_cached(ParserContext *ctx, Lexer *l)
+{
+    Lexer end = *l;
+    if (0 != l->pos || 0 == skip_leading_imports(&end))
+    {
+        return NULL;
+    }
+
+    char entry[PATH_MAX];
+    uint64_t key;
+    if (!imports_key(ctx, l, &end, &key) ||
+        !cache_entry_path(entry, sizeof(entry), "mod-", key))
+    {
+        return NULL;
+    }
+
+    ASTNode *nodes = NULL;
+    if (load_image(ctx, entry, l->src, &nodes))
+    {
+        cache_touch(entry);
+        if (g_config.verbose)
+        {
+            printf("[zc] Module cache hit: %s\n", entry);
+        }
+        *l = end;
+        return nodes;
+    }
+    if (g_config.verbose)
+    {
+        printf("[zc] Module cache miss: %s\n", entry);
+    }
+
+    memset(&recording, 0, sizeof(recording));
+    recording.active = 1;
+    module_cache_note_file(g_current_filename, l->src);
+    nodes = parse_imports_until(ctx, l, &end);
+    recording.active = 0;
+
+    if (!recording.tainted && l->pos == end.pos)
+    {
+        save_image(ctx, nodes, entry);
+    }
+    return nodes;
+}
+
+void module_cache_note_file(const char *path, const char *text)
+{
+    if (!recording.active)
+    {
+        return;
+    }
+    if (recording.count == recording.cap)
+    {
+        recording.cap = recording.cap ? recording.cap * 2 : 32;
+        recording.files = xrealloc(recording.files, sizeof(SourceFile) * recording.cap);
+    }
+    SourceFile *f = &recording.files[recording.count++];
+    f->path = xstrdup(path);
+    f->text = text;
+    f->len = text ? strlen(text) : 0;
+    f->hash = text ? cache_hash(CACHE_HASH_SEED, text, f->len) : 0;
+}
+
+void module_cache_taint(void)
+{
+    if (recording.active)
+    {
+        recording.tainted = 1;
+    }
+}
@@ -3,6 +3,8 @@
 #define PARSER_H
 
 #include "ast.h"
+#include "hashmap.h"
+#include "outbuf.h"
 #include "zprep.h"
 
 // Operator precedence for expression parsing
@@ -43,12 +45,24 @@ typedef struct Symbol
     Token decl_token;
     int is_const_value;
     int const_int_val;
+    unsigned int name_hash; // Cached hash of 'name' for table lookups.
     struct Symbol *next;
 } Symbol;
 
+// Open-addressing symbol index (linear probing, power-of-two capacity).
+// A later insert with the same name replaces the slot, so lookups always
+// see the most recent declaration.
+typedef struct SymbolTable
+{
+    Symbol **slots;
+    int cap;
+    int count;
+} SymbolTable;
+
 typedef struct Scope
 {
-    Symbol *symbols;
+    Symbol *symbols;   // Declaration order (newest first).
+    SymbolTable table; // Hashed index over 'symbols'.
     struct Scope *parent;
 } Scope;
 
@@ -95,8 +109,46 @@ typedef struct GenericImplTemplate
     char *generic_param;
     ASTNode *impl_node;
     struct GenericImplTemplate *next;
+    struct GenericImplTemplate *next_same_struct; // Older impl blocks for 'struct_name'.
 } GenericImplTemplate;
 
+// Rewrites a template: the parameter 'param' becomes 'concrete' and, for impl
+// blocks, the template struct 'old_struct' becomes the mangled 'new_struct'.
+// The maps only memoize results.
+typedef struct
+{
+    const char *param;
+    const char *concrete;
+    const char *old_struct;
+    const char *new_struct;
+    char *clean_concrete; // sanitize_mangled_name(concrete), or NULL.
+    HashMap type_strs;    // Type string -> substituted type string.
+    HashMap names;        // Identifier -> identifier with mangled param replaced.
+    PtrMap types;         // Interned Type -> substituted interned Type.
+} GenericSubst;
+
+// Instantiated generic impl whose method bodies are copied out of the template
+// on demand (see instantiate_lazy_method).
+typedef struct LazyImpl
+{
+    GenericSubst subst;
+    ASTNode *impl;   // Emitted NODE_IMPL; holds the materialized methods.
+    ASTNode **slots; // Materialized method per template position, or NULL.
+    int count;
+} LazyImpl;
+
+// Method of an instantiated generic impl whose body has not been copied out of
+// the template yet (see instantiate_lazy_method).
+typedef struct LazyMethod
+{
+    LazyImpl *owner;
+    ASTNode *tmpl; // Template method.
+    char *name;    // Mangled name (Vec_int_push).
+    int slot;      // Position in the template impl.
+    int done;
+    struct LazyMethod *next_same_method; // Same bare name in other instances.
+} LazyMethod;
+
 typedef struct ImportedFile
 {
     char *path;
@@ -116,8 +168,10 @@ typedef struct Instantiation
     char *name;
     char *template_name;
     char *concrete_arg;
+    Type *type; // template_name<concrete_arg>, spelled as 'name'.
     ASTNode *struct_node;
     struct Instantiation *next;
+    struct Instantiation *next_same_template; // Older instantiations of 'template_name'.
 } Instantiation;
 
 typedef struct StructRef
@@ -197,10 +251,32 @@ typedef struct ImportedPlugin
     struct ImportedPlugin *next;
 } ImportedPlugin;
 
+// Name indexes over the registries below. The linked lists stay the
+// iteration order; every lookup goes through these maps.
+typedef struct RegistryIndex
+{
+    HashMap funcs;            // name -> FuncSig*
+    HashMap templates;        // name -> GenericTemplate*
+    HashMap func_templates;   // name -> GenericFuncTemplate*
+    HashMap impl_templates;   // struct name -> newest GenericImplTemplate*
+    HashMap instantiations;   // mangled name -> Instantiation*
+    HashMap inst_by_template; // template name -> newest Instantiation*
+    HashMap parsed_structs;   // name -> ASTNode* (NODE_STRUCT)
+    HashMap parsed_enums;     // name -> ASTNode* (NODE_ENUM)
+    HashMap struct_defs;      // name -> StructDef*
+    HashMap enum_variants;    // variant name -> EnumVariantReg*
+    HashMap impls;            // "trait:struct" -> ImplReg*
+    HashMap imported_files;   // path -> ImportedFile*
+    HashMap var_mutability;   // name -> VarMutability*
+    HashMap lazy_methods;     // mangled method name -> LazyMethod* (not yet emitted)
+    HashMap lazy_by_method;   // bare method name -> newest LazyMethod*
+} RegistryIndex;
+
 struct ParserContext
 {
     Scope *current_scope;
     FuncSig *func_registry;
+    RegistryIndex index;
 
     // Lambdas
     LambdaRef *global_lambdas;
@@ -255,6 +331,7 @@ struct ParserContext
 
     // LSP: Flat symbol list (persists after parsing for LSP queries)
     Symbol *all_symbols;
+    SymbolTable all_symbols_index;
 
     // External C interop: suppress undefined warnings for external symbols
     int has_external_includes; // Set when include <...> is used
@@ -266,10 +343,16 @@ struct ParserContext
     int skip_preamble; // If 1, codegen_node(NODE_ROOT) won't emit preamble
     int is_repl;       // REPL mode flag
     int has_async;     // Track if async features are used
+
+    int has_lz4_decoder; // The hoisted code defines _z_lz4_decode (embed compressed)
+
+    int use_module_cache; // Load/store the leading imports in the module cache
 };
 
 // Token helpers
 char *token_strdup(Token t);
+// Shared, read-only copy of an identifier token (see intern()).
+char *token_intern(Token t);
 int is_token(Token t, const char *s);
 Token expect(Lexer *l, TokenType type, const char *msg);
 void skip_comments(Lexer *l);
@@ -286,9 +369,13 @@ void exit_scope(ParserContext *ctx);
 void add_symbol(ParserContext *ctx, const char *n, const char *t, Type *type_info);
 void add_symbol_with_token(ParserContext *ctx, const char *n, const char *t, Type *type_info,
                            Token tok);
+// Current scope only: no shadowing warning and no LSP record (codegen
+// re-declaring locals the parser has already checked).
+void declare_local_symbol(ParserContext *ctx, const char *n, const char *t, Type *type_info);
 Type *find_symbol_type_info(ParserContext *ctx, const char *n);
 char *find_symbol_type(ParserContext *ctx, const char *n);
 Symbol *find_symbol_entry(ParserContext *ctx, const char *n);
+Scope *find_symbol_scope(ParserContext *ctx, const char *n);
 Symbol *find_symbol_in_all(ParserContext *ctx,
                            const char *n); // LSP flat lookup
 char *find_similar_symbol(ParserContext *ctx, const char *name);
@@ -299,6 +386,7 @@ void register_func(ParserContext *ctx, const char *name, int count, char **defau
                    Token decl_token);
 void register_func_template(ParserContext *ctx, const char *name, const char *param, ASTNode *node);
 GenericFuncTemplate *find_func_template(ParserContext *ctx, const char *name);
+GenericTemplate *find_template(ParserContext *ctx, const char *name);
 
 // Generic/template helpers
 void register_generic(ParserContext *ctx, char *name);
@@ -313,6 +401,9 @@ void add_to_global_list(ParserContext *ctx, ASTNode *node);
 void register_builtins(ParserContext *ctx);
 void add_instantiated_func(ParserContext *ctx, ASTNode *fn);
 void instantiate_generic(ParserContext *ctx, const char *name, const char *concrete_type);
+// Copies the body of 'm' out of its template into the instantiated impl.
+// Returns the new method, or NULL if it was already instantiated.
+ASTNode *instantiate_lazy_method(LazyMethod *m);
 char *sanitize_mangled_name(const char *s);
 void register_impl(ParserContext *ctx, const char *trait, const char *strct);
 int check_impl(ParserContext *ctx, const char *trait, const char *strct);
@@ -329,7 +420,7 @@ int is_file_imported(ParserContext *ctx, const char *path);
 void mark_file_imported(ParserContext *ctx, const char *path);
 void register_plugin(ParserContext *ctx, const char *name, const char *alias);
 const char *resolve_plugin(ParserContext *ctx, const char *name_or_alias);
-void print_type_defs(ParserContext *ctx, FILE *out, ASTNode *nodes);
+void print_type_defs(ParserContext *ctx, OutBuf *out, ASTNode *nodes);
 
 // String manipulation
 char *replace_in_string(const char *src, const char *old_w, const char *new_w);
@@ -434,4 +525,59 @@ char *patch_self_args(const char *args, const char *struct_name);
 
 ASTNode *parse_program_nodes(ParserContext *ctx, Lexer *l);
 
+// Comptime blocks (parser_stmt.c)
+// A block on its way to the source it generates: prepared against the
+// parser's state, then, unless the cache or the interpreter produced the
+// output, compiled and run, which is safe on any thread.
+typedef enum
+{
+    COMPTIME_OK,
+    COMPTIME_COMPILE_FAILED,
+    COMPTIME_RUN_FAILED
+} ComptimeStatus;
+
+typedef struct
+{
+    const char *start; // Block body in the source being parsed.
+    char *code;        // Copy of the body.
+    char *output;      // Generated source, once known.
+    char *program;     // C file to compile and run when there is no output yet.
+    char *entry;       // Cache entry to store the output under, or NULL.
+    ComptimeStatus failed;
+    int has_async; // The preamble the program was generated with depends on it.
+    int taken;
+} ComptimeJob;
+
+// Body of the block whose '{' 'l' is just past; leaves 'l' after its '}'.
+char *comptime_block_body(Lexer *l);
+// Parses the block and finds its output, or writes the program that makes it.
+// With 'try_parse', a block that does not parse is left alone, its error
+// unreported, and 0 is returned; otherwise a syntax error exits.
+int comptime_prepare(ParserContext *ctx, ComptimeJob *job, int try_parse);
+void comptime_execute(ComptimeJob *job);
+// The job's output, after reporting its failure or caching it.
+char *comptime_finish(ComptimeJob *job);
+
+// Comptime prefetching (comptime_prefetch.c)
+// Finds the comptime blocks of the source being parsed and compiles and runs
+// those that need the C compiler on worker threads, ahead of the parser.
+void prefetch_comptime(ParserContext *ctx, const Lexer *l);
+// The prefetched job for the block whose body begins at 'start', if it still
+// matches the parser's state (once only).
+ComptimeJob *take_prefetched_comptime(ParserContext *ctx, const char *start);
+
+// Comptime interpreter (comptime_eval.c)
+// Runs the statements of a comptime block and returns what they print, or
+// NULL with the reason in 'why' when the block needs the C compiler.
+char *comptime_eval(ASTNode *stmts, const char **why);
+
+// Module cache (module_cache.c)
+// Parses the imports at the top of the main file, or restores what they
+// produced from the on-disk cache. Leaves 'l' after them; NULL if none.
+ASTNode *parse_imports_cached(ParserContext *ctx, Lexer *l);
+// Records a file the imports read ('text' NULL: probed but missing).
+void module_cache_note_file(const char *path, const char *text);
+// The imports being recorded did something the cache cannot replay.
+void module_cache_taint(void);
+
 #endif // PARSER_H
@@ -11,6 +11,7 @@ static ASTNode *generate_derive_impls(ParserContext *ctx, ASTNode *strct, char *
 ASTNode *parse_program_nodes(ParserContext *ctx, Lexer *l)
 {
     ASTNode *h = 0, *tl = 0;
+    prefetch_comptime(ctx, l);
     while (1)
     {
         skip_comments(l);
@@ -509,7 +510,19 @@ ASTNode *parse_program(ParserContext *ctx, Lexer *l)
     register_builtins(ctx);
 
     ASTNode *r = ast_create(NODE_ROOT);
-    r->root.children = parse_program_nodes(ctx, l);
+    ASTNode *imports = ctx->use_module_cache ? parse_imports_cached(ctx, l) : NULL;
+    ASTNode *rest = parse_program_nodes(ctx, l);
+    if (imports)
+    {
+        ASTNode *tail = imports;
+        while (tail->next)
+        {
+            tail = tail->next;
+        }
+        tail->next = rest;
+        rest = imports;
+    }
+    r->root.children = rest;
     return r;
 }
 
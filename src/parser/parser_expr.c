@@ -556,47 +556,14 @@ void analyze_lambda_captures(ParserContext *ctx, ASTNode *lambda)
             continue;
         }
 
-        FuncSig *fs = ctx->func_registry;
-        int is_func = 0;
-        while (fs)
-        {
-            if (0 == strcmp(fs->name, var_name))
-            {
-                is_func = 1;
-                break;
-            }
-            fs = fs->next;
-        }
-        if (is_func)
+        if (find_func(ctx, var_name))
         {
             continue;
         }
 
-        Scope *s = ctx->current_scope;
-        int is_local = 0;
-        int is_found = 0;
-        while (s)
-        {
-            Symbol *cur = s->symbols;
-            while (cur)
-            {
-                if (0 == strcmp(cur->name, var_name))
-                {
-                    is_found = 1;
-                    if (s->parent != NULL)
-                    {
-                        is_local = 1;
-                    }
-                    break;
-                }
-                cur = cur->next;
-            }
-            if (is_found)
-            {
-                break;
-            }
-            s = s->parent;
-        }
+        Scope *s = find_symbol_scope(ctx, var_name);
+        int is_found = (s != NULL);
+        int is_local = (s && s->parent != NULL);
 
         if (is_found && !is_local)
         {
@@ -675,7 +642,7 @@ ASTNode *parse_lambda(ParserContext *ctx, Lexer *l)
             zpanic("Expected parameter name");
         }
 
-        param_names[num_params] = token_strdup(name_tok);
+        param_names[num_params] = token_intern(name_tok);
 
         if (lexer_peek(l).type != TOK_COLON)
         {
@@ -1196,7 +1163,7 @@ ASTNode *parse_primary(ParserContext *ctx, Lexer *l)
             return parse_lambda(ctx, l);
         }
 
-        char *ident = token_strdup(t);
+        char *ident = token_intern(t);
 
         if (lexer_peek(l).type == TOK_OP && lexer_peek(l).start[0] == '!' && lexer_peek(l).len == 1)
         {
@@ -1284,17 +1251,7 @@ ASTNode *parse_primary(ParserContext *ctx, Lexer *l)
                     char *concrete_type = parse_type(ctx, l);
                     lexer_next(l);
 
-                    int is_struct = 0;
-                    GenericTemplate *st = ctx->templates;
-                    while (st)
-                    {
-                        if (strcmp(st->name, acc) == 0)
-                        {
-                            is_struct = 1;
-                            break;
-                        }
-                        st = st->next;
-                    }
+                    int is_struct = (find_template(ctx, acc) != NULL);
                     if (!is_struct && (strcmp(acc, "Result") == 0 || strcmp(acc, "Option") == 0))
                     {
                         is_struct = 1;
@@ -1622,7 +1579,7 @@ ASTNode *parse_primary(ParserContext *ctx, Lexer *l)
             node->call.arg_count = args_provided;
             if (sig)
             {
-                node->definition_token = sig->decl_token;
+                node->definition_token = &sig->decl_token;
             }
             if (sig->is_async)
             {
@@ -1722,7 +1679,7 @@ ASTNode *parse_primary(ParserContext *ctx, Lexer *l)
             if (sym)
             {
                 sym->is_used = 1;
-                node->definition_token = sym->decl_token;
+                node->definition_token = &sym->decl_token;
             }
 
             char *type_str = find_symbol_type(ctx, acc);
@@ -2651,7 +2608,7 @@ ASTNode *parse_expr_prec(ParserContext *ctx, Lexer *l, Precedence min_prec)
             }
             ASTNode *node = ast_create(NODE_EXPR_MEMBER);
             node->member.target = lhs;
-            node->member.field = token_strdup(field);
+            node->member.field = token_intern(field);
             node->member.is_pointer_access = 1;
 
             node->type_info = get_field_type(ctx, lhs->type_info, node->member.field);
@@ -2680,7 +2637,7 @@ ASTNode *parse_expr_prec(ParserContext *ctx, Lexer *l, Precedence min_prec)
             }
             ASTNode *node = ast_create(NODE_EXPR_MEMBER);
             node->member.target = lhs;
-            node->member.field = token_strdup(field);
+            node->member.field = token_intern(field);
             node->member.is_pointer_access = 2;
 
             node->type_info = get_field_type(ctx, lhs->type_info, node->member.field);
@@ -2970,7 +2927,7 @@ ASTNode *parse_expr_prec(ParserContext *ctx, Lexer *l, Precedence min_prec)
             }
             ASTNode *node = ast_create(NODE_EXPR_MEMBER);
             node->member.target = lhs;
-            node->member.field = token_strdup(field);
+            node->member.field = token_intern(field);
             node->member.is_pointer_access = 0;
 
             if (lhs->type_info && lhs->type_info->kind == TYPE_POINTER)
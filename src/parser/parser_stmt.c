@@ -1,6 +1,8 @@
 
 #include "parser.h"
+#include "cache.h"
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,7 +37,7 @@ ASTNode *parse_function(ParserContext *ctx, Lexer *l, int is_async)
 {
     lexer_next(l); // eat 'fn'
     Token name_tok = lexer_next(l);
-    char *name = token_strdup(name_tok);
+    char *name = token_intern(name_tok);
 
     if (is_async)
     {
@@ -1276,6 +1278,7 @@ ASTNode *parse_const(ParserContext *ctx, Lexer *l)
     {
         type_obj = type_new(TYPE_UNKNOWN); // Ensure we have an object
     }
+    type_obj = type_clone(type_obj);
     type_obj->is_const = 1;
     add_symbol(ctx, ns, type_str ? type_str : "unknown", type_obj);
 
@@ -2880,6 +2883,10 @@ ASTNode *parse_impl(ParserContext *ctx, Lexer *l)
             Symbol *s = find_symbol_entry(ctx, name2);
             if (s && s->type_info)
             {
+                if (s->type_info->is_interned)
+                {
+                    s->type_info = type_clone(s->type_info);
+                }
                 s->type_info->has_drop = 1;
             }
             else
@@ -2888,6 +2895,10 @@ ASTNode *parse_impl(ParserContext *ctx, Lexer *l)
                 ASTNode *def = find_struct_def(ctx, name2);
                 if (def && def->type_info)
                 {
+                    if (def->type_info->is_interned)
+                    {
+                        def->type_info = type_clone(def->type_info);
+                    }
                     def->type_info->has_drop = 1;
                 }
             }
@@ -3161,7 +3172,7 @@ ASTNode *parse_struct(ParserContext *ctx, Lexer *l, int is_union)
 
     lexer_next(l); // eat struct or union
     Token n = lexer_next(l);
-    char *name = token_strdup(n);
+    char *name = token_intern(n);
 
     // Generic Param <T>
     char *gp = NULL;
@@ -3273,7 +3284,7 @@ ASTNode *parse_struct(ParserContext *ctx, Lexer *l, int is_union)
             char *f_type = parse_type(ctx, l);
 
             ASTNode *f = ast_create(NODE_FIELD);
-            f->field.name = token_strdup(f_name);
+            f->field.name = token_intern(f_name);
             f->field.type = f_type;
             f->field.bit_width = 0;
 
@@ -3311,7 +3322,6 @@ ASTNode *parse_struct(ParserContext *ctx, Lexer *l, int is_union)
     }
 
     ASTNode *node = ast_create(NODE_STRUCT);
-    add_to_struct_list(ctx, node);
 
     // Auto-prefix struct name if in module context
     if (ctx->current_module_prefix && !gp)
@@ -3323,6 +3333,7 @@ ASTNode *parse_struct(ParserContext *ctx, Lexer *l, int is_union)
     }
 
     node->strct.name = name;
+    add_to_struct_list(ctx, node);
 
     // Initialize Type Info so we can track traits (like Drop)
     node->type_info = type_new(TYPE_STRUCT);
@@ -3392,7 +3403,7 @@ ASTNode *parse_enum(ParserContext *ctx, Lexer *l)
 
     ASTNode *h = 0, *tl = 0;
     int v = 0;
-    char *ename = token_strdup(n); // Store enum name
+    char *ename = token_intern(n); // Store enum name
 
     while (1)
     {
@@ -3412,7 +3423,7 @@ ASTNode *parse_enum(ParserContext *ctx, Lexer *l)
         if (t.type == TOK_IDENT)
         {
             Token vt = lexer_next(l);
-            char *vname = token_strdup(vt);
+            char *vname = token_intern(vt);
 
             // 2. Parse Payload Type (Ok(int))
             Type *payload = NULL;
@@ -3527,6 +3538,76 @@ ASTNode *parse_include(ParserContext *ctx, Lexer *l)
     n->include.is_system = is_system;
     return n;
 }
+
+// Path an import of the string token 't' refers to, from the file 'importer':
+// relative to it for "./" and "../", else as given, else under a system path.
+static char *resolve_import_path(Token t, const char *importer)
+{
+    int ln = t.len - 2; // Remove quotes
+    char *fn = xmalloc(ln + 1);
+    strncpy(fn, t.start + 1, ln);
+    fn[ln] = 0;
+
+    // Resolve relative paths (if starts with ./ or ../
+    char resolved_path[1024];
+    if (fn[0] == '.' && (fn[1] == '/' || (fn[1] == '.' && fn[2] == '/')))
+    {
+        // Relative import - resolve relative to current file
+        char *current_dir = xstrdup(importer);
+        char *last_slash = strrchr(current_dir, '/');
+        if (last_slash)
+        {
+            *last_slash = 0; // Truncate to directory
+            const char *leaf = fn;
+            if (leaf[0] == '.' && leaf[1] == '/')
+            {
+                leaf += 2;
+            }
+            snprintf(resolved_path, sizeof(resolved_path), "%s/%s", current_dir, leaf);
+        }
+        else
+        {
+            snprintf(resolved_path, sizeof(resolved_path), "%s", fn);
+        }
+        free(current_dir);
+        free(fn);
+        fn = xstrdup(resolved_path);
+    }
+
+    // Check if file exists, if not try system-wide paths
+    if (access(fn, R_OK) != 0)
+    {
+        module_cache_note_file(fn, NULL);
+
+        // Try system-wide standard library location
+        static const char *system_paths[] = {"/usr/local/share/zenc", "/usr/share/zenc", NULL};
+
+        char system_path[1024];
+        int found = 0;
+
+        for (int i = 0; system_paths[i] && !found; i++)
+        {
+            snprintf(system_path, sizeof(system_path), "%s/%s", system_paths[i], fn);
+            if (access(system_path, R_OK) == 0)
+            {
+                free(fn);
+                fn = xstrdup(system_path);
+                found = 1;
+            }
+            else
+            {
+                module_cache_note_file(system_path, NULL);
+            }
+        }
+
+        if (!found)
+        {
+            // File not found anywhere - will error later when trying to open
+        }
+    }
+    return fn;
+}
+
 ASTNode *parse_import(ParserContext *ctx, Lexer *l)
 {
     lexer_next(l); // eat 'import'
@@ -3649,62 +3730,7 @@ ASTNode *parse_import(ParserContext *ctx, Lexer *l)
                "type %d",
                t.type);
     }
-    int ln = t.len - 2; // Remove quotes
-    char *fn = xmalloc(ln + 1);
-    strncpy(fn, t.start + 1, ln);
-    fn[ln] = 0;
-
-    // Resolve relative paths (if starts with ./ or ../
-    char resolved_path[1024];
-    if (fn[0] == '.' && (fn[1] == '/' || (fn[1] == '.' && fn[2] == '/')))
-    {
-        // Relative import - resolve relative to current file
-        char *current_dir = xstrdup(g_current_filename);
-        char *last_slash = strrchr(current_dir, '/');
-        if (last_slash)
-        {
-            *last_slash = 0; // Truncate to directory
-            const char *leaf = fn;
-            if (leaf[0] == '.' && leaf[1] == '/')
-            {
-                leaf += 2;
-            }
-            snprintf(resolved_path, sizeof(resolved_path), "%s/%s", current_dir, leaf);
-        }
-        else
-        {
-            snprintf(resolved_path, sizeof(resolved_path), "%s", fn);
-        }
-        free(current_dir);
-        free(fn);
-        fn = xstrdup(resolved_path);
-    }
-
-    // Check if file exists, if not try system-wide paths
-    if (access(fn, R_OK) != 0)
-    {
-        // Try system-wide standard library location
-        static const char *system_paths[] = {"/usr/local/share/zenc", "/usr/share/zenc", NULL};
-
-        char system_path[1024];
-        int found = 0;
-
-        for (int i = 0; system_paths[i] && !found; i++)
-        {
-            snprintf(system_path, sizeof(system_path), "%s/%s", system_paths[i], fn);
-            if (access(system_path, R_OK) == 0)
-            {
-                free(fn);
-                fn = xstrdup(system_path);
-                found = 1;
-            }
-        }
-
-        if (!found)
-        {
-            // File not found anywhere - will error later when trying to open
-        }
-    }
+    char *fn = resolve_import_path(t, g_current_filename);
 
     // Check if file already imported
     if (is_file_imported(ctx, fn))
@@ -3792,9 +3818,10 @@ ASTNode *parse_import(ParserContext *ctx, Lexer *l)
     {
         zpanic("Not found: %s", fn);
     }
+    module_cache_note_file(fn, src);
 
     Lexer i;
-    lexer_init(&i, src);
+    lexer_init_buffered(&i, src);
 
     // If this is a namespaced import or selective import, set the module prefix
     char *prev_module_prefix = ctx->current_module_prefix;
@@ -3855,69 +3882,67 @@ ASTNode *parse_import(ParserContext *ctx, Lexer *l)
     return r;
 }
 
-// Helper: Execute comptime block and return generated source
-char *run_comptime_block(ParserContext *ctx, Lexer *l)
+// Cache entry for the output of a comptime block (see run_comptime_block).
+// The key covers the block's tokens, so layout and comments don't matter,
+// the preamble it is compiled against, the C compiler and zc itself, whose
+// interpreter and lowering produce the output too. Returns 0 for blocks that
+// include local headers, which the key cannot see.
+static int comptime_cache_entry(const char *code, ASTNode *nodes, const OutBuf *preamble,
+                                char *entry, size_t size)
 {
-    (void)ctx;
-    expect(l, TOK_COMPTIME, "comptime");
-    expect(l, TOK_LBRACE, "expected { after comptime");
-
-    const char *start = l->src + l->pos;
-    int depth = 1;
-    while (depth > 0)
+    const char *self = cache_self_id();
+    if (g_config.no_cache || !self)
     {
-        Token t = lexer_next(l);
-        if (t.type == TOK_EOF)
-        {
-            zpanic("Unexpected EOF in comptime block");
-        }
-        if (t.type == TOK_LBRACE)
-        {
-            depth++;
-        }
-        if (t.type == TOK_RBRACE)
+        return 0;
+    }
+    for (ASTNode *n = nodes; n; n = n->next)
+    {
+        if (n->type == NODE_INCLUDE && !n->include.is_system)
         {
-            depth--;
+            return 0;
         }
     }
-    // End is passed the closing brace, so pos points after it.
-    // The code block is between start and (current pos - 1)
-    int len = (l->src + l->pos - 1) - start;
-    char *code = xmalloc(len + 1);
-    strncpy(code, start, len);
-    code[len] = 0;
-
-    // Wrap in block to parse mixed statements/declarations
-    int wrapped_len = len + 4; // "{ " + code + " }"
-    char *wrapped_code = xmalloc(wrapped_len + 1);
-    sprintf(wrapped_code, "{ %s }", code);
 
-    Lexer cl;
-    lexer_init(&cl, wrapped_code);
-    ParserContext cctx;
-    memset(&cctx, 0, sizeof(cctx));
-    enter_scope(&cctx); // Global scope
-    register_builtins(&cctx);
-
-    ASTNode *block = parse_block(&cctx, &cl);
-    ASTNode *nodes = block ? block->block.statements : NULL;
-
-    free(wrapped_code);
+    uint64_t h = cache_hash_str(CACHE_HASH_SEED, "zc-comptime-1");
+    Lexer lex;
+    lexer_init(&lex, code);
+    for (Token t = lexer_next(&lex); t.type != TOK_EOF; t = lexer_next(&lex))
+    {
+        h = cache_hash(h, t.start, t.len);
+        h = cache_hash(h, "", 1);
+    }
+    char *pre = ob_flatten(preamble);
+    h = cache_hash(h, pre, preamble->len);
+    free(pre);
+    h = cache_hash_str(h, cache_compiler_id("gcc"));
+    h = cache_hash_str(h, self);
+    return cache_entry_path(entry, size, "ct-", h);
+}
 
-    char filename[64];
-    sprintf(filename, "_tmp_comptime_%d.c", rand());
-    FILE *f = fopen(filename, "w");
+static void comptime_cache_store(const char *entry, const char *output)
+{
+    // Concurrent builds write their own temp files; the rename is atomic.
+    char tmp[PATH_MAX + 32];
+    cache_temp_path(tmp, sizeof(tmp), entry);
+    FILE *f = fopen(tmp, "wb");
     if (!f)
     {
-        zpanic("Could not create temp file %s", filename);
+        return;
     }
+    size_t len = strlen(output);
+    int ok = fwrite(output, 1, len, f) == len;
+    if (0 == fclose(f) && ok && 0 == rename(tmp, entry))
+    {
+        return;
+    }
+    unlink(tmp);
+}
 
-    emit_preamble(ctx, f);
-    fprintf(
-        f,
-        "size_t _z_check_bounds(size_t index, size_t size) { if (index >= size) { fprintf(stderr, "
-        "\"Index out of bounds: %%zu >= %%zu\\n\", index, size); exit(1); } return index; }\n");
-
+// Writes the block's statements ('out' holds the preamble) as a C program to
+// a new file in the working directory, so that local includes resolve as they
+// do for the build. Returns the file's name.
+static char *write_comptime_program(ParserContext *cctx, ASTNode *nodes, OutBuf *out)
+{
     ASTNode *curr = nodes;
     ASTNode *stmts = NULL;
     ASTNode *stmts_tail = NULL;
@@ -3929,23 +3954,23 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
 
         if (curr->type == NODE_INCLUDE)
         {
-            emit_includes_and_aliases(curr, f);
+            emit_includes_and_aliases(curr, out);
         }
         else if (curr->type == NODE_STRUCT)
         {
-            emit_struct_defs(&cctx, curr, f);
+            emit_struct_defs(cctx, curr, out);
         }
         else if (curr->type == NODE_ENUM)
         {
-            emit_enum_protos(curr, f);
+            emit_enum_protos(curr, out);
         }
         else if (curr->type == NODE_CONST)
         {
-            emit_globals(&cctx, curr, f);
+            emit_globals(cctx, curr, out);
         }
         else if (curr->type == NODE_FUNCTION)
         {
-            codegen_node_single(&cctx, curr, f);
+            codegen_node_single(cctx, curr, out);
         }
         else if (curr->type == NODE_IMPL)
         {
@@ -3967,55 +3992,231 @@ char *run_comptime_block(ParserContext *ctx, Lexer *l)
         curr = next;
     }
 
-    fprintf(f, "int main() {\n");
+    ob_puts(out, "int main() {\n");
     curr = stmts;
     while (curr)
     {
         if (curr->type >= NODE_EXPR_BINARY && curr->type <= NODE_EXPR_SLICE)
         {
-            codegen_expression(&cctx, curr, f);
-            fprintf(f, ";\n");
+            codegen_expression(cctx, curr, out);
+            ob_puts(out, ";\n");
         }
         else
         {
-            codegen_node_single(&cctx, curr, f);
+            codegen_node_single(cctx, curr, out);
         }
         curr = curr->next;
     }
-    fprintf(f, "return 0;\n}\n");
+    ob_puts(out, "return 0;\n}\n");
+
+    // mkstemp() creates the file, so parallel blocks and builds cannot collide.
+    char filename[] = "_tmp_comptime_XXXXXX";
+    int fd = mkstemp(filename);
+    FILE *f = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!f)
+    {
+        zpanic("Could not create temp file for comptime block");
+    }
+    ob_write_file(out, f);
     fclose(f);
+    ob_free(out);
+    return xstrdup(filename);
+}
 
-    char cmd[4096];
-    char bin[1024];
-    sprintf(bin, "%s.bin", filename);
-    sprintf(cmd, "gcc %s -o %s > /dev/null 2>&1", filename, bin);
-    int res = system(cmd);
-    if (res != 0)
+char *comptime_block_body(Lexer *l)
+{
+    const char *start = l->src + l->pos;
+    int depth = 1;
+    while (depth > 0)
     {
-        zpanic("Comptime compilation failed for:\n%s", code);
+        Token t = lexer_next(l);
+        if (t.type == TOK_EOF)
+        {
+            zpanic("Unexpected EOF in comptime block");
+        }
+        if (t.type == TOK_LBRACE)
+        {
+            depth++;
+        }
+        if (t.type == TOK_RBRACE)
+        {
+            depth--;
+        }
     }
+    // End is passed the closing brace, so pos points after it.
+    // The code block is between start and (current pos - 1)
+    int len = (l->src + l->pos - 1) - start;
+    char *code = xmalloc(len + 1);
+    strncpy(code, start, len);
+    code[len] = 0;
+    return code;
+}
 
+// Statements of the block body 'code', parsed on their own into 'cctx'. A
+// syntax error exits, like the rest of the parser, unless 'failed' is given:
+// then it is set instead, with nothing reported.
+static ASTNode *comptime_parse(ParserContext *cctx, const char *code, int *failed)
+{
+    // Wrap in block to parse mixed statements/declarations
+    int wrapped_len = strlen(code) + 4; // "{ " + code + " }"
+    char *wrapped_code = xmalloc(wrapped_len + 1);
+    sprintf(wrapped_code, "{ %s }", code);
+
+    Lexer cl;
+    lexer_init(&cl, wrapped_code);
+    memset(cctx, 0, sizeof(*cctx));
+    enter_scope(cctx); // Global scope
+    register_builtins(cctx);
+
+    jmp_buf trap;
+    if (failed)
+    {
+        *failed = 0;
+        if (setjmp(trap))
+        {
+            g_panic_trap = NULL;
+            *failed = 1;
+            return NULL;
+        }
+        g_panic_trap = &trap;
+    }
+    ASTNode *block = parse_block(cctx, &cl);
+    g_panic_trap = NULL;
+    free(wrapped_code);
+    return block ? block->block.statements : NULL;
+}
+
+int comptime_prepare(ParserContext *ctx, ComptimeJob *job, int try_parse)
+{
+    ParserContext cctx;
+    int failed = 0;
+    ASTNode *nodes = comptime_parse(&cctx, job->code, try_parse ? &failed : NULL);
+    if (failed)
+    {
+        return 0;
+    }
+
+    OutBuf out = OUTBUF_INIT;
+    emit_preamble(ctx, &out);
+    job->has_async = ctx->has_async;
+    ob_puts(
+        &out,
+        "size_t _z_check_bounds(size_t index, size_t size) { if (index >= size) { fprintf(stderr, "
+        "\"Index out of bounds: %zu >= %zu\\n\", index, size); exit(1); } return index; }\n");
+
+    // The output of a block is cached by content: rebuilds of a file skip
+    // its comptime blocks entirely. Blocks are expected to be deterministic.
+    char entry[PATH_MAX];
+    if (comptime_cache_entry(job->code, nodes, &out, entry, sizeof(entry)))
+    {
+        char *hit = 0 == access(entry, R_OK) ? load_file(entry) : NULL;
+        if (g_config.verbose)
+        {
+            printf("[zc] Comptime cache %s: %s\n", hit ? "hit" : "miss", entry);
+        }
+        if (hit)
+        {
+            cache_touch(entry);
+            ob_free(&out);
+            job->output = hit;
+            return 1;
+        }
+        job->entry = xstrdup(entry);
+    }
+
+    const char *why = NULL;
+    job->output = comptime_eval(nodes, &why);
+    if (job->output)
+    {
+        ob_free(&out);
+        return 1;
+    }
+    if (g_config.verbose)
+    {
+        printf("[zc] Compiling comptime block (%s)\n", why);
+    }
+    job->program = write_comptime_program(&cctx, nodes, &out);
+    return 1;
+}
+
+void comptime_execute(ComptimeJob *job)
+{
+    char cmd[4096];
+    char bin[1024];
     char out_file[1024];
-    sprintf(out_file, "%s.out", filename);
-    sprintf(cmd, "./%s > %s", bin, out_file);
+    sprintf(bin, "%s.bin", job->program);
+    sprintf(out_file, "%s.out", job->program);
+
+    sprintf(cmd, "gcc -x c %s -o %s > /dev/null 2>&1", job->program, bin);
     if (system(cmd) != 0)
     {
-        zpanic("Comptime execution failed");
+        job->failed = COMPTIME_COMPILE_FAILED;
     }
-
-    char *output_src = load_file(out_file);
-    if (!output_src)
+    else
     {
-        output_src = xstrdup(""); // Empty output is valid
+        sprintf(cmd, "./%s > %s", bin, out_file);
+        if (system(cmd) != 0)
+        {
+            job->failed = COMPTIME_RUN_FAILED;
+        }
+        else
+        {
+            job->output = load_file(out_file);
+            if (!job->output)
+            {
+                job->output = xstrdup(""); // Empty output is valid
+            }
+        }
     }
 
     // Cleanup
-    remove(filename);
+    remove(job->program);
     remove(bin);
     remove(out_file);
-    free(code);
+}
+
+char *comptime_finish(ComptimeJob *job)
+{
+    if (COMPTIME_COMPILE_FAILED == job->failed)
+    {
+        zpanic("Comptime compilation failed for:\n%s", job->code);
+    }
+    if (COMPTIME_RUN_FAILED == job->failed)
+    {
+        zpanic("Comptime execution failed");
+    }
+    if (job->entry)
+    {
+        comptime_cache_store(job->entry, job->output);
+    }
+    return job->output;
+}
 
-    return output_src;
+// Helper: Execute comptime block and return generated source
+char *run_comptime_block(ParserContext *ctx, Lexer *l)
+{
+    // Runs a program; its output is not a function of the sources alone.
+    module_cache_taint();
+    expect(l, TOK_COMPTIME, "comptime");
+    expect(l, TOK_LBRACE, "expected { after comptime");
+
+    const char *start = l->src + l->pos;
+    char *code = comptime_block_body(l);
+    ComptimeJob *job = take_prefetched_comptime(ctx, start);
+    if (job)
+    {
+        return comptime_finish(job);
+    }
+
+    ComptimeJob local;
+    memset(&local, 0, sizeof(local));
+    local.code = code;
+    comptime_prepare(ctx, &local, 0);
+    if (!local.output)
+    {
+        comptime_execute(&local);
+    }
+    return comptime_finish(&local);
 }
 
 ASTNode *parse_comptime(ParserContext *ctx, Lexer *l)
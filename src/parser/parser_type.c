@@ -1,10 +1,15 @@
 
 #include "../ast/ast.h"
 #include "parser.h"
+#include "cache.h"
+#include "lz4.h"
 #include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 Type *parse_type_base(ParserContext *ctx, Lexer *l)
 {
@@ -25,7 +30,7 @@ Type *parse_type_base(ParserContext *ctx, Lexer *l)
         }
 
         lexer_next(l);
-        char *name = token_strdup(t);
+        char *name = token_intern(t);
 
         // Self type alias: Replace "Self" with current impl struct type
         if (strcmp(name, "Self") == 0 && ctx->current_impl_struct)
@@ -575,7 +580,7 @@ Type *parse_type_formal(ParserContext *ctx, Lexer *l)
             fn_type->inner = type_new(TYPE_VOID);
         }
 
-        return fn_type;
+        return type_intern(fn_type);
     }
 
     // Handles: int, Struct, Generic<T>, [Slice], (Tuple)
@@ -615,9 +620,13 @@ Type *parse_type_formal(ParserContext *ctx, Lexer *l)
 
     if (is_restrict)
     {
+        if (t->is_interned)
+        {
+            t = type_clone(t);
+        }
         t->is_restrict = 1;
     }
-    return t;
+    return type_intern(t);
 }
 
 char *parse_type(ParserContext *ctx, Lexer *l)
@@ -767,9 +776,164 @@ char *parse_tuple_literal(ParserContext *ctx, Lexer *l, const char *tn)
     free(c);
     return o;
 }
+// Hash of the contents of 'f', read from the start.
+static int hash_file(FILE *f, uint64_t *hash)
+{
+    unsigned char buf[65536];
+    uint64_t h = cache_hash_str(CACHE_HASH_SEED, "zc-embed-1");
+    size_t n;
+    rewind(f);
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        h = cache_hash(h, buf, n);
+    }
+    *hash = h;
+    return !ferror(f);
+}
+
+// Defines '_z_embed_<id>' at file scope (through the hoisted code) over the
+// bytes of 'path', without passing them through the C compiler: an .incbin
+// into .rodata where the assembler is ELF, else C23 #embed. The comment line
+// carries the hash of the contents, so builds cached by their C source see
+// any change to the file.
+static int hoist_embed(ParserContext *ctx, const char *path, long len, uint64_t hash, int id)
+{
+    char full[PATH_MAX];
+    if (!ctx->hoist_out || 0 == len || !realpath(path, full) || strpbrk(full, "\"\\\n"))
+    {
+        return 0;
+    }
+    fprintf(ctx->hoist_out,
+            "// embed \"%s\" (%ld bytes, content %016llx)\n"
+            "#if defined(__ELF__)\n"
+            "__asm__(\".pushsection .rodata\\n.balign 16\\n_z_embed_%d:\\n.incbin \\\"%s\\\"\\n"
+            ".popsection\\n\");\n"
+            "extern const char _z_embed_%d[];\n"
+            "#elif defined(__has_embed)\n"
+            "static const char _z_embed_%d[] = {\n#embed \"%s\"\n};\n"
+            "#else\n"
+            "#error \"embed needs an ELF assembler or a compiler with #embed\"\n"
+            "#endif\n",
+            full, len, (unsigned long long)hash, id, full, id, id, full);
+    return 1;
+}
+
+static int write_blob(const char *path, const unsigned char *data, long len)
+{
+    char tmp[PATH_MAX + 32];
+    cache_temp_path(tmp, sizeof(tmp), path);
+    FILE *out = fopen(tmp, "wb");
+    if (!out)
+    {
+        return 0;
+    }
+    int ok = fwrite(data, 1, len, out) == (size_t)len;
+    if (0 != fclose(out) || !ok || 0 != rename(tmp, path))
+    {
+        unlink(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+// 'embed compressed': the file is LZ4-compressed into a cache entry named by
+// its content, so rebuilds reuse it, and that is embedded instead. C that is
+// kept (--emit-c, transpile) must outlive the cache, so there the compressed
+// data goes next to the C file. An accessor decodes it on its first call into
+// a buffer kept for the run.
+static int hoist_compressed_embed(ParserContext *ctx, FILE *f, long len, int id)
+{
+    if (!ctx->hoist_out || 0 == len)
+    {
+        return 0;
+    }
+    unsigned char *b = xmalloc(len);
+    rewind(f);
+    if (fread(b, 1, len, f) != (size_t)len)
+    {
+        return 0;
+    }
+
+    uint64_t key = cache_hash(cache_hash_str(CACHE_HASH_SEED, "zc-lz4-1"), b, len);
+    char entry[PATH_MAX + 32];
+    struct stat st;
+    if (g_config.emit_c)
+    {
+        snprintf(entry, sizeof(entry), "%s.lz4-%016llx", emitted_c_file(),
+                 (unsigned long long)key);
+    }
+    else if (!cache_entry_path(entry, sizeof(entry), "lz4-", key))
+    {
+        return 0;
+    }
+    long packed;
+    if (!g_config.emit_c && 0 == stat(entry, &st))
+    {
+        packed = st.st_size;
+        cache_touch(entry);
+    }
+    else
+    {
+        unsigned char *z = xmalloc(lz4_bound(len));
+        packed = lz4_compress(b, len, z);
+        if ((packed < len || !g_config.emit_c) && !write_blob(entry, z, packed))
+        {
+            return 0;
+        }
+    }
+
+    // Data that does not compress is embedded as it is.
+    if (packed >= len || !hoist_embed(ctx, entry, packed, key, id))
+    {
+        return 0;
+    }
+    if (!ctx->has_lz4_decoder)
+    {
+        fputs(lz4_decoder_source(), ctx->hoist_out);
+        ctx->has_lz4_decoder = 1;
+    }
+    fprintf(ctx->hoist_out,
+            "static char *_z_embed_%d_get(void)\n"
+            "{\n"
+            "    static char *data;\n"
+            "    char *d = __atomic_load_n(&data, __ATOMIC_ACQUIRE);\n"
+            "    if (!d)\n"
+            "    {\n"
+            "        d = z_malloc(%ld);\n"
+            "        if (!d || _z_lz4_decode((const unsigned char *)_z_embed_%d, %ld, d) != %ld)\n"
+            "        {\n"
+            "            z_panic(\"embed: could not decompress\");\n"
+            "        }\n"
+            "        char *none = NULL;\n"
+            "        if (!__atomic_compare_exchange_n(&data, &none, d, 0, __ATOMIC_ACQ_REL,\n"
+            "                                         __ATOMIC_ACQUIRE))\n"
+            "        {\n"
+            "            z_free(d); // Another thread got there first.\n"
+            "            d = none;\n"
+            "        }\n"
+            "    }\n"
+            "    return d;\n"
+            "}\n",
+            id, len, id, packed, len);
+    return 1;
+}
+
 char *parse_embed(ParserContext *ctx, Lexer *l)
 {
+    static int embed_count = 0;
+
     lexer_next(l);
+    int compressed = 0;
+    if (TOK_IDENT == lexer_peek(l).type && is_token(lexer_peek(l), "compressed"))
+    {
+        lexer_next(l);
+        compressed = 1;
+        if (!ctx->current_scope || !ctx->current_scope->parent)
+        {
+            zpanic("embed compressed is decompressed on first use: it cannot initialize a "
+                   "global");
+        }
+    }
     Token t = lexer_next(l);
     if (t.type != TOK_STRING)
     {
@@ -779,6 +943,7 @@ char *parse_embed(ParserContext *ctx, Lexer *l)
     strncpy(fn, t.start + 1, t.len - 2);
     fn[t.len - 2] = 0;
 
+    module_cache_taint(); // The embedded file is not tracked.
     FILE *f = fopen(fn, "rb");
     if (!f)
     {
@@ -786,12 +951,33 @@ char *parse_embed(ParserContext *ctx, Lexer *l)
     }
     fseek(f, 0, SEEK_END);
     long len = ftell(f);
+
+    register_slice(ctx, "char");
+    int id = embed_count;
+    if (compressed && hoist_compressed_embed(ctx, f, len, id))
+    {
+        fclose(f);
+        embed_count++;
+        char *o = xmalloc(128);
+        sprintf(o, "(Slice_char){.data=_z_embed_%d_get(),.len=%ld,.cap=%ld}", id, len, len);
+        return o;
+    }
+    uint64_t hash;
+    if (ctx->hoist_out && hash_file(f, &hash) && hoist_embed(ctx, fn, len, hash, id))
+    {
+        fclose(f);
+        embed_count++;
+        char *o = xmalloc(128);
+        sprintf(o, "(Slice_char){.data=(char *)_z_embed_%d,.len=%ld,.cap=%ld}", id, len, len);
+        return o;
+    }
+
+    // No file-scope output: spell the bytes out.
     rewind(f);
     unsigned char *b = xmalloc(len);
     fread(b, 1, len, f);
     fclose(f);
 
-    register_slice(ctx, "char");
     size_t oc = len * 6 + 128;
     char *o = xmalloc(oc);
     sprintf(o, "(Slice_char){.data=(char[]){");
@@ -15,7 +15,7 @@ Token expect(Lexer *l, TokenType type, const char *msg)
     if (t.type != type)
     {
         zpanic_at(t, "Expected %s, but got '%.*s'", msg, t.len, t.start);
-        return (Token){type, t.start, 0, t.line, t.col};
+        return (Token){type, 0, t.start, t.line, t.col};
     }
     return t;
 }
@@ -34,6 +34,11 @@ char *token_strdup(Token t)
     return s;
 }
 
+char *token_intern(Token t)
+{
+    return intern_n(t.start, t.len);
+}
+
 void skip_comments(Lexer *l)
 {
     while (lexer_peek(l).type == TOK_COMMENT)
@@ -107,10 +112,97 @@ char *consume_until_semicolon(Lexer *l)
     return xstrdup("");
 }
 
+#define SYMTAB_INITIAL_CAP 8
+
+static void symtab_insert(SymbolTable *tab, Symbol *sym);
+
+static void symtab_grow(SymbolTable *tab)
+{
+    Symbol **old_slots = tab->slots;
+    int old_cap = tab->cap;
+
+    tab->cap = old_cap ? old_cap * 2 : SYMTAB_INITIAL_CAP;
+    tab->slots = xcalloc(tab->cap, sizeof(Symbol *));
+    tab->count = 0;
+
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old_slots[i])
+        {
+            symtab_insert(tab, old_slots[i]);
+        }
+    }
+    free(old_slots);
+}
+
+static void symtab_insert(SymbolTable *tab, Symbol *sym)
+{
+    // Keep load factor under 3/4.
+    if ((tab->count + 1) * 4 > tab->cap * 3)
+    {
+        symtab_grow(tab);
+    }
+
+    unsigned int mask = (unsigned int)tab->cap - 1;
+    unsigned int i = sym->name_hash & mask;
+    while (tab->slots[i])
+    {
+        Symbol *cur = tab->slots[i];
+        if (cur->name_hash == sym->name_hash && strcmp(cur->name, sym->name) == 0)
+        {
+            tab->slots[i] = sym; // Redeclaration shadows the older entry.
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    tab->slots[i] = sym;
+    tab->count++;
+}
+
+static Symbol *symtab_find(SymbolTable *tab, const char *n, unsigned int h)
+{
+    if (tab->cap == 0)
+    {
+        return NULL;
+    }
+
+    unsigned int mask = (unsigned int)tab->cap - 1;
+    unsigned int i = h & mask;
+    while (tab->slots[i])
+    {
+        Symbol *cur = tab->slots[i];
+        if (cur->name == n || (cur->name_hash == h && strcmp(cur->name, n) == 0))
+        {
+            return cur;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+// Layered lookup: hash once, then probe each scope from innermost outwards.
+static Symbol *scope_chain_lookup(Scope *s, const char *n, Scope **found_in)
+{
+    unsigned int h = hash_string(n);
+    while (s)
+    {
+        Symbol *sym = symtab_find(&s->table, n, h);
+        if (sym)
+        {
+            if (found_in)
+            {
+                *found_in = s;
+            }
+            return sym;
+        }
+        s = s->parent;
+    }
+    return NULL;
+}
+
 void enter_scope(ParserContext *ctx)
 {
-    Scope *s = xmalloc(sizeof(Scope));
-    s->symbols = 0;
+    Scope *s = xcalloc(1, sizeof(Scope));
     s->parent = ctx->current_scope;
     ctx->current_scope = s;
 }
@@ -136,6 +228,26 @@ void exit_scope(ParserContext *ctx)
     ctx->current_scope = ctx->current_scope->parent;
 }
 
+static Symbol *scope_declare(ParserContext *ctx, const char *n, const char *t, Type *type_info,
+                             Token tok)
+{
+    Symbol *s = xmalloc(sizeof(Symbol));
+    s->name = intern(n);
+    s->type_name = t ? xstrdup(t) : NULL;
+    s->type_info = type_info;
+    s->is_mutable = 1;
+    s->is_used = 0;
+    s->is_autofree = 0;
+    s->decl_token = tok;
+    s->is_const_value = 0;
+    s->const_int_val = 0;
+    s->name_hash = hash_string(s->name);
+    s->next = ctx->current_scope->symbols;
+    ctx->current_scope->symbols = s;
+    symtab_insert(&ctx->current_scope->table, s);
+    return s;
+}
+
 void add_symbol(ParserContext *ctx, const char *n, const char *t, Type *type_info)
 {
     add_symbol_with_token(ctx, n, t, type_info, (Token){0});
@@ -151,126 +263,59 @@ void add_symbol_with_token(ParserContext *ctx, const char *n, const char *t, Typ
 
     if (n[0] != '_' && ctx->current_scope->parent && strcmp(n, "it") != 0 && strcmp(n, "self") != 0)
     {
-        Scope *p = ctx->current_scope->parent;
-        while (p)
+        if (scope_chain_lookup(ctx->current_scope->parent, n, NULL))
         {
-            Symbol *sh = p->symbols;
-            while (sh)
-            {
-                if (strcmp(sh->name, n) == 0)
-                {
-                    warn_shadowing(tok, n);
-                    break;
-                }
-                sh = sh->next;
-            }
-            if (sh)
-            {
-                break; // found it
-            }
-            p = p->parent;
+            warn_shadowing(tok, n);
         }
     }
-    Symbol *s = xmalloc(sizeof(Symbol));
-    s->name = xstrdup(n);
-    s->type_name = t ? xstrdup(t) : NULL;
-    s->type_info = type_info;
-    s->is_mutable = 1;
-    s->is_used = 0;
-    s->decl_token = tok;
-    s->is_const_value = 0;
-    s->next = ctx->current_scope->symbols;
-    ctx->current_scope->symbols = s;
+    Symbol *s = scope_declare(ctx, n, t, type_info, tok);
 
     // LSP: Also add to flat list (for persistent access after scope exit)
     Symbol *lsp_copy = xmalloc(sizeof(Symbol));
     *lsp_copy = *s;
     lsp_copy->next = ctx->all_symbols;
     ctx->all_symbols = lsp_copy;
+    symtab_insert(&ctx->all_symbols_index, lsp_copy);
 }
 
-Type *find_symbol_type_info(ParserContext *ctx, const char *n)
+void declare_local_symbol(ParserContext *ctx, const char *n, const char *t, Type *type_info)
 {
     if (!ctx->current_scope)
     {
-        return NULL;
-    }
-    Scope *s = ctx->current_scope;
-    while (s)
-    {
-        Symbol *sym = s->symbols;
-        while (sym)
-        {
-            if (strcmp(sym->name, n) == 0)
-            {
-                return sym->type_info;
-            }
-            sym = sym->next;
-        }
-        s = s->parent;
+        enter_scope(ctx);
     }
-    return NULL;
+    scope_declare(ctx, n, t, type_info, (Token){0});
+}
+
+Type *find_symbol_type_info(ParserContext *ctx, const char *n)
+{
+    Symbol *sym = find_symbol_entry(ctx, n);
+    return sym ? sym->type_info : NULL;
 }
 
 char *find_symbol_type(ParserContext *ctx, const char *n)
 {
-    if (!ctx->current_scope)
-    {
-        return NULL;
-    }
-    Scope *s = ctx->current_scope;
-    while (s)
-    {
-        Symbol *sym = s->symbols;
-        while (sym)
-        {
-            if (strcmp(sym->name, n) == 0)
-            {
-                return sym->type_name;
-            }
-            sym = sym->next;
-        }
-        s = s->parent;
-    }
-    return NULL;
+    Symbol *sym = find_symbol_entry(ctx, n);
+    return sym ? sym->type_name : NULL;
 }
 
 Symbol *find_symbol_entry(ParserContext *ctx, const char *n)
 {
-    if (!ctx->current_scope)
-    {
-        return NULL;
-    }
-    Scope *s = ctx->current_scope;
-    while (s)
-    {
-        Symbol *sym = s->symbols;
-        while (sym)
-        {
-            if (strcmp(sym->name, n) == 0)
-            {
-                return sym;
-            }
-            sym = sym->next;
-        }
-        s = s->parent;
-    }
-    return NULL;
+    return scope_chain_lookup(ctx->current_scope, n, NULL);
+}
+
+// Returns the innermost scope declaring 'n', or NULL.
+Scope *find_symbol_scope(ParserContext *ctx, const char *n)
+{
+    Scope *found = NULL;
+    scope_chain_lookup(ctx->current_scope, n, &found);
+    return found;
 }
 
 // LSP: Search flat symbol list (works after scopes are destroyed).
 Symbol *find_symbol_in_all(ParserContext *ctx, const char *n)
 {
-    Symbol *sym = ctx->all_symbols;
-    while (sym)
-    {
-        if (strcmp(sym->name, n) == 0)
-        {
-            return sym;
-        }
-        sym = sym->next;
-    }
-    return NULL;
+    return symtab_find(&ctx->all_symbols_index, n, hash_string(n));
 }
 
 void init_builtins()
@@ -287,7 +332,7 @@ void register_func(ParserContext *ctx, const char *name, int count, char **defau
                    Type **arg_types, Type *ret_type, int is_varargs, int is_async, Token decl_token)
 {
     FuncSig *f = xmalloc(sizeof(FuncSig));
-    f->name = xstrdup(name);
+    f->name = intern(name);
     f->decl_token = decl_token;
     f->total_args = count;
     f->defaults = defaults;
@@ -298,22 +343,24 @@ void register_func(ParserContext *ctx, const char *name, int count, char **defau
     f->must_use = 0; // Default: can discard result
     f->next = ctx->func_registry;
     ctx->func_registry = f;
+    hashmap_put(&ctx->index.funcs, f->name, f);
 }
 
 void register_func_template(ParserContext *ctx, const char *name, const char *param, ASTNode *node)
 {
     GenericFuncTemplate *t = xmalloc(sizeof(GenericFuncTemplate));
-    t->name = xstrdup(name);
+    t->name = intern(name);
     t->generic_param = xstrdup(param);
     t->func_node = node;
     t->next = ctx->func_templates;
     ctx->func_templates = t;
+    hashmap_put(&ctx->index.func_templates, t->name, t);
 }
 
 void register_deprecated_func(ParserContext *ctx, const char *name, const char *reason)
 {
     DeprecatedFunc *d = xmalloc(sizeof(DeprecatedFunc));
-    d->name = xstrdup(name);
+    d->name = intern(name);
     d->reason = reason ? xstrdup(reason) : NULL;
     d->next = ctx->deprecated_funcs;
     ctx->deprecated_funcs = d;
@@ -335,16 +382,7 @@ DeprecatedFunc *find_deprecated_func(ParserContext *ctx, const char *name)
 
 GenericFuncTemplate *find_func_template(ParserContext *ctx, const char *name)
 {
-    GenericFuncTemplate *t = ctx->func_templates;
-    while (t)
-    {
-        if (strcmp(t->name, name) == 0)
-        {
-            return t;
-        }
-        t = t->next;
-    }
-    return NULL;
+    return hashmap_get(&ctx->index.func_templates, name);
 }
 
 void register_generic(ParserContext *ctx, char *name)
@@ -379,17 +417,15 @@ void register_impl_template(ParserContext *ctx, const char *sname, const char *p
     t->impl_node = node;
     t->next = ctx->impl_templates;
     ctx->impl_templates = t;
+    t->next_same_struct = hashmap_put(&ctx->index.impl_templates, t->struct_name, t);
 
     // Late binding: Check if any existing instantiations match this new impl
     // template
-    Instantiation *inst = ctx->instantiations;
+    Instantiation *inst = hashmap_get(&ctx->index.inst_by_template, sname);
     while (inst)
     {
-        if (inst->template_name && strcmp(inst->template_name, sname) == 0)
-        {
-            instantiate_methods(ctx, t, inst->name, inst->concrete_arg);
-        }
-        inst = inst->next;
+        instantiate_methods(ctx, t, inst->name, inst->concrete_arg);
+        inst = inst->next_same_template;
     }
 }
 
@@ -399,6 +435,7 @@ void add_to_struct_list(ParserContext *ctx, ASTNode *node)
     r->node = node;
     r->next = ctx->parsed_structs_list;
     ctx->parsed_structs_list = r;
+    hashmap_put(&ctx->index.parsed_structs, node->strct.name, node);
 }
 
 void add_to_enum_list(ParserContext *ctx, ASTNode *node)
@@ -407,6 +444,7 @@ void add_to_enum_list(ParserContext *ctx, ASTNode *node)
     r->node = node;
     r->next = ctx->parsed_enums_list;
     ctx->parsed_enums_list = r;
+    hashmap_put(&ctx->index.parsed_enums, node->enm.name, node);
 }
 
 void add_to_func_list(ParserContext *ctx, ASTNode *node)
@@ -489,20 +527,12 @@ void register_enum_variant(ParserContext *ctx, const char *ename, const char *vn
     r->tag_id = tag;
     r->next = ctx->enum_variants;
     ctx->enum_variants = r;
+    hashmap_put(&ctx->index.enum_variants, r->variant_name, r);
 }
 
 EnumVariantReg *find_enum_variant(ParserContext *ctx, const char *vname)
 {
-    EnumVariantReg *r = ctx->enum_variants;
-    while (r)
-    {
-        if (strcmp(r->variant_name, vname) == 0)
-        {
-            return r;
-        }
-        r = r->next;
-    }
-    return NULL;
+    return hashmap_get(&ctx->index.enum_variants, vname);
 }
 
 void register_lambda(ParserContext *ctx, ASTNode *node)
@@ -516,22 +546,17 @@ void register_lambda(ParserContext *ctx, ASTNode *node)
 void register_var_mutability(ParserContext *ctx, const char *name, int is_mutable)
 {
     VarMutability *v = xmalloc(sizeof(VarMutability));
-    v->name = xstrdup(name);
+    v->name = intern(name);
     v->is_mutable = is_mutable;
     v->next = ctx->var_mutability_table;
     ctx->var_mutability_table = v;
+    hashmap_put(&ctx->index.var_mutability, v->name, v);
 }
 
 int is_var_mutable(ParserContext *ctx, const char *name)
 {
-    for (VarMutability *v = ctx->var_mutability_table; v; v = v->next)
-    {
-        if (strcmp(v->name, name) == 0)
-        {
-            return v->is_mutable;
-        }
-    }
-    return 1;
+    VarMutability *v = hashmap_get(&ctx->index.var_mutability, name);
+    return v ? v->is_mutable : 1;
 }
 
 void register_extern_symbol(ParserContext *ctx, const char *name)
@@ -668,67 +693,38 @@ void register_tuple(ParserContext *ctx, const char *sig)
 void register_struct_def(ParserContext *ctx, const char *name, ASTNode *node)
 {
     StructDef *d = xmalloc(sizeof(StructDef));
-    d->name = xstrdup(name);
+    d->name = intern(name);
     d->node = node;
     d->next = ctx->struct_defs;
     ctx->struct_defs = d;
+    hashmap_put(&ctx->index.struct_defs, d->name, d);
 }
 
 ASTNode *find_struct_def(ParserContext *ctx, const char *name)
 {
-    Instantiation *i = ctx->instantiations;
-    while (i)
+    // Instantiated generics (struct_node stays NULL while one is in progress;
+    // every entry of instantiated_structs is also registered here).
+    Instantiation *i = hashmap_get(&ctx->index.instantiations, name);
+    if (i)
     {
-        if (strcmp(i->name, name) == 0)
-        {
-            return i->struct_node;
-        }
-        i = i->next;
+        return i->struct_node;
     }
 
-    ASTNode *s = ctx->instantiated_structs;
-    while (s)
+    ASTNode *s = hashmap_get(&ctx->index.parsed_structs, name);
+    if (s)
     {
-        if (s->type == NODE_STRUCT && strcmp(s->strct.name, name) == 0)
-        {
-            return s;
-        }
-        s = s->next;
-    }
-
-    StructRef *r = ctx->parsed_structs_list;
-    while (r)
-    {
-        if (strcmp(r->node->strct.name, name) == 0)
-        {
-            return r->node;
-        }
-        r = r->next;
+        return s;
     }
 
     // Check manually registered definitions (e.g. Slices)
-    StructDef *d = ctx->struct_defs;
-    while (d)
+    StructDef *d = hashmap_get(&ctx->index.struct_defs, name);
+    if (d)
     {
-        if (strcmp(d->name, name) == 0)
-        {
-            return d->node;
-        }
-        d = d->next;
+        return d->node;
     }
 
     // Check enums list (for @derive(Eq) and field type lookups)
-    StructRef *e = ctx->parsed_enums_list;
-    while (e)
-    {
-        if (e->node->type == NODE_ENUM && strcmp(e->node->enm.name, name) == 0)
-        {
-            return e->node;
-        }
-        e = e->next;
-    }
-
-    return NULL;
+    return hashmap_get(&ctx->index.parsed_enums, name);
 }
 
 Module *find_module(ParserContext *ctx, const char *alias)
@@ -825,9 +821,16 @@ char *replace_in_string(const char *src, const char *old_w, const char *new_w)
     int newWlen = strlen(new_w);
     int oldWlen = strlen(old_w);
 
+    if (oldWlen == 0)
+    {
+        return xstrdup(src);
+    }
+
+    // Match in place: strstr() here would rescan the whole tail at every
+    // position and make this quadratic.
     for (i = 0; src[i] != '\0'; i++)
     {
-        if (strstr(&src[i], old_w) == &src[i])
+        if (src[i] == old_w[0] && strncmp(&src[i], old_w, oldWlen) == 0)
         {
             // Check boundaries to ensure we match whole words only
             int valid = 1;
@@ -858,7 +861,7 @@ char *replace_in_string(const char *src, const char *old_w, const char *new_w)
     i = 0;
     while (*src)
     {
-        if (strstr(src, old_w) == src)
+        if (*src == old_w[0] && strncmp(src, old_w, oldWlen) == 0)
         {
             int valid = 1;
 
@@ -984,11 +987,32 @@ char *replace_type_str(const char *src, const char *param, const char *concrete,
     return xstrdup(src);
 }
 
-ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char *os,
-                            const char *ns);
+// ** Generic substitution **
+// One GenericSubst (see parser.h) per instantiation: derived strings are
+// computed once, and every distinct type string, identifier and interned Type
+// in the template is rewritten once, so instantiating a template costs a
+// single walk over it.
 
-Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os, const char *ns)
+static void subst_init(GenericSubst *s, const char *p, const char *c, const char *os,
+                       const char *ns)
+{
+    memset(s, 0, sizeof(GenericSubst));
+    s->param = p;
+    s->concrete = c;
+    s->old_struct = os;
+    s->new_struct = ns;
+    s->clean_concrete = c ? sanitize_mangled_name(c) : NULL;
+}
+
+static Type *subst_type(GenericSubst *s, Type *t);
+
+static Type *subst_type_rec(GenericSubst *s, Type *t)
 {
+    const char *p = s->param;
+    const char *c = s->concrete;
+    const char *os = s->old_struct;
+    const char *ns = s->new_struct;
+
     if (!t)
     {
         return NULL;
@@ -1145,8 +1169,7 @@ Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os,
         return n;
     }
 
-    Type *n = xmalloc(sizeof(Type));
-    *n = *t;
+    Type *n = type_clone(t);
 
     if (t->name)
     {
@@ -1168,13 +1191,12 @@ Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os,
             if (nlen > slen && strcmp(t->name + nlen - slen, suffix) == 0)
             {
                 // It ends in _T. Replace with _int (c), sanitizing for pointers
-                char *clean_c = sanitize_mangled_name(c);
+                const char *clean_c = s->clean_concrete;
                 char *new_name = xmalloc(nlen - slen + strlen(clean_c) + 2);
                 strncpy(new_name, t->name, nlen - slen);
                 new_name[nlen - slen] = 0;
                 strcat(new_name, "_");
                 strcat(new_name, clean_c);
-                free(clean_c);
                 n->name = new_name;
                 // Ensure it's concrete to prevent double mangling later
                 n->kind = TYPE_STRUCT;
@@ -1194,7 +1216,7 @@ Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os,
 
     if (t->kind == TYPE_POINTER || t->kind == TYPE_ARRAY)
     {
-        n->inner = replace_type_formal(t->inner, p, c, os, ns);
+        n->inner = subst_type(s, t->inner);
     }
 
     if (n->arg_count > 0 && t->args)
@@ -1202,13 +1224,60 @@ Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os,
         n->args = xmalloc(sizeof(Type *) * t->arg_count);
         for (int i = 0; i < t->arg_count; i++)
         {
-            n->args[i] = replace_type_formal(t->args[i], p, c, os, ns);
+            n->args[i] = subst_type(s, t->args[i]);
         }
     }
 
     return n;
 }
 
+static Type *subst_type(GenericSubst *s, Type *t)
+{
+    if (!t)
+    {
+        return NULL;
+    }
+
+    // Only interned types are shared, so only they can be memoized.
+    if (t->is_interned)
+    {
+        Type *done = ptrmap_get(&s->types, t);
+        if (done)
+        {
+            return done;
+        }
+    }
+
+    Type *r = type_intern(subst_type_rec(s, t));
+    if (t->is_interned)
+    {
+        ptrmap_put(&s->types, t, r);
+    }
+    return r;
+}
+
+Type *replace_type_formal(Type *t, const char *p, const char *c, const char *os, const char *ns)
+{
+    GenericSubst s;
+    subst_init(&s, p, c, os, ns);
+    return subst_type(&s, t);
+}
+
+static char *subst_type_str(GenericSubst *s, const char *src)
+{
+    if (!src)
+    {
+        return NULL;
+    }
+    char *done = hashmap_get(&s->type_strs, src);
+    if (!done)
+    {
+        done = replace_type_str(src, s->param, s->concrete, s->old_struct, s->new_struct);
+        hashmap_put(&s->type_strs, src, done);
+    }
+    return done;
+}
+
 // Helper to replace generic params in mangled names (e.g. Option_V_None ->
 // Option_int_None)
 char *replace_mangled_part(const char *src, const char *param, const char *concrete)
@@ -1218,12 +1287,24 @@ char *replace_mangled_part(const char *src, const char *param, const char *concr
         return src ? xstrdup(src) : NULL;
     }
 
-    char *result = xmalloc(4096); // Basic buffer for simplicity
-    result[0] = 0;
+    int plen = strlen(param);
+    int clen = strlen(concrete);
+    if (plen == 0)
+    {
+        return xstrdup(src);
+    }
+
+    // Worst case: every plen-sized run is a replaced parameter.
+    size_t slen = strlen(src);
+    size_t cap = slen + 1;
+    if (clen > plen)
+    {
+        cap += (slen / plen) * (clen - plen);
+    }
+    char *result = xmalloc(cap);
 
     const char *curr = src;
     char *out = result;
-    int plen = strlen(param);
 
     while (*curr)
     {
@@ -1251,8 +1332,8 @@ char *replace_mangled_part(const char *src, const char *param, const char *concr
 
             if (valid)
             {
-                strcpy(out, concrete);
-                out += strlen(concrete);
+                memcpy(out, concrete, clen);
+                out += clen;
                 curr += plen;
                 continue;
             }
@@ -1260,11 +1341,43 @@ char *replace_mangled_part(const char *src, const char *param, const char *concr
         *out++ = *curr++;
     }
     *out = 0;
-    return xstrdup(result);
+    return result;
 }
 
-ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char *os,
-                            const char *ns)
+// Identifier with the mangled template parameter replaced (Vec_T_push ->
+// Vec_int_push).
+static char *subst_name(GenericSubst *s, const char *name)
+{
+    if (!s->param || !s->concrete)
+    {
+        return xstrdup(name);
+    }
+    char *done = hashmap_get(&s->names, name);
+    if (!done)
+    {
+        done = replace_mangled_part(name, s->param, s->clean_concrete);
+        hashmap_put(&s->names, name, done);
+    }
+    return done;
+}
+
+// Argument lists and raw C text: whole-word param -> concrete, template struct
+// -> mangled struct, then mangled occurrences of the param.
+static char *subst_text(GenericSubst *s, const char *src)
+{
+    char *out = replace_in_string(src, s->param, s->concrete);
+    if (s->old_struct && s->new_struct)
+    {
+        out = replace_in_string(out, s->old_struct, s->new_struct);
+    }
+    if (s->param && s->concrete)
+    {
+        out = replace_mangled_part(out, s->param, s->clean_concrete);
+    }
+    return out;
+}
+
+static ASTNode *subst_ast(GenericSubst *s, ASTNode *n)
 {
     if (!n)
     {
@@ -1276,113 +1389,69 @@ ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char
 
     if (n->resolved_type)
     {
-        new_node->resolved_type = replace_type_str(n->resolved_type, p, c, os, ns);
+        new_node->resolved_type = subst_type_str(s, n->resolved_type);
     }
-    new_node->type_info = replace_type_formal(n->type_info, p, c, os, ns);
+    new_node->type_info = subst_type(s, n->type_info);
+    new_node->inferred_type = NULL;
 
-    new_node->next = copy_ast_replacing(n->next, p, c, os, ns);
+    new_node->next = subst_ast(s, n->next);
 
     switch (n->type)
     {
     case NODE_FUNCTION:
         new_node->func.name = xstrdup(n->func.name);
-        new_node->func.ret_type = replace_type_str(n->func.ret_type, p, c, os, ns);
+        new_node->func.ret_type = subst_type_str(s, n->func.ret_type);
 
-        char *tmp_args = replace_in_string(n->func.args, p, c);
-        if (os && ns)
-        {
-            char *tmp2 = replace_in_string(tmp_args, os, ns);
-            free(tmp_args);
-            tmp_args = tmp2;
-        }
-        if (p && c)
-        {
-            char *clean_c = sanitize_mangled_name(c);
-            char *tmp3 = replace_mangled_part(tmp_args, p, clean_c);
-            free(clean_c);
-            free(tmp_args);
-            tmp_args = tmp3;
-        }
-        new_node->func.args = tmp_args;
+        new_node->func.args = subst_text(s, n->func.args);
 
-        new_node->func.ret_type_info = replace_type_formal(n->func.ret_type_info, p, c, os, ns);
+        new_node->func.ret_type_info = subst_type(s, n->func.ret_type_info);
         if (n->func.arg_types)
         {
             new_node->func.arg_types = xmalloc(sizeof(Type *) * n->func.arg_count);
             for (int i = 0; i < n->func.arg_count; i++)
             {
                 new_node->func.arg_types[i] =
-                    replace_type_formal(n->func.arg_types[i], p, c, os, ns);
+                    subst_type(s, n->func.arg_types[i]);
             }
         }
 
-        new_node->func.body = copy_ast_replacing(n->func.body, p, c, os, ns);
+        new_node->func.body = subst_ast(s, n->func.body);
         break;
     case NODE_BLOCK:
-        new_node->block.statements = copy_ast_replacing(n->block.statements, p, c, os, ns);
+        new_node->block.statements = subst_ast(s, n->block.statements);
         break;
     case NODE_RAW_STMT:
-    {
-        char *s1 = replace_in_string(n->raw_stmt.content, p, c);
-        if (os && ns)
-        {
-            char *s2 = replace_in_string(s1, os, ns);
-            free(s1);
-            s1 = s2;
-        }
-
-        if (p && c)
-        {
-            char *clean_c = sanitize_mangled_name(c);
-            char *s3 = replace_mangled_part(s1, p, clean_c);
-            free(clean_c);
-            free(s1);
-            s1 = s3;
-        }
-
-        new_node->raw_stmt.content = s1;
-    }
-    break;
+        new_node->raw_stmt.content = subst_text(s, n->raw_stmt.content);
+        break;
     case NODE_VAR_DECL:
         new_node->var_decl.name = xstrdup(n->var_decl.name);
-        new_node->var_decl.type_str = replace_type_str(n->var_decl.type_str, p, c, os, ns);
-        new_node->var_decl.init_expr = copy_ast_replacing(n->var_decl.init_expr, p, c, os, ns);
+        new_node->var_decl.type_str = subst_type_str(s, n->var_decl.type_str);
+        new_node->var_decl.init_expr = subst_ast(s, n->var_decl.init_expr);
         break;
     case NODE_RETURN:
-        new_node->ret.value = copy_ast_replacing(n->ret.value, p, c, os, ns);
+        new_node->ret.value = subst_ast(s, n->ret.value);
         break;
     case NODE_EXPR_BINARY:
-        new_node->binary.left = copy_ast_replacing(n->binary.left, p, c, os, ns);
-        new_node->binary.right = copy_ast_replacing(n->binary.right, p, c, os, ns);
+        new_node->binary.left = subst_ast(s, n->binary.left);
+        new_node->binary.right = subst_ast(s, n->binary.right);
         new_node->binary.op = xstrdup(n->binary.op);
         break;
     case NODE_EXPR_UNARY:
         new_node->unary.op = xstrdup(n->unary.op);
-        new_node->unary.operand = copy_ast_replacing(n->unary.operand, p, c, os, ns);
+        new_node->unary.operand = subst_ast(s, n->unary.operand);
         break;
     case NODE_EXPR_CALL:
-        new_node->call.callee = copy_ast_replacing(n->call.callee, p, c, os, ns);
-        new_node->call.args = copy_ast_replacing(n->call.args, p, c, os, ns);
+        new_node->call.callee = subst_ast(s, n->call.callee);
+        new_node->call.args = subst_ast(s, n->call.args);
         new_node->call.arg_names = n->call.arg_names; // Share pointer (shallow copy)
         new_node->call.arg_count = n->call.arg_count;
         break;
     case NODE_EXPR_VAR:
-    {
-        char *n1 = xstrdup(n->var_ref.name);
-        if (p && c)
-        {
-            char *clean_c = sanitize_mangled_name(c);
-            char *n2 = replace_mangled_part(n1, p, clean_c);
-            free(clean_c);
-            free(n1);
-            n1 = n2;
-        }
-        new_node->var_ref.name = n1;
-    }
-    break;
+        new_node->var_ref.name = subst_name(s, n->var_ref.name);
+        break;
     case NODE_FIELD:
         new_node->field.name = xstrdup(n->field.name);
-        new_node->field.type = replace_type_str(n->field.type, p, c, os, ns);
+        new_node->field.type = subst_type_str(s, n->field.type);
         break;
     case NODE_EXPR_LITERAL:
         if (n->literal.type_kind == 2)
@@ -1391,24 +1460,24 @@ ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char
         }
         break;
     case NODE_EXPR_MEMBER:
-        new_node->member.target = copy_ast_replacing(n->member.target, p, c, os, ns);
+        new_node->member.target = subst_ast(s, n->member.target);
         new_node->member.field = xstrdup(n->member.field);
         break;
     case NODE_EXPR_INDEX:
-        new_node->index.array = copy_ast_replacing(n->index.array, p, c, os, ns);
-        new_node->index.index = copy_ast_replacing(n->index.index, p, c, os, ns);
+        new_node->index.array = subst_ast(s, n->index.array);
+        new_node->index.index = subst_ast(s, n->index.index);
         break;
     case NODE_EXPR_CAST:
-        new_node->cast.target_type = replace_type_str(n->cast.target_type, p, c, os, ns);
-        new_node->cast.expr = copy_ast_replacing(n->cast.expr, p, c, os, ns);
+        new_node->cast.target_type = subst_type_str(s, n->cast.target_type);
+        new_node->cast.expr = subst_ast(s, n->cast.expr);
         break;
     case NODE_EXPR_STRUCT_INIT:
         new_node->struct_init.struct_name =
-            replace_type_str(n->struct_init.struct_name, p, c, os, ns);
+            subst_type_str(s, n->struct_init.struct_name);
         ASTNode *h = NULL, *t = NULL, *curr = n->struct_init.fields;
         while (curr)
         {
-            ASTNode *cp = copy_ast_replacing(curr, p, c, os, ns);
+            ASTNode *cp = subst_ast(s, curr);
             cp->next = NULL;
             if (!h)
             {
@@ -1424,30 +1493,28 @@ ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char
         new_node->struct_init.fields = h;
         break;
     case NODE_IF:
-        new_node->if_stmt.condition = copy_ast_replacing(n->if_stmt.condition, p, c, os, ns);
-        new_node->if_stmt.then_body = copy_ast_replacing(n->if_stmt.then_body, p, c, os, ns);
-        new_node->if_stmt.else_body = copy_ast_replacing(n->if_stmt.else_body, p, c, os, ns);
+        new_node->if_stmt.condition = subst_ast(s, n->if_stmt.condition);
+        new_node->if_stmt.then_body = subst_ast(s, n->if_stmt.then_body);
+        new_node->if_stmt.else_body = subst_ast(s, n->if_stmt.else_body);
         break;
     case NODE_WHILE:
-        new_node->while_stmt.condition = copy_ast_replacing(n->while_stmt.condition, p, c, os, ns);
-        new_node->while_stmt.body = copy_ast_replacing(n->while_stmt.body, p, c, os, ns);
+        new_node->while_stmt.condition = subst_ast(s, n->while_stmt.condition);
+        new_node->while_stmt.body = subst_ast(s, n->while_stmt.body);
         break;
     case NODE_FOR:
-        new_node->for_stmt.init = copy_ast_replacing(n->for_stmt.init, p, c, os, ns);
-        new_node->for_stmt.condition = copy_ast_replacing(n->for_stmt.condition, p, c, os, ns);
-        new_node->for_stmt.step = copy_ast_replacing(n->for_stmt.step, p, c, os, ns);
-        new_node->for_stmt.body = copy_ast_replacing(n->for_stmt.body, p, c, os, ns);
+        new_node->for_stmt.init = subst_ast(s, n->for_stmt.init);
+        new_node->for_stmt.condition = subst_ast(s, n->for_stmt.condition);
+        new_node->for_stmt.step = subst_ast(s, n->for_stmt.step);
+        new_node->for_stmt.body = subst_ast(s, n->for_stmt.body);
         break;
 
     case NODE_MATCH_CASE:
         if (n->match_case.pattern)
         {
-            char *s1 = replace_in_string(n->match_case.pattern, p, c);
-            if (os && ns)
+            char *s1 = replace_in_string(n->match_case.pattern, s->param, s->concrete);
+            if (s->old_struct && s->new_struct)
             {
-                char *s2 = replace_in_string(s1, os, ns);
-                free(s1);
-                s1 = s2;
+                s1 = replace_in_string(s1, s->old_struct, s->new_struct);
                 char *colons = strstr(s1, "::");
                 if (colons)
                 {
@@ -1457,16 +1524,16 @@ ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char
             }
             new_node->match_case.pattern = s1;
         }
-        new_node->match_case.body = copy_ast_replacing(n->match_case.body, p, c, os, ns);
+        new_node->match_case.body = subst_ast(s, n->match_case.body);
         if (n->match_case.guard)
         {
-            new_node->match_case.guard = copy_ast_replacing(n->match_case.guard, p, c, os, ns);
+            new_node->match_case.guard = subst_ast(s, n->match_case.guard);
         }
         break;
 
     case NODE_IMPL:
-        new_node->impl.struct_name = replace_type_str(n->impl.struct_name, p, c, os, ns);
-        new_node->impl.methods = copy_ast_replacing(n->impl.methods, p, c, os, ns);
+        new_node->impl.struct_name = subst_type_str(s, n->impl.struct_name);
+        new_node->impl.methods = subst_ast(s, n->impl.methods);
         break;
     default:
         break;
@@ -1474,6 +1541,14 @@ ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char
     return new_node;
 }
 
+ASTNode *copy_ast_replacing(ASTNode *n, const char *p, const char *c, const char *os,
+                            const char *ns)
+{
+    GenericSubst s;
+    subst_init(&s, p, c, os, ns);
+    return subst_ast(&s, n);
+}
+
 // Helper to sanitize type names for mangling (e.g. "int*" -> "intPtr")
 char *sanitize_mangled_name(const char *s)
 {
@@ -1507,16 +1582,7 @@ char *sanitize_mangled_name(const char *s)
 
 FuncSig *find_func(ParserContext *ctx, const char *name)
 {
-    FuncSig *c = ctx->func_registry;
-    while (c)
-    {
-        if (strcmp(c->name, name) == 0)
-        {
-            return c;
-        }
-        c = c->next;
-    }
-    return NULL;
+    return hashmap_get(&ctx->index.funcs, name);
 }
 
 char *instantiate_function_template(ParserContext *ctx, const char *name, const char *concrete_type)
@@ -1683,33 +1749,37 @@ void register_impl(ParserContext *ctx, const char *trait, const char *strct)
     r->strct = xstrdup(strct);
     r->next = ctx->registered_impls;
     ctx->registered_impls = r;
+
+    char *key = xmalloc(strlen(trait) + strlen(strct) + 2);
+    sprintf(key, "%s:%s", trait, strct);
+    hashmap_put(&ctx->index.impls, key, r);
 }
 
 int check_impl(ParserContext *ctx, const char *trait, const char *strct)
 {
-    ImplReg *r = ctx->registered_impls;
-    while (r)
-    {
-        if (strcmp(r->trait, trait) == 0 && strcmp(r->strct, strct) == 0)
-        {
-            return 1;
-        }
-        r = r->next;
-    }
-    return 0;
+    char buf[512];
+    size_t len = strlen(trait) + strlen(strct) + 2;
+    char *key = len <= sizeof(buf) ? buf : xmalloc(len);
+    sprintf(key, "%s:%s", trait, strct);
+    return hashmap_contains(&ctx->index.impls, key);
 }
 
 void register_template(ParserContext *ctx, const char *name, ASTNode *node)
 {
     GenericTemplate *t = xmalloc(sizeof(GenericTemplate));
-    t->name = xstrdup(name);
+    t->name = intern(name);
     t->struct_node = node;
     t->next = ctx->templates;
     ctx->templates = t;
+    hashmap_put(&ctx->index.templates, t->name, t);
 }
 
-ASTNode *copy_fields_replacing(ParserContext *ctx, ASTNode *fields, const char *param,
-                               const char *concrete)
+GenericTemplate *find_template(ParserContext *ctx, const char *name)
+{
+    return hashmap_get(&ctx->index.templates, name);
+}
+
+static ASTNode *copy_fields_replacing(ParserContext *ctx, GenericSubst *s, ASTNode *fields)
 {
     if (!fields)
     {
@@ -1719,10 +1789,10 @@ ASTNode *copy_fields_replacing(ParserContext *ctx, ASTNode *fields, const char *
     n->field.name = xstrdup(fields->field.name);
 
     // Replace strings
-    n->field.type = replace_type_str(fields->field.type, param, concrete, NULL, NULL);
+    n->field.type = subst_type_str(s, fields->field.type);
 
     // Replace formal types (Deep Copy)
-    n->type_info = replace_type_formal(fields->type_info, param, concrete, NULL, NULL);
+    n->type_info = subst_type(s, fields->type_info);
 
     if (n->field.type && strchr(n->field.type, '_'))
     {
@@ -1747,19 +1817,7 @@ ASTNode *copy_fields_replacing(ParserContext *ctx, ASTNode *fields, const char *
                 char *concrete_arg = underscore + 1;
 
                 // Check if this is actually a known generic template
-                GenericTemplate *gt = ctx->templates;
-                int found = 0;
-                while (gt)
-                {
-                    if (strcmp(gt->name, template_name) == 0)
-                    {
-                        found = 1;
-                        break;
-                    }
-                    gt = gt->next;
-                }
-
-                if (found)
+                if (find_template(ctx, template_name))
                 {
                     instantiate_generic(ctx, template_name, concrete_arg);
                 }
@@ -1768,10 +1826,55 @@ ASTNode *copy_fields_replacing(ParserContext *ctx, ASTNode *fields, const char *
         }
     }
 
-    n->next = copy_fields_replacing(ctx, fields->next, param, concrete);
+    n->next = copy_fields_replacing(ctx, s, fields->next);
     return n;
 }
 
+// ** Demand-driven method instantiation **
+// Instantiating a generic struct registers the signatures of all of its impl
+// methods right away, so calls resolve and type-check as before, but a method
+// body is only copied out of the template once the reachability pass
+// (analysis/reachability.c) finds a reference to it. Unused methods of Vec<T>,
+// Option<T>, ... never reach codegen or the C compiler.
+ASTNode *instantiate_lazy_method(LazyMethod *m)
+{
+    if (m->done)
+    {
+        return NULL;
+    }
+    m->done = 1;
+
+    LazyImpl *li = m->owner;
+    ASTNode *backup_next = m->tmpl->next;
+    m->tmpl->next = NULL; // Break link to isolate node
+    ASTNode *fn = subst_ast(&li->subst, m->tmpl);
+    m->tmpl->next = backup_next; // Restore
+    fn->func.name = m->name;
+    li->slots[m->slot] = fn;
+
+    // Keep template order in the emitted impl.
+    ASTNode *head = NULL, *tail = NULL;
+    for (int i = 0; i < li->count; i++)
+    {
+        if (!li->slots[i])
+        {
+            continue;
+        }
+        li->slots[i]->next = NULL;
+        if (tail)
+        {
+            tail->next = li->slots[i];
+        }
+        else
+        {
+            head = li->slots[i];
+        }
+        tail = li->slots[i];
+    }
+    li->impl->impl.methods = head;
+    return fn;
+}
+
 void instantiate_methods(ParserContext *ctx, GenericImplTemplate *it,
                          const char *mangled_struct_name, const char *arg)
 {
@@ -1780,32 +1883,71 @@ void instantiate_methods(ParserContext *ctx, GenericImplTemplate *it,
         return; // Simple dedupe check
     }
 
-    ASTNode *backup_next = it->impl_node->next;
-    it->impl_node->next = NULL; // Break link to isolate node
-    ASTNode *new_impl = copy_ast_replacing(it->impl_node, it->generic_param, arg, it->struct_name,
-                                           mangled_struct_name);
-    it->impl_node->next = backup_next; // Restore
+    LazyImpl *li = xmalloc(sizeof(LazyImpl));
+    char *mangled = xstrdup(mangled_struct_name);
+    subst_init(&li->subst, it->generic_param, xstrdup(arg), it->struct_name, mangled);
+
+    li->impl = xmalloc(sizeof(ASTNode));
+    *li->impl = *it->impl_node;
+    li->impl->next = NULL;
+    li->impl->impl.struct_name = mangled;
+    li->impl->impl.methods = NULL;
 
-    new_impl->impl.struct_name = xstrdup(mangled_struct_name);
-    ASTNode *meth = new_impl->impl.methods;
-    while (meth)
+    li->count = 0;
+    for (ASTNode *meth = it->impl_node->impl.methods; meth; meth = meth->next)
     {
+        li->count++;
+    }
+    li->slots = xcalloc(li->count ? li->count : 1, sizeof(ASTNode *));
+
+    size_t tpl_len = strlen(it->struct_name);
+    int slot = 0;
+    for (ASTNode *meth = it->impl_node->impl.methods; meth; meth = meth->next, slot++)
+    {
+        LazyMethod *m = xmalloc(sizeof(LazyMethod));
+        m->owner = li;
+        m->tmpl = meth;
+        m->slot = slot;
+        m->done = 0;
+        m->name = meth->func.name;
+        m->next_same_method = NULL;
+
+        const char *method = meth->func.name;
         char *suffix = strchr(meth->func.name, '_');
         if (suffix)
         {
-            char *new_name = xmalloc(strlen(mangled_struct_name) + strlen(suffix) + 1);
-            sprintf(new_name, "%s%s", mangled_struct_name, suffix);
-            free(meth->func.name);
-            meth->func.name = new_name;
-            register_func(ctx, new_name, meth->func.arg_count, meth->func.defaults,
-                          meth->func.arg_types, meth->func.ret_type_info, meth->func.is_varargs, 0,
-                          meth->token);
+            m->name = xmalloc(strlen(mangled) + strlen(suffix) + 1);
+            sprintf(m->name, "%s%s", mangled, suffix);
+
+            Type **arg_types = NULL;
+            if (meth->func.arg_types)
+            {
+                arg_types = xmalloc(sizeof(Type *) * meth->func.arg_count);
+                for (int i = 0; i < meth->func.arg_count; i++)
+                {
+                    arg_types[i] = subst_type(&li->subst, meth->func.arg_types[i]);
+                }
+            }
+            register_func(ctx, m->name, meth->func.arg_count, meth->func.defaults, arg_types,
+                          subst_type(&li->subst, meth->func.ret_type_info),
+                          meth->func.is_varargs, 0, meth->token);
+
+            method = suffix + 1;
+            if (strncmp(meth->func.name, it->struct_name, tpl_len) == 0 &&
+                meth->func.name[tpl_len] == '_')
+            {
+                method = meth->func.name + tpl_len + 1;
+            }
         }
+        hashmap_put(&ctx->index.lazy_methods, m->name, m);
+        m->next_same_method = hashmap_put(&ctx->index.lazy_by_method, intern(method), m);
 
         // Handle generic return types in methods (e.g., Option<T> -> Option_int)
-        if (meth->func.ret_type && strchr(meth->func.ret_type, '_'))
+        char *ret_type =
+            meth->func.ret_type ? subst_type_str(&li->subst, meth->func.ret_type) : NULL;
+        if (ret_type && strchr(ret_type, '_'))
         {
-            char *ret_copy = xstrdup(meth->func.ret_type);
+            char *ret_copy = xstrdup(ret_type);
             char *underscore = strrchr(ret_copy, '_');
             if (underscore && underscore > ret_copy)
             {
@@ -1813,24 +1955,15 @@ void instantiate_methods(ParserContext *ctx, GenericImplTemplate *it,
                 char *template_name = ret_copy;
 
                 // Check if this looks like a generic (e.g., "Option_V" or "Result_V")
-                GenericTemplate *gt = ctx->templates;
-                while (gt)
+                if (find_template(ctx, template_name))
                 {
-                    if (strcmp(gt->name, template_name) == 0)
-                    {
-                        // Found matching template, instantiate it
-                        instantiate_generic(ctx, template_name, arg);
-                        break;
-                    }
-                    gt = gt->next;
+                    instantiate_generic(ctx, template_name, arg);
                 }
             }
             free(ret_copy);
         }
-
-        meth = meth->next;
     }
-    add_instantiated_func(ctx, new_impl);
+    add_instantiated_func(ctx, li->impl);
 }
 
 void instantiate_generic(ParserContext *ctx, const char *tpl, const char *arg)
@@ -1850,25 +1983,12 @@ void instantiate_generic(ParserContext *ctx, const char *tpl, const char *arg)
     sprintf(m, "%s_%s", tpl, clean_arg);
     free(clean_arg);
 
-    Instantiation *c = ctx->instantiations;
-    while (c)
+    if (hashmap_contains(&ctx->index.instantiations, m))
     {
-        if (strcmp(c->name, m) == 0)
-        {
-            return; // Already instantiated, DO NOTHING.
-        }
-        c = c->next;
+        return; // Already instantiated, DO NOTHING.
     }
 
-    GenericTemplate *t = ctx->templates;
-    while (t)
-    {
-        if (strcmp(t->name, tpl) == 0)
-        {
-            break;
-        }
-        t = t->next;
-    }
+    GenericTemplate *t = find_template(ctx, tpl);
     if (!t)
     {
         zpanic("Unknown generic: %s", tpl);
@@ -1878,24 +1998,32 @@ void instantiate_generic(ParserContext *ctx, const char *tpl, const char *arg)
     ni->name = xstrdup(m);
     ni->template_name = xstrdup(tpl);
     ni->concrete_arg = xstrdup(arg);
+    ni->type = type_instance(ni->template_name, type_from_spelling(arg));
     ni->struct_node = NULL; // Placeholder to break cycles
     ni->next = ctx->instantiations;
     ctx->instantiations = ni;
+    hashmap_put(&ctx->index.instantiations, ni->name, ni);
+    ni->next_same_template = hashmap_put(&ctx->index.inst_by_template, ni->template_name, ni);
 
     ASTNode *struct_node_copy = NULL;
 
     if (t->struct_node->type == NODE_STRUCT)
     {
+        GenericSubst s;
+        subst_init(&s, t->struct_node->strct.generic_param, arg, NULL, NULL);
+
         ASTNode *i = ast_create(NODE_STRUCT);
         i->strct.name = xstrdup(m);
         i->strct.is_template = 0;
-        i->strct.fields = copy_fields_replacing(ctx, t->struct_node->strct.fields,
-                                                t->struct_node->strct.generic_param, arg);
+        i->strct.fields = copy_fields_replacing(ctx, &s, t->struct_node->strct.fields);
         struct_node_copy = i;
         register_struct_def(ctx, m, i);
     }
     else if (t->struct_node->type == NODE_ENUM)
     {
+        GenericSubst s;
+        subst_init(&s, t->struct_node->enm.generic_param, arg, NULL, NULL);
+
         ASTNode *i = ast_create(NODE_ENUM);
         i->enm.name = xstrdup(m);
         i->enm.is_template = 0;
@@ -1906,8 +2034,7 @@ void instantiate_generic(ParserContext *ctx, const char *tpl, const char *arg)
             ASTNode *nv = ast_create(NODE_ENUM_VARIANT);
             nv->variant.name = xstrdup(v->variant.name);
             nv->variant.tag_id = v->variant.tag_id;
-            nv->variant.payload = replace_type_formal(
-                v->variant.payload, t->struct_node->enm.generic_param, arg, NULL, NULL);
+            nv->variant.payload = subst_type(&s, v->variant.payload);
             char mangled_var[512];
             sprintf(mangled_var, "%s_%s", m, nv->variant.name);
             register_enum_variant(ctx, m, mangled_var, nv->variant.tag_id);
@@ -1934,29 +2061,17 @@ void instantiate_generic(ParserContext *ctx, const char *tpl, const char *arg)
         ctx->instantiated_structs = struct_node_copy;
     }
 
-    GenericImplTemplate *it = ctx->impl_templates;
+    GenericImplTemplate *it = hashmap_get(&ctx->index.impl_templates, tpl);
     while (it)
     {
-        if (strcmp(it->struct_name, tpl) == 0)
-        {
-            instantiate_methods(ctx, it, m, arg);
-        }
-        it = it->next;
+        instantiate_methods(ctx, it, m, arg);
+        it = it->next_same_struct;
     }
 }
 
 int is_file_imported(ParserContext *ctx, const char *p)
 {
-    ImportedFile *c = ctx->imported_files;
-    while (c)
-    {
-        if (strcmp(c->path, p) == 0)
-        {
-            return 1;
-        }
-        c = c->next;
-    }
-    return 0;
+    return hashmap_contains(&ctx->index.imported_files, p);
 }
 
 void mark_file_imported(ParserContext *ctx, const char *p)
@@ -1965,6 +2080,7 @@ void mark_file_imported(ParserContext *ctx, const char *p)
     f->path = xstrdup(p);
     f->next = ctx->imported_files;
     ctx->imported_files = f;
+    hashmap_put(&ctx->index.imported_files, f->path, f);
 }
 
 char *parse_condition_raw(ParserContext *ctx, Lexer *l)
@@ -2031,16 +2147,31 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
     }
 
     int in_expr = 0;
-    char *result = xmalloc(strlen(raw) * 4 + 100);
+    size_t cap = strlen(raw) + 64;
+    char *result = xmalloc(cap);
     char *dest = result;
     char *src = raw;
 
+    // Grow the output so that 'n' more bytes (plus the terminator) fit.
+#define RW_RESERVE(n)                                                                              \
+    do                                                                                             \
+    {                                                                                              \
+        size_t used_ = dest - result;                                                              \
+        if (used_ + (n) + 1 > cap)                                                                 \
+        {                                                                                          \
+            cap = (used_ + (n) + 1) * 2;                                                           \
+            result = xrealloc(result, cap);                                                        \
+            dest = result + used_;                                                                 \
+        }                                                                                          \
+    } while (0)
+
     while (*src)
     {
         if (strncmp(src, "#{", 2) == 0)
         {
             in_expr = 1;
             src += 2;
+            RW_RESERVE(1);
             *dest++ = '(';
             continue;
         }
@@ -2048,6 +2179,7 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
         if (in_expr && *src == '}')
         {
             in_expr = 0;
+            RW_RESERVE(1);
             *dest++ = ')';
             src++;
             continue;
@@ -2072,6 +2204,7 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
             char *vtype = find_symbol_type(ctx, acc);
             if (!vtype)
             {
+                RW_RESERVE(1);
                 *dest++ = *src++;
                 continue;
             }
@@ -2116,10 +2249,12 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
                 dest -= strlen(acc);
                 if (is_ptr_type)
                 {
+                    RW_RESERVE(strlen(acc) + strlen(method) + 16);
                     dest += sprintf(dest, "(%s)->%s", acc, method);
                 }
                 else
                 {
+                    RW_RESERVE(strlen(acc) + strlen(method) + 16);
                     dest += sprintf(dest, "(%s).%s", acc, method);
                 }
                 continue;
@@ -2144,6 +2279,7 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
                     }
                 }
 
+                RW_RESERVE(strlen(ptr_check) + strlen(method) + strlen(acc) + 16);
                 dest += sprintf(dest, "%s_%s(%s%s", ptr_check, method, is_ptr ? "" : "&", acc);
 
                 int has_args = 0;
@@ -2165,15 +2301,18 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
                     {
                         break;
                     }
+                    RW_RESERVE(1);
                     *dest++ = *src++;
                 }
 
                 if (has_args)
                 {
+                    RW_RESERVE(1);
                     *dest++ = ')';
                 }
                 else
                 {
+                    RW_RESERVE(1);
                     *dest++ = ')';
                 }
 
@@ -2194,6 +2333,7 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
                         *p = 0;
                     }
                 }
+                RW_RESERVE(strlen(ptr_check) + strlen(method) + strlen(acc) + 16);
                 dest += sprintf(dest, "%s_%s(%s%s)", ptr_check, method, is_ptr ? "" : "&", acc);
                 continue;
             }
@@ -2229,10 +2369,12 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
             Module *mod = find_module(ctx, acc);
             if (mod && mod->is_c_header)
             {
+                RW_RESERVE(strlen(field) + 16);
                 dest += sprintf(dest, "%s", field);
             }
             else
             {
+                RW_RESERVE(strlen(acc) + strlen(field) + 16);
                 dest += sprintf(dest, "%s_%s", acc, field);
             }
             continue;
@@ -2280,6 +2422,7 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
 
                     if (*src == ')')
                     {
+                        RW_RESERVE(strlen(mangled) + 16);
                         dest += sprintf(dest, "%s()", mangled);
                         src++;
                     }
@@ -2288,11 +2431,14 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
                         FuncSig *sig = find_func(ctx, func_name);
                         if (sig)
                         {
+                            RW_RESERVE(strlen(mangled) + strlen(func_name) + 16);
                             dest += sprintf(dest, "%s(&(%s){0}", mangled, func_name);
                             while (*src && *src != ')')
                             {
+                                RW_RESERVE(1);
                                 *dest++ = *src++;
                             }
+                            RW_RESERVE(1);
                             *dest++ = ')';
                             if (*src == ')')
                             {
@@ -2301,11 +2447,14 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
                         }
                         else
                         {
+                            RW_RESERVE(strlen(mangled) + 16);
                             dest += sprintf(dest, "%s(", mangled);
                             while (*src && *src != ')')
                             {
+                                RW_RESERVE(1);
                                 *dest++ = *src++;
                             }
+                            RW_RESERVE(1);
                             *dest++ = ')';
                             if (*src == ')')
                             {
@@ -2317,15 +2466,18 @@ char *rewrite_expr_methods(ParserContext *ctx, char *raw)
                 }
             }
 
+            RW_RESERVE(strlen(tok));
             strcpy(dest, tok);
             dest += strlen(tok);
             continue;
         }
 
+        RW_RESERVE(1);
         *dest++ = *src++;
     }
 
     *dest = 0;
+#undef RW_RESERVE
     return result;
 }
 
@@ -122,8 +122,17 @@ void run_repl(const char *self_path)
     int brace_depth = 0;
     int paren_depth = 0;
 
+    // Scratch for commands and evaluations; reset whenever a fresh prompt starts.
+    Arena *eval_arena = arena_create("repl-eval");
+    Arena *session_arena = arena_switch(eval_arena);
+
     while (1)
     {
+        if (NULL == input_buffer)
+        {
+            arena_reset(eval_arena);
+        }
+
         if (brace_depth > 0 || paren_depth > 0)
         {
             printf("... ");
@@ -516,7 +525,7 @@ void run_repl(const char *self_path)
                     ctx.skip_preamble = 1;
 
                     Lexer l;
-                    lexer_init(&l, code);
+                    lexer_init_buffered(&l, code);
                     ASTNode *nodes = parse_program(&ctx, &l);
 
                     ASTNode *search = nodes;
@@ -1351,6 +1360,9 @@ void run_repl(const char *self_path)
         }
     }
 
+    arena_switch(session_arena);
+    arena_destroy(eval_arena);
+
     if (history_path[0])
     {
         FILE *hf = fopen(history_path, "w");
@@ -0,0 +1,379 @@
+
+#include "cache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_ID_MAX 4096
+#define CACHE_DAY (24 * 60 * 60)
+#define CACHE_MAX_AGE (30 * CACHE_DAY)
+#define CACHE_MAX_BYTES (1024LL * 1024 * 1024)
+
+uint64_t cache_hash(uint64_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t cache_hash_str(uint64_t h, const char *s)
+{
+    return cache_hash(h, s ? s : "", strlen(s ? s : "") + 1);
+}
+
+// mkdir -p for an absolute path.
+static int make_dirs(char *path)
+{
+    for (char *p = path + 1; *p; p++)
+    {
+        if ('/' == *p)
+        {
+            *p = 0;
+            int rc = mkdir(path, 0755);
+            *p = '/';
+            if (rc != 0 && errno != EEXIST)
+            {
+                return -1;
+            }
+        }
+    }
+    return (mkdir(path, 0755) == 0 || EEXIST == errno) ? 0 : -1;
+}
+
+const char *cache_dir(void)
+{
+    static char dir[PATH_MAX];
+    static int state = 0; // 0 unknown, 1 usable, -1 unusable.
+    if (state)
+    {
+        return state > 0 ? dir : NULL;
+    }
+
+    const char *env = getenv("ZC_CACHE_DIR");
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+    if (env && *env)
+    {
+        n = snprintf(dir, sizeof(dir), "%s", env);
+    }
+    else if (xdg && '/' == *xdg)
+    {
+        n = snprintf(dir, sizeof(dir), "%s/zenc", xdg);
+    }
+    else if (home && *home)
+    {
+        n = snprintf(dir, sizeof(dir), "%s/.cache/zenc", home);
+    }
+    else
+    {
+        n = -1;
+    }
+
+    state = -1;
+    if (n > 0 && (size_t)n < sizeof(dir) && '/' == dir[0] && 0 == make_dirs(dir) &&
+        0 == access(dir, W_OK | X_OK))
+    {
+        state = 1;
+    }
+    return state > 0 ? dir : NULL;
+}
+
+int cache_entry_path(char *buf, size_t size, const char *prefix, uint64_t key)
+{
+    const char *dir = cache_dir();
+    if (!dir)
+    {
+        return 0;
+    }
+    int n = snprintf(buf, size, "%s/%s%016llx", dir, prefix, (unsigned long long)key);
+    return n > 0 && (size_t)n < size;
+}
+
+void cache_temp_path(char *buf, size_t size, const char *entry)
+{
+    snprintf(buf, size, "%s.tmp%ld", entry, (long)getpid());
+}
+
+void cache_touch(const char *entry)
+{
+    utimensat(AT_FDCWD, entry, NULL, 0);
+}
+
+int cache_hash_file(uint64_t *h, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        *h = cache_hash(*h, buf, (size_t)n);
+    }
+    close(fd);
+    return 0 == n;
+}
+
+typedef struct
+{
+    char *name;
+    time_t used; // mtime: written, or touched by a hit.
+    long long size;
+} TrimEntry;
+
+static int trim_older_first(const void *a, const void *b)
+{
+    time_t x = ((const TrimEntry *)a)->used;
+    time_t y = ((const TrimEntry *)b)->used;
+    return (x > y) - (x < y);
+}
+
+static int is_build_entry(const char *name)
+{
+    static const char *const prefixes[] = {"bin-", "mod-", "ct-", "lz4-"};
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++)
+    {
+        if (0 == strncmp(name, prefixes[i], strlen(prefixes[i])))
+        {
+            return !strstr(name, ".tmp"); // Another build's entry in the making.
+        }
+    }
+    return 0;
+}
+
+void cache_trim(void)
+{
+    const char *dir = cache_dir();
+    char path[PATH_MAX];
+    struct stat st;
+    time_t now = time(NULL);
+    if (!dir || snprintf(path, sizeof(path), "%s/trim-stamp", dir) >= (int)sizeof(path) ||
+        (0 == stat(path, &st) && now - st.st_mtime < CACHE_DAY))
+    {
+        return;
+    }
+
+    // Claim the round first, so that concurrent builds do not all scan.
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return;
+    }
+    close(fd);
+    cache_touch(path);
+
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        return;
+    }
+    TrimEntry *kept = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    long long total = 0;
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        if (!is_build_entry(e->d_name) ||
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name) >= (int)sizeof(path) ||
+            0 != lstat(path, &st) || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+        if (now - st.st_mtime > CACHE_MAX_AGE)
+        {
+            unlink(path);
+            continue;
+        }
+        if (count == cap)
+        {
+            cap = cap ? cap * 2 : 256;
+            TrimEntry *grown = realloc(kept, cap * sizeof(TrimEntry));
+            if (!grown)
+            {
+                break;
+            }
+            kept = grown;
+        }
+        kept[count].name = strdup(e->d_name);
+        kept[count].used = st.st_mtime;
+        kept[count].size = (long long)st.st_size;
+        total += kept[count].size;
+        count++;
+    }
+    closedir(d);
+
+    // Over budget: least recently used first, but never an entry used today,
+    // which a build may be about to open.
+    if (count > 1)
+    {
+        qsort(kept, count, sizeof(TrimEntry), trim_older_first);
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (total > CACHE_MAX_BYTES && now - kept[i].used >= CACHE_DAY && kept[i].name &&
+            snprintf(path, sizeof(path), "%s/%s", dir, kept[i].name) < (int)sizeof(path) &&
+            0 == unlink(path))
+        {
+            total -= kept[i].size;
+        }
+        free(kept[i].name);
+    }
+    free(kept);
+}
+
+// Full path of the executable 'name' would run, like the shell's lookup.
+static int find_in_path(const char *name, char *out, size_t size)
+{
+    if (strchr(name, '/'))
+    {
+        snprintf(out, size, "%s", name);
+        return 0 == access(out, X_OK);
+    }
+    const char *path = getenv("PATH");
+    while (path && *path)
+    {
+        const char *end = strchr(path, ':');
+        size_t len = end ? (size_t)(end - path) : strlen(path);
+        int n = snprintf(out, size, "%.*s/%s", (int)len, len ? path : ".", name);
+        if (n > 0 && (size_t)n < size && 0 == access(out, X_OK))
+        {
+            return 1;
+        }
+        path = end ? end + 1 : NULL;
+    }
+    return 0;
+}
+
+static size_t read_all(FILE *f, char *buf, size_t cap)
+{
+    size_t len = 0;
+    size_t n;
+    while (len < cap && (n = fread(buf + len, 1, cap - len, f)) > 0)
+    {
+        len += n;
+    }
+    return len;
+}
+
+const char *cache_compiler_id(const char *cc)
+{
+    static char id[2 * PATH_MAX + CACHE_ID_MAX + 1];
+    static int ready = 0;
+    if (ready)
+    {
+        return id;
+    }
+    ready = 1;
+
+    char name[PATH_MAX];
+    size_t wl = strcspn(cc, " \t");
+    snprintf(name, sizeof(name), "%.*s", (int)wl, cc);
+
+    // Identity of the binary, then the version text it prints.
+    char exe[PATH_MAX];
+    struct stat st;
+    int n;
+    if (find_in_path(name, exe, sizeof(exe)) && 0 == stat(exe, &st))
+    {
+        n = snprintf(id, sizeof(id), "%s|%s|%lld|%lld.%09ld\n", cc, exe, (long long)st.st_size,
+                     (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    }
+    else
+    {
+        // Unknown binary: no stable identity to memoize under.
+        n = snprintf(id, sizeof(id), "%s\n", cc);
+        exe[0] = 0;
+    }
+    size_t len = n < 0 ? 0 : (size_t)n;
+    if (len > 2 * PATH_MAX)
+    {
+        len = 2 * PATH_MAX;
+    }
+
+    char entry[PATH_MAX];
+    int memo = exe[0] && cache_entry_path(entry, sizeof(entry), "cc-",
+                                          cache_hash(CACHE_HASH_SEED, id, len));
+    if (memo)
+    {
+        FILE *f = fopen(entry, "rb");
+        if (f)
+        {
+            len += read_all(f, id + len, CACHE_ID_MAX);
+            fclose(f);
+            id[len] = 0;
+            return id;
+        }
+    }
+
+    char cmd[PATH_MAX + 64];
+    snprintf(cmd, sizeof(cmd), "%s --version 2>/dev/null", cc);
+    FILE *p = popen(cmd, "r");
+    size_t vlen = 0;
+    if (p)
+    {
+        vlen = read_all(p, id + len, CACHE_ID_MAX);
+        pclose(p);
+    }
+
+    if (memo)
+    {
+        char tmp[PATH_MAX + 32];
+        cache_temp_path(tmp, sizeof(tmp), entry);
+        FILE *f = fopen(tmp, "wb");
+        if (f)
+        {
+            int ok = fwrite(id + len, 1, vlen, f) == vlen;
+            if (0 == fclose(f) && ok)
+            {
+                rename(tmp, entry);
+            }
+            else
+            {
+                unlink(tmp);
+            }
+        }
+    }
+    id[len + vlen] = 0;
+    return id;
+}
+
+const char *cache_self_id(void)
+{
+    static char id[PATH_MAX + 64];
+    static int state = 0; // 0 unknown, 1 known, -1 unknown for good.
+    if (state)
+    {
+        return state > 0 ? id : NULL;
+    }
+
+    state = -1;
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    struct stat st;
+    if (n > 0)
+    {
+        exe[n] = 0;
+        if (0 == stat(exe, &st))
+        {
+            snprintf(id, sizeof(id), "%s|%lld|%lld.%09ld", exe, (long long)st.st_size,
+                     (long long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+            state = 1;
+        }
+    }
+    return state > 0 ? id : NULL;
+}
@@ -0,0 +1,46 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// On-disk cache shared by every zc process of a user: one file per entry,
+// named by a 64-bit content hash. Entries are written under a temporary name
+// and renamed into place, so concurrent builds never see a partial entry.
+
+#define CACHE_HASH_SEED 0xcbf29ce484222325ULL
+
+// FNV-1a 64, continued from 'h'.
+uint64_t cache_hash(uint64_t h, const void *data, size_t len);
+// Hashes 's' and its terminator, so consecutive strings cannot run together.
+uint64_t cache_hash_str(uint64_t h, const char *s);
+
+// $ZC_CACHE_DIR, else $XDG_CACHE_HOME/zenc, else $HOME/.cache/zenc, created
+// on first use. NULL when none is usable.
+const char *cache_dir(void);
+
+// "<cache_dir>/<prefix><16 hex digits>". Returns 0 when there is no cache.
+int cache_entry_path(char *buf, size_t size, const char *prefix, uint64_t key);
+// A name next to 'entry' that only this process writes to.
+void cache_temp_path(char *buf, size_t size, const char *entry);
+// Records a hit on 'entry', so that cache_trim() keeps it.
+void cache_touch(const char *entry);
+
+// Continues 'h' with the contents of the file at 'path'. Returns 0 when it
+// cannot be read.
+int cache_hash_file(uint64_t *h, const char *path);
+
+// Keeps the cache bounded: drops build entries (bin-, mod-, ct-, lz4-) not
+// used for a month, then the least recently used ones until the rest fit in
+// a gigabyte. Does the scan at most once a day; otherwise it is one stat().
+void cache_trim(void);
+
+// Identifies the C compiler run by 'cc' ("gcc", "zig cc"...): its --version
+// output, memoized per compiler binary (path, size and mtime).
+const char *cache_compiler_id(const char *cc);
+
+// Identifies the running zc binary (path, size and mtime), for entries whose
+// format or content depends on the compiler itself. NULL if it cannot be found.
+const char *cache_self_id(void);
+
+#endif // CACHE_H
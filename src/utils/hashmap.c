@@ -0,0 +1,230 @@
+
+#include "hashmap.h"
+#include "zprep.h"
+#include <stdint.h>
+
+#define HASHMAP_INITIAL_CAP 16
+
+unsigned int hash_string(const char *s)
+{
+    // FNV-1a.
+    unsigned int h = 2166136261u;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static unsigned int hash_string_n(const char *s, int len)
+{
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static HashMapEntry *hashmap_slot(HashMap *m, const char *key, unsigned int h)
+{
+    unsigned int mask = (unsigned int)m->cap - 1;
+    unsigned int i = h & mask;
+    while (m->entries[i].key)
+    {
+        const char *k = m->entries[i].key;
+        if (k == key || (m->entries[i].hash == h && strcmp(k, key) == 0))
+        {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &m->entries[i];
+}
+
+static void hashmap_grow(HashMap *m)
+{
+    HashMapEntry *old = m->entries;
+    int old_cap = m->cap;
+
+    m->cap = old_cap ? old_cap * 2 : HASHMAP_INITIAL_CAP;
+    m->entries = xcalloc(m->cap, sizeof(HashMapEntry));
+
+    for (int i = 0; i < old_cap; i++)
+    {
+        if (old[i].key)
+        {
+            *hashmap_slot(m, old[i].key, old[i].hash) = old[i];
+        }
+    }
+    free(old);
+}
+
+void *hashmap_put(HashMap *m, const char *key, void *value)
+{
+    // Keep load factor under 3/4.
+    if ((m->count + 1) * 4 > m->cap * 3)
+    {
+        hashmap_grow(m);
+    }
+
+    unsigned int h = hash_string(key);
+    HashMapEntry *e = hashmap_slot(m, key, h);
+    if (e->key)
+    {
+        void *prev = e->value;
+        e->value = value;
+        return prev;
+    }
+
+    e->key = key;
+    e->hash = h;
+    e->value = value;
+    m->count++;
+    return NULL;
+}
+
+void *hashmap_get(HashMap *m, const char *key)
+{
+    if (m->cap == 0)
+    {
+        return NULL;
+    }
+    HashMapEntry *e = hashmap_slot(m, key, hash_string(key));
+    return e->key ? e->value : NULL;
+}
+
+int hashmap_contains(HashMap *m, const char *key)
+{
+    if (m->cap == 0)
+    {
+        return 0;
+    }
+    return hashmap_slot(m, key, hash_string(key))->key != NULL;
+}
+
+static unsigned int hash_ptr(const void *p)
+{
+    uintptr_t v = (uintptr_t)p;
+    v ^= v >> 17;
+    v *= 0xed5ad4bbu;
+    v ^= v >> 11;
+    return (unsigned int)v;
+}
+
+static PtrMapEntry *ptrmap_slot(PtrMap *m, const void *key)
+{
+    unsigned int mask = (unsigned int)m->cap - 1;
+    unsigned int i = hash_ptr(key) & mask;
+    while (m->entries[i].key && m->entries[i].key != key)
+    {
+        i = (i + 1) & mask;
+    }
+    return &m->entries[i];
+}
+
+void ptrmap_put(PtrMap *m, const void *key, void *value)
+{
+    if ((m->count + 1) * 4 > m->cap * 3)
+    {
+        PtrMapEntry *old = m->entries;
+        int old_cap = m->cap;
+        m->cap = old_cap ? old_cap * 2 : HASHMAP_INITIAL_CAP;
+        m->entries = xcalloc(m->cap, sizeof(PtrMapEntry));
+        for (int i = 0; i < old_cap; i++)
+        {
+            if (old[i].key)
+            {
+                *ptrmap_slot(m, old[i].key) = old[i];
+            }
+        }
+        free(old);
+    }
+
+    PtrMapEntry *e = ptrmap_slot(m, key);
+    if (!e->key)
+    {
+        e->key = key;
+        m->count++;
+    }
+    e->value = value;
+}
+
+void *ptrmap_get(PtrMap *m, const void *key)
+{
+    if (m->cap == 0)
+    {
+        return NULL;
+    }
+    return ptrmap_slot(m, key)->value;
+}
+
+// The intern table is a HashMap whose keys are the canonical strings; values
+// are unused. Lookups compare against a (pointer, length) slice so callers can
+// intern straight out of a token without a temporary copy.
+static HashMap intern_table;
+
+static HashMapEntry *intern_slot(const char *s, int len, unsigned int h)
+{
+    unsigned int mask = (unsigned int)intern_table.cap - 1;
+    unsigned int i = h & mask;
+    while (intern_table.entries[i].key)
+    {
+        const char *k = intern_table.entries[i].key;
+        if (intern_table.entries[i].hash == h && strncmp(k, s, len) == 0 && k[len] == 0)
+        {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &intern_table.entries[i];
+}
+
+char *intern_n(const char *s, int len)
+{
+    unsigned int h = hash_string_n(s, len);
+    arena_global_lock();
+    if (intern_table.cap)
+    {
+        HashMapEntry *e = intern_slot(s, len, h);
+        if (e->key)
+        {
+            arena_global_unlock();
+            return (char *)e->key;
+        }
+    }
+
+    // Interned strings outlive any scoped arena.
+    Arena *prev = arena_switch(arena_global());
+    if ((intern_table.count + 1) * 4 > intern_table.cap * 3)
+    {
+        hashmap_grow(&intern_table);
+    }
+    HashMapEntry *e = intern_slot(s, len, h);
+    char *copy = xmalloc(len + 1);
+    memcpy(copy, s, len);
+    copy[len] = 0;
+    e->key = copy;
+    e->hash = h;
+    intern_table.count++;
+    arena_switch(prev);
+    arena_global_unlock();
+    return copy;
+}
+
+char *intern(const char *s)
+{
+    return intern_n(s, (int)strlen(s));
+}
+
+int is_interned(const char *s)
+{
+    int len = (int)strlen(s);
+    unsigned int h = hash_string_n(s, len);
+    arena_global_lock();
+    int r = intern_table.cap && intern_slot(s, len, h)->key == s;
+    arena_global_unlock();
+    return r;
+}
@@ -0,0 +1,57 @@
+
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include <stddef.h>
+
+// String-keyed hash map (open addressing, linear probing).
+// Keys are not copied: callers pass strings that outlive the map, which is
+// always true for arena-allocated names. Entries are never removed.
+typedef struct
+{
+    const char *key;
+    unsigned int hash;
+    void *value;
+} HashMapEntry;
+
+typedef struct HashMap
+{
+    HashMapEntry *entries;
+    int cap;
+    int count;
+} HashMap;
+
+unsigned int hash_string(const char *s);
+
+// Inserts or replaces. Returns the previous value for 'key', or NULL.
+void *hashmap_put(HashMap *m, const char *key, void *value);
+void *hashmap_get(HashMap *m, const char *key);
+int hashmap_contains(HashMap *m, const char *key);
+
+// Pointer-keyed variant (identity, not contents). NULL keys are not allowed.
+typedef struct
+{
+    const void *key;
+    void *value;
+} PtrMapEntry;
+
+typedef struct PtrMap
+{
+    PtrMapEntry *entries;
+    int cap;
+    int count;
+} PtrMap;
+
+void ptrmap_put(PtrMap *m, const void *key, void *value);
+void *ptrmap_get(PtrMap *m, const void *key);
+
+// ** String interning **
+// One canonical, arena-owned copy per distinct string. Interned strings are
+// shared and must never be written to. Two interned strings are equal iff
+// their pointers are, so lookups keyed on them can skip strcmp.
+char *intern(const char *s);
+char *intern_n(const char *s, int len);
+// Whether 's' is itself the canonical copy (not merely equal to one).
+int is_interned(const char *s);
+
+#endif
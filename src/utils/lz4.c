@@ -0,0 +1,138 @@
+
+#include "lz4.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ4_HASH_BITS 16
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+// The format ends every block with literals: a match may not start in the
+// last 12 bytes, nor cover the last 5.
+#define LZ4_MF_LIMIT 12
+#define LZ4_LAST_LITERALS 5
+
+size_t lz4_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned char *put_length(unsigned char *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+    {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+// One sequence: literals, then a match of 'match' bytes 'offset' back (none
+// when 'match' is 0, for the last sequence).
+static unsigned char *put_sequence(unsigned char *op, const unsigned char *lit, size_t lit_len,
+                                   size_t offset, size_t match)
+{
+    size_t m = match ? match - LZ4_MIN_MATCH : 0;
+    *op++ = (unsigned char)((lit_len < 15 ? lit_len : 15) << 4 | (m < 15 ? m : 15));
+    if (lit_len >= 15)
+    {
+        op = put_length(op, lit_len - 15);
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match)
+    {
+        *op++ = (unsigned char)offset;
+        *op++ = (unsigned char)(offset >> 8);
+        if (m >= 15)
+        {
+            op = put_length(op, m - 15);
+        }
+    }
+    return op;
+}
+
+size_t lz4_compress(const unsigned char *src, size_t len, unsigned char *dst)
+{
+    unsigned char *op = dst;
+    size_t anchor = 0;
+
+    // Greedy: the last position seen with the same 4 bytes (by hash) is the
+    // only candidate. Positions are 0 until set, which just costs a compare.
+    uint32_t *table = len > LZ4_MF_LIMIT ? calloc(1 << LZ4_HASH_BITS, sizeof(uint32_t)) : NULL;
+    if (table)
+    {
+        size_t limit = len - LZ4_MF_LIMIT;
+        size_t i = 1;
+        while (i < limit)
+        {
+            uint32_t seq = read32(src + i);
+            uint32_t h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            size_t cand = table[h];
+            table[h] = (uint32_t)i;
+            if (i - cand > LZ4_MAX_OFFSET || read32(src + cand) != seq)
+            {
+                // Skip faster through data that does not compress.
+                i += 1 + ((i - anchor) >> 6);
+                continue;
+            }
+
+            while (i > anchor && cand > 0 && src[i - 1] == src[cand - 1])
+            {
+                i--;
+                cand--;
+            }
+            size_t match = LZ4_MIN_MATCH;
+            size_t max = len - LZ4_LAST_LITERALS - i;
+            while (match < max && src[i + match] == src[cand + match])
+            {
+                match++;
+            }
+            op = put_sequence(op, src + anchor, i - anchor, i - cand, match);
+            i += match;
+            anchor = i;
+        }
+        free(table);
+    }
+    op = put_sequence(op, src + anchor, len - anchor, 0, 0);
+    return op - dst;
+}
+
+const char *lz4_decoder_source(void)
+{
+    return "static size_t _z_lz4_decode(const unsigned char *src, size_t len, char *dst)\n"
+           "{\n"
+           "    const unsigned char *end = src + len;\n"
+           "    char *op = dst;\n"
+           "    while (src < end)\n"
+           "    {\n"
+           "        unsigned token = *src++;\n"
+           "        size_t n = token >> 4;\n"
+           "        if (15 == n)\n"
+           "        {\n"
+           "            unsigned char b;\n"
+           "            do { b = *src++; n += b; } while (255 == b);\n"
+           "        }\n"
+           "        while (n--) { *op++ = (char)*src++; }\n"
+           "        if (src >= end) { break; }\n"
+           "        size_t offset = src[0] | (size_t)src[1] << 8;\n"
+           "        src += 2;\n"
+           "        n = (token & 15) + 4;\n"
+           "        if (19 == n)\n"
+           "        {\n"
+           "            unsigned char b;\n"
+           "            do { b = *src++; n += b; } while (255 == b);\n"
+           "        }\n"
+           "        const char *m = op - offset;\n"
+           "        while (n--) { *op++ = *m++; }\n"
+           "    }\n"
+           "    return op - dst;\n"
+           "}\n";
+}
@@ -0,0 +1,19 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+
+// LZ4 block format compressor, for data decoded by the generated runtime (see
+// lz4_decoder_source()). No frame: the caller records both sizes.
+
+// Largest compressed size for 'len' input bytes.
+size_t lz4_bound(size_t len);
+// Compresses 'src' into 'dst' (lz4_bound(len) bytes). Returns the size used.
+size_t lz4_compress(const unsigned char *src, size_t len, unsigned char *dst);
+
+// C definition of
+//   static size_t _z_lz4_decode(const unsigned char *src, size_t len, char *dst)
+// which decodes a block and returns the size it wrote. It needs no headers.
+const char *lz4_decoder_source(void);
+
+#endif // LZ4_H
@@ -0,0 +1,577 @@
+
+#include "outbuf.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Chunks are plain malloc memory (this file does not include zprep.h): a
+// buffer outlives arena resets and can be filled by worker threads.
+#define OUTBUF_CHUNK_SIZE (64 * 1024)
+
+struct OutChunk
+{
+    OutChunk *next;
+    size_t len;
+    size_t cap;
+    char data[];
+};
+
+static OutChunk *ob_new_chunk(OutBuf *b, size_t min)
+{
+    size_t cap = min > OUTBUF_CHUNK_SIZE ? min : OUTBUF_CHUNK_SIZE;
+    OutChunk *c = malloc(sizeof(OutChunk) + cap);
+    if (!c)
+    {
+        fprintf(stderr, "Fatal: Out of memory\n");
+        exit(1);
+    }
+    c->next = NULL;
+    c->len = 0;
+    c->cap = cap;
+    if (b->tail)
+    {
+        b->tail->next = c;
+    }
+    else
+    {
+        b->head = c;
+    }
+    b->tail = c;
+    return c;
+}
+
+// At least 'n' contiguous free bytes at the end of the buffer.
+static char *ob_reserve(OutBuf *b, size_t n)
+{
+    OutChunk *c = b->tail;
+    if (!c || c->cap - c->len < n)
+    {
+        c = ob_new_chunk(b, n);
+    }
+    return c->data + c->len;
+}
+
+static void ob_commit(OutBuf *b, size_t n)
+{
+    b->tail->len += n;
+    b->len += n;
+}
+
+void ob_write(OutBuf *b, const char *s, size_t n)
+{
+    while (n > 0)
+    {
+        OutChunk *c = b->tail;
+        if (!c || c->len == c->cap)
+        {
+            c = ob_new_chunk(b, n);
+        }
+        size_t room = c->cap - c->len;
+        size_t take = n < room ? n : room;
+        memcpy(c->data + c->len, s, take);
+        c->len += take;
+        b->len += take;
+        s += take;
+        n -= take;
+    }
+}
+
+void ob_puts(OutBuf *b, const char *s)
+{
+    ob_write(b, s, strlen(s));
+}
+
+void ob_putc(OutBuf *b, char c)
+{
+    *ob_reserve(b, 1) = c;
+    ob_commit(b, 1);
+}
+
+static void ob_uint(OutBuf *b, unsigned long long v, int negative)
+{
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    do
+    {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (negative)
+    {
+        *--p = '-';
+    }
+    ob_write(b, p, (size_t)(tmp + sizeof(tmp) - p));
+}
+
+void ob_int(OutBuf *b, long long v)
+{
+    if (v < 0)
+    {
+        ob_uint(b, 0ULL - (unsigned long long)v, 1);
+    }
+    else
+    {
+        ob_uint(b, (unsigned long long)v, 0);
+    }
+}
+
+void ob_indent(OutBuf *b, int levels)
+{
+    static const char spaces[] = "                                ";
+    size_t n = (size_t)(levels > 0 ? levels : 0) * 4;
+    while (n > 0)
+    {
+        size_t take = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+        ob_write(b, spaces, take);
+        n -= take;
+    }
+}
+
+// One conversion through vsnprintf, formatted straight into the tail chunk.
+static void ob_snprintf(OutBuf *b, const char *spec, ...)
+{
+    va_list ap, retry;
+    va_start(ap, spec);
+    va_copy(retry, ap);
+    char *dst = ob_reserve(b, 64);
+    size_t room = b->tail->cap - b->tail->len;
+    int n = vsnprintf(dst, room, spec, ap);
+    if (n >= 0 && (size_t)n >= room)
+    {
+        dst = ob_reserve(b, (size_t)n + 1);
+        vsnprintf(dst, (size_t)n + 1, spec, retry);
+    }
+    if (n > 0)
+    {
+        ob_commit(b, (size_t)n);
+    }
+    va_end(retry);
+    va_end(ap);
+}
+
+enum
+{
+    LEN_NONE,
+    LEN_HH,
+    LEN_H,
+    LEN_L,
+    LEN_LL,
+    LEN_Z,
+    LEN_J,
+    LEN_T,
+    LEN_BIG_L
+};
+
+void ob_vprintf(OutBuf *b, const char *fmt, va_list ap)
+{
+    const char *p = fmt;
+    while (*p)
+    {
+        const char *lit = p;
+        while (*p && *p != '%')
+        {
+            p++;
+        }
+        if (p > lit)
+        {
+            ob_write(b, lit, (size_t)(p - lit));
+        }
+        if (!*p)
+        {
+            break;
+        }
+
+        const char *spec = p++;
+        if ('%' == *p)
+        {
+            ob_putc(b, '%');
+            p++;
+            continue;
+        }
+
+        // Flags, width and precision; '*' values are spliced into the spec
+        // so the slow path only ever sees literal numbers.
+        char buf[64];
+        size_t bl = 0;
+        int plain = 1;
+        int precision = -1;
+        buf[bl++] = '%';
+        while (*p && strchr("-+ #0", *p))
+        {
+            plain = 0;
+            if (bl < 16)
+            {
+                buf[bl++] = *p;
+            }
+            p++;
+        }
+        if ('*' == *p)
+        {
+            plain = 0;
+            bl += (size_t)snprintf(buf + bl, sizeof(buf) - bl, "%d", va_arg(ap, int));
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+        {
+            plain = 0;
+            if (bl < 40)
+            {
+                buf[bl++] = *p;
+            }
+            p++;
+        }
+        if ('.' == *p)
+        {
+            p++;
+            precision = 0;
+            if ('*' == *p)
+            {
+                precision = va_arg(ap, int);
+                p++;
+            }
+            else
+            {
+                while (*p >= '0' && *p <= '9')
+                {
+                    precision = precision * 10 + (*p - '0');
+                    p++;
+                }
+            }
+            if (precision >= 0 && bl < 40)
+            {
+                bl += (size_t)snprintf(buf + bl, sizeof(buf) - bl, ".%d", precision);
+            }
+        }
+
+        int len = LEN_NONE;
+        const char *len_start = p;
+        switch (*p)
+        {
+        case 'h':
+            len = ('h' == p[1]) ? LEN_HH : LEN_H;
+            p += (LEN_HH == len) ? 2 : 1;
+            break;
+        case 'l':
+            len = ('l' == p[1]) ? LEN_LL : LEN_L;
+            p += (LEN_LL == len) ? 2 : 1;
+            break;
+        case 'z':
+            len = LEN_Z;
+            p++;
+            break;
+        case 'j':
+            len = LEN_J;
+            p++;
+            break;
+        case 't':
+            len = LEN_T;
+            p++;
+            break;
+        case 'L':
+            len = LEN_BIG_L;
+            p++;
+            break;
+        }
+        memcpy(buf + bl, len_start, (size_t)(p - len_start));
+        bl += (size_t)(p - len_start);
+
+        char conv = *p;
+        if (!conv)
+        {
+            // Dangling '%': print it as written.
+            ob_puts(b, spec);
+            break;
+        }
+        p++;
+        buf[bl++] = conv;
+        buf[bl] = 0;
+
+        if (plain)
+        {
+            switch (conv)
+            {
+            case 's':
+            {
+                const char *s = va_arg(ap, const char *);
+                if (!s)
+                {
+                    s = "(null)";
+                }
+                ob_write(b, s, precision >= 0 ? strnlen(s, (size_t)precision) : strlen(s));
+                continue;
+            }
+            case 'd':
+            case 'i':
+                if (precision < 0 && (LEN_NONE == len || LEN_L == len || LEN_LL == len ||
+                                      LEN_Z == len))
+                {
+                    long long v = LEN_LL == len  ? va_arg(ap, long long)
+                                  : LEN_L == len ? va_arg(ap, long)
+                                  : LEN_Z == len ? (long long)va_arg(ap, ssize_t)
+                                                 : va_arg(ap, int);
+                    ob_int(b, v);
+                    continue;
+                }
+                break;
+            case 'u':
+                if (precision < 0 && (LEN_NONE == len || LEN_L == len || LEN_LL == len ||
+                                      LEN_Z == len))
+                {
+                    unsigned long long v = LEN_LL == len  ? va_arg(ap, unsigned long long)
+                                           : LEN_L == len ? va_arg(ap, unsigned long)
+                                           : LEN_Z == len ? va_arg(ap, size_t)
+                                                          : va_arg(ap, unsigned int);
+                    ob_uint(b, v, 0);
+                    continue;
+                }
+                break;
+            case 'c':
+                if (LEN_NONE == len)
+                {
+                    ob_putc(b, (char)va_arg(ap, int));
+                    continue;
+                }
+                break;
+            }
+        }
+
+        // Slow path: one vsnprintf for this specifier, argument read by type.
+        switch (conv)
+        {
+        case 'd':
+        case 'i':
+            switch (len)
+            {
+            case LEN_L:
+                ob_snprintf(b, buf, va_arg(ap, long));
+                break;
+            case LEN_LL:
+                ob_snprintf(b, buf, va_arg(ap, long long));
+                break;
+            case LEN_Z:
+                ob_snprintf(b, buf, va_arg(ap, ssize_t));
+                break;
+            case LEN_J:
+                ob_snprintf(b, buf, va_arg(ap, intmax_t));
+                break;
+            case LEN_T:
+                ob_snprintf(b, buf, va_arg(ap, ptrdiff_t));
+                break;
+            default:
+                ob_snprintf(b, buf, va_arg(ap, int));
+                break;
+            }
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            switch (len)
+            {
+            case LEN_L:
+                ob_snprintf(b, buf, va_arg(ap, unsigned long));
+                break;
+            case LEN_LL:
+                ob_snprintf(b, buf, va_arg(ap, unsigned long long));
+                break;
+            case LEN_Z:
+                ob_snprintf(b, buf, va_arg(ap, size_t));
+                break;
+            case LEN_J:
+                ob_snprintf(b, buf, va_arg(ap, uintmax_t));
+                break;
+            case LEN_T:
+                ob_snprintf(b, buf, va_arg(ap, ptrdiff_t));
+                break;
+            default:
+                ob_snprintf(b, buf, va_arg(ap, unsigned int));
+                break;
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (LEN_BIG_L == len)
+            {
+                ob_snprintf(b, buf, va_arg(ap, long double));
+            }
+            else
+            {
+                ob_snprintf(b, buf, va_arg(ap, double));
+            }
+            break;
+        case 'c':
+            ob_snprintf(b, buf, va_arg(ap, int));
+            break;
+        case 's':
+            ob_snprintf(b, buf, va_arg(ap, const char *));
+            break;
+        case 'p':
+            ob_snprintf(b, buf, va_arg(ap, void *));
+            break;
+        default:
+            // Unknown conversion: copy it through verbatim.
+            ob_write(b, spec, (size_t)(p - spec));
+            break;
+        }
+    }
+}
+
+void ob_printf(OutBuf *b, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    ob_vprintf(b, fmt, ap);
+    va_end(ap);
+}
+
+void ob_append(OutBuf *dst, OutBuf *src)
+{
+    if (!src->head)
+    {
+        return;
+    }
+    if (dst->tail)
+    {
+        dst->tail->next = src->head;
+    }
+    else
+    {
+        dst->head = src->head;
+    }
+    dst->tail = src->tail;
+    dst->len += src->len;
+    src->head = NULL;
+    src->tail = NULL;
+    src->len = 0;
+}
+
+char *ob_flatten(const OutBuf *b)
+{
+    char *s = malloc(b->len + 1);
+    if (!s)
+    {
+        fprintf(stderr, "Fatal: Out of memory\n");
+        exit(1);
+    }
+    size_t off = 0;
+    for (OutChunk *c = b->head; c; c = c->next)
+    {
+        memcpy(s + off, c->data, c->len);
+        off += c->len;
+    }
+    s[off] = 0;
+    return s;
+}
+
+int ob_write_fd(const OutBuf *b, int fd)
+{
+#ifdef IOV_MAX
+    enum
+    {
+        BATCH = IOV_MAX < 256 ? IOV_MAX : 256
+    };
+#else
+    enum
+    {
+        BATCH = 16
+    };
+#endif
+    struct iovec iov[BATCH];
+    OutChunk *c = b->head;
+    size_t skip = 0; // Bytes of 'c' already written by a short writev.
+    while (c)
+    {
+        int n = 0;
+        for (OutChunk *it = c; it && n < BATCH; it = it->next)
+        {
+            size_t off = (it == c) ? skip : 0;
+            if (it->len > off)
+            {
+                iov[n].iov_base = it->data + off;
+                iov[n].iov_len = it->len - off;
+                n++;
+            }
+        }
+        if (0 == n)
+        {
+            break;
+        }
+        ssize_t w = writev(fd, iov, n);
+        if (w < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return -1;
+        }
+        size_t done = (size_t)w;
+        while (c && done >= c->len - skip)
+        {
+            done -= c->len - skip;
+            skip = 0;
+            c = c->next;
+        }
+        skip += done;
+    }
+    return 0;
+}
+
+int ob_write_file(const OutBuf *b, FILE *f)
+{
+    for (OutChunk *c = b->head; c; c = c->next)
+    {
+        if (c->len && fwrite(c->data, 1, c->len, f) != c->len)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void ob_free(OutBuf *b)
+{
+    OutChunk *c = b->head;
+    while (c)
+    {
+        OutChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    b->head = NULL;
+    b->tail = NULL;
+    b->len = 0;
+}
+
+FILE *ob_stream_begin(ObStream *s)
+{
+    s->data = NULL;
+    s->size = 0;
+    s->f = open_memstream(&s->data, &s->size);
+    return s->f;
+}
+
+void ob_stream_end(OutBuf *b, ObStream *s)
+{
+    if (!s->f)
+    {
+        return;
+    }
+    fclose(s->f);
+    ob_write(b, s->data, s->size);
+    free(s->data);
+    s->f = NULL;
+    s->data = NULL;
+    s->size = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Output buffer for generated code.
+// Text is appended to a list of chunks that never move once written, and the
+// whole buffer is emitted at the end with a single writev() (ob_write_fd) or
+// handed to another consumer. Chunks come from malloc rather than the arena, so
+// a buffer is private to its owner and may be filled on any thread.
+typedef struct OutChunk OutChunk;
+
+typedef struct OutBuf
+{
+    OutChunk *head;
+    OutChunk *tail;
+    size_t len; // Total bytes written.
+} OutBuf;
+
+#define OUTBUF_INIT {NULL, NULL, 0}
+
+void ob_write(OutBuf *b, const char *s, size_t n);
+void ob_puts(OutBuf *b, const char *s);
+void ob_putc(OutBuf *b, char c);
+void ob_int(OutBuf *b, long long v);
+// 'levels' steps of four spaces.
+void ob_indent(OutBuf *b, int levels);
+
+// printf subset with a fast path for literal text and %s %d %i %u %c %% (with
+// l / ll / z length modifiers) and %.*s; any other conversion goes through
+// snprintf for that one specifier only.
+void ob_printf(OutBuf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void ob_vprintf(OutBuf *b, const char *fmt, va_list ap);
+
+// Moves every chunk of 'src' to the end of 'dst' without copying; 'src' is
+// left empty.
+void ob_append(OutBuf *dst, OutBuf *src);
+
+// Contents as one NUL-terminated malloc'd string (caller frees).
+char *ob_flatten(const OutBuf *b);
+
+// Returns 0 on success, -1 with errno set on a write error.
+int ob_write_fd(const OutBuf *b, int fd);
+int ob_write_file(const OutBuf *b, FILE *f);
+
+// Releases all chunks; the buffer can be reused afterwards.
+void ob_free(OutBuf *b);
+
+// Bridge for code that can only write to a FILE* (plugins): whatever is
+// written to the returned stream is appended to 'b' by ob_stream_end().
+typedef struct
+{
+    FILE *f;
+    char *data;
+    size_t size;
+} ObStream;
+
+FILE *ob_stream_begin(ObStream *s);
+void ob_stream_end(OutBuf *b, ObStream *s);
+
+#endif // OUTBUF_H
@@ -1,78 +1,464 @@
 
 #include "parser.h"
 #include "zprep.h"
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 char *g_current_filename = "unknown";
 ParserContext *g_parser_ctx = NULL;
+jmp_buf *g_panic_trap = NULL;
 
 // ** Arena Implementation **
 #define ARENA_BLOCK_SIZE (1024 * 1024)
-
+#define ARENA_LARGE_ALLOC (ARENA_BLOCK_SIZE / 4) // Bigger requests get a block of their own.
+#define ARENA_ALIGN 16
+#define ARENA_MIN_CLASS_SHIFT 4 // Smallest size class: 16 bytes.
+#define ARENA_NUM_CLASSES 15    // 16 bytes .. ARENA_LARGE_ALLOC.
+#define POOL_SLAB_BYTES (16 * 1024)
+
+// Blocks are mapped straight from the OS so that big inputs (and the large
+// one-off blocks they need) go back to it on reset instead of fragmenting
+// the malloc heap.
 typedef struct ArenaBlock
 {
     struct ArenaBlock *next;
     size_t used;
     size_t cap;
+    size_t mapped; // Bytes to munmap(), block header included.
     char data[];
 } ArenaBlock;
 
-static ArenaBlock *current_block = NULL;
+// Every allocation is preceded by its owner and usable size.
+typedef struct ChunkHeader
+{
+    Arena *arena;
+    size_t cap;
+} ChunkHeader;
 
-static void *arena_alloc_raw(size_t size)
+typedef struct FreeChunk
 {
-    size_t actual_size = size + sizeof(size_t);
-    actual_size = (actual_size + 7) & ~7;
+    struct FreeChunk *next;
+} FreeChunk;
 
-    if (!current_block || (current_block->used + actual_size > current_block->cap))
-    {
-        size_t block_size = actual_size > ARENA_BLOCK_SIZE ? actual_size : ARENA_BLOCK_SIZE;
+struct Arena
+{
+    const char *name;
+    ArenaBlock *blocks; // Newest regular block first.
+    FreeChunk *free_lists[ARENA_NUM_CLASSES];
+    size_t reserved;
+    size_t used;
+    unsigned long epoch; // Changes on reset, so pools know their slab is gone.
+    struct Arena *next;  // Live arenas, for arena_report().
+};
+
+static Arena global_arena = {"global", NULL, {NULL}, 0, 0, 0, NULL};
+static unsigned long arena_epochs = 0;
+static _Thread_local Arena *current_arena = &global_arena;
+static Arena *live_arenas = &global_arena; // Only changed outside threaded sections.
+static pthread_mutex_t global_arena_mutex;
+static int arena_threaded = 0;
+
+// Arena headers come from the system allocator.
 #undef malloc
-        ArenaBlock *new_block = malloc(sizeof(ArenaBlock) + block_size);
-        if (!new_block)
+#undef calloc
+#undef free
+
+static size_t arena_align(size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    return size ? size : ARENA_ALIGN;
+}
+
+// Free list that 'cap' bytes are filed under (largest class <= cap)...
+static int class_floor(size_t cap)
+{
+    int k = 0;
+    while (k + 1 < ARENA_NUM_CLASSES && ((size_t)1 << (k + 1 + ARENA_MIN_CLASS_SHIFT)) <= cap)
+    {
+        k++;
+    }
+    return k;
+}
+
+// ...and the one that can satisfy a request of 'cap' (smallest class >= cap).
+static int class_ceil(size_t cap)
+{
+    int k = 0;
+    while (((size_t)1 << (k + ARENA_MIN_CLASS_SHIFT)) < cap)
+    {
+        k++;
+    }
+    return k;
+}
+
+static ArenaBlock *arena_map_block(Arena *a, size_t min_cap)
+{
+    static size_t page = 0;
+    if (!page)
+    {
+        page = (size_t)sysconf(_SC_PAGESIZE);
+    }
+    size_t mapped = sizeof(ArenaBlock) + min_cap;
+    mapped = (mapped + page - 1) & ~(page - 1);
+
+    void *mem = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mem)
+    {
+        fprintf(stderr, "Fatal: Out of memory\n");
+        exit(1);
+    }
+
+    ArenaBlock *b = mem;
+    b->next = NULL;
+    b->used = 0;
+    b->cap = mapped - sizeof(ArenaBlock);
+    b->mapped = mapped;
+    a->reserved += mapped;
+    return b;
+}
+
+static void arena_unmap_block(Arena *a, ArenaBlock *b)
+{
+    a->reserved -= b->mapped;
+    munmap(b, b->mapped);
+}
+
+static void *chunk_init(Arena *a, char *at, size_t cap)
+{
+    ChunkHeader *h = (ChunkHeader *)at;
+    h->arena = a;
+    h->cap = cap;
+    a->used += sizeof(ChunkHeader) + cap;
+    return h + 1;
+}
+
+// Large chunks sit alone in their block, linked behind the current one so
+// the remaining space there is not abandoned.
+static void *arena_alloc_large(Arena *a, size_t cap)
+{
+    ArenaBlock *b = arena_map_block(a, sizeof(ChunkHeader) + cap);
+    b->used = b->cap;
+    if (a->blocks)
+    {
+        b->next = a->blocks->next;
+        a->blocks->next = b;
+    }
+    else
+    {
+        a->blocks = b;
+    }
+    return chunk_init(a, b->data, b->cap - sizeof(ChunkHeader));
+}
+
+static void *arena_alloc_raw(Arena *a, size_t size)
+{
+    size_t cap = arena_align(size);
+    if (cap > ARENA_LARGE_ALLOC)
+    {
+        return arena_alloc_large(a, cap);
+    }
+
+    FreeChunk **list = &a->free_lists[class_ceil(cap)];
+    if (*list)
+    {
+        FreeChunk *c = *list;
+        *list = c->next;
+        ChunkHeader *h = (ChunkHeader *)c - 1;
+        a->used += sizeof(ChunkHeader) + h->cap;
+        return c;
+    }
+
+    size_t need = sizeof(ChunkHeader) + cap;
+    if (!a->blocks || (a->blocks->used + need > a->blocks->cap))
+    {
+        ArenaBlock *b = arena_map_block(a, ARENA_BLOCK_SIZE - sizeof(ArenaBlock));
+        b->next = a->blocks;
+        a->blocks = b;
+    }
+
+    char *at = a->blocks->data + a->blocks->used;
+    a->blocks->used += need;
+    return chunk_init(a, at, cap);
+}
+
+static int is_block_tail(Arena *a, ChunkHeader *h)
+{
+    ArenaBlock *b = a->blocks;
+    return b && (char *)(h + 1) + h->cap == b->data + b->used;
+}
+
+Arena *arena_global(void)
+{
+    return &global_arena;
+}
+
+void arena_set_threaded(int on)
+{
+    static int mutex_ready = 0;
+    if (!mutex_ready)
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&global_arena_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        mutex_ready = 1;
+    }
+    arena_threaded = on;
+}
+
+void arena_global_lock(void)
+{
+    if (arena_threaded)
+    {
+        pthread_mutex_lock(&global_arena_mutex);
+    }
+}
+
+void arena_global_unlock(void)
+{
+    if (arena_threaded)
+    {
+        pthread_mutex_unlock(&global_arena_mutex);
+    }
+}
+
+Arena *arena_create(const char *name)
+{
+    Arena *a = calloc(1, sizeof(Arena));
+    if (!a)
+    {
+        fprintf(stderr, "Fatal: Out of memory\n");
+        exit(1);
+    }
+    a->name = name;
+    a->epoch = ++arena_epochs;
+    a->next = live_arenas;
+    live_arenas = a;
+    return a;
+}
+
+Arena *arena_switch(Arena *a)
+{
+    Arena *prev = current_arena;
+    current_arena = a ? a : &global_arena;
+    return prev;
+}
+
+void arena_reset(Arena *a)
+{
+    // Keep one regular block for the next round; large ones go back to the OS.
+    ArenaBlock *keep = NULL;
+    ArenaBlock *b = a->blocks;
+    while (b)
+    {
+        ArenaBlock *next = b->next;
+        if (!keep && ARENA_BLOCK_SIZE == b->mapped)
+        {
+            keep = b;
+            keep->used = 0;
+            keep->next = NULL;
+        }
+        else
         {
-            fprintf(stderr, "Fatal: Out of memory\n");
-            exit(1);
+            arena_unmap_block(a, b);
         }
+        b = next;
+    }
+
+    a->blocks = keep;
+    memset(a->free_lists, 0, sizeof(a->free_lists));
+    a->used = 0;
+    a->epoch = ++arena_epochs;
+}
+
+void arena_destroy(Arena *a)
+{
+    if (a == &global_arena)
+    {
+        return;
+    }
+    if (current_arena == a)
+    {
+        current_arena = &global_arena;
+    }
 
-        new_block->cap = block_size;
-        new_block->used = 0;
-        new_block->next = current_block;
-        current_block = new_block;
+    ArenaBlock *b = a->blocks;
+    while (b)
+    {
+        ArenaBlock *next = b->next;
+        arena_unmap_block(a, b);
+        b = next;
     }
 
-    void *ptr = current_block->data + current_block->used;
-    current_block->used += actual_size;
-    *(size_t *)ptr = size;
-    return (char *)ptr + sizeof(size_t);
+    Arena **link = &live_arenas;
+    while (*link && *link != a)
+    {
+        link = &(*link)->next;
+    }
+    if (*link)
+    {
+        *link = a->next;
+    }
+    free(a);
 }
 
+size_t arena_reserved(const Arena *a)
+{
+    return a->reserved;
+}
+
+size_t arena_used(const Arena *a)
+{
+    return a->used;
+}
+
+void arena_report(FILE *out)
+{
+    for (Arena *a = live_arenas; a; a = a->next)
+    {
+        fprintf(out, "[arena] %-16s reserved %8zu KB, used %8zu KB\n", a->name,
+                a->reserved / 1024, a->used / 1024);
+    }
+}
+
+#define free(ptr) ((void)0)
+
 void *xmalloc(size_t size)
 {
-    return arena_alloc_raw(size);
+    return arena_alloc_raw(current_arena, size);
 }
 
 void *xcalloc(size_t n, size_t size)
 {
     size_t total = n * size;
-    void *p = arena_alloc_raw(total);
+    void *p = arena_alloc_raw(current_arena, total);
     memset(p, 0, total);
     return p;
 }
 
+void *pool_alloc(Pool *p)
+{
+    if (p->arena != current_arena || p->epoch != current_arena->epoch || 0 == p->left)
+    {
+        size_t count = POOL_SLAB_BYTES / p->elem_size;
+        count = count ? count : 1;
+        p->arena = current_arena;
+        p->epoch = current_arena->epoch;
+        p->next = arena_alloc_raw(current_arena, count * p->elem_size);
+        p->left = count;
+    }
+
+    void *obj = p->next;
+    p->next += p->elem_size;
+    p->left--;
+    memset(obj, 0, p->elem_size);
+    return obj;
+}
+
+static void chunk_release(Arena *a, ChunkHeader *h)
+{
+    a->used -= sizeof(ChunkHeader) + h->cap;
+
+    if (h->cap > ARENA_LARGE_ALLOC)
+    {
+        ArenaBlock **link = &a->blocks;
+        while (*link && (*link)->data != (char *)h)
+        {
+            link = &(*link)->next;
+        }
+        if (*link)
+        {
+            ArenaBlock *b = *link;
+            *link = b->next;
+            arena_unmap_block(a, b);
+        }
+        return;
+    }
+
+    if (is_block_tail(a, h))
+    {
+        a->blocks->used -= sizeof(ChunkHeader) + h->cap;
+        return;
+    }
+
+    FreeChunk *c = (FreeChunk *)(h + 1);
+    FreeChunk **list = &a->free_lists[class_floor(h->cap)];
+    c->next = *list;
+    *list = c;
+}
+
+static void *chunk_grow(Arena *a, ChunkHeader *h, size_t new_size)
+{
+    size_t cap = arena_align(new_size);
+    if (cap <= ARENA_LARGE_ALLOC && is_block_tail(a, h) &&
+        a->blocks->used + (cap - h->cap) <= a->blocks->cap)
+    {
+        a->blocks->used += cap - h->cap;
+        a->used += cap - h->cap;
+        h->cap = cap;
+        return h + 1;
+    }
+
+    void *new_ptr = arena_alloc_raw(a, new_size);
+    memcpy(new_ptr, h + 1, h->cap);
+    chunk_release(a, h);
+    return new_ptr;
+}
+
+// Only the calling thread touches its current arena's free lists and tail.
+// While threaded, a global chunk is grown or recycled under the global lock,
+// and a chunk of any other arena is never touched: xfree leaves it to that
+// arena's reset, xrealloc copies it into the current arena.
+void xfree(void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+    ChunkHeader *h = (ChunkHeader *)ptr - 1;
+    Arena *a = h->arena;
+    if (a == current_arena || !arena_threaded)
+    {
+        chunk_release(a, h);
+    }
+    else if (a == &global_arena)
+    {
+        arena_global_lock();
+        chunk_release(a, h);
+        arena_global_unlock();
+    }
+}
+
 void *xrealloc(void *ptr, size_t new_size)
 {
     if (!ptr)
     {
         return xmalloc(new_size);
     }
-    size_t *header = (size_t *)((char *)ptr - sizeof(size_t));
-    size_t old_size = *header;
-    if (new_size <= old_size)
+    ChunkHeader *h = (ChunkHeader *)ptr - 1;
+    if (new_size <= h->cap)
     {
         return ptr;
     }
-    void *new_ptr = xmalloc(new_size);
-    memcpy(new_ptr, ptr, old_size);
+
+    // The chunk stays in the arena that owns it, whichever one is current.
+    Arena *a = h->arena;
+    if (a == current_arena || !arena_threaded)
+    {
+        return chunk_grow(a, h, new_size);
+    }
+    if (a == &global_arena)
+    {
+        arena_global_lock();
+        void *new_ptr = chunk_grow(a, h, new_size);
+        arena_global_unlock();
+        return new_ptr;
+    }
+
+    void *new_ptr = arena_alloc_raw(current_arena, new_size);
+    memcpy(new_ptr, ptr, h->cap);
     return new_ptr;
 }
 
@@ -91,6 +477,10 @@ char *xstrdup(const char *s)
 
 void zpanic(const char *fmt, ...)
 {
+    if (g_panic_trap)
+    {
+        longjmp(*g_panic_trap, 1);
+    }
     va_list a;
     va_start(a, fmt);
     fprintf(stderr, COLOR_RED "error: " COLOR_RESET COLOR_BOLD);
@@ -121,6 +511,9 @@ void zwarn_at(Token t, const char *fmt, ...)
     {
         return;
     }
+    // One warning at a time when codegen runs on several threads.
+    flockfile(stderr);
+
     // Header: 'warning: message'.
     va_list a;
     va_start(a, fmt);
@@ -156,10 +549,15 @@ void zwarn_at(Token t, const char *fmt, ...)
         fprintf(stderr, COLOR_YELLOW "^ here" COLOR_RESET "\n");
         fprintf(stderr, COLOR_BLUE "   |\n" COLOR_RESET);
     }
+    funlockfile(stderr);
 }
 
 void zpanic_at(Token t, const char *fmt, ...)
 {
+    if (g_panic_trap)
+    {
+        longjmp(*g_panic_trap, 1);
+    }
     // Header: 'error: message'.
     va_list a;
     va_start(a, fmt);
@@ -213,6 +611,10 @@ void zpanic_at(Token t, const char *fmt, ...)
 // Enhanced error with suggestion.
 void zpanic_with_suggestion(Token t, const char *msg, const char *suggestion)
 {
+    if (g_panic_trap)
+    {
+        longjmp(*g_panic_trap, 1);
+    }
     // Header.
     fprintf(stderr, COLOR_RED "error: " COLOR_RESET COLOR_BOLD "%s" COLOR_RESET "\n", msg);
 
@@ -530,6 +932,11 @@ char g_link_flags[MAX_FLAGS_SIZE] = "";
 char g_cflags[MAX_FLAGS_SIZE] = "";
 CompilerConfig g_config = {0};
 
+const char *emitted_c_file(void)
+{
+    return g_config.mode_transpile && g_config.output_file ? g_config.output_file : "out.c";
+}
+
 void scan_build_directives(ParserContext *ctx, const char *src)
 {
     const char *p = src;
@@ -3,6 +3,7 @@
 #define ZPREP_H
 
 #include <ctype.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -83,37 +84,95 @@ typedef enum
 typedef struct
 {
     TokenType type;
+    int len; // Kept next to 'type' so a token packs into 24 bytes.
     const char *start;
-    int len;
     int line;
     int col;
 } Token;
 
+typedef struct TokenBuffer TokenBuffer;
+
 typedef struct
 {
     const char *src;
     int pos;
     int line;
     int col;
+    TokenBuffer *tokens; // Pre-lexed tokens (NULL when scanning on demand).
+    int tok_idx;         // Buffer index expected at 'pos'.
 } Lexer;
 
 void lexer_init(Lexer *l, const char *src);
+// Lexes all of 'src' up front; next/peek become cursor moves over the array.
+void lexer_init_buffered(Lexer *l, const char *src);
 Token lexer_next(Lexer *l);
 Token lexer_peek(Lexer *l);
 Token lexer_peek2(Lexer *l);
+Token lexer_peek_n(Lexer *l, int n); // n-th upcoming token (1 == lexer_peek).
+// Checks that every keyword sits in the slot KEYWORD_HASH gives it. Returns 1
+// if so; otherwise names the first misplaced keyword on stderr and returns 0.
+int lexer_check_keywords(void);
 
 void register_trait(const char *name);
 int is_trait(const char *name);
 
 // Arena and memory.
+// x* allocations (and so malloc/realloc/calloc above) come from the current
+// arena; 'free' stays a no-op. xrealloc grows the newest allocation in place
+// and recycles what it moves away from, as does an explicit xfree, through
+// per-arena size-class free lists. As with the C library's realloc, a
+// pointer into a buffer that xrealloc moved is dead: its bytes may be handed
+// out again. The global arena lives as long as the
+// process; long-running modes (LSP, REPL) parse into scoped arenas and reset
+// them instead of growing forever. Process-wide tables (interned strings and
+// types, trait and plugin registries) always allocate from the global arena.
+typedef struct Arena Arena;
+Arena *arena_global(void);
+Arena *arena_create(const char *name);
+Arena *arena_switch(Arena *a); // Makes 'a' current; returns the previous one.
+void arena_reset(Arena *a);    // Drops every allocation, keeps one block.
+void arena_destroy(Arena *a);
+size_t arena_reserved(const Arena *a); // Bytes obtained from the system.
+size_t arena_used(const Arena *a);     // Bytes in live allocations (with headers).
+void arena_report(FILE *out);          // One line per live arena.
+
+// The current arena is per thread (a new thread starts on the global one).
+// Between arena_set_threaded(1) and (0) other threads may be running: they
+// must switch to an arena of their own, and every use of the global arena
+// (and the process-wide tables above) goes through arena_global_lock(),
+// which is recursive. Outside threaded sections the lock is a no-op.
+// xrealloc and xfree take it themselves for a chunk of the global arena, and
+// leave the free lists of other threads' arenas alone.
+void arena_set_threaded(int on);
+void arena_global_lock(void);
+void arena_global_unlock(void);
+
 void *xmalloc(size_t size);
 void *xrealloc(void *ptr, size_t new_size);
 void *xcalloc(size_t n, size_t size);
+void xfree(void *ptr); // Only for x* memory that is provably dead.
+
+// Same-size objects carved in slabs out of the current arena: no per-object
+// header, and objects made one after another stay adjacent in memory. A new
+// slab is started when the current arena changes or has been reset.
+typedef struct
+{
+    size_t elem_size;
+    Arena *arena;
+    unsigned long epoch;
+    char *next;
+    size_t left;
+} Pool;
+#define POOL_INIT(type) {sizeof(type), NULL, 0, NULL, 0}
+void *pool_alloc(Pool *p); // Zero-filled.
 char *xstrdup(const char *s);
 
 // Error reporting.
 void zpanic(const char *fmt, ...);
 void zpanic_at(Token t, const char *fmt, ...);
+// While set, a panic reports nothing and jumps here instead of exiting: the
+// error belongs to a parse that is allowed to fail.
+extern jmp_buf *g_panic_trap;
 
 char *load_file(const char *filename);
 
@@ -175,6 +234,8 @@ typedef struct
     int repl_mode;       // 1 if --repl (internal flag for REPL usage).
     int is_freestanding; // 1 if --freestanding.
     int mode_transpile;  // 1 if 'transpile' command.
+    int jobs;            // -j: codegen threads (0 = one per CPU).
+    int no_cache;        // 1 if --no-cache.
 
     // GCC Flags accumulator.
     char gcc_flags[4096];
@@ -184,6 +245,8 @@ typedef struct
 } CompilerConfig;
 
 extern CompilerConfig g_config;
+// The C file --emit-c and transpile write.
+const char *emitted_c_file(void);
 extern char g_link_flags[];
 extern char g_cflags[];
 
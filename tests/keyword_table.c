@@ -0,0 +1,18 @@
+// Zen-C Keyword Table Check
+// Usage: ./tests/keyword_table
+//
+// The lexer's keyword table is filled by hand to match KEYWORD_HASH. 'make
+// test' runs this first, so a keyword added in the wrong slot fails the build
+// instead of lexing as an identifier.
+
+#include "zprep.h"
+
+int main(void)
+{
+    if (!lexer_check_keywords())
+    {
+        return 1;
+    }
+    printf("Keyword table OK\n");
+    return 0;
+}